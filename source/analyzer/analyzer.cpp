@@ -1,3 +1,4 @@
+#include <memory>
 #include <stdexcept>
 #include <string>
 
@@ -35,7 +36,7 @@ namespace
 
 void analyze_program(const program* program,
                      symbol_table* existing_symbols,
-                     const environment* existing_env) noexcept(false)
+                     environment* existing_env) noexcept(false)
 {
     symbol_table* symbols = nullptr;
     if (existing_symbols != nullptr) {
@@ -47,12 +48,25 @@ void analyze_program(const program* program,
         }
     }
     if (existing_env != nullptr) {
-        for (const auto& [key, _] : existing_env->store) {
-            symbols->define(key);
+        for (auto idx = 0; const auto& name : existing_env->names) {
+            if (!name.empty()) {
+                symbols->define_global(name, idx);
+            }
+            idx++;
         }
+        // the unnamed slots hold the variables of loops of earlier programs, which closures may still refer to
+        symbols->reserve_definitions(static_cast<int>(existing_env->slots.size()));
     }
     analyzer an {symbols};
     an.analyze(program);
+    program->num_globals = symbols->num_definitions();
+    if (existing_env != nullptr) {
+        for (const auto& [name, sym] : symbols->symbols()) {
+            if (sym.is_global()) {
+                existing_env->define(name, sym.index);
+            }
+        }
+    }
 }
 
 analyzer::analyzer(symbol_table* symbols)
@@ -65,6 +79,26 @@ void analyzer::analyze(const program* prgrm)
     prgrm->accept(*this);
 }
 
+void analyzer::bind(const identifier& ident) const
+{
+    // the environments of the evaluator are the global one and one per call, a loop body uses the environment of the
+    // enclosing function and the symbols of its table are allocated there
+    auto depth = 0;
+    for (const auto* table = m_symbols; table != nullptr; table = table->outer()) {
+        // free symbols and the name of the function being defined refer to a symbol of an enclosing table
+        if (const auto sym = table->find(ident.value);
+            sym.has_value() && sym->scope != symbol_scope::free && !sym->is_function())
+        {
+            ident.depth = sym->scope == symbol_scope::builtin ? identifier::builtin : depth;
+            ident.slot = sym->index;
+            return;
+        }
+        if (!table->inside_loop()) {
+            depth++;
+        }
+    }
+}
+
 void analyzer::visit(const array_literal& expr)
 {
     for (const auto* element : expr.elements) {
@@ -79,11 +113,13 @@ void analyzer::visit(const assign_expression& expr)
         fail(fmt::format("{}: identifier not found: {}", expr.l, expr.name->value));
     }
     const auto& symbol = maybe_symbol.value();
-    // NOLINTBEGIN(bugprone-unchecked-optional-access)
-    if (symbol.is_function() || (symbol.is_outer() && symbol.ptr.value().is_function())) {
+    if (symbol.is_function()) {
         fail(fmt::format("{}: cannot reassign the current function being defined: {}", expr.l, expr.name->value));
     }
-    // NOLINTEND(bugprone-unchecked-optional-access)
+    if (symbol.scope == symbol_scope::builtin) {
+        fail(fmt::format("{}: cannot reassign the builtin: {}", expr.l, expr.name->value));
+    }
+    bind(*expr.name);
     expr.value->accept(*this);
 }
 
@@ -107,6 +143,7 @@ void analyzer::visit(const identifier& expr)
     if (!symbol.has_value()) {
         fail(fmt::format("{}: identifier not found: {}", expr.l, expr.value));
     }
+    bind(expr);
 }
 
 void analyzer::visit(const if_expression& expr)
@@ -142,14 +179,15 @@ void analyzer::visit(const program& expr)
 
 void analyzer::visit(const let_statement& expr)
 {
-    auto symbol = m_symbols->resolve(expr.name->value);
+    auto symbol = m_symbols->find(expr.name->value);
     if (symbol.has_value()) {
         const auto& value = symbol.value();
-        if (value.is_local() || (value.is_global() && m_symbols->is_global())) {
+        if (value.is_local() || value.is_global()) {
             fail(fmt::format("{}: {} is already defined", expr.l, expr.name->value));
         }
     }
     m_symbols->define(expr.name->value);
+    bind(*expr.name);
     expr.value->accept(*this);
 }
 
@@ -201,6 +239,7 @@ void analyzer::visit(const function_literal& expr)
     }
     analyzer f(inner);
     expr.body->accept(f);
+    expr.num_locals = inner->num_definitions();
 }
 
 void analyzer::visit(const call_expression& expr)
@@ -221,21 +260,21 @@ auto check_no_parse_errors(const parser& prsr) -> bool
     return prsr.errors().empty();
 }
 
-using parsed_program = std::pair<program*, parser>;
+using parsed_program = std::pair<std::unique_ptr<program>, parser>;
 
 auto check_program(std::string_view input) -> parsed_program
 {
     auto prsr = parser {lexer {input}};
-    auto* prgrm = prsr.parse_program();
+    auto prgrm = prsr.parse_program();
     INFO("while parsing: `", input, "`");
     CHECK(check_no_parse_errors(prsr));
-    return {prgrm, std::move(prsr)};
+    return {std::move(prgrm), std::move(prsr)};
 }
 
 auto analyze(std::string_view input) noexcept(false) -> void
 {
     auto [prgrm, _] = check_program(input);
-    analyze_program(prgrm, nullptr, nullptr);
+    analyze_program(prgrm.get(), nullptr, nullptr);
 }
 
 TEST_SUITE("analyzer")
@@ -279,12 +318,61 @@ TEST_SUITE("analyzer")
             test {.input = "{2: x}", .expected_exception_string = "<stdin>:1:5: identifier not found: x"},
             test {.input = "let f = fn(x) { if (x > 0) { f(x - 1); f = 2; } }",
                   .expected_exception_string = "<stdin>:1:40: cannot reassign the current function being defined: f"},
+            test {.input = "len = 2;", .expected_exception_string = "<stdin>:1:1: cannot reassign the builtin: len"},
         };
         for (const auto& test : tests) {
             INFO(test.input, " expected error: ", std::string(test.expected_exception_string));
             CHECK_THROWS_WITH_AS(analyze(test.input), test.expected_exception_string, std::runtime_error);
         }
     }
+
+    TEST_CASE("resolveSlots")
+    {
+        auto [prgrm, _] = check_program(
+            "let a = 1; let f = fn(x) { let y = a; while (true) { let z = y; break; } fn() { x + len(y) } };");
+        analyze_program(prgrm.get(), nullptr, nullptr);
+        CHECK_EQ(prgrm->num_globals, 2);
+
+        const auto* outer =
+            dynamic_cast<const function_literal*>(dynamic_cast<const let_statement*>(prgrm->statements[1])->value);
+        REQUIRE(outer);
+        // the parameter, y and the z of the loop body
+        CHECK_EQ(outer->num_locals, 3);
+        const auto* let_y = dynamic_cast<const let_statement*>(outer->body->statements[0]);
+        REQUIRE(let_y);
+        CHECK_EQ(let_y->name->slot, 1);
+        const auto* a = dynamic_cast<const identifier*>(let_y->value);
+        REQUIRE(a);
+        CHECK_EQ(a->depth, 1);
+        CHECK_EQ(a->slot, 0);
+
+        const auto* loop = dynamic_cast<const while_statement*>(outer->body->statements[1]);
+        REQUIRE(loop);
+        const auto* let_z = dynamic_cast<const let_statement*>(loop->body->statements[0]);
+        REQUIRE(let_z);
+        CHECK_EQ(let_z->name->depth, 0);
+        CHECK_EQ(let_z->name->slot, 2);
+
+        const auto* inner = dynamic_cast<const function_literal*>(
+            dynamic_cast<const expression_statement*>(outer->body->statements[2])->expr);
+        REQUIRE(inner);
+        CHECK_EQ(inner->num_locals, 0);
+        const auto* body = dynamic_cast<const expression_statement*>(inner->body->statements[0]);
+        REQUIRE(body);
+        const auto* sum = dynamic_cast<const binary_expression*>(body->expr);
+        REQUIRE(sum);
+        const auto* x = dynamic_cast<const identifier*>(sum->left);
+        REQUIRE(x);
+        CHECK_EQ(x->depth, 1);
+        CHECK_EQ(x->slot, 0);
+        const auto* call = dynamic_cast<const call_expression*>(sum->right);
+        REQUIRE(call);
+        CHECK_EQ(dynamic_cast<const identifier*>(call->function)->depth, identifier::builtin);
+        const auto* y = dynamic_cast<const identifier*>(call->arguments[0]);
+        REQUIRE(y);
+        CHECK_EQ(y->depth, 1);
+        CHECK_EQ(y->slot, 1);
+    }
 }
 
 // NOLINTEND(*)
@@ -42,9 +42,14 @@ struct analyzer final : visitor
     void visit(const string_literal& /* expr */) final {}
 
   private:
+    /// resolves the identifier to the environment and slot of its value when evaluating
+    void bind(const identifier& ident) const;
+
     symbol_table* m_symbols;
 };
 
+/// checks the program and resolves its identifiers for the evaluator, the globals it defines get named slots in the
+/// existing environment
 void analyze_program(const program* program,
                      symbol_table* existing_symbols,
-                     const environment* existing_env) noexcept(false);
+                     environment* existing_env) noexcept(false);
@@ -0,0 +1,110 @@
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "arena.hpp"
+
+#include <doctest/doctest.h>
+
+#include "identifier.hpp"
+#include "integer_literal.hpp"
+#include "statements.hpp"
+
+arena::~arena()
+{
+    for (auto itr = m_nodes.rbegin(); itr != m_nodes.rend(); ++itr) {
+        (*itr)->~expression();
+    }
+}
+
+auto arena::allocate(std::size_t size, std::size_t alignment) -> void*
+{
+    assert(alignment <= alignof(std::max_align_t));
+    void* current = m_current;
+    if (current != nullptr && std::align(alignment, size, current, m_remaining) != nullptr) {
+        m_current = static_cast<std::byte*>(current) + size;
+        m_remaining -= size;
+        return current;
+    }
+    if (size > block_size / 4) {
+        // large nodes get a block of their own, so the rest of the current block is not wasted
+        return m_blocks.emplace_back(std::make_unique_for_overwrite<std::byte[]>(size)).get();  // NOLINT(*-c-arrays)
+    }
+    auto* block = m_blocks.emplace_back(std::make_unique_for_overwrite<std::byte[]>(block_size)).get();  // NOLINT(*)
+    m_current = block + size;
+    m_remaining = block_size - size;
+    return block;
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+TEST_SUITE_BEGIN("arena");
+
+struct counted final : expression
+{
+    counted(int& destroyed, location loc)
+        : expression {loc}
+        , m_destroyed {destroyed}
+    {
+    }
+
+    ~counted() override { m_destroyed++; }
+
+    counted(const counted&) = delete;
+    counted(counted&&) = delete;
+    auto operator=(const counted&) -> counted& = delete;
+    auto operator=(counted&&) -> counted& = delete;
+
+    [[nodiscard]] auto string() const -> std::string final { return "counted"; }
+
+    void accept(struct visitor& /*visitor*/) const final {}
+
+    int& m_destroyed;
+    std::string payload = std::string(64, 'x');
+};
+
+TEST_CASE("nodesAreDestroyedWithTheArena")
+{
+    int destroyed = 0;
+    {
+        arena nodes;
+        for (int i = 0; i < 1000; i++) {
+            nodes.make<counted>(destroyed, location {});
+        }
+        CHECK_EQ(nodes.nodes(), 1000);
+        CHECK_EQ(destroyed, 0);
+    }
+    CHECK_EQ(destroyed, 1000);
+}
+
+TEST_CASE("nodesAreAllocatedContiguously")
+{
+    arena nodes;
+    auto* first = nodes.make<integer_literal>(location {});
+    auto* second = nodes.make<identifier>("name", location {});
+    auto* third = nodes.make<let_statement>(location {});
+    const auto distance = [](const void* from, const void* to)
+    { return reinterpret_cast<std::uintptr_t>(to) - reinterpret_cast<std::uintptr_t>(from); };
+    CHECK_EQ(nodes.blocks(), 1);
+    CHECK_LT(distance(first, second), sizeof(integer_literal) + alignof(std::max_align_t));
+    CHECK_LT(distance(second, third), sizeof(identifier) + alignof(std::max_align_t));
+    CHECK_EQ(reinterpret_cast<std::uintptr_t>(second) % alignof(identifier), 0);
+    CHECK_EQ(second->value, "name");
+}
+
+TEST_CASE("blocksGrowWithTheTree")
+{
+    arena nodes;
+    for (std::size_t i = 0; i < 4 * arena::block_size / sizeof(integer_literal); i++) {
+        nodes.make<integer_literal>(location {})->value = static_cast<int64_t>(i);
+    }
+    CHECK_GE(nodes.blocks(), 4);
+    CHECK_LE(nodes.blocks(), 5);
+}
+
+TEST_SUITE_END();
+// NOLINTEND(*)
+}  // namespace
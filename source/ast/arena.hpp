@@ -0,0 +1,55 @@
+#pragma once
+
+#include <concepts>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "expression.hpp"
+
+/// Bump allocator owning the nodes of one parsed program.
+///
+/// Nodes are placed one after another into large blocks, so a tree is laid out in parsing order and releasing it
+/// frees a handful of blocks instead of every node on its own. Nodes can not be freed individually, their destructors
+/// run when the arena is destroyed.
+class arena final
+{
+  public:
+    static constexpr std::size_t block_size = 16UL * 1024UL;
+
+    arena() = default;
+    arena(const arena&) = delete;
+    arena(arena&&) = delete;
+    auto operator=(const arena&) -> arena& = delete;
+    auto operator=(arena&&) -> arena& = delete;
+    ~arena();
+
+    template<typename T, typename... Args>
+        requires std::derived_from<T, expression>
+    auto make(Args&&... args) -> T*
+    {
+        T* node = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        try {
+            m_nodes.push_back(node);
+        } catch (...) {
+            // the node is not registered for destruction yet
+            node->~T();
+            throw;
+        }
+        return node;
+    }
+
+    [[nodiscard]] auto nodes() const -> std::size_t { return m_nodes.size(); }
+
+    [[nodiscard]] auto blocks() const -> std::size_t { return m_blocks.size(); }
+
+  private:
+    auto allocate(std::size_t size, std::size_t alignment) -> void*;
+
+    std::vector<std::unique_ptr<std::byte[]>> m_blocks;  // NOLINT(*-avoid-c-arrays)
+    std::byte* m_current {};
+    std::size_t m_remaining {};
+    std::vector<expression*> m_nodes;
+};
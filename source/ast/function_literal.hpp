@@ -19,4 +19,6 @@ struct function_literal final : expression
     std::string name;
     identifiers parameters;
     const block_statement* body {};
+    /// the number of slots the environment of a call needs, counted by the analyzer
+    mutable int num_locals {};
 };
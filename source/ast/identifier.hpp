@@ -19,6 +19,13 @@ struct identifier final : expression
     void accept(struct visitor& visitor) const override;
 
     std::string value;
+    /// where the evaluator finds the value, resolved by the analyzer: the number of function scopes outwards of the one
+    /// the identifier is used in and the slot in the environment of that scope, or the index of a builtin
+    mutable int depth {unresolved};
+    mutable int slot {};
+
+    static constexpr int unresolved = -1;
+    static constexpr int builtin = -2;
 };
 
 using identifiers = std::vector<const identifier*>;
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <memory>
+
+#include "arena.hpp"
 #include "expression.hpp"
 
 struct program final : expression
@@ -9,4 +12,8 @@ struct program final : expression
     void accept(struct visitor& visitor) const final;
 
     expressions statements;
+    /// the number of slots of the global environment the program uses, counted by the analyzer
+    mutable int num_globals {};
+    /// owns all nodes of the program, the function objects of the evaluator share it to keep their bodies alive
+    std::shared_ptr<arena> nodes = std::make_shared<arena>();
 };
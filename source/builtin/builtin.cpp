@@ -1,8 +1,9 @@
 #include <algorithm>
+#include <array>
 #include <cctype>
 #include <cstdint>
-#include <functional>
 #include <iterator>
+#include <span>
 #include <string>
 #include <utility>
 #include <vector>
@@ -14,12 +15,10 @@
 #include <gc.hpp>
 #include <object/object.hpp>
 
-builtin::builtin(std::string name,
-                 std::vector<std::string> params,
-                 std::function<const object*(array_object::value_type&& arguments)> bod)
+builtin::builtin(std::string name, std::vector<std::string> params, body_type bod)
     : name {std::move(name)}
     , parameters {std::move(params)}
-    , body {std::move(bod)}
+    , body {bod}
 {
 }
 
@@ -29,7 +28,7 @@ namespace
 const builtin len {
     "len",
     {"val"},
-    [](const array_object::value_type& arguments) -> const object*
+    [](std::span<const object* const> arguments) -> const object*
     {
         if (arguments.size() != 1) {
             return make_error("wrong number of arguments to len(): expected=1, got={}", arguments.size());
@@ -37,7 +36,7 @@ const builtin len {
         const auto& maybe_string_or_array_or_hash = arguments[0];
         using enum object::object_type;
         if (maybe_string_or_array_or_hash->is(string)) {
-            const auto& str = maybe_string_or_array_or_hash->as<string_object>()->value;
+            const auto str = maybe_string_or_array_or_hash->as<string_object>()->value();
             return make<integer_object>(static_cast<int64_t>(str.size()));
         }
         if (maybe_string_or_array_or_hash->is(array)) {
@@ -55,7 +54,7 @@ const builtin len {
 
 const builtin pts {"puts",
                    {"val..."},
-                   [](const array_object::value_type& arguments) -> const object*
+                   [](std::span<const object* const> arguments) -> const object*
                    {
                        using enum object::object_type;
                        for (bool first = true; const auto& arg : arguments) {
@@ -63,7 +62,7 @@ const builtin pts {"puts",
                                fmt::print(" ");
                            }
                            if (arg->is(string)) {
-                               fmt::print("{}", arg->as<string_object>()->value);
+                               fmt::print("{}", arg->as<string_object>()->value());
                            } else {
                                fmt::print("{}", arg->inspect());
                            }
@@ -76,17 +75,17 @@ const builtin pts {"puts",
 const builtin first {
     "first",
     {"arr|str"},
-    [](const array_object::value_type& arguments) -> const object*
+    [](std::span<const object* const> arguments) -> const object*
     {
         if (arguments.size() != 1) {
             return make_error("wrong number of arguments to first(): expected=1, got={}", arguments.size());
         }
-        const auto& maybe_string_or_array = arguments.at(0);
+        const auto& maybe_string_or_array = arguments[0];
         using enum object::object_type;
         if (maybe_string_or_array->is(string)) {
-            const auto& str = maybe_string_or_array->as<string_object>()->value;
+            const auto str = maybe_string_or_array->as<string_object>()->value();
             if (!str.empty()) {
-                return make<string_object>(str.substr(0, 1));
+                return single_character(str.front());
             }
             return null();
         }
@@ -103,7 +102,7 @@ const builtin first {
 const builtin last {
     "last",
     {"arr|str"},
-    [](const array_object::value_type& arguments) -> const object*
+    [](std::span<const object* const> arguments) -> const object*
     {
         if (arguments.size() != 1) {
             return make_error("wrong number of arguments to last(): expected=1, got={}", arguments.size());
@@ -111,9 +110,9 @@ const builtin last {
         const auto& maybe_string_or_array = arguments[0];
         using enum object::object_type;
         if (maybe_string_or_array->is(string)) {
-            const auto& str = maybe_string_or_array->as<string_object>()->value;
+            const auto str = maybe_string_or_array->as<string_object>()->value();
             if (!str.empty()) {
-                return make<string_object>(str.substr(str.length() - 1, 1));
+                return single_character(str.back());
             }
             return null();
         }
@@ -130,26 +129,24 @@ const builtin last {
 const builtin rest {
     "rest",
     {"arr|str"},
-    [](const array_object::value_type& arguments) -> const object*
+    [](std::span<const object* const> arguments) -> const object*
     {
         if (arguments.size() != 1) {
             return make_error("wrong number of arguments to rest(): expected=1, got={}", arguments.size());
         }
-        const auto& maybe_string_or_array = arguments.at(0);
+        const auto& maybe_string_or_array = arguments[0];
         using enum object::object_type;
         if (maybe_string_or_array->is(string)) {
-            const auto& str = maybe_string_or_array->as<string_object>()->value;
+            const auto str = maybe_string_or_array->as<string_object>()->value();
             if (str.size() > 1) {
-                return make<string_object>(str.substr(1));
+                return make<string_object>(std::string {str.substr(1)});
             }
             return null();
         }
         if (maybe_string_or_array->is(array)) {
             const auto& arr = maybe_string_or_array->as<array_object>()->value;
             if (arr.size() > 1) {
-                array_object::value_type rest;
-                std::copy(arr.cbegin() + 1, arr.cend(), std::back_inserter(rest));
-                return make<array_object>(std::move(rest));
+                return make<array_object>(arr.drop_front(1));
             }
             return null();
         }
@@ -159,7 +156,7 @@ const builtin rest {
 const builtin push {
     "push",
     {"arr|str|hsh", "val|str|hashable", "val"},
-    [](const array_object::value_type& arguments) -> const object*
+    [](std::span<const object* const> arguments) -> const object*
     {
         if (arguments.size() != 2 && arguments.size() != 3) {
             return make_error("wrong number of arguments to push(): expected=2 or 3, got={}", arguments.size());
@@ -174,9 +171,7 @@ const builtin push {
                 return make<array_object>(std::move(copy));
             }
             if (lhs->is(string) && rhs->is(string)) {
-                auto copy = lhs->as<string_object>()->value;
-                copy.append(rhs->as<string_object>()->value);
-                return make<string_object>(std::move(copy));
+                return lhs->as<string_object>()->concat(rhs->as<string_object>()->value());
             }
             return make_error("argument of type {} and {} to push() are not supported", lhs->type(), rhs->type());
         }
@@ -200,7 +195,7 @@ const builtin push {
 
 const builtin type {"type",
                     {"val"},
-                    [](const array_object::value_type& arguments) -> const object*
+                    [](std::span<const object* const> arguments) -> const object*
                     {
                         if (arguments.size() != 1) {
                             return make_error("wrong number of arguments to type(): expected=1, got={}",
@@ -211,7 +206,7 @@ const builtin type {"type",
                     }};
 const builtin chr {"chr",
                    {"int"},
-                   [](const array_object::value_type& arguments) -> const object*
+                   [](std::span<const object* const> arguments) -> const object*
                    {
                        if (arguments.size() != 1) {
                            return make_error("wrong number of arguments to chr(): expected=1, got={}",
@@ -221,7 +216,7 @@ const builtin chr {"chr",
                        if (val->is(object::object_type::integer)) {
                            const auto& as_int = val->as<integer_object>()->value;
                            if (isascii(static_cast<int>(as_int))) {
-                               return make<string_object>(fmt::format("{}", static_cast<char>(as_int)));
+                               return single_character(static_cast<char>(as_int));
                            }
                            return make_error("number {} is out of range to be an ascii character", as_int);
                        }
@@ -234,3 +229,24 @@ auto builtin::builtins() -> const std::vector<const builtin*>&
     static const std::vector<const builtin*> bltns {&len, &pts, &first, &last, &rest, &push, &type, &chr};
     return bltns;
 };
+
+auto builtin::builtin_objects() -> const std::vector<const builtin_object*>&
+{
+    static const std::array instances {builtin_object {&len},
+                                       builtin_object {&pts},
+                                       builtin_object {&first},
+                                       builtin_object {&last},
+                                       builtin_object {&rest},
+                                       builtin_object {&push},
+                                       builtin_object {&type},
+                                       builtin_object {&chr}};
+    static const std::vector<const builtin_object*> objects = []
+    {
+        std::vector<const builtin_object*> result;
+        for (const auto& instance : instances) {
+            result.push_back(&instance);
+        }
+        return result;
+    }();
+    return objects;
+}
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <functional>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -8,13 +8,16 @@
 
 struct builtin final
 {
-    builtin(std::string name,
-            std::vector<std::string> params,
-            std::function<const object*(std::vector<const object*>&& arguments)> bod);
+    /// the arguments are only borrowed for the duration of the call
+    using body_type = auto (*)(std::span<const object* const> arguments) -> const object*;
+
+    builtin(std::string name, std::vector<std::string> params, body_type bod);
 
     static auto builtins() -> const std::vector<const builtin*>&;
+    /// one immortal object per builtin, in the same order as builtins(), so looking up a builtin never allocates
+    static auto builtin_objects() -> const std::vector<const builtin_object*>&;
 
     std::string name;
     std::vector<std::string> parameters;
-    std::function<const object*(array_object::value_type&& arguments)> body;
+    body_type body {};
 };
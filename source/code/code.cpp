@@ -47,6 +47,8 @@ auto operator<<(std::ostream& ostream, opcodes opcode) -> std::ostream&
             return ostream << "bang";
         case jump_not_truthy:
             return ostream << "jump_not_truthy";
+        case jump_truthy:
+            return ostream << "jump_truthy";
         case jump:
             return ostream << "jump";
         case null:
@@ -79,6 +81,8 @@ auto operator<<(std::ostream& ostream, opcodes opcode) -> std::ostream&
             return ostream << "get_free";
         case current_closure:
             return ostream << "current_closure";
+        case call_builtin:
+            return ostream << "call_builtin";
         case mod:
             return ostream << "mod";
         case bit_and:
@@ -91,22 +95,42 @@ auto operator<<(std::ostream& ostream, opcodes opcode) -> std::ostream&
             return ostream << "bit_lsh";
         case bit_rsh:
             return ostream << "bit_rsh";
-        case logical_and:
-            return ostream << "logical_and";
-        case logical_or:
-            return ostream << "logical_or";
         case set_free:
             return ostream << "set_free";
-        case get_outer:
-            return ostream << "get_outer";
-        case set_outer:
-            return ostream << "set_outer";
-        case brake:
-            return ostream << "break";
-        case cont:
-            return ostream << "continue";
         case greater_equal:
             return ostream << "greater_equal";
+        case add_const:
+            return ostream << "add_const";
+        case sub_const:
+            return ostream << "sub_const";
+        case jump_not_equal:
+            return ostream << "jump_not_equal";
+        case jump_not_greater:
+            return ostream << "jump_not_greater";
+        case jump_not_greater_equal:
+            return ostream << "jump_not_greater_equal";
+        case get_local_get_local:
+            return ostream << "get_local_get_local";
+        case inc_local:
+            return ostream << "inc_local";
+        case add_int_int:
+            return ostream << "add_int_int";
+        case sub_int_int:
+            return ostream << "sub_int_int";
+        case mul_int_int:
+            return ostream << "mul_int_int";
+        case equal_int_int:
+            return ostream << "equal_int_int";
+        case not_equal_int_int:
+            return ostream << "not_equal_int_int";
+        case greater_than_int_int:
+            return ostream << "greater_than_int_int";
+        case greater_equal_int_int:
+            return ostream << "greater_equal_int_int";
+        case index_array_int:
+            return ostream << "index_array_int";
+        case call_closure:
+            return ostream << "call_closure";
     }
     throw std::runtime_error(
         fmt::format("operator <<(std::ostream&) for {} is not implemented yet", static_cast<uint8_t>(opcode)));
@@ -114,25 +138,29 @@ auto operator<<(std::ostream& ostream, opcodes opcode) -> std::ostream&
 
 auto make(opcodes opcode, const operands& operands) -> instructions
 {
-    if (!definitions.contains(opcode)) {
+    const auto def = lookup(opcode);
+    if (!def.has_value()) {
         throw std::invalid_argument(fmt::format("definition given opcode {} is not defined", opcode));
     }
-    const auto& definition = definitions.at(opcode);
-    instructions instr;
-    instr.push_back(static_cast<uint8_t>(opcode));
+    instructions instr(def->size());
+    instr[0] = static_cast<uint8_t>(opcode);
+    auto offset = 1UL;
     for (size_t idx = 0; const auto operand : operands) {
-        auto width = definition.operand_widths[idx];
+        const auto width = def->operand_widths()[idx];
         switch (width) {
+            case 4:
+                write_operand(&instr[offset], static_cast<std::uint32_t>(operand));
+                break;
             case 2:
-                write_uint16_big_endian(
-                    instr, static_cast<std::uint16_t>(instr.size()), static_cast<std::uint16_t>(operand));
+                write_operand(&instr[offset], static_cast<std::uint16_t>(operand));
                 break;
             case 1:
-                instr.push_back(static_cast<uint8_t>(operand));
+                instr[offset] = static_cast<uint8_t>(operand);
                 break;
             default:
                 throw std::runtime_error(fmt::format("invalid operand width: {}", width));
         }
+        offset += width;
         idx++;
     }
     return instr;
@@ -148,12 +176,18 @@ auto make(opcodes opcode, size_t operand) -> instructions
 auto read_operands(const definition& def, const instructions& instr) -> std::pair<operands, operands::size_type>
 {
     std::pair<operands, operands::size_type> result;
-    result.first.resize(def.operand_widths.size());
+    result.first.resize(def.operand_widths().size());
     auto offset = 0UL;
-    for (size_t idx = 0; const auto width : def.operand_widths) {
+    for (size_t idx = 0; const auto width : def.operand_widths()) {
+        if (offset + width > instr.size()) {
+            throw std::out_of_range("Offset is out of bounds");
+        }
         switch (width) {
+            case 4:
+                result.first[idx] = read_operand<std::uint32_t>(&instr[offset]);
+                break;
             case 2:
-                result.first[idx] = read_uint16_big_endian(instr, offset);
+                result.first[idx] = read_operand<std::uint16_t>(&instr[offset]);
                 break;
             case 1:
                 result.first[idx] = instr[offset];
@@ -170,17 +204,18 @@ auto read_operands(const definition& def, const instructions& instr) -> std::pai
 
 auto lookup(opcodes opcode) -> std::optional<definition>
 {
-    if (!definitions.contains(opcode)) {
+    const auto idx = static_cast<std::size_t>(opcode);
+    if (idx >= definitions.size()) {
         return std::nullopt;
     }
-    return definitions.at(opcode);
+    return definitions[idx];
 }
 
 namespace
 {
 auto fmt_instruction(const definition& def, const operands& operands) -> std::string
 {
-    auto count = def.operand_widths.size();
+    auto count = def.operand_widths().size();
     if (count != operands.size()) {
         return fmt::format("ERROR: operand len {} does not match defined {}\n", operands.size(), count);
     }
@@ -216,31 +251,6 @@ auto to_string(const instructions& code) -> std::string
     return result;
 }
 
-constexpr auto bits_in_byte = 8U;
-constexpr auto byte_mask = 0xFFU;
-
-auto read_uint16_big_endian(const std::vector<uint8_t>& bytes, size_t offset) -> uint16_t
-{
-    if (offset + 2 > bytes.size()) {
-        throw std::out_of_range("Offset is out of bounds");
-    }
-
-    auto result = static_cast<uint16_t>((bytes[offset]) << bits_in_byte);
-    result |= bytes[offset + 1];
-
-    return result;
-}
-
-void write_uint16_big_endian(std::vector<uint8_t>& bytes, size_t offset, uint16_t value)
-{
-    if (offset + 2 > bytes.size()) {
-        bytes.resize(offset + 2);
-    }
-
-    bytes[offset] = static_cast<uint8_t>(value >> bits_in_byte);
-    bytes[offset + 1] = static_cast<uint8_t>(value & byte_mask);
-}
-
 namespace
 {
 // NOLINTBEGIN(*)
@@ -255,6 +265,14 @@ auto flatten(const std::vector<std::vector<T>>& arrs) -> std::vector<T>
     return result;
 }
 
+template<std::unsigned_integral T>
+auto bytes_of(T value) -> instructions
+{
+    instructions result(sizeof(T));
+    write_operand(result.data(), value);
+    return result;
+}
+
 TEST_SUITE("code")
 {
     TEST_CASE("make")
@@ -269,8 +287,8 @@ TEST_SUITE("code")
         std::array tests {
             test {
                 constant,
-                {65534},
-                {static_cast<uint8_t>(constant), 255, 254},
+                {65536},
+                flatten<uint8_t>({{static_cast<uint8_t>(constant)}, bytes_of<uint32_t>(65536)}),
             },
             test {
                 add,
@@ -287,15 +305,26 @@ TEST_SUITE("code")
                 {255},
                 {static_cast<uint8_t>(get_local), 255},
             },
+            test {
+                get_global,
+                {65534},
+                flatten<uint8_t>({{static_cast<uint8_t>(get_global)}, bytes_of<uint16_t>(65534)}),
+            },
             test {
                 closure,
-                {65534, 255},
-                {static_cast<uint8_t>(closure), 255, 254, 255},
+                {65536, 255},
+                flatten<uint8_t>({{static_cast<uint8_t>(closure)}, bytes_of<uint32_t>(65536), {255}}),
+            },
+            test {
+                inc_local,
+                {255, 65534},
+                flatten<uint8_t>({{static_cast<uint8_t>(inc_local), 255}, bytes_of<uint32_t>(65534)}),
             },
         };
         for (auto&& [opcode, operands, expected] : tests) {
             auto actual = make(opcode, operands);
             REQUIRE_EQ(actual, expected);
+            REQUIRE_EQ(actual.size(), lookup(opcode)->size());
         }
     }
 
@@ -304,15 +333,17 @@ TEST_SUITE("code")
         const auto* const expected = R"(0000 OpAdd
 0001 OpGetLocal 1
 0003 OpConstant 2
-0006 OpConstant 65535
-0009 OpClosure 65535 255
+0008 OpConstant 65536
+0013 OpClosure 65536 255
+0019 OpJump 100000
 )";
         std::vector<instructions> instrs {
             make(opcodes::add),
             make(opcodes::get_local, 1),
             make(opcodes::constant, 2),
-            make(opcodes::constant, 65535),
-            make(opcodes::closure, {65535, 255}),
+            make(opcodes::constant, 65536),
+            make(opcodes::closure, {65536, 255}),
+            make(opcodes::jump, 100000),
         };
         auto concatenated = flatten(instrs);
         auto actual = to_string(concatenated);
@@ -331,9 +362,19 @@ TEST_SUITE("code")
         std::array tests {
             test {
                 opcodes::constant,
+                {65536},
+                4,
+            },
+            test {
+                opcodes::get_global,
                 {65534},
                 2,
             },
+            test {
+                opcodes::inc_local,
+                {255, 65534},
+                5,
+            },
         };
         for (auto&& [opcode, operands, bytes] : tests) {
             const auto instr = make(opcode, operands);
@@ -1,9 +1,15 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <concepts>
 #include <cstddef>
 #include <cstdint>
-#include <map>
+#include <cstring>
+#include <initializer_list>
 #include <optional>
+#include <span>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <fmt/ostream.h>
@@ -24,8 +30,6 @@ enum class opcodes : uint8_t
     bit_xor,
     bit_lsh,
     bit_rsh,
-    logical_and,
-    logical_or,
     pop,
     tru,
     fals,
@@ -36,6 +40,7 @@ enum class opcodes : uint8_t
     minus,
     bang,
     jump_not_truthy,
+    jump_truthy,
     jump,
     null,
     get_global,
@@ -44,21 +49,39 @@ enum class opcodes : uint8_t
     hash,
     index,
     call,
-    brake,
-    cont,
     return_value,
     ret,
     get_local,
     set_local,
     get_free,
     set_free,
-    get_outer,
-    set_outer,
     get_builtin,
     closure,
     current_closure,
+    call_builtin,
+    // superinstructions emitted by the peephole optimization of the compiler
+    add_const,
+    sub_const,
+    jump_not_equal,
+    jump_not_greater,
+    jump_not_greater_equal,
+    get_local_get_local,
+    inc_local,
+    // specialized instructions the vm rewrites a generic instruction to, once it observed the types of its operands
+    add_int_int,
+    sub_int_int,
+    mul_int_int,
+    equal_int_int,
+    not_equal_int_int,
+    greater_than_int_int,
+    greater_equal_int_int,
+    index_array_int,
+    call_closure,
 };
 
+/// number of opcodes, has to be kept in sync with the last opcode
+constexpr auto opcodes_count = static_cast<std::size_t>(opcodes::call_closure) + 1;
+
 auto operator<<(std::ostream& ostream, opcodes opcode) -> std::ostream&;
 
 template<>
@@ -67,63 +90,199 @@ struct fmt::formatter<opcodes> : ostream_formatter
 };
 
 using operands = std::vector<std::size_t>;
-using instructions = std::vector<uint8_t>;
 
+/// maximum number of operands of an instruction
+constexpr std::size_t max_operands = 2;
+
+/// Layout of an instruction: the opcode byte is followed by operands of 1, 2 or 4 bytes in native byte order.
 struct definition final
 {
+    constexpr definition(opcodes opc, std::string_view nm, std::initializer_list<std::uint8_t> widths = {})
+        : opcode {opc}
+        , name {nm}
+        , m_count {widths.size()}
+    {
+        std::copy(widths.begin(), widths.end(), m_widths.begin());
+    }
+
+    [[nodiscard]] constexpr auto operand_widths() const -> std::span<const std::uint8_t>
+    {
+        return {m_widths.data(), m_count};
+    }
+
+    /// size of the instruction in bytes including the opcode
+    [[nodiscard]] constexpr auto size() const -> std::size_t
+    {
+        std::size_t result = 1;
+        for (const auto width : operand_widths()) {
+            result += width;
+        }
+        return result;
+    }
+
+    opcodes opcode;
     std::string_view name;
-    operands operand_widths;
+
+  private:
+    std::array<std::uint8_t, max_operands> m_widths {};
+    std::size_t m_count {};
 };
 
-using definition_type = std::map<opcodes, definition>;
-
-const definition_type definitions {
-    {opcodes::constant, definition {.name = "OpConstant", .operand_widths = {2}}},
-    {opcodes::add, definition {.name = "OpAdd"}},
-    {opcodes::sub, definition {.name = "OpSub"}},
-    {opcodes::mul, definition {.name = "OpMul"}},
-    {opcodes::div, definition {.name = "OpDiv"}},
-    {opcodes::mod, definition {.name = "OpMod"}},
-    {opcodes::floor_div, definition {.name = "OpFloorDiv"}},
-    {opcodes::bit_and, definition {.name = "OpBitAnd"}},
-    {opcodes::bit_or, definition {.name = "OpBitOr"}},
-    {opcodes::bit_xor, definition {.name = "OpBitXor"}},
-    {opcodes::bit_lsh, definition {.name = "OpBitLsh"}},
-    {opcodes::bit_rsh, definition {.name = "OpBitRsh"}},
-    {opcodes::logical_and, definition {.name = "OpLogicalAnd"}},
-    {opcodes::logical_or, definition {.name = "OpLogicalOr"}},
-    {opcodes::pop, definition {.name = "OpPop"}},
-    {opcodes::tru, definition {.name = "OpTrue"}},
-    {opcodes::fals, definition {.name = "OpFalse"}},
-    {opcodes::equal, definition {.name = "OpEqual"}},
-    {opcodes::not_equal, definition {.name = "OpNotEquql"}},
-    {opcodes::greater_than, definition {.name = "OpGreaterThan"}},
-    {opcodes::greater_equal, definition {.name = "OpGreaterEuqal"}},
-    {opcodes::minus, definition {.name = "OpMinus"}},
-    {opcodes::bang, definition {.name = "OpBang"}},
-    {opcodes::jump_not_truthy, definition {.name = "OpJumpNotTruthy", .operand_widths = {2}}},
-    {opcodes::jump, definition {.name = "OpJump", .operand_widths = {2}}},
-    {opcodes::null, definition {.name = "OpNull"}},
-    {opcodes::get_global, definition {.name = "OpGetGlobal", .operand_widths = {2}}},
-    {opcodes::set_global, definition {.name = "OpSetGlobal", .operand_widths = {2}}},
-    {opcodes::array, definition {.name = "OpArray", .operand_widths = {2}}},
-    {opcodes::hash, definition {.name = "OpHash", .operand_widths = {2}}},
-    {opcodes::index, definition {.name = "OpIndex"}},
-    {opcodes::call, definition {.name = "OpCall", .operand_widths = {1}}},
-    {opcodes::brake, definition {.name = "OpBreak"}},
-    {opcodes::cont, definition {.name = "OpContinue"}},
-    {opcodes::return_value, definition {.name = "OpReturnValue"}},
-    {opcodes::ret, definition {.name = "OpReturn"}},
-    {opcodes::get_local, definition {.name = "OpGetLocal", .operand_widths = {1}}},
-    {opcodes::set_local, definition {.name = "OpSetLocal", .operand_widths = {1}}},
-    {opcodes::get_free, definition {.name = "OpGetFree", .operand_widths = {1}}},
-    {opcodes::set_free, definition {.name = "OpSetFree", .operand_widths = {1}}},
-    {opcodes::set_outer, definition {.name = "OpSetOuter", .operand_widths = {1, 1, 1}}},
-    {opcodes::get_outer, definition {.name = "OpGetOuter", .operand_widths = {1, 1, 1}}},
-    {opcodes::get_builtin, definition {.name = "OpGetBuiltin", .operand_widths = {1}}},
-    {opcodes::closure, definition {.name = "OpClosure", .operand_widths = {2, 1}}},
-    {opcodes::current_closure, definition {.name = "OpCurrentClosure"}},
+/// the definitions indexed by opcode
+constexpr std::array definitions {
+    definition {opcodes::constant, "OpConstant", {4}},
+    definition {opcodes::add, "OpAdd"},
+    definition {opcodes::sub, "OpSub"},
+    definition {opcodes::mul, "OpMul"},
+    definition {opcodes::div, "OpDiv"},
+    definition {opcodes::floor_div, "OpFloorDiv"},
+    definition {opcodes::mod, "OpMod"},
+    definition {opcodes::bit_and, "OpBitAnd"},
+    definition {opcodes::bit_or, "OpBitOr"},
+    definition {opcodes::bit_xor, "OpBitXor"},
+    definition {opcodes::bit_lsh, "OpBitLsh"},
+    definition {opcodes::bit_rsh, "OpBitRsh"},
+    definition {opcodes::pop, "OpPop"},
+    definition {opcodes::tru, "OpTrue"},
+    definition {opcodes::fals, "OpFalse"},
+    definition {opcodes::equal, "OpEqual"},
+    definition {opcodes::not_equal, "OpNotEquql"},
+    definition {opcodes::greater_than, "OpGreaterThan"},
+    definition {opcodes::greater_equal, "OpGreaterEuqal"},
+    definition {opcodes::minus, "OpMinus"},
+    definition {opcodes::bang, "OpBang"},
+    definition {opcodes::jump_not_truthy, "OpJumpNotTruthy", {4}},
+    definition {opcodes::jump_truthy, "OpJumpTruthy", {4}},
+    definition {opcodes::jump, "OpJump", {4}},
+    definition {opcodes::null, "OpNull"},
+    definition {opcodes::get_global, "OpGetGlobal", {2}},
+    definition {opcodes::set_global, "OpSetGlobal", {2}},
+    definition {opcodes::array, "OpArray", {2}},
+    definition {opcodes::hash, "OpHash", {2}},
+    definition {opcodes::index, "OpIndex"},
+    definition {opcodes::call, "OpCall", {1}},
+    definition {opcodes::return_value, "OpReturnValue"},
+    definition {opcodes::ret, "OpReturn"},
+    definition {opcodes::get_local, "OpGetLocal", {1}},
+    definition {opcodes::set_local, "OpSetLocal", {1}},
+    definition {opcodes::get_free, "OpGetFree", {1}},
+    definition {opcodes::set_free, "OpSetFree", {1}},
+    definition {opcodes::get_builtin, "OpGetBuiltin", {1}},
+    definition {opcodes::closure, "OpClosure", {4, 1}},
+    definition {opcodes::current_closure, "OpCurrentClosure"},
+    definition {opcodes::call_builtin, "OpCallBuiltin", {1, 1}},
+    definition {opcodes::add_const, "OpAddConst", {4}},
+    definition {opcodes::sub_const, "OpSubConst", {4}},
+    definition {opcodes::jump_not_equal, "OpJumpNotEqual", {4}},
+    definition {opcodes::jump_not_greater, "OpJumpNotGreater", {4}},
+    definition {opcodes::jump_not_greater_equal, "OpJumpNotGreaterEqual", {4}},
+    definition {opcodes::get_local_get_local, "OpGetLocalGetLocal", {1, 1}},
+    definition {opcodes::inc_local, "OpIncLocal", {1, 4}},
+    definition {opcodes::add_int_int, "OpAddIntInt"},
+    definition {opcodes::sub_int_int, "OpSubIntInt"},
+    definition {opcodes::mul_int_int, "OpMulIntInt"},
+    definition {opcodes::equal_int_int, "OpEqualIntInt"},
+    definition {opcodes::not_equal_int_int, "OpNotEqualIntInt"},
+    definition {opcodes::greater_than_int_int, "OpGreaterThanIntInt"},
+    definition {opcodes::greater_equal_int_int, "OpGreaterEqualIntInt"},
+    definition {opcodes::index_array_int, "OpIndexArrayInt"},
+    definition {opcodes::call_closure, "OpCallClosure", {1}},
 };
+static_assert(definitions.size() == opcodes_count, "every opcode needs a definition");
+static_assert(
+    []
+    {
+        for (std::size_t idx = 0; idx < definitions.size(); idx++) {
+            if (static_cast<std::size_t>(definitions[idx].opcode) != idx) {
+                return false;
+            }
+        }
+        return true;
+    }(),
+    "the definitions have to be in the order of the opcodes");
+
+/// the variant of a binary operator specialized for two integer operands, the opcode itself if there is none
+[[nodiscard]] constexpr auto integer_variant(opcodes opcode) -> opcodes
+{
+    using enum opcodes;
+    switch (opcode) {
+        case add:
+            return add_int_int;
+        case sub:
+            return sub_int_int;
+        case mul:
+            return mul_int_int;
+        case equal:
+            return equal_int_int;
+        case not_equal:
+            return not_equal_int_int;
+        case greater_than:
+            return greater_than_int_int;
+        case greater_equal:
+            return greater_equal_int_int;
+        default:
+            return opcode;
+    }
+}
+
+/// the generic instruction a specialized instruction was rewritten from, the opcode itself for the others
+[[nodiscard]] constexpr auto generic_variant(opcodes opcode) -> opcodes
+{
+    using enum opcodes;
+    switch (opcode) {
+        case add_int_int:
+            return add;
+        case sub_int_int:
+            return sub;
+        case mul_int_int:
+            return mul;
+        case equal_int_int:
+            return equal;
+        case not_equal_int_int:
+            return not_equal;
+        case greater_than_int_int:
+            return greater_than;
+        case greater_equal_int_int:
+            return greater_equal;
+        case index_array_int:
+            return index;
+        case call_closure:
+            return call;
+        default:
+            return opcode;
+    }
+}
+
+static_assert(
+    []
+    {
+        for (std::size_t idx = 0; idx < opcodes_count; idx++) {
+            const auto opcode = static_cast<opcodes>(idx);
+            if (integer_variant(opcode) != opcode && generic_variant(integer_variant(opcode)) != opcode) {
+                return false;
+            }
+            if (definitions[idx].size() != definitions[static_cast<std::size_t>(generic_variant(opcode))].size()) {
+                return false;
+            }
+        }
+        return true;
+    }(),
+    "a specialized instruction has to map back to its generic instruction, which has the same size");
+
+/// reads an operand stored in native byte order, the copy compiles to a single load
+template<std::unsigned_integral T>
+[[nodiscard]] inline auto read_operand(const std::uint8_t* bytes) -> T
+{
+    T result {};
+    std::memcpy(&result, bytes, sizeof(T));
+    return result;
+}
+
+template<std::unsigned_integral T>
+inline void write_operand(std::uint8_t* bytes, T value)
+{
+    std::memcpy(bytes, &value, sizeof(T));
+}
 
 [[nodiscard]] auto make(opcodes opcode, const operands& operands = {}) -> instructions;
 [[nodiscard]] auto make(opcodes opcode, size_t operand) -> instructions;
@@ -131,5 +290,3 @@ const definition_type definitions {
 [[nodiscard]] auto read_operands(const definition& def, const instructions& instr)
     -> std::pair<operands, operands::size_type>;
 [[nodiscard]] auto to_string(const instructions& code) -> std::string;
-[[nodiscard]] auto read_uint16_big_endian(const instructions& bytes, size_t offset) -> uint16_t;
-void write_uint16_big_endian(instructions& bytes, size_t offset, uint16_t value);
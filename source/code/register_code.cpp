@@ -0,0 +1,234 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "register_code.hpp"
+
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+
+#include "code.hpp"
+
+namespace registers
+{
+auto binary_operator(opcodes opcode) -> ::opcodes
+{
+    using enum opcodes;
+    switch (opcode) {
+        case add:
+        case add_const:
+            return ::opcodes::add;
+        case sub:
+        case sub_const:
+            return ::opcodes::sub;
+        case mul:
+            return ::opcodes::mul;
+        case div:
+            return ::opcodes::div;
+        case floor_div:
+            return ::opcodes::floor_div;
+        case mod:
+            return ::opcodes::mod;
+        case bit_and:
+            return ::opcodes::bit_and;
+        case bit_or:
+            return ::opcodes::bit_or;
+        case bit_xor:
+            return ::opcodes::bit_xor;
+        case bit_lsh:
+            return ::opcodes::bit_lsh;
+        case bit_rsh:
+            return ::opcodes::bit_rsh;
+        case equal:
+        case jump_not_equal:
+            return ::opcodes::equal;
+        case not_equal:
+            return ::opcodes::not_equal;
+        case greater_than:
+        case jump_not_greater:
+            return ::opcodes::greater_than;
+        case greater_equal:
+        case jump_not_greater_equal:
+            return ::opcodes::greater_equal;
+        default:
+            throw std::invalid_argument(fmt::format("{} is not a binary operation", lookup(opcode).name));
+    }
+}
+
+auto make(opcodes opcode, const operands& operands) -> instructions
+{
+    const auto& def = lookup(opcode);
+    if (operands.size() != def.operand_widths().size()) {
+        throw std::invalid_argument(
+            fmt::format("{} takes {} operands, got {}", def.name, def.operand_widths().size(), operands.size()));
+    }
+    instructions instr(def.size());
+    instr[0] = static_cast<uint8_t>(opcode);
+    auto offset = 1UL;
+    for (size_t idx = 0; const auto operand : operands) {
+        const auto width = def.operand_widths()[idx];
+        switch (width) {
+            case 4:
+                write_operand(&instr[offset], static_cast<std::uint32_t>(operand));
+                break;
+            case 2:
+                write_operand(&instr[offset], static_cast<std::uint16_t>(operand));
+                break;
+            case 1:
+                instr[offset] = static_cast<uint8_t>(operand);
+                break;
+            default:
+                throw std::runtime_error(fmt::format("invalid operand width: {}", width));
+        }
+        offset += width;
+        idx++;
+    }
+    return instr;
+}
+
+auto to_string(const instructions& code) -> std::string
+{
+    std::string result;
+    for (size_t idx = 0; idx < code.size();) {
+        if (code[idx] >= opcodes_count) {
+            result += fmt::format("{:04d} ERROR: unknown opcode {}\n", idx, code[idx]);
+            idx++;
+            continue;
+        }
+        const auto& def = lookup(static_cast<opcodes>(code[idx]));
+        if (idx + def.size() > code.size()) {
+            result += fmt::format("{:04d} ERROR: truncated {}\n", idx, def.name);
+            break;
+        }
+        std::string line {def.name};
+        auto offset = idx + 1;
+        for (size_t operand = 0; const auto width : def.operand_widths()) {
+            std::size_t value = 0;
+            switch (width) {
+                case 4:
+                    value = read_operand<std::uint32_t>(&code[offset]);
+                    break;
+                case 2:
+                    value = read_operand<std::uint16_t>(&code[offset]);
+                    break;
+                default:
+                    value = code[offset];
+                    break;
+            }
+            line += operand < def.registers ? fmt::format(" r{}", value) : fmt::format(" {}", value);
+            offset += width;
+            operand++;
+        }
+        result += fmt::format("{:04d} {}\n", idx, line);
+        idx += def.size();
+    }
+    return result;
+}
+}  // namespace registers
+
+namespace
+{
+// NOLINTBEGIN(*)
+
+template<std::unsigned_integral T>
+auto bytes_of(T value) -> std::vector<uint8_t>
+{
+    std::vector<uint8_t> result(sizeof(T));
+    write_operand(result.data(), value);
+    return result;
+}
+
+auto concat(std::initializer_list<std::vector<uint8_t>> parts) -> instructions
+{
+    instructions result;
+    for (const auto& part : parts) {
+        result.insert(result.end(), part.begin(), part.end());
+    }
+    return result;
+}
+
+TEST_SUITE("register_code")
+{
+    TEST_CASE("make")
+    {
+        using enum registers::opcodes;
+        struct test
+        {
+            registers::opcodes opcode;
+            operands opers;
+            instructions expected;
+        };
+        std::array tests {
+            test {
+                add,
+                {2, 0, 1},
+                concat({
+                    {static_cast<uint8_t>(add)},
+                    bytes_of<uint16_t>(2),
+                    bytes_of<uint16_t>(0),
+                    bytes_of<uint16_t>(1),
+                }),
+            },
+            test {
+                load_constant,
+                {300, 65536},
+                concat({{static_cast<uint8_t>(load_constant)}, bytes_of<uint16_t>(300), bytes_of<uint32_t>(65536)}),
+            },
+            test {
+                call_builtin,
+                {4, 5, 3, 2},
+                concat({{static_cast<uint8_t>(call_builtin)}, bytes_of<uint16_t>(4), bytes_of<uint16_t>(5), {3, 2}}),
+            },
+            test {
+                jump,
+                {100000},
+                concat({{static_cast<uint8_t>(jump)}, bytes_of<uint32_t>(100000)}),
+            },
+            test {
+                ret,
+                {},
+                {static_cast<uint8_t>(ret)},
+            },
+        };
+        for (auto&& [opcode, operands, expected] : tests) {
+            const auto actual = registers::make(opcode, operands);
+            REQUIRE_EQ(actual, expected);
+            REQUIRE_EQ(actual.size(), registers::lookup(opcode).size());
+        }
+        CHECK_THROWS_AS((void)registers::make(add, {1, 2}), std::invalid_argument);
+    }
+
+    TEST_CASE("operandOffsets")
+    {
+        const auto& closure = registers::lookup(registers::opcodes::closure);
+        CHECK_EQ(closure.operand_offset(0), 1);
+        CHECK_EQ(closure.operand_offset(2), 5);
+        CHECK_EQ(closure.operand_offset(3), 9);
+        CHECK_EQ(closure.size(), 10);
+    }
+
+    TEST_CASE("instructionsToString")
+    {
+        using enum registers::opcodes;
+        const auto* const expected = R"(0000 LoadConstant r0 1
+0007 Add r2 r0 r1
+0014 JumpNotGreater r2 r0 100000
+0023 Closure r3 r4 65536 2
+0033 Return
+)";
+        const auto code = concat({
+            registers::make(load_constant, {0, 1}),
+            registers::make(add, {2, 0, 1}),
+            registers::make(jump_not_greater, {2, 0, 100000}),
+            registers::make(closure, {3, 4, 65536, 2}),
+            registers::make(ret),
+        });
+        REQUIRE_EQ(registers::to_string(code), expected);
+    }
+}
+
+// NOLINTEND(*)
+}  // namespace
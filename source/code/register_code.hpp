@@ -0,0 +1,194 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+
+#include "code.hpp"
+
+/// Instruction set of the register machine.
+///
+/// Every frame has a window of registers, the locals of a function occupy the first registers of its window and the
+/// temporaries of the expressions follow them. Instructions name their operands and their destination by register
+/// instead of passing them on a stack, so `a + b` with two locals is a single `Add r2 r0 r1`.
+namespace registers
+{
+/// registers are 2 byte operands, so a frame can address up to 65536 of them
+using reg_type = std::uint16_t;
+
+enum class opcodes : uint8_t
+{
+    move,
+    load_constant,
+    load_null,
+    load_true,
+    load_false,
+    get_global,
+    set_global,
+    get_free,
+    set_free,
+    get_builtin,
+    current_closure,
+    add,
+    sub,
+    mul,
+    div,
+    floor_div,
+    mod,
+    bit_and,
+    bit_or,
+    bit_xor,
+    bit_lsh,
+    bit_rsh,
+    equal,
+    not_equal,
+    greater_than,
+    greater_equal,
+    minus,
+    bang,
+    add_const,
+    sub_const,
+    jump,
+    jump_not_truthy,
+    jump_truthy,
+    jump_not_equal,
+    jump_not_greater,
+    jump_not_greater_equal,
+    array,
+    hash,
+    index,
+    call,
+    call_builtin,
+    closure,
+    return_value,
+    ret,
+};
+
+/// number of opcodes, has to be kept in sync with the last opcode
+constexpr auto opcodes_count = static_cast<std::size_t>(opcodes::ret) + 1;
+
+/// maximum number of operands of an instruction, registers included
+constexpr std::size_t max_operands = 4;
+
+/// Layout of an instruction: the opcode byte is followed by the register operands and then by the other operands of
+/// 1, 2 or 4 bytes, all in native byte order.
+struct definition final
+{
+    constexpr definition(opcodes opc,
+                         std::string_view nm,
+                         std::size_t num_registers,
+                         std::initializer_list<std::uint8_t> widths = {})
+        : opcode {opc}
+        , name {nm}
+        , registers {num_registers}
+        , m_count {num_registers + widths.size()}
+    {
+        std::fill_n(m_widths.begin(), num_registers, static_cast<std::uint8_t>(sizeof(reg_type)));
+        std::copy(widths.begin(), widths.end(), m_widths.begin() + static_cast<std::ptrdiff_t>(num_registers));
+    }
+
+    [[nodiscard]] constexpr auto operand_widths() const -> std::span<const std::uint8_t>
+    {
+        return {m_widths.data(), m_count};
+    }
+
+    /// offset of an operand from the start of the instruction
+    [[nodiscard]] constexpr auto operand_offset(std::size_t operand) const -> std::size_t
+    {
+        std::size_t result = 1;
+        for (std::size_t idx = 0; idx < operand; idx++) {
+            result += m_widths[idx];
+        }
+        return result;
+    }
+
+    /// size of the instruction in bytes including the opcode
+    [[nodiscard]] constexpr auto size() const -> std::size_t { return operand_offset(m_count); }
+
+    opcodes opcode;
+    std::string_view name;
+    /// number of leading operands which name a register
+    std::size_t registers;
+
+  private:
+    std::array<std::uint8_t, max_operands> m_widths {};
+    std::size_t m_count {};
+};
+
+/// the definitions indexed by opcode
+constexpr std::array definitions {
+    definition {opcodes::move, "Move", 2},
+    definition {opcodes::load_constant, "LoadConstant", 1, {4}},
+    definition {opcodes::load_null, "LoadNull", 1},
+    definition {opcodes::load_true, "LoadTrue", 1},
+    definition {opcodes::load_false, "LoadFalse", 1},
+    definition {opcodes::get_global, "GetGlobal", 1, {2}},
+    definition {opcodes::set_global, "SetGlobal", 1, {2}},
+    definition {opcodes::get_free, "GetFree", 1, {1}},
+    definition {opcodes::set_free, "SetFree", 1, {1}},
+    definition {opcodes::get_builtin, "GetBuiltin", 1, {1}},
+    definition {opcodes::current_closure, "CurrentClosure", 1},
+    definition {opcodes::add, "Add", 3},
+    definition {opcodes::sub, "Sub", 3},
+    definition {opcodes::mul, "Mul", 3},
+    definition {opcodes::div, "Div", 3},
+    definition {opcodes::floor_div, "FloorDiv", 3},
+    definition {opcodes::mod, "Mod", 3},
+    definition {opcodes::bit_and, "BitAnd", 3},
+    definition {opcodes::bit_or, "BitOr", 3},
+    definition {opcodes::bit_xor, "BitXor", 3},
+    definition {opcodes::bit_lsh, "BitLsh", 3},
+    definition {opcodes::bit_rsh, "BitRsh", 3},
+    definition {opcodes::equal, "Equal", 3},
+    definition {opcodes::not_equal, "NotEqual", 3},
+    definition {opcodes::greater_than, "GreaterThan", 3},
+    definition {opcodes::greater_equal, "GreaterEqual", 3},
+    definition {opcodes::minus, "Minus", 2},
+    definition {opcodes::bang, "Bang", 2},
+    definition {opcodes::add_const, "AddConst", 2, {4}},
+    definition {opcodes::sub_const, "SubConst", 2, {4}},
+    definition {opcodes::jump, "Jump", 0, {4}},
+    definition {opcodes::jump_not_truthy, "JumpNotTruthy", 1, {4}},
+    definition {opcodes::jump_truthy, "JumpTruthy", 1, {4}},
+    definition {opcodes::jump_not_equal, "JumpNotEqual", 2, {4}},
+    definition {opcodes::jump_not_greater, "JumpNotGreater", 2, {4}},
+    definition {opcodes::jump_not_greater_equal, "JumpNotGreaterEqual", 2, {4}},
+    definition {opcodes::array, "Array", 2, {2}},
+    definition {opcodes::hash, "Hash", 2, {2}},
+    definition {opcodes::index, "Index", 3},
+    definition {opcodes::call, "Call", 2, {1}},
+    definition {opcodes::call_builtin, "CallBuiltin", 2, {1, 1}},
+    definition {opcodes::closure, "Closure", 2, {4, 1}},
+    definition {opcodes::return_value, "ReturnValue", 1},
+    definition {opcodes::ret, "Return", 0},
+};
+static_assert(definitions.size() == opcodes_count, "every opcode needs a definition");
+static_assert(
+    []
+    {
+        for (std::size_t idx = 0; idx < definitions.size(); idx++) {
+            if (static_cast<std::size_t>(definitions[idx].opcode) != idx) {
+                return false;
+            }
+        }
+        return true;
+    }(),
+    "the definitions have to be in the order of the opcodes");
+
+[[nodiscard]] constexpr auto lookup(opcodes opcode) -> const definition&
+{
+    return definitions[static_cast<std::size_t>(opcode)];
+}
+
+/// the operator of the stack machine an arithmetic or comparison instruction applies
+[[nodiscard]] auto binary_operator(opcodes opcode) -> ::opcodes;
+
+/// encodes an instruction, the register operands come first
+[[nodiscard]] auto make(opcodes opcode, const operands& operands = {}) -> instructions;
+[[nodiscard]] auto to_string(const instructions& code) -> std::string;
+}  // namespace registers
@@ -0,0 +1,644 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+#include "bytecode_cache.hpp"
+
+#include <builtin/builtin.hpp>
+#include <code/code.hpp>
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+#include <gc.hpp>
+#include <lexer/lexer.hpp>
+#include <object/object.hpp>
+#include <parser/parser.hpp>
+#include <vm/vm.hpp>
+
+#if defined(_WIN32)
+#    include <iterator>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+#endif
+
+#include "symbol_table.hpp"
+
+namespace
+{
+constexpr std::uint32_t cache_magic = 0x31435043;  // "CPC1" in little endian
+
+enum class constant_tag : std::uint8_t
+{
+    null,
+    integer,
+    decimal,
+    string,
+    function,
+};
+
+struct writer final
+{
+    template<typename T>
+    auto write(T val) -> void
+    {
+        const auto bytes = std::bit_cast<std::array<std::uint8_t, sizeof(T)>>(val);
+        buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+    }
+
+    auto write(std::span<const std::uint8_t> bytes) -> void
+    {
+        write(static_cast<std::uint32_t>(bytes.size()));
+        buffer.insert(buffer.end(), bytes.begin(), bytes.end());
+    }
+
+    auto write(std::string_view str) -> void
+    {
+        write(std::span {reinterpret_cast<const std::uint8_t*>(str.data()), str.size()});  // NOLINT
+    }
+
+    std::vector<std::uint8_t> buffer;
+};
+
+struct reader final
+{
+    template<typename T>
+    auto read() -> T
+    {
+        std::array<std::uint8_t, sizeof(T)> bytes {};
+        const auto source = take(sizeof(T));
+        std::copy(source.begin(), source.end(), bytes.begin());
+        return std::bit_cast<T>(bytes);
+    }
+
+    auto read_bytes() -> std::span<const std::uint8_t> { return take(read<std::uint32_t>()); }
+
+    auto read_string() -> std::string
+    {
+        const auto bytes = read_bytes();
+        return {bytes.begin(), bytes.end()};
+    }
+
+    auto take(std::size_t count) -> std::span<const std::uint8_t>
+    {
+        if (count > data.size() - offset) {
+            throw std::runtime_error("truncated bytecode cache");
+        }
+        const auto bytes = data.subspan(offset, count);
+        offset += count;
+        return bytes;
+    }
+
+    std::span<const std::uint8_t> data;
+    std::size_t offset {};
+};
+
+auto write_constant(writer& out, const object* constant) -> void
+{
+    using enum object::object_type;
+    if (constant->is_null()) {
+        out.write(constant_tag::null);
+        return;
+    }
+    switch (constant->type()) {
+        case integer:
+            out.write(constant_tag::integer);
+            out.write(constant->as<integer_object>()->value);
+            return;
+        case decimal:
+            out.write(constant_tag::decimal);
+            out.write(constant->as<decimal_object>()->value);
+            return;
+        case string:
+            out.write(constant_tag::string);
+            out.write(std::string_view {constant->as<string_object>()->value()});
+            return;
+        case compiled_function: {
+            const auto* function = constant->as<compiled_function_object>();
+            out.write(constant_tag::function);
+            out.write(static_cast<std::int32_t>(function->num_locals));
+            out.write(static_cast<std::int32_t>(function->num_arguments));
+            out.write(std::span<const std::uint8_t> {function->instrs});
+            out.write(std::string_view {function->name});
+            return;
+        }
+        default:
+            throw std::runtime_error(fmt::format("cannot cache a constant of type {}", constant->type()));
+    }
+}
+
+auto read_constant(reader& in) -> const object*
+{
+    switch (in.read<constant_tag>()) {
+        case constant_tag::null:
+            return null();
+        case constant_tag::integer:
+            return make<integer_object>(in.read<std::int64_t>());
+        case constant_tag::decimal:
+            return make<decimal_object>(in.read<double>());
+        case constant_tag::string:
+            return intern(in.read_string());
+        case constant_tag::function: {
+            const auto num_locals = in.read<std::int32_t>();
+            const auto num_arguments = in.read<std::int32_t>();
+            const auto instrs = in.read_bytes();
+            auto* function =
+                make<compiled_function_object>(instructions {instrs.begin(), instrs.end()}, num_locals, num_arguments);
+            function->name = in.read_string();
+            return function;
+        }
+    }
+    throw std::runtime_error("invalid constant in bytecode cache");
+}
+
+/// calls the visitor with the opcode, the offset and the operands of every instruction, returns false if an
+/// instruction has an unknown opcode, is cut off or the visitor rejects it
+template<typename Visitor>
+auto visit_instructions(std::span<const std::uint8_t> instrs, Visitor&& visitor) -> bool
+{
+    for (std::size_t ip = 0; ip < instrs.size();) {
+        if (instrs[ip] >= opcodes_count) {
+            return false;
+        }
+        const auto& def = definitions[instrs[ip]];
+        if (def.size() > instrs.size() - ip) {
+            return false;
+        }
+        std::array<std::size_t, max_operands> operands {};
+        auto offset = ip + 1;
+        for (std::size_t idx = 0; const auto width : def.operand_widths()) {
+            switch (width) {
+                case 4:
+                    operands[idx] = read_operand<std::uint32_t>(&instrs[offset]);
+                    break;
+                case 2:
+                    operands[idx] = read_operand<std::uint16_t>(&instrs[offset]);
+                    break;
+                default:
+                    operands[idx] = instrs[offset];
+            }
+            offset += width;
+            idx++;
+        }
+        if (!visitor(def.opcode, ip, operands)) {
+            return false;
+        }
+        ip += def.size();
+    }
+    return true;
+}
+
+/// The vm trusts its bytecode, so a cache file that is corrupt but still matches the source must not reach it.
+///
+/// Every instruction has to be complete and may only refer to constants of the expected type, locals and free
+/// variables of its function, builtins that exist and jump to the start of an instruction or the end of the code.
+/// Globals need no check, their 2 byte operand can not exceed the globals of the vm.
+auto is_valid_program(std::span<const std::uint8_t> main, const constants& consts) -> bool
+{
+    using enum opcodes;
+    const auto is_constant = [&consts](std::size_t index, object::object_type type)
+    { return index < consts.size() && consts[index]->is(type); };
+
+    struct function_code final
+    {
+        std::span<const std::uint8_t> instrs;
+        std::size_t num_locals;
+        // the free variables of the closures created from the function, the fewest of all closure instructions
+        std::size_t num_free {std::numeric_limits<std::size_t>::max()};
+    };
+
+    // the main program runs without locals and free variables
+    std::vector<function_code> functions {{.instrs = main, .num_locals = 0, .num_free = 0}};
+    std::vector<std::size_t> function_of(consts.size(), 0);
+    for (std::size_t idx = 0; idx < consts.size(); idx++) {
+        if (consts[idx]->is(object::object_type::compiled_function)) {
+            const auto* function = consts[idx]->as<compiled_function_object>();
+            if (function->num_arguments < 0 || function->num_locals < function->num_arguments) {
+                return false;
+            }
+            function_of[idx] = functions.size();
+            functions.push_back(
+                {.instrs = function->instrs, .num_locals = static_cast<std::size_t>(function->num_locals)});
+        }
+    }
+
+    for (const auto& [instrs, num_locals, _] : functions) {
+        std::vector<bool> boundaries(instrs.size() + 1);
+        boundaries.back() = true;
+        std::vector<std::size_t> targets;
+        const auto valid = visit_instructions(
+            instrs,
+            [&](opcodes opcode, std::size_t ip, const std::array<std::size_t, max_operands>& operands)
+            {
+                boundaries[ip] = true;
+                switch (opcode) {
+                    case constant:
+                        return operands[0] < consts.size();
+                    case add_const:
+                    case sub_const:
+                        return is_constant(operands[0], object::object_type::integer);
+                    case inc_local:
+                        return operands[0] < num_locals && is_constant(operands[1], object::object_type::integer);
+                    case closure:
+                        if (!is_constant(operands[0], object::object_type::compiled_function)) {
+                            return false;
+                        }
+                        functions[function_of[operands[0]]].num_free =
+                            std::min(functions[function_of[operands[0]]].num_free, operands[1]);
+                        return true;
+                    case get_local:
+                    case set_local:
+                        return operands[0] < num_locals;
+                    case get_local_get_local:
+                        return operands[0] < num_locals && operands[1] < num_locals;
+                    case get_builtin:
+                    case call_builtin:
+                        return operands[0] < builtin::builtins().size();
+                    case jump:
+                    case jump_truthy:
+                    case jump_not_truthy:
+                    case jump_not_equal:
+                    case jump_not_greater:
+                    case jump_not_greater_equal:
+                        targets.push_back(operands[0]);
+                        return true;
+                    default:
+                        return true;
+                }
+            });
+        if (!valid
+            || !std::ranges::all_of(targets,
+                                    [&boundaries](std::size_t target)
+                                    { return target < boundaries.size() && boundaries[target]; }))
+        {
+            return false;
+        }
+    }
+
+    // the free variables are known once every closure instruction was seen
+    return std::ranges::all_of(
+        functions,
+        [](const function_code& function)
+        {
+            const auto num_free =
+                function.num_free == std::numeric_limits<std::size_t>::max() ? 0 : function.num_free;
+            return visit_instructions(
+                function.instrs,
+                [num_free](opcodes opcode, std::size_t /*ip*/, const std::array<std::size_t, max_operands>& operands)
+                { return (opcode != opcodes::get_free && opcode != opcodes::set_free) || operands[0] < num_free; });
+        });
+}
+
+/// read only view of a file, mapped into memory where supported
+class mapped_file final
+{
+  public:
+    explicit mapped_file(const std::string& path)
+    {
+#if defined(_WIN32)
+        std::ifstream ifs(path, std::ios::binary);
+        m_buffer.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+#else
+        const auto fdesc = ::open(path.c_str(), O_RDONLY);  // NOLINT(cppcoreguidelines-pro-type-vararg)
+        if (fdesc < 0) {
+            return;
+        }
+        struct stat info {};
+        if (::fstat(fdesc, &info) == 0 && info.st_size > 0) {
+            m_size = static_cast<std::size_t>(info.st_size);
+            m_addr = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fdesc, 0);
+        }
+        ::close(fdesc);
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file(mapped_file&&) = delete;
+    auto operator=(const mapped_file&) -> mapped_file& = delete;
+    auto operator=(mapped_file&&) -> mapped_file& = delete;
+
+    ~mapped_file()
+    {
+#if !defined(_WIN32)
+        if (m_addr != MAP_FAILED) {
+            ::munmap(m_addr, m_size);
+        }
+#endif
+    }
+
+    [[nodiscard]] auto data() const -> std::span<const std::uint8_t>
+    {
+#if defined(_WIN32)
+        return m_buffer;
+#else
+        if (m_addr == MAP_FAILED) {
+            return {};
+        }
+        return {static_cast<const std::uint8_t*>(m_addr), m_size};
+#endif
+    }
+
+  private:
+#if defined(_WIN32)
+    std::vector<std::uint8_t> m_buffer;
+#else
+    void* m_addr {MAP_FAILED};  // NOLINT(cppcoreguidelines-pro-type-cstyle-cast)
+    std::size_t m_size {};
+#endif
+};
+}  // namespace
+
+auto cache_file_for(std::string_view source_file) -> std::string
+{
+    auto path = std::filesystem::path {source_file};
+    path.replace_extension(".cpc");
+    return path.string();
+}
+
+auto hash_source(std::string_view source) -> std::uint64_t
+{
+    return hash_bytes({reinterpret_cast<const std::uint8_t*>(source.data()), source.size()});  // NOLINT
+}
+
+auto hash_bytes(std::span<const std::uint8_t> bytes) -> std::uint64_t
+{
+    constexpr std::uint64_t fnv_offset_basis = 14695981039346656037ULL;
+    constexpr std::uint64_t fnv_prime = 1099511628211ULL;
+    auto hash = fnv_offset_basis;
+    for (const auto byte : bytes) {
+        hash ^= byte;
+        hash *= fnv_prime;
+    }
+    return hash;
+}
+
+auto serialize_program(std::uint64_t source_hash, const bytecode& code, const symbol_table* symbols)
+    -> std::vector<std::uint8_t>
+{
+    writer out;
+    out.write(cache_magic);
+    out.write(bytecode_cache_version);
+    out.write(source_hash);
+    // the checksum of the payload following it is filled in once the payload is written
+    const auto checksum_offset = out.buffer.size();
+    out.write(std::uint64_t {});
+
+    std::vector<const symbol*> globals;
+    for (const auto& [_, sym] : symbols->symbols()) {
+        if (sym.is_global()) {
+            globals.push_back(&sym);
+        }
+    }
+    out.write(static_cast<std::uint32_t>(globals.size()));
+    for (const auto* sym : globals) {
+        out.write(static_cast<std::int32_t>(sym->index));
+        out.write(std::string_view {sym->name});
+    }
+
+    out.write(std::span {code.instrs});
+    out.write(static_cast<std::uint32_t>(code.consts->size()));
+    for (const auto* constant : *code.consts) {
+        write_constant(out, constant);
+    }
+    const auto checksum = hash_bytes(std::span {out.buffer}.subspan(checksum_offset + sizeof(std::uint64_t)));
+    const auto bytes = std::bit_cast<std::array<std::uint8_t, sizeof(checksum)>>(checksum);
+    std::copy(bytes.begin(), bytes.end(), out.buffer.begin() + static_cast<std::ptrdiff_t>(checksum_offset));
+    return std::move(out.buffer);
+}
+
+auto deserialize_program(std::span<const std::uint8_t> data, std::uint64_t source_hash) -> std::optional<cached_program>
+{
+    try {
+        reader in {.data = data};
+        if (in.read<std::uint32_t>() != cache_magic || in.read<std::uint32_t>() != bytecode_cache_version
+            || in.read<std::uint64_t>() != source_hash)
+        {
+            return std::nullopt;
+        }
+        // the validation below keeps the vm in bounds, the checksum also rejects corrupt instructions that are valid
+        if (in.read<std::uint64_t>() != hash_bytes(data.subspan(in.offset))) {
+            return std::nullopt;
+        }
+
+        auto* symbols = symbol_table::create();
+        for (auto idx = 0; const auto& builtin : builtin::builtins()) {
+            symbols->define_builtin(idx++, builtin->name);
+        }
+        const auto num_globals = in.read<std::uint32_t>();
+        for (auto idx = 0U; idx < num_globals; idx++) {
+            const auto index = in.read<std::int32_t>();
+            symbols->define_global(in.read_string(), index);
+        }
+
+        const auto instrs = in.read_bytes();
+        auto* consts = make<constants>();
+        const auto num_constants = in.read<std::uint32_t>();
+        for (auto idx = 0U; idx < num_constants; idx++) {
+            consts->push_back(read_constant(in));
+        }
+        if (in.offset != data.size() || !is_valid_program(instrs, *consts)) {
+            return std::nullopt;
+        }
+        return cached_program {.code = {.instrs = {instrs.begin(), instrs.end()}, .consts = consts},
+                               .symbols = symbols};
+    } catch (const std::runtime_error&) {
+        return std::nullopt;
+    }
+}
+
+auto load_cached_program(const std::string& cache_file, std::uint64_t source_hash) -> std::optional<cached_program>
+{
+    const mapped_file file {cache_file};
+    return deserialize_program(file.data(), source_hash);
+}
+
+auto save_cached_program(const std::string& cache_file,
+                         std::uint64_t source_hash,
+                         const bytecode& code,
+                         const symbol_table* symbols) -> bool
+{
+    const auto data = serialize_program(source_hash, code, symbols);
+    const auto temp_file = cache_file + ".tmp";
+    {
+        std::ofstream ofs(temp_file, std::ios::binary | std::ios::trunc);
+        if (!ofs) {
+            return false;
+        }
+        ofs.write(reinterpret_cast<const char*>(data.data()),  // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+                  static_cast<std::streamsize>(data.size()));
+        if (!ofs) {
+            return false;
+        }
+    }
+    std::error_code err;
+    std::filesystem::rename(temp_file, cache_file, err);
+    if (err) {
+        std::filesystem::remove(temp_file, err);
+        return false;
+    }
+    return true;
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+TEST_SUITE_BEGIN("bytecode cache");
+
+auto compile(std::string_view input) -> std::pair<bytecode, const symbol_table*>
+{
+    auto prsr = parser {lexer {input}};
+    auto prgrm = prsr.parse_program();
+    REQUIRE(prsr.errors().empty());
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    return {cmplr.byte_code(), cmplr.all_symbols()};
+}
+
+constexpr auto program_source = R"(
+    let greet = fn(name) { "hello " + name };
+    let half = 0.5;
+    let nothing = null;
+    let i = 0;
+    while (i < 3) { let twice = i * 2; i = i + 1; }
+    [greet("world"), half, nothing, i])";
+
+TEST_CASE("roundTrip")
+{
+    const auto [code, symbols] = compile(program_source);
+    const auto data = serialize_program(hash_source(program_source), code, symbols);
+    const auto loaded = deserialize_program(data, hash_source(program_source));
+    REQUIRE(loaded.has_value());
+
+    CHECK_EQ(loaded->code.instrs, code.instrs);
+    REQUIRE_EQ(loaded->code.consts->size(), code.consts->size());
+    for (std::size_t idx = 0; idx < code.consts->size(); idx++) {
+        CHECK_EQ(loaded->code.consts->at(idx)->type(), code.consts->at(idx)->type());
+        CHECK_EQ(loaded->code.consts->at(idx)->inspect(), code.consts->at(idx)->inspect());
+    }
+    CHECK_EQ(loaded->symbols->resolve("greet"), symbols->find("greet"));
+    CHECK_EQ(loaded->symbols->resolve("i"), symbols->find("i"));
+    CHECK_EQ(loaded->symbols->resolve("puts"), symbols->find("puts"));
+
+    auto mchn = vm::create(loaded->code);
+    mchn.run();
+    CHECK_EQ(mchn.last_popped()->inspect(), R"(["hello world", 0.5, null, 3])");
+}
+
+TEST_CASE("staleOrCorruptDataIsRejected")
+{
+    const auto [code, symbols] = compile(program_source);
+    auto data = serialize_program(hash_source(program_source), code, symbols);
+
+    CHECK_FALSE(deserialize_program(data, hash_source("changed")).has_value());
+    CHECK_FALSE(deserialize_program(std::span {data}.first(data.size() - 1), hash_source(program_source)).has_value());
+    CHECK_FALSE(deserialize_program({}, hash_source(program_source)).has_value());
+    data[4] ^= 0xFFU;
+    CHECK_FALSE(deserialize_program(data, hash_source(program_source)).has_value());
+}
+
+TEST_CASE("everyFlippedByteIsRejected")
+{
+    const auto [code, symbols] = compile(program_source);
+    auto data = serialize_program(hash_source(program_source), code, symbols);
+    for (std::size_t offset = 0; offset < data.size(); offset++) {
+        for (const std::uint8_t mask : {0x01, 0x80, 0xFF}) {
+            data[offset] ^= mask;
+            INFO("offset ", offset, " mask ", int {mask});
+            CHECK_FALSE(deserialize_program(data, hash_source(program_source)).has_value());
+            data[offset] ^= mask;
+        }
+    }
+    CHECK(deserialize_program(data, hash_source(program_source)).has_value());
+}
+
+TEST_CASE("everyInstructionIsAccepted")
+{
+    constexpr auto source = R"(
+        let counter = fn(start) { let count = start; fn() { count = count + 1; count } };
+        let next = counter(1);
+        let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };
+        let loop = fn(n) { let i = 0; let s = 0; while (i < n) { s = s + i * 2; i = i + 1; } s };
+        let h = {"a": [1, 2], true: 1.5};
+        [next(), next(), fib(10), loop(10), len(h["a"]), h[true] && !false || null])";
+    const auto [code, symbols] = compile(source);
+    const auto loaded = deserialize_program(serialize_program(hash_source(source), code, symbols), hash_source(source));
+    REQUIRE(loaded.has_value());
+
+    auto mchn = vm::create(loaded->code);
+    mchn.run();
+    CHECK_EQ(mchn.last_popped()->inspect(), "[2, 3, 55, 90, 2, true]");
+}
+
+TEST_CASE("invalidInstructionsAreRejected")
+{
+    const auto concat = [](std::initializer_list<instructions> parts)
+    {
+        instructions result;
+        for (const auto& part : parts) {
+            result.insert(result.end(), part.begin(), part.end());
+        }
+        return result;
+    };
+    const auto is_loaded = [](instructions main, std::initializer_list<const object*> objects)
+    {
+        auto* consts = make<constants>(objects);
+        const auto data = serialize_program(0, {.instrs = std::move(main), .consts = consts}, symbol_table::create());
+        return deserialize_program(data, 0).has_value();
+    };
+    const auto* function =
+        make<compiled_function_object>(concat({make(opcodes::get_free, 0), make(opcodes::ret)}), 0, 0);
+
+    CHECK(is_loaded(concat({make(opcodes::constant, 0), make(opcodes::pop)}), {make<integer_object>(1)}));
+    // unknown opcode
+    CHECK_FALSE(is_loaded({static_cast<std::uint8_t>(opcodes_count)}, {}));
+    // cut off operand
+    CHECK_FALSE(is_loaded({static_cast<std::uint8_t>(opcodes::constant), 0}, {}));
+    // constant out of bounds
+    CHECK_FALSE(is_loaded(make(opcodes::constant, 1), {make<integer_object>(1)}));
+    // superinstructions only add integer constants
+    CHECK_FALSE(is_loaded(make(opcodes::add_const, 0), {intern("text")}));
+    // the main program has no locals
+    CHECK_FALSE(is_loaded(make(opcodes::get_local, 0), {}));
+    CHECK_FALSE(is_loaded(make(opcodes::get_builtin, builtin::builtins().size()), {}));
+    // jumps land on an instruction or the end of the code
+    CHECK(is_loaded(concat({make(opcodes::jump, 5), make(opcodes::null)}), {}));
+    CHECK(is_loaded(concat({make(opcodes::jump, 6), make(opcodes::null)}), {}));
+    CHECK_FALSE(is_loaded(concat({make(opcodes::jump, 2), make(opcodes::null)}), {}));
+    CHECK_FALSE(is_loaded(concat({make(opcodes::jump, 7), make(opcodes::null)}), {}));
+    // closures are created from functions and provide the free variables their function reads
+    CHECK(is_loaded(concat({make(opcodes::null), make(opcodes::closure, {0, 1})}), {function}));
+    CHECK_FALSE(is_loaded(make(opcodes::closure, {0, 0}), {function}));
+    CHECK_FALSE(is_loaded(make(opcodes::closure, {0, 0}), {make<integer_object>(1)}));
+}
+
+TEST_CASE("saveAndLoad")
+{
+    const auto [code, symbols] = compile(program_source);
+    const auto cache_file = cache_file_for((std::filesystem::temp_directory_path() / "cappuchin-cache.cp").string());
+    CHECK(cache_file.ends_with("cappuchin-cache.cpc"));
+
+    REQUIRE(save_cached_program(cache_file, hash_source(program_source), code, symbols));
+    const auto loaded = load_cached_program(cache_file, hash_source(program_source));
+    std::filesystem::remove(cache_file);
+    REQUIRE(loaded.has_value());
+    CHECK_EQ(loaded->code.instrs, code.instrs);
+    CHECK_FALSE(load_cached_program(cache_file, hash_source(program_source)).has_value());
+}
+
+TEST_SUITE_END();
+// NOLINTEND(*)
+}  // namespace
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "compiler.hpp"
+#include "symbol_table.hpp"
+
+/// Version of the cache format, has to be bumped whenever the opcodes, the builtins or the layout of the
+/// serialized data change, so stale cache files are recompiled instead of being misinterpreted.
+constexpr std::uint32_t bytecode_cache_version = 7;
+
+/// A compiled program restored from a cache file, the symbols are the globals of the program.
+struct cached_program final
+{
+    bytecode code;
+    symbol_table* symbols {};
+};
+
+/// returns the path of the cache file belonging to a source file, e.g. `file.cpc` for `file.cp`
+[[nodiscard]] auto cache_file_for(std::string_view source_file) -> std::string;
+
+/// FNV-1a hash of the source a cache file was compiled from
+[[nodiscard]] auto hash_source(std::string_view source) -> std::uint64_t;
+
+/// FNV-1a hash of the bytes, the checksum of the payload of a cache file
+[[nodiscard]] auto hash_bytes(std::span<const std::uint8_t> bytes) -> std::uint64_t;
+
+[[nodiscard]] auto serialize_program(std::uint64_t source_hash, const bytecode& code, const symbol_table* symbols)
+    -> std::vector<std::uint8_t>;
+
+/// returns std::nullopt if the data is truncated, corrupt, was written by another version or for another source
+[[nodiscard]] auto deserialize_program(std::span<const std::uint8_t> data, std::uint64_t source_hash)
+    -> std::optional<cached_program>;
+
+/// maps the cache file into memory and deserializes it, returns std::nullopt if the cache is missing or stale
+[[nodiscard]] auto load_cached_program(const std::string& cache_file, std::uint64_t source_hash)
+    -> std::optional<cached_program>;
+
+/// writes the cache file, failing to write it is not an error as the program can always be recompiled
+auto save_cached_program(const std::string& cache_file,
+                         std::uint64_t source_hash,
+                         const bytecode& code,
+                         const symbol_table* symbols) -> bool;
@@ -1,8 +1,12 @@
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <cassert>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <iterator>
+#include <memory>
 #include <optional>
 #include <stdexcept>
 #include <string>
@@ -37,11 +41,63 @@
 #include <gc.hpp>
 #include <lexer/token_type.hpp>
 #include <object/object.hpp>
+#include <optimizer/optimizer.hpp>
 #include <overloaded.hpp>
 #include <parser/parser.hpp>
 
 #include "symbol_table.hpp"
 
+constant_index::constant_index(constants* consts)
+    : m_consts {consts}
+{
+    for (std::size_t idx = 0; idx < consts->size(); idx++) {
+        if (const auto key = key_of((*consts)[idx]); key.has_value()) {
+            m_indices.try_emplace(key.value(), idx);
+        }
+    }
+}
+
+auto constant_index::add(const object* obj) -> std::size_t
+{
+    const auto key = key_of(obj);
+    if (key.has_value()) {
+        if (const auto itr = m_indices.find(key.value()); itr != m_indices.end()) {
+            return itr->second;
+        }
+    }
+    m_consts->push_back(obj);
+    const auto idx = m_consts->size() - 1;
+    if (key.has_value()) {
+        m_indices.emplace(key.value(), idx);
+    }
+    return idx;
+}
+
+auto constant_index::key_hash::operator()(const key& k) const -> std::size_t
+{
+    return std::hash<std::uint64_t> {}(k.second) ^ static_cast<std::size_t>(k.first);
+}
+
+auto constant_index::key_of(const object* obj) -> std::optional<key>
+{
+    using enum object::object_type;
+    if (obj->is_null()) {
+        return key {obj->type(), 0};
+    }
+    switch (obj->type()) {
+        case integer:
+            return key {integer, std::bit_cast<std::uint64_t>(obj->as<integer_object>()->value)};
+        case decimal:
+            // compares the bits, so 0.0 and -0.0 stay apart
+            return key {decimal, std::bit_cast<std::uint64_t>(obj->as<decimal_object>()->value)};
+        case string:
+            // string literals are interned, so equal texts have the same address
+            return key {string, reinterpret_cast<std::uintptr_t>(obj)};  // NOLINT(*-reinterpret-cast)
+        default:
+            return std::nullopt;
+    }
+}
+
 auto compiler::create() -> compiler
 {
     auto* symbols = symbol_table::create();
@@ -53,6 +109,7 @@ auto compiler::create() -> compiler
 
 compiler::compiler(constants* consts, symbol_table* symbols)
     : m_consts {consts}
+    , m_constant_index {consts}
     , m_symbols {symbols}
     , m_scopes {1}
 {
@@ -65,8 +122,7 @@ auto compiler::compile(const program* program) -> void
 
 auto compiler::add_constant(const object* obj) -> std::size_t
 {
-    m_consts->push_back(obj);
-    return m_consts->size() - 1;
+    return m_constant_index.add(obj);
 }
 
 auto compiler::add_instructions(const instructions& ins) -> std::size_t
@@ -79,6 +135,9 @@ auto compiler::add_instructions(const instructions& ins) -> std::size_t
 
 auto compiler::emit(opcodes opcode, const operands& operands) -> std::size_t
 {
+    if (const auto fused = fuse(opcode, operands); fused.has_value()) {
+        return fused.value();
+    }
     auto& scope = m_scopes[m_scope_index];
     scope.previous_instr = scope.last_instr;
 
@@ -89,6 +148,73 @@ auto compiler::emit(opcodes opcode, const operands& operands) -> std::size_t
     return pos;
 }
 
+auto compiler::fuse(opcodes opcode, const operands& operands) -> std::optional<std::size_t>
+{
+    auto& scope = m_scopes[m_scope_index];
+    const auto last = scope.last_instr;
+    if (scope.instrs.empty() || scope.last_label > last.position) {
+        return std::nullopt;
+    }
+    using enum opcodes;
+    switch (opcode) {
+        case add:
+        case sub: {
+            if (last.opcode != constant) {
+                break;
+            }
+            const auto const_idx = read_operand<uint32_t>(&scope.instrs[last.position + 1]);
+            if ((*m_consts)[const_idx]->is(object::object_type::integer)) {
+                return replace_last_instruction(opcode == add ? add_const : sub_const, {const_idx});
+            }
+        } break;
+        case jump_not_truthy:
+            if (last.opcode == equal) {
+                return replace_last_instruction(jump_not_equal, operands);
+            }
+            if (last.opcode == greater_than) {
+                return replace_last_instruction(jump_not_greater, operands);
+            }
+            if (last.opcode == greater_equal) {
+                return replace_last_instruction(jump_not_greater_equal, operands);
+            }
+            break;
+        case get_local:
+            if (last.opcode == get_local) {
+                return replace_last_instruction(get_local_get_local, {scope.instrs[last.position + 1], operands[0]});
+            }
+            break;
+        case set_local: {
+            // x = x + <integer>
+            const auto prev = scope.previous_instr;
+            if (last.opcode == add_const && prev.opcode == get_local && prev.position + 2 == last.position
+                && scope.last_label <= prev.position && scope.instrs[prev.position + 1] == operands[0])
+            {
+                const auto const_idx = read_operand<uint32_t>(&scope.instrs[last.position + 1]);
+                scope.last_instr = prev;
+                return replace_last_instruction(inc_local, {operands[0], const_idx});
+            }
+        } break;
+        default:
+            break;
+    }
+    return std::nullopt;
+}
+
+auto compiler::replace_last_instruction(opcodes opcode, const operands& operands) -> std::size_t
+{
+    auto& scope = m_scopes[m_scope_index];
+    scope.instrs.resize(scope.last_instr.position);
+    scope.last_instr.opcode = opcode;
+    return add_instructions(make(opcode, operands));
+}
+
+auto compiler::label() -> std::size_t
+{
+    auto& scope = m_scopes[m_scope_index];
+    scope.last_label = scope.instrs.size();
+    return scope.last_label;
+}
+
 auto compiler::last_instruction_is(opcodes opcode) const -> bool
 {
     if (current_instrs().empty()) {
@@ -129,6 +255,13 @@ auto compiler::change_operand(std::size_t pos, std::size_t operand) -> void
     replace_instruction(pos, instr);
 }
 
+auto compiler::change_operands(const std::vector<std::size_t>& positions, std::size_t operand) -> void
+{
+    for (const auto pos : positions) {
+        change_operand(pos, operand);
+    }
+}
+
 auto compiler::current_instrs() const -> const instructions&
 {
     return m_scopes[m_scope_index].instrs;
@@ -139,11 +272,11 @@ auto compiler::byte_code() const -> bytecode
     return {.instrs = m_scopes[m_scope_index].instrs, .consts = m_consts};
 }
 
-auto compiler::enter_scope(bool inside_loop) -> void
+auto compiler::enter_scope() -> void
 {
     m_scopes.resize(m_scopes.size() + 1);
     m_scope_index++;
-    m_symbols = symbol_table::create_enclosed(m_symbols, inside_loop);
+    m_symbols = symbol_table::create_enclosed(m_symbols);
 }
 
 auto compiler::leave_scope() -> instructions
@@ -185,16 +318,6 @@ auto compiler::load_symbol(const symbol& sym) -> void
         case function:
             emit(current_closure);
             break;
-        case outer: {
-            assert(sym.ptr.has_value());
-            const auto& val = sym.ptr.value();
-            emit(get_outer,
-                 {
-                     static_cast<operands::value_type>(val.level),
-                     static_cast<operands::value_type>(val.scope),
-                     static_cast<operands::value_type>(val.index),
-                 });
-        } break;
     }
 }
 
@@ -221,8 +344,9 @@ auto compiler::consts() const -> constants*
 void compiler::visit(const array_literal& expr)
 {
     for (const auto& element : expr.elements) {
-        element->accept(*this);
+        compile_operand(element);
     }
+    m_operands -= expr.elements.size();
     emit(opcodes::array, expr.elements.size());
 }
 
@@ -236,34 +360,100 @@ void compiler::visit(const assign_expression& expr)
         emit(opcodes::set_global, sym.index);
     } else if (sym.scope == symbol_scope::local) {
         emit(opcodes::set_local, sym.index);
-    } else if (sym.scope == symbol_scope::free) {
-        emit(opcodes::set_free, sym.index);
     } else {
-        assert(sym.ptr.has_value());
-        const auto& val = sym.ptr.value();
-        emit(opcodes::set_outer,
-             {static_cast<operands::value_type>(val.level),
-              static_cast<operands::value_type>(val.scope),
-              static_cast<operands::value_type>(val.index)});
+        assert(sym.scope == symbol_scope::free);
+        emit(opcodes::set_free, sym.index);
+    }
+}
+
+namespace
+{
+/// the expression if it is a binary expression of the operator
+auto binary_of(const expression* expr, token_type oper) -> const binary_expression*
+{
+    const auto* binary = dynamic_cast<const binary_expression*>(expr);
+    return binary != nullptr && binary->op == oper ? binary : nullptr;
+}
+
+auto negated(const expression* expr) -> const expression*
+{
+    const auto* unary = dynamic_cast<const unary_expression*>(expr);
+    return unary != nullptr && unary->op == token_type::exclamation ? unary->right : nullptr;
+}
+}  // namespace
+
+auto compiler::compile_jumps_if_false(const expression* condition) -> std::vector<std::size_t>
+{
+    if (const auto* conjunction = binary_of(condition, token_type::logical_and); conjunction != nullptr) {
+        auto jumps = compile_jumps_if_false(conjunction->left);
+        const auto right = compile_jumps_if_false(conjunction->right);
+        jumps.insert(jumps.end(), right.begin(), right.end());
+        return jumps;
+    }
+    if (const auto* disjunction = binary_of(condition, token_type::logical_or); disjunction != nullptr) {
+        const auto holds = compile_jumps_if_true(disjunction->left);
+        auto jumps = compile_jumps_if_false(disjunction->right);
+        change_operands(holds, label());
+        return jumps;
+    }
+    if (const auto* operand = negated(condition); operand != nullptr) {
+        return compile_jumps_if_true(operand);
+    }
+    condition->accept(*this);
+    return {emit(opcodes::jump_not_truthy, 0)};
+}
+
+auto compiler::compile_jumps_if_true(const expression* condition) -> std::vector<std::size_t>
+{
+    if (const auto* disjunction = binary_of(condition, token_type::logical_or); disjunction != nullptr) {
+        auto jumps = compile_jumps_if_true(disjunction->left);
+        const auto right = compile_jumps_if_true(disjunction->right);
+        jumps.insert(jumps.end(), right.begin(), right.end());
+        return jumps;
+    }
+    if (const auto* conjunction = binary_of(condition, token_type::logical_and); conjunction != nullptr) {
+        const auto fails = compile_jumps_if_false(conjunction->left);
+        auto jumps = compile_jumps_if_true(conjunction->right);
+        change_operands(fails, label());
+        return jumps;
     }
+    if (const auto* operand = negated(condition); operand != nullptr) {
+        return compile_jumps_if_false(operand);
+    }
+    condition->accept(*this);
+    return {emit(opcodes::jump_truthy, 0)};
 }
 
 void compiler::visit(const binary_expression& expr)
 {
+    using enum opcodes;
+    if (expr.op == token_type::logical_and || expr.op == token_type::logical_or) {
+        // the right operand is only evaluated if the left one does not decide the result
+        const auto fails = compile_jumps_if_false(&expr);
+        emit(tru);
+        const auto jump_pos = emit(jump, 0);
+        change_operands(fails, label());
+        emit(fals);
+        change_operand(jump_pos, label());
+        return;
+    }
     if (expr.op == token_type::less_than) {
-        expr.right->accept(*this);
+        compile_operand(expr.right);
         expr.left->accept(*this);
+        m_operands--;
         emit(opcodes::greater_than);
         return;
     }
     if (expr.op == token_type::less_equal) {
-        expr.right->accept(*this);
+        compile_operand(expr.right);
         expr.left->accept(*this);
+        m_operands--;
         emit(opcodes::greater_equal);
         return;
     }
-    expr.left->accept(*this);
+    compile_operand(expr.left);
     expr.right->accept(*this);
+    m_operands--;
     switch (expr.op) {
         case token_type::plus:
             emit(opcodes::add);
@@ -298,12 +488,6 @@ void compiler::visit(const binary_expression& expr)
         case token_type::shift_right:
             emit(opcodes::bit_rsh);
             break;
-        case token_type::logical_and:
-            emit(opcodes::logical_and);
-            break;
-        case token_type::logical_or:
-            emit(opcodes::logical_or);
-            break;
         case token_type::greater_than:
             emit(opcodes::greater_than);
             break;
@@ -329,9 +513,10 @@ void compiler::visit(const boolean_literal& expr)
 void compiler::visit(const hash_literal& expr)
 {
     for (const auto& [key, value] : expr.pairs) {
-        key->accept(*this);
-        value->accept(*this);
+        compile_operand(key);
+        compile_operand(value);
     }
+    m_operands -= expr.pairs.size() * 2;
     emit(opcodes::hash, expr.pairs.size() * 2);
 }
 
@@ -345,62 +530,70 @@ void compiler::visit(const identifier& expr)
     load_symbol(symbol);
 }
 
+auto compiler::keep_block_value() -> void
+{
+    if (last_instruction_is(opcodes::pop)) {
+        remove_last_pop();
+    } else {
+        // blocks which are empty or end with a statement like let leave no value behind
+        emit(opcodes::null);
+    }
+}
+
 void compiler::visit(const if_expression& expr)
 {
-    expr.condition->accept(*this);
+    // an if known to take its branch is left by the optimizer without alternative
+    if (constant_condition(expr.condition) == true && expr.alternative == nullptr) {
+        expr.consequence->accept(*this);
+        keep_block_value();
+        return;
+    }
     using enum opcodes;
-    auto jump_not_truthy_pos = emit(jump_not_truthy, 0);
+    const auto fails = compile_jumps_if_false(expr.condition);
     expr.consequence->accept(*this);
-    if (last_instruction_is(pop)) {
-        remove_last_pop();
-    }
+    keep_block_value();
     auto jump_pos = emit(jump, 0);
-    auto after_consequence = current_instrs().size();
-    change_operand(jump_not_truthy_pos, after_consequence);
+    auto after_consequence = label();
+    change_operands(fails, after_consequence);
 
     if (expr.alternative == nullptr) {
         emit(null);
     } else {
         expr.alternative->accept(*this);
-        if (last_instruction_is(pop)) {
-            remove_last_pop();
-        }
+        keep_block_value();
     }
-    auto after_alternative = current_instrs().size();
+    auto after_alternative = label();
     change_operand(jump_pos, after_alternative);
 }
 
 void compiler::visit(const while_statement& expr)
 {
     using enum opcodes;
-    auto loop_start_pos = current_instrs().size();
-    expr.condition->accept(*this);
-    auto jump_not_truthy_pos = emit(jump_not_truthy, 0);
-
-    /* create a closure for the while loop body */
-    enter_scope(/*inside_loop=*/true);
-    expr.body->accept(*this);
-    /* add a continue opcode at the end, to detect whether break was called or not */
-    emit(cont);
-
-    auto free = free_symbols();
-    auto num_locals = number_symbol_definitions();
-    auto instrs = leave_scope();
-    for (const auto& sym : free) {
-        load_symbol(sym);
+    const auto condition = constant_condition(expr.condition);
+    if (condition == false) {
+        emit(null);
+        emit(pop);
+        return;
+    }
+    auto loop_start_pos = label();
+    std::vector<std::size_t> fails;
+    if (!condition.has_value()) {
+        fails = compile_jumps_if_false(expr.condition);
     }
-    auto* cmpl = make<compiled_function_object>(std::move(instrs), num_locals, 0);
-    cmpl->inside_loop = true;
-    auto function_index = add_constant(cmpl);
-    emit(closure, {function_index, free.size()});
-    emit(call, 0);
 
-    auto jump_on_break_pos = emit(jump_not_truthy, 0);
+    /* the body runs in the frame of the enclosing function, its definitions only get a scope of their own */
+    m_scopes[m_scope_index].loops.push_back({.start = loop_start_pos, .breaks = {}, .operands = m_operands});
+    m_symbols = symbol_table::create_enclosed(m_symbols, /*inside_loop=*/true);
+    expr.body->accept(*this);
+    m_symbols = m_symbols->outer();
     emit(jump, loop_start_pos);
 
-    const auto after_body_pos = current_instrs().size();
-    change_operand(jump_not_truthy_pos, after_body_pos);
-    change_operand(jump_on_break_pos, after_body_pos);
+    const auto after_body_pos = label();
+    change_operands(fails, after_body_pos);
+    for (const auto break_pos : m_scopes[m_scope_index].loops.back().breaks) {
+        change_operand(break_pos, after_body_pos);
+    }
+    m_scopes[m_scope_index].loops.pop_back();
 
     emit(null);
     emit(pop);
@@ -408,8 +601,9 @@ void compiler::visit(const while_statement& expr)
 
 void compiler::visit(const index_expression& expr)
 {
-    expr.left->accept(*this);
+    compile_operand(expr.left);
     expr.index->accept(*this);
+    m_operands--;
     emit(opcodes::index);
 }
 
@@ -452,14 +646,30 @@ void compiler::visit(const return_statement& expr)
     emit(opcodes::return_value);
 }
 
+auto compiler::compile_operand(const expression* operand) -> void
+{
+    operand->accept(*this);
+    m_operands++;
+}
+
+auto compiler::pop_loop_operands() -> void
+{
+    for (auto idx = m_scopes[m_scope_index].loops.back().operands; idx < m_operands; idx++) {
+        emit(opcodes::pop);
+    }
+}
+
 void compiler::visit(const break_statement& /*expr*/)
 {
-    emit(opcodes::brake);
+    pop_loop_operands();
+    const auto break_pos = emit(opcodes::jump, 0);
+    m_scopes[m_scope_index].loops.back().breaks.push_back(break_pos);
 }
 
 void compiler::visit(const continue_statement& /*expr*/)
 {
-    emit(opcodes::cont);
+    pop_loop_operands();
+    emit(opcodes::jump, m_scopes[m_scope_index].loops.back().start);
 }
 
 void compiler::visit(const expression_statement& expr)
@@ -477,7 +687,7 @@ void compiler::visit(const block_statement& expr)
 
 void compiler::visit(const string_literal& expr)
 {
-    emit(opcodes::constant, add_constant(make<string_object>(expr.value)));
+    emit(opcodes::constant, add_constant(intern(expr.value)));
 }
 
 void compiler::visit(const unary_expression& expr)
@@ -519,17 +729,31 @@ void compiler::visit(const function_literal& expr)
     for (const auto& sym : free) {
         load_symbol(sym);
     }
-    auto function_index = add_constant(
-        make<compiled_function_object>(std::move(instrs), num_locals, static_cast<int>(expr.parameters.size())));
+    auto* function =
+        make<compiled_function_object>(std::move(instrs), num_locals, static_cast<int>(expr.parameters.size()));
+    function->name = expr.name;
+    auto function_index = add_constant(function);
     emit(closure, {function_index, free.size()});
 }
 
 void compiler::visit(const call_expression& expr)
 {
-    expr.function->accept(*this);
+    // builtins called by name are called directly, without loading a callee object first
+    if (const auto* ident = dynamic_cast<const identifier*>(expr.function); ident != nullptr) {
+        if (const auto sym = resolve_symbol(ident->value); sym.has_value() && sym->scope == symbol_scope::builtin) {
+            for (const auto& arg : expr.arguments) {
+                compile_operand(arg);
+            }
+            m_operands -= expr.arguments.size();
+            emit(opcodes::call_builtin, {static_cast<std::size_t>(sym->index), expr.arguments.size()});
+            return;
+        }
+    }
+    compile_operand(expr.function);
     for (const auto& arg : expr.arguments) {
-        arg->accept(*this);
+        compile_operand(arg);
     }
+    m_operands -= expr.arguments.size() + 1;
     emit(opcodes::call, expr.arguments.size());
 }
 
@@ -559,7 +783,7 @@ auto check_no_parse_errors(const parser& prsr) -> bool
     return prsr.errors().empty();
 }
 
-using parsed_program = std::pair<program*, parser>;
+using parsed_program = std::pair<std::unique_ptr<program>, parser>;
 
 auto check_program(std::string_view input) -> parsed_program
 {
@@ -596,7 +820,7 @@ auto check_constants(const std::vector<expected_value>& expecteds, const constan
             overloaded {
                 [&](const std::monostate&) { CHECK(actual->is_null()); },
                 [&](const int64_t val) { CHECK_EQ(val, actual->as<integer_object>()->value); },
-                [&](const std::string& val) { CHECK_EQ(val, actual->as<string_object>()->value); },
+                [&](const std::string& val) { CHECK_EQ(val, actual->as<string_object>()->value()); },
                 [&](const std::vector<instructions>& instrs)
                 { check_instructions(instrs, actual->as<compiled_function_object>()->instrs); },
             },
@@ -611,7 +835,7 @@ auto run(std::array<ctc, N>&& tests)
     for (const auto& [input, constants, instructions] : tests) {
         auto [prgrm, _] = check_program(input);
         auto cmplr = compiler::create();
-        cmplr.compile(prgrm);
+        cmplr.compile(prgrm.get());
         check_instructions(instructions, cmplr.current_instrs());
         check_constants(constants, *cmplr.consts());
     }
@@ -646,8 +870,7 @@ TEST_CASE("integerArithmetics")
             {{1}, {2}},
             {
                 make(constant, 0),
-                make(constant, 1),
-                make(add),
+                make(add_const, 1),
                 make(pop),
             },
         },
@@ -666,8 +889,7 @@ TEST_CASE("integerArithmetics")
             {{1}, {2}},
             {
                 make(constant, 0),
-                make(constant, 1),
-                make(sub),
+                make(sub_const, 1),
                 make(pop),
             },
         },
@@ -766,8 +988,12 @@ TEST_CASE("integerArithmetics")
             {{1}, {2}},
             {
                 make(constant, 0),
+                make(jump_not_truthy, 26),
                 make(constant, 1),
-                make(logical_and),
+                make(jump_not_truthy, 26),
+                make(tru),
+                make(jump, 27),
+                make(fals),
                 make(pop),
             },
         },
@@ -776,8 +1002,12 @@ TEST_CASE("integerArithmetics")
             {{1}, {2}},
             {
                 make(constant, 0),
+                make(jump_truthy, 20),
                 make(constant, 1),
-                make(logical_or),
+                make(jump_not_truthy, 26),
+                make(tru),
+                make(jump, 27),
+                make(fals),
                 make(pop),
             },
         },
@@ -958,8 +1188,12 @@ TEST_CASE("booleanExpressions")
             {},
             {
                 make(tru),
+                make(jump_not_truthy, 18),
                 make(tru),
-                make(logical_and),
+                make(jump_not_truthy, 18),
+                make(tru),
+                make(jump, 19),
+                make(fals),
                 make(pop),
             },
         },
@@ -968,8 +1202,12 @@ TEST_CASE("booleanExpressions")
             {},
             {
                 make(tru),
+                make(jump_truthy, 12),
                 make(tru),
-                make(logical_or),
+                make(jump_not_truthy, 18),
+                make(tru),
+                make(jump, 19),
+                make(fals),
                 make(pop),
             },
         },
@@ -988,11 +1226,8 @@ TEST_CASE("conditionals")
                 3333,
             }},
             {
-                make(tru),
-                make(jump_not_truthy, 10),
+                // the branch is always taken, so there is nothing to jump over
                 make(constant, 0),
-                make(jump, 11),
-                make(null),
                 make(pop),
                 make(constant, 1),
                 make(pop),
@@ -1007,9 +1242,9 @@ TEST_CASE("conditionals")
             }},
             {
                 make(tru),
-                make(jump_not_truthy, 10),
+                make(jump_not_truthy, 16),
                 make(constant, 0),
-                make(jump, 13),
+                make(jump, 21),
                 make(constant, 1),
                 make(pop),
                 make(constant, 2),
@@ -1121,11 +1356,9 @@ TEST_CASE("arrayLiterals")
             {{1, 2, 3, 4, 5, 6}},
             {
                 make(constant, 0),
-                make(constant, 1),
-                make(add),
+                make(add_const, 1),
                 make(constant, 2),
-                make(constant, 3),
-                make(sub),
+                make(sub_const, 3),
                 make(constant, 4),
                 make(constant, 5),
                 make(mul),
@@ -1153,8 +1386,7 @@ TEST_CASE("arrayLiterals")
             {
                 make(constant, 0),
                 make(constant, 1),
-                make(constant, 2),
-                make(add),
+                make(add_const, 2),
                 make(constant, 3),
                 make(array, 2),
                 make(mul),
@@ -1197,8 +1429,7 @@ TEST_CASE("hashLiterals")
             {
                 make(constant, 0),
                 make(constant, 1),
-                make(constant, 2),
-                make(add),
+                make(add_const, 2),
                 make(constant, 3),
                 make(constant, 4),
                 make(constant, 5),
@@ -1233,29 +1464,27 @@ TEST_CASE("indexExpression")
     std::array tests {
         ctc {
             R"([1, 2, 3][1 + 1])",
-            {1, 2, 3, 1, 1},
+            {1, 2, 3},
             {
                 make(constant, 0),
                 make(constant, 1),
                 make(constant, 2),
                 make(array, 3),
-                make(constant, 3),
-                make(constant, 4),
-                make(add),
+                make(constant, 0),
+                make(add_const, 0),
                 make(index),
                 make(pop),
             },
         },
         ctc {
             R"({1: 2}[2 - 1])",
-            {1, 2, 2, 1},
+            {1, 2},
             {
                 make(constant, 0),
                 make(constant, 1),
                 make(hash, 2),
-                make(constant, 2),
-                make(constant, 3),
-                make(sub),
+                make(constant, 1),
+                make(sub_const, 0),
                 make(index),
                 make(pop),
             },
@@ -1273,7 +1502,7 @@ TEST_CASE("functions")
             {
                 5,
                 10,
-                maker({make(constant, 0), make(constant, 1), make(add), make(return_value)}),
+                maker({make(constant, 0), make(add_const, 1), make(return_value)}),
             },
             {
                 make(closure, {2, 0}),
@@ -1285,7 +1514,7 @@ TEST_CASE("functions")
             {
                 5,
                 10,
-                maker({make(constant, 0), make(constant, 1), make(add), make(return_value)}),
+                maker({make(constant, 0), make(add_const, 1), make(return_value)}),
             },
             {
                 make(closure, {2, 0}),
@@ -1482,8 +1711,7 @@ TEST_CASE("letStatementScopes")
                        make(set_local, 0),
                        make(constant, 1),
                        make(set_local, 1),
-                       make(get_local, 0),
-                       make(get_local, 1),
+                       make(get_local_get_local, {0, 1}),
                        make(add),
                        make(return_value)}),
             },
@@ -1507,14 +1735,12 @@ TEST_CASE("builtins")
             )",
             {1},
             {
-                make(get_builtin, 0),
                 make(array, 0),
-                make(call, 1),
+                make(call_builtin, {0, 1}),
                 make(pop),
-                make(get_builtin, 5),
                 make(array, 0),
                 make(constant, 0),
-                make(call, 2),
+                make(call_builtin, {5, 2}),
                 make(pop),
 
             },
@@ -1524,9 +1750,8 @@ TEST_CASE("builtins")
             fn() { len([]) }
             )",
             {maker({
-                make(get_builtin, 0),
                 make(array, 0),
-                make(call, 1),
+                make(call_builtin, {0, 1}),
                 make(return_value),
             })},
             {
@@ -1534,6 +1759,21 @@ TEST_CASE("builtins")
                 make(pop),
             },
         },
+        ctc {
+            R"(
+            let l = len;
+            l([]);
+            )",
+            {},
+            {
+                make(get_builtin, 0),
+                make(set_global, 0),
+                make(get_global, 0),
+                make(array, 0),
+                make(call, 1),
+                make(pop),
+            },
+        },
     };
     run(std::move(tests));
 }
@@ -1667,60 +1907,40 @@ TEST_CASE("closures")
                 3,
                 maker({
                     make(get_global, 0),
-                    make(get_free, 0),
+                    make(get_global, 1),
                     make(add),
                     make(return_value),
                 }),
-                0,
-                1,
-                maker({
-                    make(get_outer, {1, 1, 0}),
-                    make(constant, 6),
-                    make(sub),
-                    make(set_outer, {1, 1, 0}),
-                    make(get_builtin, 1),
-                    make(get_outer, {1, 1, 1}),
-                    make(call, 0),
-                    make(get_outer, {1, 1, 0}),
-                    make(add),
-                    make(call, 1),
-                    make(pop),
-                    make(cont),
-                }),
-                maker({
-                    make(get_global, 0),
-                    make(constant, 2),
-                    make(sub),
-                    make(set_global, 0),
-                    make(constant, 3),
-                    make(set_local, 0),
-                    make(get_local, 0),
-                    make(closure, {4, 1}),
-                    make(set_local, 1),
-                    make(get_local, 0),
-                    make(constant, 5),
-                    make(greater_than),
-                    make(jump_not_truthy, 44),
-                    make(closure, {7, 0}),
-                    make(call, 0),
-                    make(jump_not_truthy, 44),
-                    make(jump, 23),
-                    make(null),
-                    make(pop),
-                    make(cont),
-                }),
             },
             {
                 make(constant, 0),
                 make(set_global, 0),
                 make(get_global, 0),
                 make(constant, 1),
-                make(greater_than),
-                make(jump_not_truthy, 28),
-                make(closure, {8, 0}),
+                make(jump_not_greater, 98),
+                make(get_global, 0),
+                make(sub_const, 2),
+                make(set_global, 0),
+                make(constant, 3),
+                make(set_global, 1),
+                make(closure, {4, 0}),
+                make(set_global, 2),
+                make(get_global, 1),
+                make(constant, 1),
+                make(jump_not_greater, 91),
+                make(get_global, 1),
+                make(sub_const, 2),
+                make(set_global, 1),
+                make(get_global, 2),
                 make(call, 0),
-                make(jump_not_truthy, 28),
-                make(jump, 6),
+                make(get_global, 1),
+                make(add),
+                make(call_builtin, {1, 1}),
+                make(pop),
+                make(jump, 49),
+                make(null),
+                make(pop),
+                make(jump, 8),
                 make(null),
                 make(pop),
             }},
@@ -1730,100 +1950,54 @@ TEST_CASE("closures")
                 break;
                 continue;
             })",
+            {},
             {
-                maker({
-                    make(brake),
-                    make(cont),
-                    make(cont),
-                }),
-            },
-            {
-                make(tru),
-                make(jump_not_truthy, 16),
-                make(closure, {0, 0}),
-                make(call, 0),
-                make(jump_not_truthy, 16),
+                make(jump, 15),
+                make(jump, 0),
                 make(jump, 0),
                 make(null),
                 make(pop),
             }},
         ctc {
             R"(
-            let i = 2;
-            while (i > 0) {
-             i = i - 1;
-             let j = 3;
-             let f = fn() {
-                 i + j;
-             }
-             while (j > 0) {
-                 j = j - 1;
-                 puts(f() + j);
-             }
-            }
-            )",
+            fn() {
+                let i = 0;
+                while (true) {
+                    i = i + 1;
+                    if (i > 2) { break; }
+                    let j = i;
+                    continue;
+                }
+                i
+            })",
             {
-                2,
                 0,
                 1,
-                3,
-                maker({
-                    make(get_global, 0),
-                    make(get_free, 0),
-                    make(add),
-                    make(return_value),
-                }),
-                0,
-                1,
-                maker({
-                    make(get_outer, {1, 1, 0}),
-                    make(constant, 6),
-                    make(sub),
-                    make(set_outer, {1, 1, 0}),
-                    make(get_builtin, 1),
-                    make(get_outer, {1, 1, 1}),
-                    make(call, 0),
-                    make(get_outer, {1, 1, 0}),
-                    make(add),
-                    make(call, 1),
-                    make(pop),
-                    make(cont),
-                }),
+                2,
                 maker({
-                    make(get_global, 0),
-                    make(constant, 2),
-                    make(sub),
-                    make(set_global, 0),
-                    make(constant, 3),
+                    make(constant, 0),
                     make(set_local, 0),
+                    make(inc_local, {0, 1}),
                     make(get_local, 0),
-                    make(closure, {4, 1}),
-                    make(set_local, 1),
+                    make(constant, 2),
+                    make(jump_not_greater, 36),
+                    make(jump, 52),
+                    make(null),
+                    make(jump, 37),
+                    make(null),
+                    make(pop),
                     make(get_local, 0),
-                    make(constant, 5),
-                    make(greater_than),
-                    make(jump_not_truthy, 44),
-                    make(closure, {7, 0}),
-                    make(call, 0),
-                    make(jump_not_truthy, 44),
-                    make(jump, 23),
+                    make(set_local, 1),
+                    make(jump, 7),
+                    make(jump, 7),
                     make(null),
                     make(pop),
-                    make(cont),
+                    make(get_local, 0),
+                    make(return_value),
                 }),
             },
             {
-                make(constant, 0),
-                make(set_global, 0),
-                make(get_global, 0),
-                make(constant, 1),
-                make(greater_than),
-                make(jump_not_truthy, 28),
-                make(closure, {8, 0}),
-                make(call, 0),
-                make(jump_not_truthy, 28),
-                make(jump, 6),
-                make(null),
+                make(closure, {3, 0}),
                 make(pop),
             }},
     };
@@ -1842,16 +2016,14 @@ TEST_CASE("recursiveFunctions")
             {1,
              maker({make(current_closure),
                     make(get_local, 0),
-                    make(constant, 0),
-                    make(sub),
+                    make(sub_const, 0),
                     make(call, 1),
-                    make(return_value)}),
-             1},
+                    make(return_value)})},
             {
                 make(closure, {1, 0}),
                 make(set_global, 0),
                 make(get_global, 0),
-                make(constant, 2),
+                make(constant, 0),
                 make(call, 1),
                 make(pop),
             },
@@ -1867,21 +2039,19 @@ TEST_CASE("recursiveFunctions")
             {1,
              maker({make(current_closure),
                     make(get_local, 0),
-                    make(constant, 0),
-                    make(sub),
+                    make(sub_const, 0),
                     make(call, 1),
                     make(return_value)}),
-             1,
              maker({
                  make(closure, {1, 0}),
                  make(set_local, 0),
                  make(get_local, 0),
-                 make(constant, 2),
+                 make(constant, 0),
                  make(call, 1),
                  make(return_value),
              })},
             {
-                make(closure, {3, 0}),
+                make(closure, {2, 0}),
                 make(set_global, 0),
                 make(get_global, 0),
                 make(call, 0),
@@ -1892,6 +2062,63 @@ TEST_CASE("recursiveFunctions")
     run(std::move(tests));
 }
 
+TEST_CASE("superinstructions")
+{
+    using enum opcodes;
+    std::array tests {
+        ctc {
+            R"(fn(a) { a = a + 1; })",
+            {
+                1,
+                maker({make(inc_local, {0, 0}), make(ret)}),
+            },
+            {
+                make(closure, {1, 0}),
+                make(pop),
+            },
+        },
+        ctc {
+            R"(fn(a, b) { if (a == b) { a - 1 } else { b } })",
+            {
+                1,
+                maker({
+                    make(get_local_get_local, {0, 1}),
+                    make(jump_not_equal, 20),
+                    make(get_local, 0),
+                    make(sub_const, 0),
+                    make(jump, 22),
+                    make(get_local, 1),
+                    make(return_value),
+                }),
+            },
+            {
+                make(closure, {1, 0}),
+                make(pop),
+            },
+        },
+        ctc {
+            R"(fn(a, b, c) { [if (a) { b } else { c }, a] })",
+            {
+                maker({
+                    make(get_local, 0),
+                    make(jump_not_truthy, 14),
+                    make(get_local, 1),
+                    make(jump, 16),
+                    make(get_local, 2),
+                    make(get_local, 0),
+                    make(array, 2),
+                    make(return_value),
+                }),
+            },
+            {
+                make(closure, {0, 0}),
+                make(pop),
+            },
+        },
+    };
+    run(std::move(tests));
+}
+
 TEST_SUITE_END();
 // NOLINTEND(*)
 }  // namespace
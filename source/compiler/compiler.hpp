@@ -1,6 +1,10 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <utility>
 
 #include <ast/program.hpp>
 #include <ast/visitor.hpp>
@@ -11,6 +15,31 @@
 
 using constants = std::vector<const object*>;
 
+/// Index of the constants by value, so all literals of the same value share one constant.
+///
+/// Integers, decimals, interned strings and null are shared, every function literal is a constant of its own.
+class constant_index final
+{
+  public:
+    /// indexes the constants already in the pool, like those of the previous inputs of the repl
+    explicit constant_index(constants* consts);
+    /// returns the index of the constant equal to the object, the object is added if there is none
+    auto add(const object* obj) -> std::size_t;
+
+  private:
+    using key = std::pair<object::object_type, std::uint64_t>;
+
+    struct key_hash
+    {
+        auto operator()(const key& k) const -> std::size_t;
+    };
+
+    [[nodiscard]] static auto key_of(const object* obj) -> std::optional<key>;
+
+    constants* m_consts;
+    std::unordered_map<key, std::size_t, key_hash> m_indices;
+};
+
 struct bytecode final
 {
     instructions instrs;
@@ -23,11 +52,22 @@ struct emitted_instruction final
     std::size_t position {};
 };
 
+/// jump targets of a while loop, the jumps emitted for break are patched once the end of the loop is known
+struct loop_context final
+{
+    std::size_t start {};
+    std::vector<std::size_t> breaks;
+    /// the operands on the stack when the loop is entered, break and continue pop the ones pushed since
+    std::size_t operands {};
+};
+
 struct compilation_scope final
 {
     instructions instrs;
     emitted_instruction last_instr;
     emitted_instruction previous_instr;
+    std::size_t last_label {};
+    std::vector<loop_context> loops;
 };
 
 struct compiler final : public visitor
@@ -51,14 +91,17 @@ struct compiler final : public visitor
         return emit(opcode, std::vector {static_cast<std::size_t>(operand)});
     }
 
+    /// marks the current position as a jump target, instructions are never fused across a label
+    auto label() -> std::size_t;
     [[nodiscard]] auto last_instruction_is(opcodes opcode) const -> bool;
     auto remove_last_pop() -> void;
     auto replace_last_pop_with_return() -> void;
     auto replace_instruction(std::size_t pos, const instructions& instr) -> void;
     auto change_operand(std::size_t pos, std::size_t operand) -> void;
+    auto change_operands(const std::vector<std::size_t>& positions, std::size_t operand) -> void;
     [[nodiscard]] auto byte_code() const -> bytecode;
     [[nodiscard]] auto current_instrs() const -> const instructions&;
-    auto enter_scope(bool inside_loop = false) -> void;
+    auto enter_scope() -> void;
     auto leave_scope() -> instructions;
     auto define_symbol(const std::string& name) -> symbol;
     auto define_function_name(const std::string& name) -> symbol;
@@ -96,9 +139,25 @@ struct compiler final : public visitor
     void visit(const while_statement& expr) final;
 
   private:
+    auto fuse(opcodes opcode, const operands& operands) -> std::optional<std::size_t>;
+    auto replace_last_instruction(opcodes opcode, const operands& operands) -> std::size_t;
+    /// leaves the value of the block just compiled on the stack, null if it ends without an expression
+    auto keep_block_value() -> void;
+    /// compiles a condition to jumps taken if it does not hold, && and || only evaluate their right operand if needed
+    auto compile_jumps_if_false(const expression* condition) -> std::vector<std::size_t>;
+    /// compiles a condition to jumps taken if it holds
+    auto compile_jumps_if_true(const expression* condition) -> std::vector<std::size_t>;
+    /// compiles an operand that stays on the stack while the following operands are compiled
+    auto compile_operand(const expression* operand) -> void;
+    /// pops the operands pushed since the innermost loop was entered, before jumping out of its body
+    auto pop_loop_operands() -> void;
+
     constants* m_consts {};
+    constant_index m_constant_index;
     symbol_table* m_symbols;
     std::vector<compilation_scope> m_scopes;
     std::size_t m_scope_index {0};
+    // the operands pushed by the enclosing expressions of the expression being compiled
+    std::size_t m_operands {0};
     compiler(constants* consts, symbol_table* symbols);
 };
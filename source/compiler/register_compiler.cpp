@@ -0,0 +1,868 @@
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "register_compiler.hpp"
+
+#include <ast/array_literal.hpp>
+#include <ast/assign_expression.hpp>
+#include <ast/binary_expression.hpp>
+#include <ast/boolean_literal.hpp>
+#include <ast/call_expression.hpp>
+#include <ast/decimal_literal.hpp>
+#include <ast/expression.hpp>
+#include <ast/function_literal.hpp>
+#include <ast/hash_literal.hpp>
+#include <ast/identifier.hpp>
+#include <ast/if_expression.hpp>
+#include <ast/index_expression.hpp>
+#include <ast/integer_literal.hpp>
+#include <ast/program.hpp>
+#include <ast/statements.hpp>
+#include <ast/string_literal.hpp>
+#include <ast/unary_expression.hpp>
+#include <builtin/builtin.hpp>
+#include <code/code.hpp>
+#include <code/register_code.hpp>
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+#include <gc.hpp>
+#include <lexer/token_type.hpp>
+#include <object/object.hpp>
+#include <optimizer/optimizer.hpp>
+#include <parser/parser.hpp>
+
+#include "symbol_table.hpp"
+
+namespace
+{
+/// registers addressable by the 2 byte register operands
+constexpr auto max_registers = static_cast<int>(std::numeric_limits<registers::reg_type>::max()) + 1;
+
+/// whether evaluating the expression might assign a local of the function being compiled, which is only possible
+/// through the statements in the blocks of an if expression
+auto may_assign_locals(const expression* expr) -> bool
+{
+    if (dynamic_cast<const if_expression*>(expr) != nullptr) {
+        return true;
+    }
+    if (const auto* binary = dynamic_cast<const binary_expression*>(expr); binary != nullptr) {
+        return may_assign_locals(binary->left) || may_assign_locals(binary->right);
+    }
+    if (const auto* unary = dynamic_cast<const unary_expression*>(expr); unary != nullptr) {
+        return may_assign_locals(unary->right);
+    }
+    if (const auto* index = dynamic_cast<const index_expression*>(expr); index != nullptr) {
+        return may_assign_locals(index->left) || may_assign_locals(index->index);
+    }
+    if (const auto* call = dynamic_cast<const call_expression*>(expr); call != nullptr) {
+        return may_assign_locals(call->function) || std::ranges::any_of(call->arguments, may_assign_locals);
+    }
+    if (const auto* arr = dynamic_cast<const array_literal*>(expr); arr != nullptr) {
+        return std::ranges::any_of(arr->elements, may_assign_locals);
+    }
+    if (const auto* hsh = dynamic_cast<const hash_literal*>(expr); hsh != nullptr) {
+        return std::ranges::any_of(hsh->pairs,
+                                   [](const auto& pair)
+                                   { return may_assign_locals(pair.first) || may_assign_locals(pair.second); });
+    }
+    return false;
+}
+
+auto binary_opcode(token_type op) -> registers::opcodes
+{
+    using enum registers::opcodes;
+    switch (op) {
+        case token_type::plus:
+            return add;
+        case token_type::minus:
+            return sub;
+        case token_type::asterisk:
+            return mul;
+        case token_type::slash:
+            return div;
+        case token_type::percent:
+            return mod;
+        case token_type::double_slash:
+            return floor_div;
+        case token_type::ampersand:
+            return bit_and;
+        case token_type::pipe:
+            return bit_or;
+        case token_type::caret:
+            return bit_xor;
+        case token_type::shift_left:
+            return bit_lsh;
+        case token_type::shift_right:
+            return bit_rsh;
+        case token_type::greater_than:
+        case token_type::less_than:
+            return greater_than;
+        case token_type::greater_equal:
+        case token_type::less_equal:
+            return greater_equal;
+        case token_type::equals:
+            return equal;
+        case token_type::not_equals:
+            return not_equal;
+        default:
+            throw std::runtime_error(fmt::format("unsupported operator {}", op));
+    }
+}
+
+/// less than and less equal are compiled as greater than and greater equal with the operands swapped
+auto swaps_operands(token_type op) -> bool
+{
+    return op == token_type::less_than || op == token_type::less_equal;
+}
+
+/// the expression if it is a binary expression of the operator
+auto binary_of(const expression* expr, token_type oper) -> const binary_expression*
+{
+    const auto* binary = dynamic_cast<const binary_expression*>(expr);
+    return binary != nullptr && binary->op == oper ? binary : nullptr;
+}
+
+auto negated(const expression* expr) -> const expression*
+{
+    const auto* unary = dynamic_cast<const unary_expression*>(expr);
+    return unary != nullptr && unary->op == token_type::exclamation ? unary->right : nullptr;
+}
+}  // namespace
+
+auto register_compiler::create() -> register_compiler
+{
+    auto* symbols = symbol_table::create();
+    for (auto idx = 0; const auto& builtin : builtin::builtins()) {
+        symbols->define_builtin(idx++, builtin->name);
+    }
+    return {make<constants>(), symbols};
+}
+
+register_compiler::register_compiler(constants* consts, symbol_table* symbols)
+    : m_consts {consts}
+    , m_constant_index {consts}
+    , m_symbols {symbols}
+    , m_scopes {1}
+    , m_program_result {allocate()}
+{
+}
+
+auto register_compiler::compile(const program* program) -> void
+{
+    program->accept(*this);
+}
+
+auto register_compiler::byte_code() const -> register_bytecode
+{
+    // the main program has no locals, so its temporaries already have their final numbers
+    const auto& main = m_scopes.front();
+    return {.instrs = main.instrs, .consts = m_consts, .num_registers = main.max_temporaries};
+}
+
+auto register_compiler::scope() -> register_scope&
+{
+    return m_scopes.back();
+}
+
+auto register_compiler::position() const -> std::size_t
+{
+    return m_scopes.back().instrs.size();
+}
+
+auto register_compiler::add_constant(const object* obj) -> std::size_t
+{
+    return m_constant_index.add(obj);
+}
+
+auto register_compiler::destination() -> reg
+{
+    if (m_target.has_value()) {
+        const auto target = m_target.value();
+        m_target.reset();
+        return target;
+    }
+    return allocate();
+}
+
+auto register_compiler::allocate() -> reg
+{
+    auto& current = scope();
+    const reg result {.index = current.next_temporary++, .temporary = true};
+    current.max_temporaries = std::max(current.max_temporaries, current.next_temporary);
+    return result;
+}
+
+auto register_compiler::mark() const -> int
+{
+    return m_scopes.back().next_temporary;
+}
+
+auto register_compiler::release(int mark) -> void
+{
+    scope().next_temporary = mark;
+}
+
+auto register_compiler::emit(registers::opcodes opcode, std::initializer_list<reg> regs, const operands& rest)
+    -> std::size_t
+{
+    const auto& def = registers::lookup(opcode);
+    assert(regs.size() == def.registers);
+    auto& current = scope();
+    const auto pos = current.instrs.size();
+    operands all;
+    all.reserve(regs.size() + rest.size());
+    for (std::size_t idx = 0; const auto& operand : regs) {
+        if (operand.index >= max_registers) {
+            throw std::runtime_error("too many registers in function");
+        }
+        if (operand.temporary) {
+            current.temporaries.push_back(pos + def.operand_offset(idx));
+        }
+        all.push_back(static_cast<std::size_t>(operand.index));
+        idx++;
+    }
+    all.insert(all.end(), rest.begin(), rest.end());
+    const auto instr = registers::make(opcode, all);
+    current.instrs.insert(current.instrs.end(), instr.begin(), instr.end());
+    return pos;
+}
+
+auto register_compiler::patch_jump(std::size_t pos, std::size_t target) -> void
+{
+    auto& instrs = scope().instrs;
+    const auto& def = registers::lookup(static_cast<registers::opcodes>(instrs[pos]));
+    write_operand(&instrs[pos + def.operand_offset(def.registers)], static_cast<std::uint32_t>(target));
+}
+
+auto register_compiler::patch_jumps(const std::vector<std::size_t>& positions, std::size_t target) -> void
+{
+    for (const auto pos : positions) {
+        patch_jump(pos, target);
+    }
+}
+
+auto register_compiler::enter_scope() -> void
+{
+    m_scopes.emplace_back();
+    m_symbols = symbol_table::create_enclosed(m_symbols);
+}
+
+auto register_compiler::leave_scope(int num_locals) -> std::pair<instructions, int>
+{
+    auto current = std::move(m_scopes.back());
+    m_scopes.pop_back();
+    m_symbols = m_symbols->outer();
+    const auto num_registers = num_locals + current.max_temporaries;
+    if (num_registers > max_registers) {
+        throw std::runtime_error("too many registers in function");
+    }
+    for (const auto pos : current.temporaries) {
+        const auto temporary = read_operand<registers::reg_type>(&current.instrs[pos]);
+        write_operand(&current.instrs[pos], static_cast<registers::reg_type>(temporary + num_locals));
+    }
+    return {std::move(current.instrs), num_registers};
+}
+
+auto register_compiler::compile(const expression* expr, std::optional<reg> target) -> reg
+{
+    m_target = target;
+    expr->accept(*this);
+    m_target.reset();
+    return m_result;
+}
+
+auto register_compiler::compile_into(const expression* expr, reg target) -> void
+{
+    const auto result = compile(expr, target);
+    if (result.index != target.index || result.temporary != target.temporary) {
+        emit(registers::opcodes::move, {target, result});
+    }
+}
+
+auto register_compiler::protect(reg operand, const expression* following) -> reg
+{
+    if (operand.temporary || !may_assign_locals(following)) {
+        return operand;
+    }
+    const auto copy = allocate();
+    emit(registers::opcodes::move, {copy, operand});
+    return copy;
+}
+
+auto register_compiler::load_symbol(const symbol& sym, reg target) -> void
+{
+    using enum symbol_scope;
+    using enum registers::opcodes;
+    switch (sym.scope) {
+        case global:
+            emit(get_global, {target}, {static_cast<std::size_t>(sym.index)});
+            break;
+        case local:
+            emit(move, {target, reg {.index = sym.index}});
+            break;
+        case builtin:
+            emit(get_builtin, {target}, {static_cast<std::size_t>(sym.index)});
+            break;
+        case free:
+            emit(get_free, {target}, {static_cast<std::size_t>(sym.index)});
+            break;
+        case function:
+            emit(current_closure, {target});
+            break;
+    }
+}
+
+auto register_compiler::compile_jumps_if_false(const expression* condition) -> std::vector<std::size_t>
+{
+    using enum registers::opcodes;
+    if (const auto* conjunction = binary_of(condition, token_type::logical_and); conjunction != nullptr) {
+        auto jumps = compile_jumps_if_false(conjunction->left);
+        const auto right = compile_jumps_if_false(conjunction->right);
+        jumps.insert(jumps.end(), right.begin(), right.end());
+        return jumps;
+    }
+    if (const auto* disjunction = binary_of(condition, token_type::logical_or); disjunction != nullptr) {
+        const auto holds = compile_jumps_if_true(disjunction->left);
+        auto jumps = compile_jumps_if_false(disjunction->right);
+        patch_jumps(holds, position());
+        return jumps;
+    }
+    if (const auto* operand = negated(condition); operand != nullptr) {
+        return compile_jumps_if_true(operand);
+    }
+    const auto start = mark();
+    std::size_t jump_pos = 0;
+    const auto* binary = dynamic_cast<const binary_expression*>(condition);
+    const auto fusable = binary != nullptr
+        && (binary->op == token_type::equals || binary->op == token_type::greater_than
+            || binary->op == token_type::greater_equal || binary->op == token_type::less_than
+            || binary->op == token_type::less_equal);
+    if (fusable) {
+        const auto left = protect(compile(binary->left), binary->right);
+        const auto right = compile(binary->right);
+        const auto opcode = binary->op == token_type::equals ? jump_not_equal
+            : binary_opcode(binary->op) == greater_than      ? jump_not_greater
+                                                             : jump_not_greater_equal;
+        if (swaps_operands(binary->op)) {
+            jump_pos = emit(opcode, {right, left}, {0});
+        } else {
+            jump_pos = emit(opcode, {left, right}, {0});
+        }
+    } else {
+        jump_pos = emit(jump_not_truthy, {compile(condition)}, {0});
+    }
+    release(start);
+    return {jump_pos};
+}
+
+auto register_compiler::compile_jumps_if_true(const expression* condition) -> std::vector<std::size_t>
+{
+    if (const auto* disjunction = binary_of(condition, token_type::logical_or); disjunction != nullptr) {
+        auto jumps = compile_jumps_if_true(disjunction->left);
+        const auto right = compile_jumps_if_true(disjunction->right);
+        jumps.insert(jumps.end(), right.begin(), right.end());
+        return jumps;
+    }
+    if (const auto* conjunction = binary_of(condition, token_type::logical_and); conjunction != nullptr) {
+        const auto fails = compile_jumps_if_false(conjunction->left);
+        auto jumps = compile_jumps_if_true(conjunction->right);
+        patch_jumps(fails, position());
+        return jumps;
+    }
+    if (const auto* operand = negated(condition); operand != nullptr) {
+        return compile_jumps_if_false(operand);
+    }
+    const auto start = mark();
+    const auto jump_pos = emit(registers::opcodes::jump_truthy, {compile(condition)}, {0});
+    release(start);
+    return {jump_pos};
+}
+
+auto register_compiler::compile_block(const block_statement* block, reg target) -> void
+{
+    const auto& statements = block->statements;
+    for (std::size_t idx = 0; idx + 1 < statements.size(); idx++) {
+        statements[idx]->accept(*this);
+    }
+    if (statements.empty()) {
+        emit(registers::opcodes::load_null, {target});
+        return;
+    }
+    if (const auto* last = dynamic_cast<const expression_statement*>(statements.back()); last != nullptr) {
+        compile_into(last->expr, target);
+        return;
+    }
+    // blocks which end with a statement like let have no value
+    statements.back()->accept(*this);
+    emit(registers::opcodes::load_null, {target});
+}
+
+auto register_compiler::compile_body(const block_statement* body) -> void
+{
+    using enum registers::opcodes;
+    const auto& statements = body->statements;
+    for (std::size_t idx = 0; idx + 1 < statements.size(); idx++) {
+        statements[idx]->accept(*this);
+    }
+    if (statements.empty()) {
+        emit(ret, {});
+        return;
+    }
+    if (const auto* last = dynamic_cast<const expression_statement*>(statements.back()); last != nullptr) {
+        emit(return_value, {compile(last->expr)});
+        return;
+    }
+    statements.back()->accept(*this);
+    if (dynamic_cast<const return_statement*>(statements.back()) == nullptr) {
+        emit(ret, {});
+    }
+}
+
+void register_compiler::visit(const program& expr)
+{
+    for (const auto* stmt : expr.statements) {
+        if (const auto* expr_stmt = dynamic_cast<const expression_statement*>(stmt); expr_stmt != nullptr) {
+            compile_into(expr_stmt->expr, m_program_result);
+        } else {
+            stmt->accept(*this);
+        }
+    }
+}
+
+void register_compiler::visit(const array_literal& expr)
+{
+    const auto dst = destination();
+    const auto start = mark();
+    auto first = dst;
+    for (std::size_t idx = 0; const auto* element : expr.elements) {
+        const auto slot = allocate();
+        if (idx++ == 0) {
+            first = slot;
+        }
+        compile_into(element, slot);
+    }
+    emit(registers::opcodes::array, {dst, first}, {expr.elements.size()});
+    release(start);
+    m_result = dst;
+}
+
+void register_compiler::visit(const hash_literal& expr)
+{
+    const auto dst = destination();
+    const auto start = mark();
+    auto first = dst;
+    for (std::size_t idx = 0; const auto& [key, value] : expr.pairs) {
+        const auto key_slot = allocate();
+        if (idx++ == 0) {
+            first = key_slot;
+        }
+        compile_into(key, key_slot);
+        compile_into(value, allocate());
+    }
+    emit(registers::opcodes::hash, {dst, first}, {expr.pairs.size() * 2});
+    release(start);
+    m_result = dst;
+}
+
+void register_compiler::visit(const assign_expression& expr)
+{
+    const auto maybe_symbol = m_symbols->resolve(expr.name->value);
+    assert(maybe_symbol.has_value());
+    const auto& sym = maybe_symbol.value();
+    if (sym.is_local()) {
+        compile_into(expr.value, reg {.index = sym.index});
+        return;
+    }
+    const auto start = mark();
+    const auto value = compile(expr.value);
+    if (sym.is_global()) {
+        emit(registers::opcodes::set_global, {value}, {static_cast<std::size_t>(sym.index)});
+    } else {
+        assert(sym.scope == symbol_scope::free);
+        emit(registers::opcodes::set_free, {value}, {static_cast<std::size_t>(sym.index)});
+    }
+    release(start);
+}
+
+void register_compiler::visit(const binary_expression& expr)
+{
+    using enum registers::opcodes;
+    const auto dst = destination();
+    if (expr.op == token_type::logical_and || expr.op == token_type::logical_or) {
+        // the right operand is only evaluated if the left one does not decide the result
+        const auto fails = compile_jumps_if_false(&expr);
+        emit(load_true, {dst});
+        const auto jump_pos = emit(jump, {}, {0});
+        patch_jumps(fails, position());
+        emit(load_false, {dst});
+        patch_jump(jump_pos, position());
+        m_result = dst;
+        return;
+    }
+    const auto start = mark();
+    const auto left = protect(compile(expr.left), expr.right);
+    const auto* literal = dynamic_cast<const integer_literal*>(expr.right);
+    if (literal != nullptr && (expr.op == token_type::plus || expr.op == token_type::minus)) {
+        const auto const_idx = add_constant(make<integer_object>(literal->value));
+        emit(expr.op == token_type::plus ? add_const : sub_const, {dst, left}, {const_idx});
+    } else {
+        const auto right = compile(expr.right);
+        if (swaps_operands(expr.op)) {
+            emit(binary_opcode(expr.op), {dst, right, left});
+        } else {
+            emit(binary_opcode(expr.op), {dst, left, right});
+        }
+    }
+    release(start);
+    m_result = dst;
+}
+
+void register_compiler::visit(const block_statement& expr)
+{
+    for (const auto* stmt : expr.statements) {
+        stmt->accept(*this);
+    }
+}
+
+void register_compiler::visit(const boolean_literal& expr)
+{
+    const auto dst = destination();
+    emit(expr.value ? registers::opcodes::load_true : registers::opcodes::load_false, {dst});
+    m_result = dst;
+}
+
+void register_compiler::visit(const break_statement& /*expr*/)
+{
+    const auto break_pos = emit(registers::opcodes::jump, {}, {0});
+    scope().loops.back().breaks.push_back(break_pos);
+}
+
+void register_compiler::visit(const continue_statement& /*expr*/)
+{
+    emit(registers::opcodes::jump, {}, {scope().loops.back().start});
+}
+
+void register_compiler::visit(const call_expression& expr)
+{
+    using enum registers::opcodes;
+    // the result of a call without a target goes to the register of the callee
+    const auto dst = destination();
+    const auto start = mark();
+    // builtins called by name are called directly, without loading a callee object first
+    if (const auto* ident = dynamic_cast<const identifier*>(expr.function); ident != nullptr) {
+        if (const auto sym = m_symbols->resolve(ident->value); sym.has_value() && sym->scope == symbol_scope::builtin) {
+            // the result overwrites the first argument only after the call, so a fresh destination can hold it
+            const auto reuse_destination = dst.temporary && dst.index + 1 == start;
+            auto first = dst;
+            for (std::size_t idx = 0; const auto* arg : expr.arguments) {
+                const auto slot = idx == 0 && reuse_destination ? dst : allocate();
+                if (idx++ == 0) {
+                    first = slot;
+                }
+                compile_into(arg, slot);
+            }
+            emit(call_builtin, {dst, first}, {static_cast<std::size_t>(sym->index), expr.arguments.size()});
+            release(start);
+            m_result = dst;
+            return;
+        }
+    }
+    const auto callee = dst.temporary && dst.index + 1 == start ? dst : allocate();
+    compile_into(expr.function, callee);
+    for (const auto* arg : expr.arguments) {
+        compile_into(arg, allocate());
+    }
+    emit(call, {dst, callee}, {expr.arguments.size()});
+    release(start);
+    m_result = dst;
+}
+
+void register_compiler::visit(const decimal_literal& expr)
+{
+    const auto dst = destination();
+    emit(registers::opcodes::load_constant, {dst}, {add_constant(make<decimal_object>(expr.value))});
+    m_result = dst;
+}
+
+void register_compiler::visit(const expression_statement& expr)
+{
+    const auto start = mark();
+    compile(expr.expr);
+    release(start);
+}
+
+void register_compiler::visit(const function_literal& expr)
+{
+    const auto dst = destination();
+    enter_scope();
+    if (!expr.name.empty()) {
+        m_symbols->define_function_name(expr.name);
+    }
+    for (const auto* param : expr.parameters) {
+        m_symbols->define(param->value);
+    }
+    compile_body(expr.body);
+    const auto free = m_symbols->free();
+    auto [instrs, num_registers] = leave_scope(m_symbols->num_definitions());
+
+    // the frame of a register function is sized by num_locals, which counts its temporaries as well
+    auto* function =
+        make<compiled_function_object>(std::move(instrs), num_registers, static_cast<int>(expr.parameters.size()));
+    function->name = expr.name;
+    const auto function_index = add_constant(function);
+
+    const auto start = mark();
+    auto first = dst;
+    for (std::size_t idx = 0; const auto& sym : free) {
+        const auto slot = allocate();
+        if (idx++ == 0) {
+            first = slot;
+        }
+        load_symbol(sym, slot);
+    }
+    emit(registers::opcodes::closure, {dst, first}, {function_index, free.size()});
+    release(start);
+    m_result = dst;
+}
+
+void register_compiler::visit(const identifier& expr)
+{
+    const auto maybe_symbol = m_symbols->resolve(expr.value);
+    if (!maybe_symbol.has_value()) {
+        throw std::runtime_error(fmt::format("undefined variable {}", expr.value));
+    }
+    const auto& sym = maybe_symbol.value();
+    if (sym.is_local() && !m_target.has_value()) {
+        // locals are read in place
+        m_result = reg {.index = sym.index};
+        return;
+    }
+    const auto dst = destination();
+    load_symbol(sym, dst);
+    m_result = dst;
+}
+
+void register_compiler::visit(const if_expression& expr)
+{
+    using enum registers::opcodes;
+    const auto dst = destination();
+    // an if known to take its branch is left by the optimizer without alternative
+    if (constant_condition(expr.condition) == true && expr.alternative == nullptr) {
+        compile_block(expr.consequence, dst);
+        m_result = dst;
+        return;
+    }
+    const auto start = mark();
+    const auto fails = compile_jumps_if_false(expr.condition);
+    compile_block(expr.consequence, dst);
+    const auto jump_pos = emit(jump, {}, {0});
+    patch_jumps(fails, position());
+    if (expr.alternative == nullptr) {
+        emit(load_null, {dst});
+    } else {
+        compile_block(expr.alternative, dst);
+    }
+    patch_jump(jump_pos, position());
+    release(start);
+    m_result = dst;
+}
+
+void register_compiler::visit(const index_expression& expr)
+{
+    const auto dst = destination();
+    const auto start = mark();
+    const auto left = protect(compile(expr.left), expr.index);
+    const auto index = compile(expr.index);
+    emit(registers::opcodes::index, {dst, left, index});
+    release(start);
+    m_result = dst;
+}
+
+void register_compiler::visit(const integer_literal& expr)
+{
+    const auto dst = destination();
+    emit(registers::opcodes::load_constant, {dst}, {add_constant(make<integer_object>(expr.value))});
+    m_result = dst;
+}
+
+void register_compiler::visit(const let_statement& expr)
+{
+    const auto sym = m_symbols->define(expr.name->value);
+    if (sym.is_local()) {
+        compile_into(expr.value, reg {.index = sym.index});
+        return;
+    }
+    const auto start = mark();
+    emit(registers::opcodes::set_global, {compile(expr.value)}, {static_cast<std::size_t>(sym.index)});
+    release(start);
+}
+
+void register_compiler::visit(const null_literal& /*expr*/)
+{
+    const auto dst = destination();
+    emit(registers::opcodes::load_null, {dst});
+    m_result = dst;
+}
+
+void register_compiler::visit(const return_statement& expr)
+{
+    const auto start = mark();
+    emit(registers::opcodes::return_value, {compile(expr.value)});
+    release(start);
+}
+
+void register_compiler::visit(const string_literal& expr)
+{
+    const auto dst = destination();
+    emit(registers::opcodes::load_constant, {dst}, {add_constant(intern(expr.value))});
+    m_result = dst;
+}
+
+void register_compiler::visit(const unary_expression& expr)
+{
+    using enum registers::opcodes;
+    const auto dst = destination();
+    const auto start = mark();
+    const auto operand = compile(expr.right);
+    switch (expr.op) {
+        case token_type::exclamation:
+            emit(bang, {dst, operand});
+            break;
+        case token_type::minus:
+            emit(minus, {dst, operand});
+            break;
+        default:
+            throw std::runtime_error(fmt::format("invalid operator {}", expr.op));
+    }
+    release(start);
+    m_result = dst;
+}
+
+void register_compiler::visit(const while_statement& expr)
+{
+    using enum registers::opcodes;
+    const auto condition = constant_condition(expr.condition);
+    if (condition == false) {
+        return;
+    }
+    const auto loop_start_pos = position();
+    std::vector<std::size_t> fails;
+    if (!condition.has_value()) {
+        fails = compile_jumps_if_false(expr.condition);
+    }
+
+    /* the body runs in the frame of the enclosing function, its definitions only get a scope of their own */
+    scope().loops.push_back({.start = loop_start_pos, .breaks = {}});
+    m_symbols = symbol_table::create_enclosed(m_symbols, /*inside_loop=*/true);
+    expr.body->accept(*this);
+    m_symbols = m_symbols->outer();
+    emit(jump, {}, {loop_start_pos});
+
+    const auto after_body_pos = position();
+    patch_jumps(fails, after_body_pos);
+    for (const auto break_pos : scope().loops.back().breaks) {
+        patch_jump(break_pos, after_body_pos);
+    }
+    scope().loops.pop_back();
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+auto compile_program(std::string_view input) -> register_bytecode
+{
+    auto prsr = parser {lexer {input}};
+    auto prgrm = prsr.parse_program();
+    INFO("while parsing: `", input, "`");
+    REQUIRE(prsr.errors().empty());
+    auto cmplr = register_compiler::create();
+    cmplr.compile(prgrm.get());
+    return cmplr.byte_code();
+}
+
+/// the function compiled last, the constants of its body are added before it
+auto last_function(const register_bytecode& code) -> const compiled_function_object*
+{
+    const auto* constant = code.consts->back();
+    REQUIRE(constant->is(object::object_type::compiled_function));
+    return constant->as<compiled_function_object>();
+}
+
+TEST_SUITE_BEGIN("register_compiler");
+
+TEST_CASE("operandsOfLocalsAreReadInPlace")
+{
+    const auto code = compile_program("fn(a, b) { a + b }");
+    const auto* function = last_function(code);
+    CHECK_EQ(registers::to_string(function->instrs), R"(0000 Add r2 r0 r1
+0007 ReturnValue r2
+)");
+    CHECK_EQ(function->num_locals, 3);
+    CHECK_EQ(function->num_arguments, 2);
+    CHECK_EQ(registers::to_string(code.instrs), "0000 Closure r0 r0 0 0\n");
+}
+
+TEST_CASE("temporariesAreMovedAboveTheLocals")
+{
+    const auto code = compile_program("fn(a) { let b = a * 2; let c = b - 1; [a, b + c] }");
+    const auto* function = last_function(code);
+    CHECK_EQ(registers::to_string(function->instrs), R"(0000 LoadConstant r3 0
+0007 Mul r1 r0 r3
+0014 SubConst r2 r1 1
+0023 Move r4 r0
+0028 Add r5 r1 r2
+0035 Array r3 r4 2
+0042 ReturnValue r3
+)");
+    CHECK_EQ(function->num_locals, 6);
+}
+
+TEST_CASE("assignmentsTargetTheRegisterOfTheLocal")
+{
+    const auto code = compile_program("fn() { let i = 0; while (i < 10) { i = i + 1; } i }");
+    const auto* function = last_function(code);
+    CHECK_EQ(registers::to_string(function->instrs), R"(0000 LoadConstant r0 0
+0007 LoadConstant r1 1
+0014 JumpNotGreater r1 r0 37
+0023 AddConst r0 r0 2
+0032 Jump 7
+0037 ReturnValue r0
+)");
+}
+
+TEST_CASE("argumentsOccupyConsecutiveRegisters")
+{
+    const auto code = compile_program("let f = fn(x, y) { x }; f(1, len([2]))");
+    CHECK_EQ(registers::to_string(code.instrs), R"(0000 Closure r1 r1 0 0
+0010 SetGlobal r1 0
+0015 GetGlobal r0 0
+0020 LoadConstant r1 1
+0027 LoadConstant r3 2
+0034 Array r2 r3 1
+0041 CallBuiltin r2 r2 0 1
+0048 Call r0 r0 2
+)");
+    CHECK_EQ(code.num_registers, 4);
+}
+
+TEST_CASE("localsAssignedByLaterOperandsAreCopied")
+{
+    const auto code = compile_program("fn(a) { a + if (true) { a = 2; 1 } else { 0 } }");
+    const auto* function = last_function(code);
+    CHECK(registers::to_string(function->instrs).starts_with("0000 Move r2 r0\n"));
+}
+
+TEST_SUITE_END();
+// NOLINTEND(*)
+}  // namespace
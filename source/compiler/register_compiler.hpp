@@ -0,0 +1,128 @@
+#pragma once
+
+#include <cstddef>
+#include <initializer_list>
+#include <optional>
+#include <vector>
+
+#include <ast/program.hpp>
+#include <ast/visitor.hpp>
+#include <code/code.hpp>
+#include <code/register_code.hpp>
+
+#include "compiler.hpp"
+#include "symbol_table.hpp"
+
+struct register_bytecode final
+{
+    instructions instrs;
+    const constants* consts {};
+    /// number of registers of the frame of the main program, the value of the program is left in the first one
+    int num_registers {};
+};
+
+/// Register operand while compiling a function.
+///
+/// The locals of a function take the registers numbered by their symbols, the temporaries follow them. As the number
+/// of locals is only known once the whole function is compiled, temporaries are numbered from zero and moved above
+/// the locals when leaving the function.
+struct reg final
+{
+    int index {};
+    bool temporary {};
+};
+
+struct register_scope final
+{
+    instructions instrs;
+    /// positions of the register operands naming a temporary
+    std::vector<std::size_t> temporaries;
+    int next_temporary {};
+    int max_temporaries {};
+    std::vector<loop_context> loops;
+};
+
+/// Compiles a program to the instructions of the register machine.
+///
+/// Temporaries are allocated like a stack: every expression gets the lowest free register and releases the registers
+/// of its operands once it is emitted, so the arguments of a call always occupy consecutive registers.
+struct register_compiler final : public visitor
+{
+    auto compile(const program* program) -> void;
+    [[nodiscard]] static auto create() -> register_compiler;
+
+    [[nodiscard]] static auto create_with_state(constants* constants, symbol_table* symbols) -> register_compiler
+    {
+        return register_compiler {constants, symbols};
+    }
+
+    [[nodiscard]] auto byte_code() const -> register_bytecode;
+
+    [[nodiscard]] auto all_symbols() const -> const symbol_table* { return m_symbols; }
+
+  protected:
+    void visit(const array_literal& expr) final;
+    void visit(const assign_expression& expr) final;
+    void visit(const binary_expression& expr) final;
+    void visit(const block_statement& expr) final;
+    void visit(const boolean_literal& expr) final;
+    void visit(const break_statement& expr) final;
+    void visit(const call_expression& expr) final;
+    void visit(const continue_statement& expr) final;
+    void visit(const decimal_literal& expr) final;
+    void visit(const expression_statement& expr) final;
+    void visit(const function_literal& expr) final;
+    void visit(const hash_literal& expr) final;
+    void visit(const identifier& expr) final;
+    void visit(const if_expression& expr) final;
+    void visit(const index_expression& expr) final;
+    void visit(const integer_literal& expr) final;
+    void visit(const let_statement& expr) final;
+    void visit(const null_literal& expr) final;
+    void visit(const program& expr) final;
+    void visit(const return_statement& expr) final;
+    void visit(const string_literal& expr) final;
+    void visit(const unary_expression& expr) final;
+    void visit(const while_statement& expr) final;
+
+  private:
+    register_compiler(constants* consts, symbol_table* symbols);
+
+    /// compiles an expression into the target, or into the register of its value if there is no target
+    auto compile(const expression* expr, std::optional<reg> target = std::nullopt) -> reg;
+    auto compile_into(const expression* expr, reg target) -> void;
+    /// compiles a condition to jumps taken if it does not hold, && and || only evaluate their right operand if needed
+    auto compile_jumps_if_false(const expression* condition) -> std::vector<std::size_t>;
+    /// compiles a condition to jumps taken if it holds
+    auto compile_jumps_if_true(const expression* condition) -> std::vector<std::size_t>;
+    /// compiles the statements of a block, the value of the block is left in the target
+    auto compile_block(const block_statement* block, reg target) -> void;
+    auto compile_body(const block_statement* body) -> void;
+    /// copies a local into a temporary if evaluating the following operand might assign it
+    auto protect(reg operand, const expression* following) -> reg;
+    auto load_symbol(const symbol& sym, reg target) -> void;
+
+    /// the target of the expression being compiled, a new temporary if there is none
+    auto destination() -> reg;
+    auto allocate() -> reg;
+    auto release(int mark) -> void;
+    [[nodiscard]] auto mark() const -> int;
+
+    auto emit(registers::opcodes opcode, std::initializer_list<reg> regs, const operands& rest = {}) -> std::size_t;
+    auto patch_jump(std::size_t pos, std::size_t target) -> void;
+    auto patch_jumps(const std::vector<std::size_t>& positions, std::size_t target) -> void;
+    [[nodiscard]] auto position() const -> std::size_t;
+    auto add_constant(const object* obj) -> std::size_t;
+    auto enter_scope() -> void;
+    /// leaves the scope of a function, returns its instructions and the number of registers of its frame
+    auto leave_scope(int num_locals) -> std::pair<instructions, int>;
+    auto scope() -> register_scope&;
+
+    constants* m_consts {};
+    constant_index m_constant_index;
+    symbol_table* m_symbols;
+    std::vector<register_scope> m_scopes;
+    std::optional<reg> m_target;
+    reg m_result;
+    reg m_program_result;
+};
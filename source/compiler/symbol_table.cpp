@@ -1,8 +1,8 @@
+#include <algorithm>
 #include <array>
 #include <map>
 #include <optional>
 #include <ostream>
-#include <stdexcept>
 #include <string>
 #include <vector>
 
@@ -11,17 +11,11 @@
 #include <doctest/doctest.h>
 #include <fmt/base.h>
 #include <fmt/format.h>
-#include <fmt/std.h>  // for formatting std::optional
 #include <gc.hpp>
 
-auto operator==(const symbol_pointer& lhs, const symbol_pointer& rhs) -> bool
-{
-    return lhs.index == rhs.index && lhs.scope == rhs.scope && lhs.level == rhs.level;
-}
-
 auto operator==(const symbol& lhs, const symbol& rhs) -> bool
 {
-    return lhs.name == rhs.name && lhs.scope == rhs.scope && lhs.index == rhs.index && lhs.ptr == rhs.ptr;
+    return lhs.name == rhs.name && lhs.scope == rhs.scope && lhs.index == rhs.index;
 }
 
 auto operator<<(std::ostream& ost, symbol_scope scope) -> std::ostream&
@@ -38,20 +32,13 @@ auto operator<<(std::ostream& ost, symbol_scope scope) -> std::ostream&
             return ost << "free";
         case function:
             return ost << "function";
-        case outer:
-            return ost << "outer";
     }
     return ost;
 }
 
 auto operator<<(std::ostream& ost, const symbol& sym) -> std::ostream&
 {
-    return ost << fmt::format("symbol{{{}, {}, {}, {}}}", sym.name, sym.scope, sym.index, sym.ptr);
-}
-
-auto operator<<(std::ostream& ost, const symbol_pointer& ptr) -> std::ostream&
-{
-    return ost << fmt::format("symbol_pointer{{{}, {}, {}}}", ptr.level, ptr.scope, ptr.index);
+    return ost << fmt::format("symbol{{{}, {}, {}}}", sym.name, sym.scope, sym.index);
 }
 
 auto symbol_table::create() -> symbol_table*
@@ -73,10 +60,14 @@ symbol_table::symbol_table(symbol_table* outer, bool inside_loop)
 auto symbol_table::define(const std::string& name) -> symbol
 {
     using enum symbol_scope;
+    auto* owner = this;
+    while (owner->m_inside_loop) {
+        owner = owner->m_outer;
+    }
     return m_store[name] = symbol {
                .name = name,
-               .scope = (m_outer != nullptr) ? local : global,
-               .index = m_defs++,
+               .scope = owner->is_global() ? global : local,
+               .index = owner->m_defs++,
            };
 }
 
@@ -98,59 +89,49 @@ auto symbol_table::define_function_name(const std::string& name) -> symbol
            };
 }
 
-auto symbol_table::define_outer(const symbol& original, int level) -> symbol
+auto symbol_table::reserve_definitions(int count) -> void
 {
-    using enum symbol_scope;
-    if (original.scope == local || original.scope == free || original.scope == function) {
-        return m_store[original.name] = symbol {.name = original.name,
-                                                .scope = outer,
-                                                .index = 0,
-                                                .ptr =
-                                                    symbol_pointer {
-                                                        .level = level,
-                                                        .scope = original.scope,
-                                                        .index = original.index,
-                                                    }
-
-               };
-    }
-    if (original.scope == outer) {
-        return m_store[original.name] = symbol {.name = original.name,
-                                                .scope = outer,
-                                                .index = 0,
-                                                .ptr = symbol_pointer {
-                                                    .level = level + original.ptr->level,
-                                                    .scope = original.ptr->scope,
-                                                    .index = original.ptr->index,
-                                                }};
-    }
-    throw std::runtime_error("invalid call to define_outer");
+    m_defs = std::max(m_defs, count);
 }
 
-auto symbol_table::resolve(const std::string& name, int level) -> std::optional<symbol>
+auto symbol_table::define_global(const std::string& name, int index) -> symbol
+{
+    m_defs = std::max(m_defs, index + 1);
+    return m_store[name] = symbol {
+               .name = name,
+               .scope = symbol_scope::global,
+               .index = index,
+           };
+}
+
+auto symbol_table::resolve(const std::string& name) -> std::optional<symbol>
 {
     using enum symbol_scope;
     if (const auto itr = m_store.find(name); itr != m_store.end()) {
         return itr->second;
     }
     if (m_outer != nullptr) {
-        level = level + 1;
-        auto maybe_symbol = m_outer->resolve(name, level);
-        if (!maybe_symbol.has_value()) {
+        auto maybe_symbol = m_outer->resolve(name);
+        if (!maybe_symbol.has_value() || m_inside_loop) {
             return maybe_symbol;
         }
         auto symbol = maybe_symbol.value();
         if (symbol.scope == global || symbol.scope == builtin) {
             return symbol;
         }
-        if (m_inside_loop) {
-            return define_outer(symbol, level);
-        }
         return define_free(symbol);
     }
     return std::nullopt;
 }
 
+auto symbol_table::find(const std::string& name) const -> std::optional<symbol>
+{
+    if (const auto itr = m_store.find(name); itr != m_store.end()) {
+        return itr->second;
+    }
+    return std::nullopt;
+}
+
 auto symbol_table::free() const -> const std::vector<symbol>&
 {
     return m_free;
@@ -186,12 +167,12 @@ TEST_CASE("define")
 {
     using enum symbol_scope;
     auto expected = string_map<symbol> {
-        {"a", symbol {"a", global, 0, std::nullopt}},
-        {"b", symbol {"b", global, 1, std::nullopt}},
-        {"c", symbol {"c", local, 0, std::nullopt}},
-        {"d", symbol {"d", local, 1, std::nullopt}},
-        {"e", symbol {"e", local, 0, std::nullopt}},
-        {"f", symbol {"f", local, 1, std::nullopt}},
+        {"a", symbol {"a", global, 0}},
+        {"b", symbol {"b", global, 1}},
+        {"c", symbol {"c", local, 0}},
+        {"d", symbol {"d", local, 1}},
+        {"e", symbol {"e", local, 0}},
+        {"f", symbol {"f", local, 1}},
     };
 
     auto globals = symbol_table::create();
@@ -221,8 +202,8 @@ TEST_CASE("resolve")
 
     using enum symbol_scope;
     std::array expecteds {
-        symbol {"a", global, 0, std::nullopt},
-        symbol {"b", global, 1, std::nullopt},
+        symbol {"a", global, 0},
+        symbol {"b", global, 1},
     };
 
     for (const auto& expected : expecteds) {
@@ -237,10 +218,10 @@ TEST_CASE("resolve")
 
         using enum symbol_scope;
         std::array expecteds {
-            symbol {"a", global, 0, std::nullopt},
-            symbol {"b", global, 1, std::nullopt},
-            symbol {"c", local, 0, std::nullopt},
-            symbol {"d", local, 1, std::nullopt},
+            symbol {"a", global, 0},
+            symbol {"b", global, 1},
+            symbol {"c", local, 0},
+            symbol {"d", local, 1},
         };
         for (const auto& expected : expecteds) {
             CHECK_EQ(locals->resolve(expected.name), expected);
@@ -254,12 +235,12 @@ TEST_CASE("resolve")
 
             using enum symbol_scope;
             std::array expecteds {
-                symbol {"a", global, 0, std::nullopt},
-                symbol {"b", global, 1, std::nullopt},
-                symbol {"c", free, 0, std::nullopt},
-                symbol {"d", free, 1, std::nullopt},
-                symbol {"e", local, 0, std::nullopt},
-                symbol {"f", local, 1, std::nullopt},
+                symbol {"a", global, 0},
+                symbol {"b", global, 1},
+                symbol {"c", free, 0},
+                symbol {"d", free, 1},
+                symbol {"e", local, 0},
+                symbol {"f", local, 1},
             };
             for (const auto& expected : expecteds) {
                 CHECK_EQ(nested->resolve(expected.name), expected);
@@ -279,10 +260,10 @@ TEST_CASE("defineResolveBuiltin")
 {
     using enum symbol_scope;
     std::array expecteds {
-        symbol {"a", builtin, 0, std::nullopt},
-        symbol {"c", builtin, 1, std::nullopt},
-        symbol {"e", builtin, 2, std::nullopt},
-        symbol {"f", builtin, 3, std::nullopt},
+        symbol {"a", builtin, 0},
+        symbol {"c", builtin, 1},
+        symbol {"e", builtin, 2},
+        symbol {"f", builtin, 3},
     };
 
     auto globals = symbol_table::create();
@@ -306,7 +287,7 @@ TEST_CASE("defineAndResolveFunctionName")
     auto globals = symbol_table::create();
     globals->define_function_name("a");
 
-    auto expected = symbol {"a", function, 0, std::nullopt};
+    auto expected = symbol {"a", function, 0};
 
     auto actual = globals->resolve("a");
     REQUIRE(actual.has_value());
@@ -320,12 +301,37 @@ TEST_CASE("shadowFunctionNames")
     globals->define_function_name("a");
     globals->define("a");
 
-    auto expected = symbol {"a", global, 0, std::nullopt};
+    auto expected = symbol {"a", global, 0};
     auto resolved = globals->resolve("a");
     REQUIRE(resolved.has_value());
     REQUIRE_EQ(resolved.value(), expected);
 }
 
+TEST_CASE("loopScopes")
+{
+    using enum symbol_scope;
+    auto globals = symbol_table::create();
+    globals->define("a");
+    auto global_loop = symbol_table::create_enclosed(globals, /*inside_loop=*/true);
+    CHECK_EQ(global_loop->define("b"), symbol {"b", global, 1});
+
+    auto locals = symbol_table::create_enclosed(globals);
+    locals->define("c");
+    auto loop = symbol_table::create_enclosed(locals, /*inside_loop=*/true);
+    auto nested_loop = symbol_table::create_enclosed(loop, /*inside_loop=*/true);
+    CHECK_EQ(loop->define("d"), symbol {"d", local, 1});
+    CHECK_EQ(nested_loop->define("e"), symbol {"e", local, 2});
+    CHECK_EQ(nested_loop->resolve("a"), symbol {"a", global, 0});
+    CHECK_EQ(nested_loop->resolve("c"), symbol {"c", local, 0});
+    CHECK_EQ(nested_loop->resolve("d"), symbol {"d", local, 1});
+    CHECK_EQ(locals->num_definitions(), 3);
+    CHECK_FALSE(locals->resolve("d").has_value());
+    CHECK_FALSE(loop->find("c").has_value());
+
+    auto inner = symbol_table::create_enclosed(nested_loop);
+    CHECK_EQ(inner->resolve("e"), symbol {"e", free, 0});
+}
+
 TEST_SUITE_END();
 // NOLINTEND(*)
 }  // namespace
@@ -19,7 +19,6 @@ enum class symbol_scope : std::uint8_t
     builtin,
     free,
     function,
-    outer,
 };
 auto operator<<(std::ostream& ost, symbol_scope scope) -> std::ostream&;
 
@@ -28,37 +27,17 @@ struct fmt::formatter<symbol_scope> : ostream_formatter
 {
 };
 
-struct symbol_pointer final
-{
-    int level {};
-    symbol_scope scope {};
-    int index {};
-
-    [[nodiscard]] auto is_function() const -> bool { return scope == symbol_scope::function; }
-};
-
-auto operator==(const symbol_pointer& lhs, const symbol_pointer& rhs) -> bool;
-auto operator<<(std::ostream& ost, const symbol_pointer& ptr) -> std::ostream&;
-
-template<>
-struct fmt::formatter<symbol_pointer> : ostream_formatter
-{
-};
-
 struct symbol final
 {
     std::string name;
     symbol_scope scope {};
     int index {};
-    std::optional<symbol_pointer> ptr;
 
     [[nodiscard]] auto is_local() const -> bool { return scope == symbol_scope::local; }
 
     [[nodiscard]] auto is_global() const -> bool { return scope == symbol_scope::global; }
 
     [[nodiscard]] auto is_function() const -> bool { return scope == symbol_scope::function; }
-
-    [[nodiscard]] auto is_outer() const -> bool { return scope == symbol_scope::outer; }
 };
 
 auto operator==(const symbol& lhs, const symbol& rhs) -> bool;
@@ -69,16 +48,25 @@ struct fmt::formatter<symbol> : ostream_formatter
 {
 };
 
+/// Symbols of a program, a function or the body of a loop.
+///
+/// The table of a loop body only limits the visibility of its definitions, the slots of its symbols are allocated
+/// in the enclosing function or in the globals, as the body runs in the frame of the enclosing function.
 struct symbol_table final
 {
     static auto create() -> symbol_table*;
     static auto create_enclosed(symbol_table* outer, bool inside_loop = false) -> symbol_table*;
     explicit symbol_table(symbol_table* outer = {}, bool inside_loop = {});
     auto define(const std::string& name) -> symbol;
-    auto define_outer(const symbol& original, int level) -> symbol;
     auto define_builtin(int index, const std::string& name) -> symbol;
     auto define_function_name(const std::string& name) -> symbol;
-    auto resolve(const std::string& name, int level = 0) -> std::optional<symbol>;
+    /// defines a global at a fixed index, used to restore the globals of a cached program
+    auto define_global(const std::string& name, int index) -> symbol;
+    /// keeps the slots below count, used by an earlier program, from being allocated again
+    auto reserve_definitions(int count) -> void;
+    auto resolve(const std::string& name) -> std::optional<symbol>;
+    /// looks up a name in this table only, without resolving it in the enclosing tables
+    [[nodiscard]] auto find(const std::string& name) const -> std::optional<symbol>;
 
     [[nodiscard]] auto is_global() const -> bool { return m_outer == nullptr; }
 
@@ -88,6 +76,8 @@ struct symbol_table final
 
     [[nodiscard]] auto num_definitions() const -> int { return m_defs; }
 
+    [[nodiscard]] auto symbols() const -> const string_map<symbol>& { return m_store; }
+
     [[nodiscard]] auto free() const -> const std::vector<symbol>&;
     auto debug() const -> void;
 
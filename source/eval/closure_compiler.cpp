@@ -0,0 +1,692 @@
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "closure_compiler.hpp"
+
+#include <analyzer/analyzer.hpp>
+#include <ast/array_literal.hpp>
+#include <ast/assign_expression.hpp>
+#include <ast/binary_expression.hpp>
+#include <ast/boolean_literal.hpp>
+#include <ast/call_expression.hpp>
+#include <ast/decimal_literal.hpp>
+#include <ast/expression.hpp>
+#include <ast/function_literal.hpp>
+#include <ast/hash_literal.hpp>
+#include <ast/identifier.hpp>
+#include <ast/if_expression.hpp>
+#include <ast/index_expression.hpp>
+#include <ast/integer_literal.hpp>
+#include <ast/null_literal.hpp>
+#include <ast/program.hpp>
+#include <ast/statements.hpp>
+#include <ast/string_literal.hpp>
+#include <ast/unary_expression.hpp>
+#include <ast/visitor.hpp>
+#include <builtin/builtin.hpp>
+#include <doctest/doctest.h>
+#include <gc.hpp>
+#include <lexer/lexer.hpp>
+#include <lexer/token_type.hpp>
+#include <object/object.hpp>
+#include <parser/parser.hpp>
+
+#include "environment.hpp"
+#include "evaluator.hpp"
+#include "roots.hpp"
+
+namespace
+{
+/// whether the result ends the evaluation of a block
+auto is_signal(const object* obj) -> bool
+{
+    return obj->is_error() || obj->is_return_value() || obj->is_break() || obj->is_continue();
+}
+
+/// the immortal object a literal evaluates to, nullptr if evaluating it allocates
+auto immortal_literal(const expression* expr) -> const object*
+{
+    if (const auto* lit = dynamic_cast<const integer_literal*>(expr); lit != nullptr) {
+        return lit->value >= small_integer_min && lit->value <= small_integer_max ? small_integer(lit->value) : nullptr;
+    }
+    if (const auto* lit = dynamic_cast<const boolean_literal*>(expr); lit != nullptr) {
+        return native_bool_to_object(lit->value);
+    }
+    if (const auto* lit = dynamic_cast<const string_literal*>(expr); lit != nullptr) {
+        return intern(lit->value);
+    }
+    if (dynamic_cast<const null_literal*>(expr) != nullptr) {
+        return null();
+    }
+    return nullptr;
+}
+
+/// whether evaluating the expression can not start a collection, collections only start in loops and so in calls
+auto cannot_collect(const expression* expr) -> bool
+{
+    if (dynamic_cast<const identifier*>(expr) != nullptr || dynamic_cast<const integer_literal*>(expr) != nullptr
+        || dynamic_cast<const decimal_literal*>(expr) != nullptr || immortal_literal(expr) != nullptr)
+    {
+        return true;
+    }
+    if (const auto* binary = dynamic_cast<const binary_expression*>(expr); binary != nullptr) {
+        return cannot_collect(binary->left) && cannot_collect(binary->right);
+    }
+    if (const auto* unary = dynamic_cast<const unary_expression*>(expr); unary != nullptr) {
+        return cannot_collect(unary->right);
+    }
+    if (const auto* index = dynamic_cast<const index_expression*>(expr); index != nullptr) {
+        return cannot_collect(index->left) && cannot_collect(index->index);
+    }
+    return false;
+}
+
+auto not_found(const identifier* ident) -> const object*
+{
+    return make_error("identifier not found: {}", ident->value);
+}
+
+/// calls a function or a builtin with the evaluated arguments
+auto call(const object* callee, const std::vector<const object*>& args) -> const object*
+{
+    if (callee->is(object::object_type::function)) {
+        const auto* func = callee->as<function_object>();
+        auto* locals = make<environment>(func->closure_env, static_cast<std::size_t>(func->num_locals));
+        std::copy_n(args.begin(), std::min(args.size(), func->parameters.size()), locals->slots.begin());
+        const root_scope scope;
+        keep_alive(locals);
+        const auto* result = func->lowered->body(locals);
+        if (result->is_return_value()) {
+            return result->as<return_value_object>()->return_value;
+        }
+        return result;
+    }
+    if (callee->is(object::object_type::builtin)) {
+        return callee->as<builtin_object>()->builtin->body(args);
+    }
+    return make_error("calling a value of type {} is not supported", callee->type());
+}
+
+/// Lowers the nodes of an analyzed tree to closures, every visit leaves the closure of its node in m_result.
+class closure_compiler final : public visitor
+{
+  public:
+    explicit closure_compiler(lowered_program* prgrm)
+        : m_program {prgrm}
+    {
+    }
+
+    auto lower(const expression* expr) -> thunk
+    {
+        expr->accept(*this);
+        return std::move(m_result);
+    }
+
+    void visit(const array_literal& expr) final;
+    void visit(const assign_expression& expr) final;
+    void visit(const binary_expression& expr) final;
+    void visit(const block_statement& expr) final;
+    void visit(const boolean_literal& expr) final;
+    void visit(const break_statement& expr) final;
+    void visit(const call_expression& expr) final;
+    void visit(const continue_statement& expr) final;
+    void visit(const decimal_literal& expr) final;
+    void visit(const expression_statement& expr) final;
+    void visit(const function_literal& expr) final;
+    void visit(const hash_literal& expr) final;
+    void visit(const identifier& expr) final;
+    void visit(const if_expression& expr) final;
+    void visit(const index_expression& expr) final;
+    void visit(const integer_literal& expr) final;
+    void visit(const let_statement& expr) final;
+    void visit(const null_literal& expr) final;
+    void visit(const program& expr) final;
+    void visit(const return_statement& expr) final;
+    void visit(const string_literal& expr) final;
+    void visit(const unary_expression& expr) final;
+    void visit(const while_statement& expr) final;
+
+  private:
+    auto constant(const object* obj) -> void
+    {
+        m_result = [obj](environment* /*env*/) { return obj; };
+    }
+
+    lowered_program* m_program;
+    thunk m_result;
+};
+
+void closure_compiler::visit(const array_literal& expr)
+{
+    std::vector<thunk> elements;
+    for (const auto* element : expr.elements) {
+        elements.push_back(lower(element));
+    }
+    m_result = [elements = std::move(elements)](environment* env) -> const object*
+    {
+        const root_scope scope;
+        array_object::value_type arr;
+        for (const auto& element : elements) {
+            const auto* val = element(env);
+            if (val->is_error()) {
+                return val;
+            }
+            keep_alive(val);
+            arr.push_back(val);
+        }
+        return make<array_object>(std::move(arr));
+    };
+}
+
+void closure_compiler::visit(const assign_expression& expr)
+{
+    auto value = lower(expr.value);
+    const auto slot = static_cast<std::size_t>(expr.name->slot);
+    if (expr.name->depth == 0) {
+        m_result = [value = std::move(value), slot](environment* env) -> const object*
+        {
+            const auto* val = value(env);
+            if (!val->is_error()) {
+                env->slots[slot] = val;
+            }
+            return val;
+        };
+        return;
+    }
+    m_result = [value = std::move(value), depth = expr.name->depth, slot = expr.name->slot](
+                   environment* env) -> const object*
+    {
+        const auto* val = value(env);
+        if (!val->is_error()) {
+            env->set(depth, slot, val);
+        }
+        return val;
+    };
+}
+
+void closure_compiler::visit(const binary_expression& expr)
+{
+    auto left = lower(expr.left);
+    const auto oper = expr.op;
+    if (oper == token_type::logical_and || oper == token_type::logical_or) {
+        // the right operand is only evaluated if the left one does not decide the result
+        const auto decided_by = oper == token_type::logical_or;
+        m_result = [left = std::move(left), right = lower(expr.right), oper, decided_by](
+                       environment* env) -> const object*
+        {
+            const auto* lhs = left(env);
+            if (lhs->is_error()) {
+                return lhs;
+            }
+            if (lhs->is_truthy() == decided_by) {
+                return native_bool_to_object(decided_by);
+            }
+            const root_scope scope;
+            keep_alive(lhs);
+            const auto* rhs = right(env);
+            if (rhs->is_error()) {
+                return rhs;
+            }
+            return evaluate_binary_operator(oper, lhs, rhs);
+        };
+        return;
+    }
+    if (const auto* rhs = immortal_literal(expr.right); rhs != nullptr) {
+        m_result = [left = std::move(left), oper, rhs](environment* env) -> const object*
+        {
+            const auto* lhs = left(env);
+            if (lhs->is_error()) {
+                return lhs;
+            }
+            return evaluate_binary_operator(oper, lhs, rhs);
+        };
+        return;
+    }
+    if (cannot_collect(expr.right)) {
+        m_result = [left = std::move(left), right = lower(expr.right), oper](environment* env) -> const object*
+        {
+            const auto* lhs = left(env);
+            if (lhs->is_error()) {
+                return lhs;
+            }
+            const auto* rhs = right(env);
+            if (rhs->is_error()) {
+                return rhs;
+            }
+            return evaluate_binary_operator(oper, lhs, rhs);
+        };
+        return;
+    }
+    m_result = [left = std::move(left), right = lower(expr.right), oper](environment* env) -> const object*
+    {
+        const auto* lhs = left(env);
+        if (lhs->is_error()) {
+            return lhs;
+        }
+        const root_scope scope;
+        keep_alive(lhs);
+        const auto* rhs = right(env);
+        if (rhs->is_error()) {
+            return rhs;
+        }
+        return evaluate_binary_operator(oper, lhs, rhs);
+    };
+}
+
+void closure_compiler::visit(const block_statement& expr)
+{
+    if (expr.statements.size() == 1) {
+        expr.statements.front()->accept(*this);
+        return;
+    }
+    std::vector<thunk> statements;
+    for (const auto* stmt : expr.statements) {
+        statements.push_back(lower(stmt));
+    }
+    m_result = [statements = std::move(statements)](environment* env) -> const object*
+    {
+        const auto* result = null();
+        for (const auto& stmt : statements) {
+            result = stmt(env);
+            if (is_signal(result)) {
+                return result;
+            }
+        }
+        return result;
+    };
+}
+
+void closure_compiler::visit(const boolean_literal& expr)
+{
+    constant(native_bool_to_object(expr.value));
+}
+
+void closure_compiler::visit(const break_statement& /*expr*/)
+{
+    constant(brake());
+}
+
+void closure_compiler::visit(const call_expression& expr)
+{
+    std::vector<thunk> arguments;
+    for (const auto* arg : expr.arguments) {
+        arguments.push_back(lower(arg));
+    }
+    m_result = [function = lower(expr.function), arguments = std::move(arguments)](environment* env) -> const object*
+    {
+        const auto* callee = function(env);
+        if (callee->is_error()) {
+            return callee;
+        }
+        const root_scope scope;
+        keep_alive(callee);
+        std::vector<const object*> args;
+        args.reserve(arguments.size());
+        for (const auto& argument : arguments) {
+            const auto* arg = argument(env);
+            if (arg->is_error()) {
+                return arg;
+            }
+            keep_alive(arg);
+            args.push_back(arg);
+        }
+        return call(callee, args);
+    };
+}
+
+void closure_compiler::visit(const continue_statement& /*expr*/)
+{
+    constant(cont());
+}
+
+void closure_compiler::visit(const decimal_literal& expr)
+{
+    m_result = [value = expr.value](environment* /*env*/) -> const object* { return make<decimal_object>(value); };
+}
+
+void closure_compiler::visit(const expression_statement& expr)
+{
+    if (expr.expr != nullptr) {
+        expr.expr->accept(*this);
+        return;
+    }
+    constant(null());
+}
+
+void closure_compiler::visit(const function_literal& expr)
+{
+    const auto* lowered = &m_program->functions.emplace_back(lower(expr.body));
+    m_result = [literal = &expr, lowered, prgrm = m_program](environment* env) -> const object*
+    {
+        // the function shares the ownership of the lowered program, which owns the tree and the lowered body
+        auto* func = make<function_object>(literal->parameters,
+                                           literal->body,
+                                           literal->num_locals,
+                                           env,
+                                           std::shared_ptr<const arena>(prgrm->shared_from_this(), prgrm->tree.get()));
+        func->lowered = lowered;
+        return func;
+    };
+}
+
+void closure_compiler::visit(const hash_literal& expr)
+{
+    std::vector<std::pair<thunk, thunk>> pairs;
+    for (const auto& [key, value] : expr.pairs) {
+        pairs.emplace_back(lower(key), lower(value));
+    }
+    m_result = [pairs = std::move(pairs)](environment* env) -> const object*
+    {
+        const root_scope scope;
+        hash_object::value_type result;
+        for (const auto& [key, value] : pairs) {
+            const auto* eval_key = key(env);
+            if (eval_key->is_error()) {
+                return eval_key;
+            }
+            if (!eval_key->is_hashable()) {
+                return make_error("unusable as hash key {}", eval_key->type());
+            }
+            keep_alive(eval_key);
+            const auto* eval_val = value(env);
+            if (eval_val->is_error()) {
+                return eval_val;
+            }
+            keep_alive(eval_val);
+            result.insert({eval_key->as<hashable>()->hash_key(), eval_val});
+        }
+        return make<hash_object>(std::move(result));
+    };
+}
+
+void closure_compiler::visit(const identifier& expr)
+{
+    const auto slot = static_cast<std::size_t>(expr.slot);
+    switch (expr.depth) {
+        case identifier::builtin:
+            constant(builtin::builtin_objects()[slot]);
+            return;
+        case identifier::unresolved:
+            m_result = [ident = &expr](environment* /*env*/) { return not_found(ident); };
+            return;
+        case 0:
+            m_result = [ident = &expr, slot](environment* env) -> const object*
+            {
+                const auto* val = env->slots[slot];
+                return val != nullptr && !val->is_null() ? val : not_found(ident);
+            };
+            return;
+        case 1:
+            m_result = [ident = &expr, slot](environment* env) -> const object*
+            {
+                const auto* val = env->outer->slots[slot];
+                return val != nullptr && !val->is_null() ? val : not_found(ident);
+            };
+            return;
+        default:
+            m_result = [ident = &expr](environment* env) -> const object*
+            {
+                const auto* val = env->get(ident->depth, ident->slot);
+                return val != nullptr && !val->is_null() ? val : not_found(ident);
+            };
+            return;
+    }
+}
+
+void closure_compiler::visit(const if_expression& expr)
+{
+    auto condition = lower(expr.condition);
+    auto consequence = lower(expr.consequence);
+    if (expr.alternative == nullptr) {
+        m_result = [condition = std::move(condition), consequence = std::move(consequence)](
+                       environment* env) -> const object*
+        {
+            const auto* cond = condition(env);
+            if (cond->is_error()) {
+                return cond;
+            }
+            return cond->is_truthy() ? consequence(env) : null();
+        };
+        return;
+    }
+    m_result = [condition = std::move(condition),
+                consequence = std::move(consequence),
+                alternative = lower(expr.alternative)](environment* env) -> const object*
+    {
+        const auto* cond = condition(env);
+        if (cond->is_error()) {
+            return cond;
+        }
+        return cond->is_truthy() ? consequence(env) : alternative(env);
+    };
+}
+
+void closure_compiler::visit(const index_expression& expr)
+{
+    auto left = lower(expr.left);
+    auto index = lower(expr.index);
+    if (cannot_collect(expr.index)) {
+        m_result = [left = std::move(left), index = std::move(index)](environment* env) -> const object*
+        {
+            const auto* container = left(env);
+            if (container->is_error()) {
+                return container;
+            }
+            const auto* key = index(env);
+            if (key->is_error()) {
+                return key;
+            }
+            return evaluate_index(container, key);
+        };
+        return;
+    }
+    m_result = [left = std::move(left), index = std::move(index)](environment* env) -> const object*
+    {
+        const auto* container = left(env);
+        if (container->is_error()) {
+            return container;
+        }
+        const root_scope scope;
+        keep_alive(container);
+        const auto* key = index(env);
+        if (key->is_error()) {
+            return key;
+        }
+        return evaluate_index(container, key);
+    };
+}
+
+void closure_compiler::visit(const integer_literal& expr)
+{
+    if (const auto* small = immortal_literal(&expr); small != nullptr) {
+        constant(small);
+        return;
+    }
+    m_result = [value = expr.value](environment* /*env*/) -> const object* { return make<integer_object>(value); };
+}
+
+void closure_compiler::visit(const let_statement& expr)
+{
+    m_result = [value = lower(expr.value), slot = static_cast<std::size_t>(expr.name->slot)](
+                   environment* env) -> const object*
+    {
+        const auto* val = value(env);
+        if (val->is_error()) {
+            return val;
+        }
+        env->slots[slot] = val;
+        return null();
+    };
+}
+
+void closure_compiler::visit(const null_literal& /*expr*/)
+{
+    constant(null());
+}
+
+void closure_compiler::visit(const program& expr)
+{
+    for (const auto* statement : expr.statements) {
+        m_program->statements.push_back(lower(statement));
+    }
+}
+
+void closure_compiler::visit(const return_statement& expr)
+{
+    if (expr.value == nullptr) {
+        constant(null());
+        return;
+    }
+    m_result = [value = lower(expr.value)](environment* env) -> const object*
+    {
+        const auto* val = value(env);
+        if (val->is_error()) {
+            return val;
+        }
+        return make<return_value_object>(val);
+    };
+}
+
+void closure_compiler::visit(const string_literal& expr)
+{
+    constant(intern(expr.value));
+}
+
+void closure_compiler::visit(const unary_expression& expr)
+{
+    if (expr.op == token_type::exclamation) {
+        m_result = [right = lower(expr.right)](environment* env) -> const object*
+        {
+            const auto* val = right(env);
+            if (val->is_error()) {
+                return val;
+            }
+            return native_bool_to_object(!val->is_truthy());
+        };
+        return;
+    }
+    m_result = [right = lower(expr.right), oper = expr.op](environment* env) -> const object*
+    {
+        const auto* val = right(env);
+        if (val->is_error()) {
+            return val;
+        }
+        return evaluate_unary_operator(oper, val);
+    };
+}
+
+void closure_compiler::visit(const while_statement& expr)
+{
+    m_result = [condition = lower(expr.condition), body = lower(expr.body)](environment* env) -> const object*
+    {
+        while (true) {
+            if (heap::get().should_collect()) {
+                collect_evaluation_garbage(env, nullptr);
+            }
+            const auto* cond = condition(env);
+            if (cond->is_error()) {
+                return cond;
+            }
+            if (!cond->is_truthy()) {
+                break;
+            }
+            const auto* result = body(env);
+            if (result->is_error() || result->is_return_value()) {
+                return result;
+            }
+            if (result->is_break()) {
+                break;
+            }
+        }
+        return null();
+    };
+}
+}  // namespace
+
+auto lowered_program::run(environment* env) const -> const object*
+{
+    const root_scope scope;
+    keep_alive(env);
+    if (env->slots.size() < static_cast<std::size_t>(num_globals)) {
+        env->slots.resize(static_cast<std::size_t>(num_globals), nullptr);
+    }
+    const auto* result = null();
+    for (const auto& statement : statements) {
+        result = statement(env);
+        if (result->is_error()) {
+            return result;
+        }
+        if (result->is_return_value()) {
+            return result->as<return_value_object>()->return_value;
+        }
+        if (heap::get().should_collect()) {
+            collect_evaluation_garbage(env, result);
+        }
+    }
+    return result;
+}
+
+auto lower_program(const program* prgrm) -> std::shared_ptr<lowered_program>
+{
+    auto lowered = std::make_shared<lowered_program>();
+    lowered->tree = prgrm->nodes;
+    lowered->num_globals = prgrm->num_globals;
+    closure_compiler cmplr {lowered.get()};
+    prgrm->accept(cmplr);
+    return lowered;
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+auto run(std::string_view input, environment* env) -> const object*
+{
+    auto prsr = parser {lexer {input}};
+    auto prgrm = prsr.parse_program();
+    INFO("while parsing: `", input, "`");
+    REQUIRE(prsr.errors().empty());
+    analyze_program(prgrm.get(), nullptr, env);
+    return lower_program(prgrm.get())->run(env);
+}
+
+TEST_SUITE_BEGIN("closures");
+
+TEST_CASE("functionsKeepTheirProgramAlive")
+{
+    environment env;
+    run("let adder = fn(x) { fn(y) { x + y } }; let inc = adder(1);", &env);
+    // the first program and its lowered form are only referenced by the function objects
+    const auto* result = run("inc(41)", &env);
+    REQUIRE(result->is(object::object_type::integer));
+    CHECK_EQ(result->as<integer_object>()->value, 42);
+}
+
+TEST_CASE("loopsCollectGarbage")
+{
+    auto& hp = heap::get();
+    const auto collections = hp.collections();
+    environment env;
+    const auto* result = run(R"(
+        let f = fn(n) {
+            let i = 0;
+            let s = 0;
+            while (i < n) {
+                s = s + [i, i][1];
+                i = i + 1;
+            }
+            s
+        };
+        f(200000))",
+                             &env);
+    CHECK_GT(hp.collections(), collections);
+    REQUIRE(result->is(object::object_type::integer));
+    CHECK_EQ(result->as<integer_object>()->value, 19999900000);
+}
+
+TEST_SUITE_END();
+// NOLINTEND(*)
+}  // namespace
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include <ast/arena.hpp>
+#include <ast/program.hpp>
+#include <object/object.hpp>
+
+#include "environment.hpp"
+
+/// evaluates one node of a lowered program in the environment of the running scope
+using thunk = std::function<const object*(environment*)>;
+
+/// the body of a function literal, shared by all function objects created from it
+struct lowered_function final
+{
+    thunk body;
+};
+
+/// A program lowered to a tree of closures.
+///
+/// Every node of the analyzed tree becomes a closure specialized for its kind and the shape of its operands, the
+/// slots of its variables and its immortal literals are bound once when lowering. Running it is a direct call tree
+/// without dispatching over the node types. It evaluates like the evaluator: errors are values, and returning,
+/// breaking and continuing is signalled by the same objects.
+struct lowered_program final : std::enable_shared_from_this<lowered_program>
+{
+    /// runs the program in the global environment, which is grown to hold the globals of the program
+    auto run(environment* env) const -> const object*;
+
+    std::vector<thunk> statements;
+    /// the bodies of the function literals, function objects point to them and keep the program alive
+    std::deque<lowered_function> functions;
+    std::shared_ptr<const arena> tree;
+    int num_globals {};
+};
+
+/// lowers an analyzed program
+[[nodiscard]] auto lower_program(const program* prgrm) -> std::shared_ptr<lowered_program>;
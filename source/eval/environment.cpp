@@ -1,46 +1,52 @@
+#include <cstddef>
 #include <string>
 
 #include "environment.hpp"
 
 #include <fmt/base.h>
+#include <gc.hpp>
 #include <object/object.hpp>
 
-environment::environment(environment* outer_env)
-    : outer(outer_env)
+environment::environment(environment* outer_env, std::size_t size)
+    : slots(size, nullptr)
+    , outer(outer_env)
 {
 }
 
-auto environment::get(const std::string& name) const -> const object*
+auto environment::define(const std::string& name, int slot) -> void
 {
-    for (const auto* ptr = this; ptr != nullptr; ptr = ptr->outer) {
-        if (const auto itr = ptr->store.find(name); itr != ptr->store.end()) {
-            return itr->second;
-        }
+    const auto index = static_cast<std::size_t>(slot);
+    if (index >= slots.size()) {
+        slots.resize(index + 1, nullptr);
     }
-    return null();
-}
-
-auto environment::set(const std::string& name, const object* val) -> void
-{
-    store[name] = val;
-}
-
-auto environment::reassign(const std::string& name, const object* val) -> const object*
-{
-    if (const auto itr = store.find(name); itr == store.end() && outer != nullptr) {
-        return outer->reassign(name, val);
+    if (index >= names.size()) {
+        names.resize(index + 1);
     }
-    set(name, val);
-    return val;
+    names[index] = name;
 }
 
 auto environment::debug() const -> void
 {
-    for (const auto& [k, v] : store) {
-        fmt::print("[{}] = {}\n", k, v->inspect());
+    for (std::size_t idx = 0; idx < slots.size(); ++idx) {
+        if (slots[idx] == nullptr) {
+            continue;
+        }
+        if (idx < names.size() && !names[idx].empty()) {
+            fmt::print("[{}] = {}\n", names[idx], slots[idx]->inspect());
+        } else {
+            fmt::print("[{}] = {}\n", idx, slots[idx]->inspect());
+        }
     }
     if (outer != nullptr) {
         fmt::print("Outer:\n");
         outer->debug();
     }
 }
+
+auto environment::mark_references(heap& hp) const -> void
+{
+    for (const auto* val : slots) {
+        hp.mark(val);
+    }
+    hp.mark(outer);
+}
@@ -1,19 +1,48 @@
 #pragma once
 
-#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
 
 struct object;
+class heap;
 
+/// The values of the variables of one scope of the evaluator, the program or a call of a function.
+///
+/// The analyzer resolves every identifier to the number of scopes outwards of the one it is used in and the slot in
+/// the environment of that scope, so looking up a variable never compares names. Slots not assigned yet are null.
 struct environment final
 {
-    explicit environment(environment* outer_env = nullptr);
+    explicit environment(environment* outer_env = nullptr, std::size_t size = 0);
 
-    auto get(const std::string& name) const -> const object*;
-    auto set(const std::string& name, const object* val) -> void;
-    auto reassign(const std::string& name, const object* val) -> const object*;
+    [[nodiscard]] auto get(int depth, int slot) const -> const object*
+    {
+        const auto* env = this;
+        for (; depth > 0; --depth) {
+            env = env->outer;
+        }
+        return env->slots[static_cast<std::size_t>(slot)];
+    }
+
+    auto set(int depth, int slot, const object* val) -> void
+    {
+        auto* env = this;
+        for (; depth > 0; --depth) {
+            env = env->outer;
+        }
+        env->slots[static_cast<std::size_t>(slot)] = val;
+    }
+
+    /// names the slot of a global, so later programs evaluated in this environment resolve it
+    auto define(const std::string& name, int slot) -> void;
 
     void debug() const;
+    void mark_references(heap& hp) const;
 
-    std::unordered_map<std::string, const object*> store;
+    std::vector<const object*> slots;
+    /// the names of the slots of the global environment, empty for the environments of functions
+    std::vector<std::string> names;
     environment* outer {};
+    mutable std::uint32_t epoch {};
 };
@@ -1,6 +1,9 @@
+#include <algorithm>
 #include <cstddef>
 #include <cstdint>
 #include <deque>
+#include <memory>
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -9,6 +12,7 @@
 
 #include "evaluator.hpp"
 
+#include <analyzer/analyzer.hpp>
 #include <ast/array_literal.hpp>
 #include <ast/assign_expression.hpp>
 #include <ast/binary_expression.hpp>
@@ -36,7 +40,9 @@
 #include <overloaded.hpp>
 #include <parser/parser.hpp>
 
+#include "closure_compiler.hpp"
 #include "environment.hpp"
+#include "roots.hpp"
 
 evaluator::evaluator(environment* existing_env)
     : m_env {existing_env != nullptr ? existing_env : make<environment>()}
@@ -45,18 +51,26 @@ evaluator::evaluator(environment* existing_env)
 
 auto evaluator::evaluate(const program* prgrm) -> const object*
 {
+    const root_scope scope;
+    keep_alive(m_env);
+    if (m_env->slots.size() < static_cast<std::size_t>(prgrm->num_globals)) {
+        m_env->slots.resize(static_cast<std::size_t>(prgrm->num_globals), nullptr);
+    }
+    m_tree = prgrm->nodes;
     prgrm->accept(*this);
     return m_result;
 }
 
 void evaluator::visit(const array_literal& expr)
 {
+    const root_scope scope;
     array_object::value_type arr;
     for (const auto& element : expr.elements) {
         element->accept(*this);
         if (m_result->is_error()) {
             return;
         }
+        keep_alive(m_result);
         arr.push_back(m_result);
     }
     m_result = make<array_object>(std::move(arr));
@@ -68,11 +82,9 @@ void evaluator::visit(const assign_expression& expr)
     if (m_result->is_error()) {
         return;
     }
-    m_env->reassign(expr.name->value, m_result);
+    m_env->set(expr.name->depth, expr.name->slot, m_result);
 }
 
-namespace
-{
 auto apply_binary_operator(token_type oper, const object* left, const object* right) -> const object*
 {
     using enum token_type;
@@ -120,8 +132,6 @@ auto apply_binary_operator(token_type oper, const object* left, const object* ri
     }
 }
 
-}  // namespace
-
 void evaluator::visit(const binary_expression& expr)
 {
     expr.left->accept(*this);
@@ -129,22 +139,33 @@ void evaluator::visit(const binary_expression& expr)
         return;
     }
     const object* evaluated_left = m_result;
-    expr.right->accept(*this);
-    if (m_result->is_error()) {
+    // the right operand is only evaluated if the left one does not decide the result
+    if (expr.op == token_type::logical_and && !evaluated_left->is_truthy()) {
+        m_result = fals();
         return;
     }
-    const object* evaluated_right = m_result;
-
-    if (const auto* val = apply_binary_operator(expr.op, evaluated_left, evaluated_right); val != nullptr) {
-        m_result = val;
+    if (expr.op == token_type::logical_or && evaluated_left->is_truthy()) {
+        m_result = tru();
         return;
     }
-    if (evaluated_left->type() != evaluated_right->type()) {
-        m_result = make_error("type mismatch: {} {} {}", evaluated_left->type(), expr.op, evaluated_right->type());
+    const root_scope scope;
+    keep_alive(evaluated_left);
+    expr.right->accept(*this);
+    if (m_result->is_error()) {
         return;
     }
+    m_result = evaluate_binary_operator(expr.op, evaluated_left, m_result);
+}
 
-    m_result = make_error("unknown operator: {} {} {}", evaluated_left->type(), expr.op, evaluated_right->type());
+auto evaluate_binary_operator(token_type oper, const object* left, const object* right) -> const object*
+{
+    if (const auto* val = apply_binary_operator(oper, left, right); val != nullptr) {
+        return val;
+    }
+    if (left->type() != right->type()) {
+        return make_error("type mismatch: {} {} {}", left->type(), oper, right->type());
+    }
+    return make_error("unknown operator: {} {} {}", left->type(), oper, right->type());
 }
 
 void evaluator::visit(const boolean_literal& expr)
@@ -154,6 +175,7 @@ void evaluator::visit(const boolean_literal& expr)
 
 void evaluator::visit(const hash_literal& expr)
 {
+    const root_scope scope;
     hash_object::value_type result;
     for (const auto& [key, value] : expr.pairs) {
         key->accept(*this);
@@ -165,11 +187,13 @@ void evaluator::visit(const hash_literal& expr)
             m_result = make_error("unusable as hash key {}", eval_key->type());
             return;
         }
+        keep_alive(eval_key);
         value->accept(*this);
         const auto* eval_val = m_result;
         if (eval_val->is_error()) {
             return;
         }
+        keep_alive(eval_val);
         result.insert({eval_key->as<hashable>()->hash_key(), eval_val});
     }
     m_result = make<hash_object>(std::move(result));
@@ -177,8 +201,12 @@ void evaluator::visit(const hash_literal& expr)
 
 void evaluator::visit(const identifier& expr)
 {
-    const auto* val = m_env->get(expr.value);
-    if (val->is_null()) {
+    if (expr.depth == identifier::builtin) {
+        m_result = builtin::builtin_objects()[static_cast<std::size_t>(expr.slot)];
+        return;
+    }
+    const auto* val = expr.depth != identifier::unresolved ? m_env->get(expr.depth, expr.slot) : nullptr;
+    if (val == nullptr || val->is_null()) {
         m_result = make_error("identifier not found: {}", expr.value);
         return;
     }
@@ -206,6 +234,9 @@ void evaluator::visit(const if_expression& expr)
 void evaluator::visit(const while_statement& expr)
 {
     while (true) {
+        if (heap::get().should_collect()) {
+            collect_garbage();
+        }
         expr.condition->accept(*this);
         const auto* evaluated_condition = m_result;
         if (evaluated_condition->is_error()) {
@@ -237,51 +268,51 @@ void evaluator::visit(const index_expression& expr)
     if (evaluated_left->is_error()) {
         return;
     }
+    const root_scope scope;
+    keep_alive(evaluated_left);
     expr.index->accept(*this);
     const auto* evaluated_index = m_result;
     if (evaluated_index->is_error()) {
         return;
     }
+    m_result = evaluate_index(evaluated_left, evaluated_index);
+}
+
+auto evaluate_index(const object* left, const object* index_obj) -> const object*
+{
     using enum object::object_type;
-    if (evaluated_left->is(array) && evaluated_index->is(integer)) {
-        const auto& arr = evaluated_left->as<array_object>()->value;
-        auto index = evaluated_index->as<integer_object>()->value;
+    if (left->is(array) && index_obj->is(integer)) {
+        const auto& arr = left->as<array_object>()->value;
+        auto index = index_obj->as<integer_object>()->value;
         auto max = static_cast<int64_t>(arr.size() - 1);
         if (index < 0 || index > max) {
-            m_result = null();
-            return;
+            return null();
         }
-        m_result = arr[static_cast<std::size_t>(index)];
-        return;
+        return arr[static_cast<std::size_t>(index)];
     }
 
-    if (evaluated_left->is(string) && evaluated_index->is(integer)) {
-        const auto& str = evaluated_left->as<string_object>()->value;
-        auto index = evaluated_index->as<integer_object>()->value;
+    if (left->is(string) && index_obj->is(integer)) {
+        const auto str = left->as<string_object>()->value();
+        auto index = index_obj->as<integer_object>()->value;
         auto max = static_cast<int64_t>(str.size() - 1);
         if (index < 0 || index > max) {
-            m_result = null();
-            return;
+            return null();
         }
-        m_result = make<string_object>(str.substr(static_cast<std::size_t>(index), 1));
-        return;
+        return single_character(str[static_cast<std::size_t>(index)]);
     }
 
-    if (evaluated_left->is(hash)) {
-        const auto& hsh = evaluated_left->as<hash_object>()->value;
-        if (!evaluated_index->is_hashable()) {
-            m_result = make_error("unusable as hash key: {}", evaluated_index->type());
-            return;
+    if (left->is(hash)) {
+        const auto& hsh = left->as<hash_object>()->value;
+        if (!index_obj->is_hashable()) {
+            return make_error("unusable as hash key: {}", index_obj->type());
         }
-        const auto hash_key = evaluated_index->as<hashable>()->hash_key();
+        const auto hash_key = index_obj->as<hashable>()->hash_key();
         if (const auto itr = hsh.find(hash_key); itr != hsh.end()) {
-            m_result = itr->second;
-            return;
+            return itr->second;
         }
-        m_result = null();
-        return;
+        return null();
     }
-    m_result = make_error("index operator not supported: {}", evaluated_left->type());
+    return make_error("index operator not supported: {}", left->type());
 }
 
 void evaluator::visit(const integer_literal& expr)
@@ -305,16 +336,24 @@ void evaluator::visit(const program& expr)
             m_result = m_result->as<return_value_object>()->return_value;
             return;
         }
+        if (heap::get().should_collect()) {
+            collect_garbage();
+        }
     }
 }
 
+void evaluator::collect_garbage()
+{
+    collect_evaluation_garbage(m_env, m_result);
+}
+
 void evaluator::visit(const let_statement& expr)
 {
     expr.value->accept(*this);
     if (m_result->is_error()) {
         return;
     }
-    m_env->set(expr.name->value, m_result);
+    m_env->set(0, expr.name->slot, m_result);
     m_result = null();
 }
 
@@ -368,34 +407,34 @@ void evaluator::visit(const block_statement& expr)
 
 void evaluator::visit(const string_literal& expr)
 {
-    m_result = make<string_object>(expr.value);
+    m_result = intern(expr.value);
 }
 
 void evaluator::visit(const unary_expression& expr)
 {
     expr.right->accept(*this);
-    const auto* evaluated_value = m_result;
-    if (evaluated_value->is_error()) {
+    if (m_result->is_error()) {
         return;
     }
+    m_result = evaluate_unary_operator(expr.op, m_result);
+}
+
+auto evaluate_unary_operator(token_type oper, const object* operand) -> const object*
+{
     using enum token_type;
-    switch (expr.op) {
+    switch (oper) {
         case minus:
-            if (evaluated_value->is(object::object_type::integer)) {
-                m_result = make<integer_object>(-evaluated_value->as<integer_object>()->value);
-                return;
-            } else if (evaluated_value->is(object::object_type::decimal)) {
-                m_result = make<decimal_object>(-evaluated_value->as<decimal_object>()->value);
-                return;
+            if (operand->is(object::object_type::integer)) {
+                return make<integer_object>(-operand->as<integer_object>()->value);
             }
-            m_result = make_error("unknown operator: -{}", evaluated_value->type());
-            return;
+            if (operand->is(object::object_type::decimal)) {
+                return make<decimal_object>(-operand->as<decimal_object>()->value);
+            }
+            return make_error("unknown operator: -{}", operand->type());
         case exclamation:
-            m_result = native_bool_to_object(!evaluated_value->is_truthy());
-            return;
+            return native_bool_to_object(!operand->is_truthy());
         default:
-            m_result = make_error("unknown operator: {}{}", expr.op, evaluated_value->type());
-            return;
+            return make_error("unknown operator: {}{}", oper, operand->type());
     }
 }
 
@@ -406,6 +445,8 @@ void evaluator::visit(const call_expression& expr)
         return;
     }
     const auto* func = m_result;
+    const root_scope scope;
+    keep_alive(func);
     auto args = evaluate_expressions(expr.arguments);
     if (m_result->is_error()) {
         return;
@@ -415,19 +456,20 @@ void evaluator::visit(const call_expression& expr)
 
 void evaluator::visit(const function_literal& expr)
 {
-    m_result = make<function_object>(expr.parameters, expr.body, m_env);
+    m_result = make<function_object>(expr.parameters, expr.body, expr.num_locals, m_env, m_tree);
 }
 
-void evaluator::apply_function(const object* function_or_builtin, array_object::value_type&& args)
+void evaluator::apply_function(const object* function_or_builtin, std::vector<const object*>&& args)
 {
     if (function_or_builtin->is(object::object_type::function)) {
         const auto* func = function_or_builtin->as<function_object>();
-        auto* locals = make<environment>(func->closure_env);
-        for (auto arg_itr = args.begin(); const auto* parameter : func->parameters) {
-            locals->set(parameter->value, *(arg_itr++));
-        }
+        auto* locals = make<environment>(func->closure_env, static_cast<std::size_t>(func->num_locals));
+        std::copy_n(args.begin(), std::min(args.size(), func->parameters.size()), locals->slots.begin());
+        const root_scope scope;
+        keep_alive(locals);
         {
             evaluator local(locals);
+            local.m_tree = func->tree;
             func->body->accept(local);
             m_result = local.m_result;
         }
@@ -438,20 +480,21 @@ void evaluator::apply_function(const object* function_or_builtin, array_object::
     }
     if (function_or_builtin->is(object::object_type::builtin)) {
         const auto* builtin = function_or_builtin->as<builtin_object>();
-        m_result = builtin->builtin->body(std::move(args));
+        m_result = builtin->builtin->body(args);
         return;
     }
     m_result = make_error("calling a value of type {} is not supported", function_or_builtin->type());
 }
 
-auto evaluator::evaluate_expressions(const expressions& exprs) -> array_object::value_type
+auto evaluator::evaluate_expressions(const expressions& exprs) -> std::vector<const object*>
 {
-    array_object::value_type result;
+    std::vector<const object*> result;
     for (const auto* expr : exprs) {
         expr->accept(*this);
         if (m_result->is_error()) {
             return {m_result};
         }
+        keep_alive(m_result);
         result.push_back(m_result);
     }
     return result;
@@ -492,7 +535,7 @@ auto require_eq(const object* obj, const std::string& expected, std::string_view
 {
     INFO(input, " expected: string with: ", expected, " got: ", obj->type(), " with: ", obj->inspect());
     REQUIRE(obj->is(object::object_type::string));
-    const auto& actual = obj->as<string_object>()->value;
+    const auto actual = obj->as<string_object>()->value();
     REQUIRE(actual == expected);
 }
 
@@ -514,7 +557,7 @@ auto require_array_eq(const object* obj, const array& expected, std::string_view
         std::visit(
             overloaded {
                 [&](const int64_t exp) { REQUIRE_EQ(exp, actual[idx]->as<integer_object>()->value); },
-                [&](const std::string& exp) { REQUIRE_EQ(exp, actual[idx]->as<string_object>()->value); },
+                [&](const std::string& exp) { REQUIRE_EQ(exp, actual[idx]->as<string_object>()->value()); },
             },
             expected_elem);
         ++idx;
@@ -528,8 +571,9 @@ auto require_hash_eq(const object* obj, const hash& expected, std::string_view i
     const auto& actual = obj->as<hash_object>()->value;
     REQUIRE(actual.size() == expected.size());
     for (const auto& [expected_key, expected_value] : expected) {
-        REQUIRE(actual.contains(expected_key));
-        auto val = actual.at(expected_key);
+        const hashable::key_type key {expected_key};
+        REQUIRE(actual.contains(key));
+        auto val = actual.at(key);
         require_eq(val, expected_value, input);
     }
 }
@@ -549,7 +593,7 @@ auto check_no_parse_errors(const parser& prsr) -> bool
     return prsr.errors().empty();
 }
 
-using parsed_program = std::pair<program*, parser>;
+using parsed_program = std::pair<std::unique_ptr<program>, parser>;
 
 auto check_program(std::string_view input) -> parsed_program
 {
@@ -557,30 +601,46 @@ auto check_program(std::string_view input) -> parsed_program
     auto prgrm = prsr.parse_program();
     INFO("while parsing: `", input, "`");
     CHECK(check_no_parse_errors(prsr));
-    return {prgrm, std::move(prsr)};
+    return {std::move(prgrm), std::move(prsr)};
 }
 
 auto run(std::string_view input) -> const object*
 {
     auto [prgrm, _] = check_program(input);
     environment env;
-    for (const auto& builtin : builtin::builtins()) {
-        env.set(builtin->name, make<builtin_object>(builtin));
-    }
+    analyze_program(prgrm.get(), nullptr, &env);
     evaluator ev(&env);
-    auto result = ev.evaluate(prgrm);
+    auto result = ev.evaluate(prgrm.get());
     REQUIRE(result);
+
+    // every program has to give the same result when lowered to closures
+    const root_scope scope;
+    keep_alive(result);
+    environment lowered_env;
+    const auto* lowered = lower_program(prgrm.get())->run(&lowered_env);
+    INFO("lowered to closures: ", input);
+    REQUIRE_EQ(lowered->type(), result->type());
+    REQUIRE_EQ(lowered->inspect(), result->inspect());
     return result;
 }
 
 auto run_multi(std::deque<std::string>& inputs) -> const object*
 {
     environment env;
+    environment lowered_env;
     const object* result = nullptr;
     while (!inputs.empty()) {
         auto [prgrm, _] = check_program(inputs.front());
+        analyze_program(prgrm.get(), nullptr, &env);
         evaluator ev {&env};
-        result = ev.evaluate(prgrm);
+        result = ev.evaluate(prgrm.get());
+
+        const root_scope scope;
+        keep_alive(result);
+        analyze_program(prgrm.get(), nullptr, &lowered_env);
+        const auto* lowered = lower_program(prgrm.get())->run(&lowered_env);
+        INFO("lowered to closures: ", inputs.front());
+        REQUIRE_EQ(lowered->inspect(), result->inspect());
         inputs.pop_front();
     }
     return result;
@@ -793,6 +853,27 @@ TEST_CASE("booleanExpression")
     }
 }
 
+TEST_CASE("shortCircuitOperators")
+{
+    struct et
+    {
+        std::string_view input;
+        int64_t expected;
+    };
+
+    std::array tests {
+        et {"let n = 0; let f = fn(x) { n = n + 1; x }; false && f(true); true || f(true); n", 0},
+        et {"let n = 0; let f = fn(x) { n = n + 1; x }; true && f(false); false || f(true); n", 2},
+        et {"let n = 0; let f = fn(x) { n = n + 1; x }; let i = 0; "
+            "while ((i < 10) && ((i < 5) || f(true))) { i = i + 1; } n",
+            5},
+    };
+    for (const auto& [input, expected] : tests) {
+        const auto evaluated = run(input);
+        require_eq(evaluated, expected, input);
+    }
+}
+
 TEST_CASE("stringExpression")
 {
     const auto* input = R"("Hello World!")";
@@ -907,6 +988,7 @@ TEST_CASE("whileStatements")
     std::array tests {
         et {R"(let x = 1; while (false) { x = x + 1; } x)", 1},
         et {R"(let x = 1; let y = 1; while (y > 0) { y = y - 1; x = x + 1; } x)", 2},
+        et {R"(let x = 1; let y = 1; while (y > 0) { y = y - 1; let x = 5; } x)", 1},
         et {R"(let a = 6;
                           let b = a;
                           let x = 1;
@@ -1012,10 +1094,6 @@ return 1;
    )r",
             "type mismatch: boolean + string",
         },
-        et {
-            "foobar",
-            "identifier not found: foobar",
-        },
         et {
             R"("Hello" - "World")",
             "unknown operator: string - string",
@@ -1030,6 +1108,8 @@ return 1;
         const auto evaluated = run(input);
         require_error_eq(evaluated, expected, input);
     }
+    // identifiers are resolved before evaluating
+    CHECK_THROWS_WITH_AS(run("foobar"), "<stdin>:1:1: identifier not found: foobar", std::runtime_error);
 }
 
 TEST_CASE("integerLetStatements")
@@ -1091,6 +1171,16 @@ TEST_CASE("multipleEvaluationsWithSameEnvAndDestroyedSources")
     require_eq(run_multi(inputs), std::string("hello banana!"), fmt::format("{}", fmt::join(inputs, "\n")));
 }
 
+TEST_CASE("laterProgramsDoNotReuseTheSlotsOfLoopVariables")
+{
+    std::deque<std::string> inputs {
+        "let fs = []; let i = 0; while (i < 1) { let j = 42; fs = push(fs, fn() { j }); i = i + 1; }",
+        "let zz = 7;",
+        "fs[0]()",
+    };
+    require_eq(run_multi(inputs), int64_t {42}, "a global defined after a loop");
+}
+
 TEST_CASE("builtinFunctions")
 {
     struct bt
@@ -1300,9 +1390,9 @@ TEST_CASE("hashLiterals")
     };
 
     std::array expected {
-        expect {"one", 1},
-        expect {"two", 2},
-        expect {"twelve", 12},
+        expect {hashable::key_type {"one"}, 1},
+        expect {hashable::key_type {"two"}, 2},
+        expect {hashable::key_type {"twelve"}, 12},
         expect {4, 4},
         expect {true, 5},
         expect {false, 6},
@@ -1,8 +1,11 @@
 #pragma once
 
+#include <memory>
+
 #include <ast/expression.hpp>
 #include <ast/program.hpp>
 #include <ast/visitor.hpp>
+#include <lexer/token_type.hpp>
 #include <object/object.hpp>
 
 #include "environment.hpp"
@@ -38,8 +41,22 @@ struct evaluator final : visitor
     void visit(const while_statement& expr) final;
 
   private:
-    void apply_function(const object* function_or_builtin, array_object::value_type&& args);
-    auto evaluate_expressions(const expressions& exprs) -> array_object::value_type;
+    void apply_function(const object* function_or_builtin, std::vector<const object*>&& args);
+    auto evaluate_expressions(const expressions& exprs) -> std::vector<const object*>;
+    void collect_garbage();
     environment* m_env {};
     const object* m_result {};
+    // the arena of the nodes being evaluated, shared with the function objects created from them
+    std::shared_ptr<const arena> m_tree;
 };
+
+/// applies the operator of a binary expression to its evaluated operands, returns nullptr if the types do not support
+/// it
+auto apply_binary_operator(token_type oper, const object* left, const object* right) -> const object*;
+/// applies the operator of a binary expression to its evaluated operands, returns an error if the types do not support
+/// it
+auto evaluate_binary_operator(token_type oper, const object* left, const object* right) -> const object*;
+/// applies a prefix operator to its evaluated operand
+auto evaluate_unary_operator(token_type oper, const object* operand) -> const object*;
+/// looks up an element of an array, a character of a string or a value of a hash
+auto evaluate_index(const object* left, const object* index_obj) -> const object*;
@@ -0,0 +1,48 @@
+#include "roots.hpp"
+
+#include <gc.hpp>
+
+#include "environment.hpp"
+
+auto roots() -> evaluation_roots&
+{
+    static evaluation_roots evaluation;
+    return evaluation;
+}
+
+void keep_alive(const object* obj)
+{
+    roots().objects.push_back(obj);
+}
+
+void keep_alive(const environment* env)
+{
+    roots().environments.push_back(env);
+}
+
+void collect_evaluation_garbage(const environment* env, const object* result)
+{
+    auto& hp = heap::get();
+    hp.begin_collection();
+    hp.mark(env);
+    hp.mark(result);
+    for (const auto* obj : roots().objects) {
+        hp.mark(obj);
+    }
+    for (const auto* root : roots().environments) {
+        hp.mark(root);
+    }
+    hp.collect();
+}
+
+root_scope::root_scope()
+    : m_objects {roots().objects.size()}
+    , m_environments {roots().environments.size()}
+{
+}
+
+root_scope::~root_scope()
+{
+    roots().objects.resize(m_objects);
+    roots().environments.resize(m_environments);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+struct object;
+struct environment;
+
+/// Objects and environments of a running evaluation, which are only referenced from the C++ stack.
+///
+/// The tree walking engines push every intermediate result that has to survive the evaluation of a sibling node,
+/// a collection started in between marks them together with the environment of the running scope.
+struct evaluation_roots
+{
+    std::vector<const object*> objects;
+    std::vector<const environment*> environments;
+};
+
+auto roots() -> evaluation_roots&;
+void keep_alive(const object* obj);
+void keep_alive(const environment* env);
+
+/// marks the environment, the result and all roots, then collects everything else
+void collect_evaluation_garbage(const environment* env, const object* result);
+
+/// releases everything kept alive during its lifetime
+class root_scope final
+{
+  public:
+    root_scope();
+    ~root_scope();
+
+    root_scope(const root_scope&) = delete;
+    root_scope(root_scope&&) = delete;
+    auto operator=(const root_scope&) -> root_scope& = delete;
+    auto operator=(root_scope&&) -> root_scope& = delete;
+
+  private:
+    std::size_t m_objects;
+    std::size_t m_environments;
+};
@@ -0,0 +1,263 @@
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "gc.hpp"
+
+#include <ast/program.hpp>
+#include <compiler/compiler.hpp>
+#include <doctest/doctest.h>
+#include <eval/environment.hpp>
+#include <eval/evaluator.hpp>
+#include <lexer/lexer.hpp>
+#include <object/object.hpp>
+#include <object/value.hpp>
+#include <parser/parser.hpp>
+#include <vm/vm.hpp>
+
+heap::~heap()
+{
+    for (auto* obj : m_objects) {
+        delete obj;
+    }
+    for (auto* env : m_environments) {
+        delete env;
+    }
+}
+
+auto heap::track(object* obj) -> void
+{
+    m_objects.push_back(obj);
+    m_allocated_since_collect++;
+    m_total_allocations++;
+}
+
+auto heap::track(environment* env) -> void
+{
+    m_environments.push_back(env);
+    m_allocated_since_collect++;
+    m_total_allocations++;
+}
+
+auto heap::begin_collection() -> void
+{
+    m_epoch++;
+    m_gray_objects.clear();
+    m_gray_environments.clear();
+}
+
+auto heap::mark(const object* obj) -> void
+{
+    if (obj == nullptr || obj->epoch == m_epoch) {
+        return;
+    }
+    obj->epoch = m_epoch;
+    m_gray_objects.push_back(obj);
+}
+
+auto heap::mark(const environment* env) -> void
+{
+    if (env == nullptr || env->epoch == m_epoch) {
+        return;
+    }
+    env->epoch = m_epoch;
+    m_gray_environments.push_back(env);
+}
+
+auto heap::mark(const value& val) -> void
+{
+    if (val.is_object()) {
+        mark(val.as_object());
+    }
+}
+
+auto heap::is_marked(const object* obj) const -> bool
+{
+    return obj->epoch == m_epoch;
+}
+
+auto heap::collect() -> void
+{
+    while (!m_gray_objects.empty() || !m_gray_environments.empty()) {
+        while (!m_gray_objects.empty()) {
+            const auto* obj = m_gray_objects.back();
+            m_gray_objects.pop_back();
+            obj->mark_references(*this);
+        }
+        while (!m_gray_environments.empty()) {
+            const auto* env = m_gray_environments.back();
+            m_gray_environments.pop_back();
+            env->mark_references(*this);
+        }
+    }
+    sweep_interned(*this);
+    // the sweep only marks interned strings, which refer to nothing but themselves
+    m_gray_objects.clear();
+
+    std::erase_if(m_objects,
+                  [epoch = m_epoch](const object* obj)
+                  {
+                      if (obj->epoch == epoch) {
+                          return false;
+                      }
+                      delete obj;
+                      return true;
+                  });
+    std::erase_if(m_environments,
+                  [epoch = m_epoch](const environment* env)
+                  {
+                      if (env->epoch == epoch) {
+                          return false;
+                      }
+                      delete env;
+                      return true;
+                  });
+
+    m_allocated_since_collect = 0;
+    m_threshold = std::max(initial_threshold, 2 * (m_objects.size() + m_environments.size()));
+    m_collections++;
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+TEST_SUITE_BEGIN("gc");
+
+TEST_CASE("unreachableObjectsAreCollected")
+{
+    auto& hp = heap::get();
+    // literals interned by earlier tests may be owned by the heap and survive every collection
+    hp.begin_collection();
+    hp.collect();
+    const auto survivors = hp.live_objects();
+    // outside of the preallocated small integers, so these are tracked by the heap
+    const auto* arr =
+        make<array_object>(array_object::value_type {make<integer_object>(100001), make<integer_object>(100002)});
+    make<integer_object>(100003);
+    make<environment>();
+
+    hp.begin_collection();
+    hp.mark(arr);
+    hp.collect();
+
+    CHECK(hp.is_marked(arr));
+    CHECK(hp.is_marked(arr->value[0]));
+    CHECK(hp.is_marked(arr->value[1]));
+    CHECK_EQ(hp.live_objects(), survivors + 3);
+}
+
+TEST_CASE("closuresKeepTheirFreeVariablesAlive")
+{
+    auto& hp = heap::get();
+    const auto* fn = make<compiled_function_object>(instructions {}, 0, 0);
+    const auto* free = make<string_object>("free");
+    const auto* clsr = make<closure_object>(fn, values {value::from(free)});
+
+    hp.begin_collection();
+    hp.mark(clsr);
+    hp.collect();
+
+    CHECK(hp.is_marked(fn));
+    CHECK(hp.is_marked(free));
+}
+
+TEST_CASE("functionsKeepTheirEnvironmentAlive")
+{
+    auto& hp = heap::get();
+    auto* env = make<environment>(nullptr, 1);
+    const auto* val = make<integer_object>(42);
+    env->set(0, 0, val);
+    const auto* func = make<function_object>(std::vector<const identifier*> {}, nullptr, 0, env, nullptr);
+
+    hp.begin_collection();
+    hp.mark(func);
+    hp.collect();
+
+    CHECK(hp.is_marked(val));
+    CHECK_EQ(env->get(0, 0), val);
+}
+
+TEST_CASE("vmCollectsGarbageOfLongRunningLoops")
+{
+    auto& hp = heap::get();
+    auto prsr = parser {lexer {R"(
+        let i = 0;
+        let s = 0;
+        while (i < 200000) {
+            s = s + [i, i][1];
+            i = i + 1;
+        }
+        s)"}};
+    auto prgrm = prsr.parse_program();
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    auto mchn = vm::create(cmplr.byte_code());
+    const auto collections = hp.collections();
+    mchn.run();
+
+    CHECK_GT(hp.collections(), collections);
+    CHECK_LT(hp.live_objects(), 8 * heap::initial_threshold);
+    CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 19999900000);
+}
+
+TEST_CASE("stringsInternedAtRuntimeAreCollected")
+{
+    auto prsr = parser {lexer {R"(
+        let digits = ["0", "1", "2", "3", "4", "5", "6", "7", "8", "9"];
+        let numbers = [];
+        let high = 0;
+        while (high < 10) {
+            let low = 0;
+            while (low < 10) {
+                numbers = push(numbers, digits[high] + digits[low]);
+                low = low + 1;
+            }
+            high = high + 1;
+        }
+        let s = 0;
+        let i = 0;
+        while (i < 100) {
+            let j = 0;
+            while (j < 10) {
+                let k = 0;
+                while (k < 100) {
+                    let key = numbers[i] + digits[j] + numbers[k];
+                    s = s + {key: 1}[key];
+                    k = k + 1;
+                }
+                j = j + 1;
+            }
+            i = i + 1;
+        }
+        s)"}};
+    auto prgrm = prsr.parse_program();
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    auto mchn = vm::create(cmplr.byte_code());
+    const auto interned = interned_count();
+    mchn.run();
+
+    CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 100000);
+    // only the keys built since the last collection are left of the 100000
+    CHECK_LT(interned_count(), interned + 10000);
+}
+
+TEST_CASE("literalsInternedAtRuntimeFirstSurviveCollections")
+{
+    auto& hp = heap::get();
+    const auto* runtime = make<string_object>("interned at runtime first");
+    const auto* copy = runtime->hash_key().as_string();
+    const auto* literal = intern("interned at runtime first");
+    CHECK_EQ(literal, copy);
+
+    hp.begin_collection();
+    hp.collect();
+
+    CHECK(hp.is_marked(literal));
+    CHECK_EQ(intern("interned at runtime first"), literal);
+    CHECK_EQ(literal->value(), "interned at runtime first");
+}
+
+TEST_SUITE_END();
+// NOLINTEND(*)
+}  // namespace
@@ -2,6 +2,7 @@
 
 #include <concepts>
 #include <cstddef>
+#include <cstdint>
 #include <cstdlib>
 #include <utility>
 #include <vector>
@@ -27,13 +28,8 @@ class gc
         static store allocations;
         static const bool registered = []()
         {
-            if constexpr (std::is_same_v<T, struct object>) {
-                constexpr auto object_reserve = static_cast<const size_t>(64 * 1024 * 1024);
-                allocations.reserve(object_reserve);
-            } else {
-                constexpr auto reserve = static_cast<const size_t>(128);
-                allocations.reserve(reserve);
-            }
+            constexpr std::size_t reserve = 128;
+            allocations.reserve(reserve);
             return std::atexit(cleanup);
         }();
         (void)registered;
@@ -41,21 +37,77 @@ class gc
     }
 };
 
+/// Mark and sweep collector for runtime objects and the environments of the evaluator.
+///
+/// Marking uses an epoch counter instead of a mark bit, so objects that are not owned by the heap, like the
+/// static singletons or objects living on the C++ stack, can be traced without ever having to be unmarked.
+/// A collection is only started by an engine at a safe point, after it marked all of its roots.
+class heap final
+{
+  public:
+    static constexpr std::size_t initial_threshold = 64UL * 1024UL;
+
+    static auto get() -> heap&
+    {
+        static heap instance;
+        return instance;
+    }
+
+    heap(const heap&) = delete;
+    heap(heap&&) = delete;
+    auto operator=(const heap&) -> heap& = delete;
+    auto operator=(heap&&) -> heap& = delete;
+    ~heap();
+
+    auto track(struct object* obj) -> void;
+    auto track(struct environment* env) -> void;
+
+    [[nodiscard]] auto should_collect() const -> bool { return m_allocated_since_collect >= m_threshold; }
+
+    /// starts a new collection cycle, the caller is expected to mark its roots before calling collect()
+    auto begin_collection() -> void;
+    auto mark(const struct object* obj) -> void;
+    auto mark(const struct environment* env) -> void;
+    auto mark(const class value& val) -> void;
+    /// traces everything reachable from the marked roots and deletes the rest
+    auto collect() -> void;
+
+    [[nodiscard]] auto is_marked(const struct object* obj) const -> bool;
+    [[nodiscard]] auto live_objects() const -> std::size_t { return m_objects.size(); }
+
+    [[nodiscard]] auto total_allocations() const -> std::size_t { return m_total_allocations; }
+
+    [[nodiscard]] auto collections() const -> std::size_t { return m_collections; }
+
+  private:
+    heap() = default;
+
+    std::vector<struct object*> m_objects;
+    std::vector<struct environment*> m_environments;
+    std::vector<const struct object*> m_gray_objects;
+    std::vector<const struct environment*> m_gray_environments;
+    std::uint32_t m_epoch {0};
+    std::size_t m_allocated_since_collect {0};
+    std::size_t m_threshold {initial_threshold};
+    std::size_t m_total_allocations {0};
+    std::size_t m_collections {0};
+};
+
 template<typename T, typename... Args>
     requires std::derived_from<T, struct object>
 auto make(Args&&... args) -> T*
 {
     T* p = new T(std::forward<Args>(args)...);
-    gc<object>::track(p);
+    heap::get().track(p);
     return p;
 }
 
 template<typename T, typename... Args>
-    requires std::derived_from<T, struct expression>
+    requires std::same_as<T, struct environment>
 auto make(Args&&... args) -> T*
 {
     T* p = new T(std::forward<Args>(args)...);
-    gc<expression>::track(p);
+    heap::get().track(p);
     return p;
 }
 
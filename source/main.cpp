@@ -13,8 +13,12 @@
 #include <analyzer/analyzer.hpp>
 #include <builtin/builtin.hpp>
 #include <code/code.hpp>
+#include <code/register_code.hpp>
+#include <compiler/bytecode_cache.hpp>
 #include <compiler/compiler.hpp>
+#include <compiler/register_compiler.hpp>
 #include <compiler/symbol_table.hpp>
+#include <eval/closure_compiler.hpp>
 #include <eval/environment.hpp>
 #include <eval/evaluator.hpp>
 #include <fmt/base.h>
@@ -22,7 +26,11 @@
 #include <gc.hpp>
 #include <lexer/lexer.hpp>
 #include <object/object.hpp>
+#include <optimizer/optimizer.hpp>
 #include <parser/parser.hpp>
+#include <vm/jit.hpp>
+#include <vm/profiler.hpp>
+#include <vm/register_vm.hpp>
 #include <vm/vm.hpp>
 
 namespace
@@ -77,6 +85,8 @@ enum class engine : std::uint8_t
 {
     vm,
     eval,
+    registers,
+    closures,
 };
 
 auto operator<<(std::ostream& strm, engine en) -> std::ostream&
@@ -86,6 +96,10 @@ auto operator<<(std::ostream& strm, engine en) -> std::ostream&
             return strm << "vm";
         case engine::eval:
             return strm << "eval";
+        case engine::registers:
+            return strm << "register vm";
+        case engine::closures:
+            return strm << "closures";
     }
     return strm << "unknown";
 }
@@ -94,6 +108,8 @@ struct command_line_args
 {
     bool help {};
     bool debug {};
+    bool profile {};
+    bool jit {};
     engine mode {};
     std::string_view file;
 };
@@ -128,7 +144,7 @@ auto get_build_type() -> std::string
         fmt::print("Error: {}\n", error_msg);
         exit_code = EXIT_FAILURE;
     }
-    fmt::print("Usage: {} [-d] [-i] [-h] [<file>]\n\n", program);
+    fmt::print("Usage: {} [-d] [-p] [-i] [-r] [-c] [-j] [-h] [<file>]\n\n", program);
     // NOLINTBEGIN(concurrency-mt-unsafe)
     exit(exit_code);
     // NOLINTEND(concurrency-mt-unsafe)
@@ -146,12 +162,24 @@ auto parse_command_line(std::string_view program, int argc, char** argv) -> comm
                 case 'i':
                     opts.mode = engine::eval;
                     break;
+                case 'r':
+                    opts.mode = engine::registers;
+                    break;
+                case 'c':
+                    opts.mode = engine::closures;
+                    break;
                 case 'h':
                     opts.help = true;
                     break;
                 case 'd':
                     opts.debug = true;
                     break;
+                case 'p':
+                    opts.profile = true;
+                    break;
+                case 'j':
+                    opts.jit = true;
+                    break;
                 default: {
                     show_usage(program, fmt::format("invalid option {}", arg));
                 }
@@ -179,6 +207,74 @@ void debug_byte_code(const bytecode& byte_code, const symbol_table* symbols)
     symbols->debug();
 }
 
+auto write_profile(const profiler& prof, std::string_view file)
+{
+    prof.report(std::cerr);
+    const auto folded_file = std::string {file} + ".folded";
+    std::ofstream ofs(folded_file);
+    if (!ofs) {
+        std::cerr << "ERROR: could not write profile: " << folded_file << '\n';
+        return;
+    }
+    prof.write_folded_stacks(ofs);
+    std::cerr << "folded stacks written to " << folded_file << '\n';
+}
+
+auto run_byte_code(const bytecode& byte_code, const symbol_table* symbols, const command_line_args& opts) -> int
+{
+    if (opts.debug) {
+        debug_byte_code(byte_code, symbols);
+    }
+    auto machine = vm::create(byte_code);
+    profiler prof;
+    if (opts.profile) {
+        machine.attach(&prof);
+    }
+    const jit native {{.perf_map = true}};
+    if (opts.jit) {
+        if (!jit::supported()) {
+            std::cerr << "WARNING: the jit is not supported on this platform\n";
+        } else if (opts.profile) {
+            std::cerr << "WARNING: the jit is disabled while profiling\n";
+        }
+        machine.attach(&native);
+    }
+    machine.run();
+    const auto* result = machine.last_popped();
+    if (!result->is_null()) {
+        std::cout << result->inspect() << '\n';
+    }
+    if (opts.profile) {
+        write_profile(prof, opts.file);
+    }
+    return 0;
+}
+
+auto run_register_byte_code(const register_bytecode& byte_code, const command_line_args& opts) -> int
+{
+    if (opts.debug) {
+        std::cout << "Instructions: \n" << registers::to_string(byte_code.instrs);
+        std::cout << "Constants:\n";
+        for (auto idx = 0; const auto* constant : (*byte_code.consts)) {
+            std::cout << idx << ": " << constant->inspect() << '\n';
+            if (constant->is(object::object_type::compiled_function)) {
+                std::cout << registers::to_string(constant->as<compiled_function_object>()->instrs);
+            }
+            idx++;
+        }
+    }
+    if (opts.profile) {
+        std::cerr << "WARNING: profiling is only supported by the vm engine\n";
+    }
+    auto machine = register_vm::create(byte_code);
+    machine.run();
+    const auto* result = machine.last_popped();
+    if (!result->is_null()) {
+        std::cout << result->inspect() << '\n';
+    }
+    return 0;
+}
+
 auto run_file(const command_line_args& opts) -> int
 {
     std::ifstream ifs(std::string {opts.file});
@@ -187,39 +283,52 @@ auto run_file(const command_line_args& opts) -> int
         return 1;
     }
     const std::string contents {(std::istreambuf_iterator<char>(ifs)), (std::istreambuf_iterator<char>())};
+    const auto cache_file = cache_file_for(opts.file);
+    const auto source_hash = hash_source(contents);
+    if (opts.mode == engine::vm) {
+        if (const auto cached = load_cached_program(cache_file, source_hash); cached.has_value()) {
+            return run_byte_code(cached->code, cached->symbols, opts);
+        }
+    }
     auto lxr = lexer {contents, opts.file};
     auto prsr = parser {lxr};
-    auto* prgrm = prsr.parse_program();
+    auto prgrm = prsr.parse_program();
     if (!prsr.errors().empty()) {
         print_parse_errors(prsr.errors());
         return 1;
     }
-    analyze_program(prgrm, nullptr, nullptr);
+    const auto evaluates = opts.mode == engine::eval || opts.mode == engine::closures;
+    auto* global_env = evaluates ? make<environment>() : nullptr;
+    analyze_program(prgrm.get(), nullptr, global_env);
+    if (opts.mode != engine::eval) {
+        optimize_program(prgrm.get());
+    }
     if (opts.mode == engine::vm) {
         auto cmplr = compiler::create();
-        cmplr.compile(prgrm);
-        if (opts.debug) {
-            debug_byte_code(cmplr.byte_code(), cmplr.all_symbols());
-        }
-        auto machine = vm::create(cmplr.byte_code());
-        machine.run();
-        const auto* result = machine.last_popped();
-        if (!result->is_null()) {
-            std::cout << result->inspect() << '\n';
-        }
+        cmplr.compile(prgrm.get());
+        // the byte code does not refer to the tree, so it is released before running
+        prgrm.reset();
+        save_cached_program(cache_file, source_hash, cmplr.byte_code(), cmplr.all_symbols());
+        return run_byte_code(cmplr.byte_code(), cmplr.all_symbols(), opts);
+    }
+    if (opts.mode == engine::registers) {
+        auto cmplr = register_compiler::create();
+        cmplr.compile(prgrm.get());
+        prgrm.reset();
+        return run_register_byte_code(cmplr.byte_code(), opts);
+    }
+    const object* result = nullptr;
+    if (opts.mode == engine::closures) {
+        result = lower_program(prgrm.get())->run(global_env);
     } else {
-        auto* global_env = make<environment>();
-        for (const auto& builtin : builtin::builtins()) {
-            global_env->set(builtin->name, make<builtin_object>(builtin));
-        }
         evaluator ev {global_env};
-        const auto* result = ev.evaluate(prgrm);
-        if (!result->is_null()) {
-            std::cout << result->inspect() << '\n';
-        }
-        if (opts.debug) {
-            global_env->debug();
-        }
+        result = ev.evaluate(prgrm.get());
+    }
+    if (!result->is_null()) {
+        std::cout << result->inspect() << '\n';
+    }
+    if (opts.debug) {
+        global_env->debug();
     }
     return 0;
 }
@@ -229,18 +338,16 @@ auto run_repl(const command_line_args& opts) -> int
     std::cout << "Cappuchin programming language using engine: " << opts.mode << ".\n";
     std::cout << get_build_type() << " built with " << get_compiler_identifier() << '\n';
     std::cout << "Feel free to type in commands\n";
-    auto* global_env = opts.mode == engine::eval ? make<environment>() : nullptr;
-    auto* symbols = opts.mode == engine::vm ? symbol_table::create() : nullptr;
+    const auto evaluates = opts.mode == engine::eval || opts.mode == engine::closures;
+    auto* global_env = evaluates ? make<environment>() : nullptr;
+    auto* symbols = !evaluates ? symbol_table::create() : nullptr;
     constants consts;
-    constants globals(globals_size);
-    for (auto idx = 0; const auto& builtin : builtin::builtins()) {
-        if (global_env != nullptr) {
-            global_env->set(builtin->name, make<builtin_object>(builtin));
+    values globals(globals_size);
+    const jit native {{.perf_map = true}};
+    if (symbols != nullptr) {
+        for (auto idx = 0; const auto& builtin : builtin::builtins()) {
+            symbols->define_builtin(idx++, builtin->name);
         }
-        if (symbols != nullptr) {
-            symbols->define_builtin(idx, builtin->name);
-        }
-        idx++;
     }
 
     auto show_prompt = []() { std::cout << prompt; };
@@ -249,7 +356,7 @@ auto run_repl(const command_line_args& opts) -> int
     while (getline(std::cin, input)) {
         auto lxr = lexer {input};
         auto prsr = parser {lxr};
-        auto* prgrm = prsr.parse_program();
+        auto prgrm = prsr.parse_program();
         if (!prsr.errors().empty()) {
             print_parse_errors(prsr.errors());
             show_prompt();
@@ -257,7 +364,10 @@ auto run_repl(const command_line_args& opts) -> int
         }
 
         try {
-            analyze_program(prgrm, symbols, global_env);
+            analyze_program(prgrm.get(), symbols, global_env);
+            if (opts.mode != engine::eval) {
+                optimize_program(prgrm.get());
+            }
         } catch (const std::exception& e) {
             fmt::println("{}", e.what());
             show_prompt();
@@ -267,11 +377,32 @@ auto run_repl(const command_line_args& opts) -> int
         if (opts.mode == engine::vm) {
             try {
                 auto cmplr = compiler::create_with_state(&consts, symbols);
-                cmplr.compile(prgrm);
+                cmplr.compile(prgrm.get());
                 if (opts.debug) {
                     debug_byte_code(cmplr.byte_code(), cmplr.all_symbols());
                 }
                 auto machine = vm::create_with_state(cmplr.byte_code(), &globals);
+                if (opts.jit) {
+                    machine.attach(&native);
+                }
+                machine.run();
+                const auto* result = machine.last_popped();
+                if (!result->is_null()) {
+                    std::cout << result->inspect() << '\n';
+                }
+            } catch (const std::exception& e) {
+                print_compile_error(e.what());
+                show_prompt();
+                continue;
+            }
+        } else if (opts.mode == engine::registers) {
+            try {
+                auto cmplr = register_compiler::create_with_state(&consts, symbols);
+                cmplr.compile(prgrm.get());
+                if (opts.debug) {
+                    std::cout << "Instructions: \n" << registers::to_string(cmplr.byte_code().instrs);
+                }
+                auto machine = register_vm::create_with_state(cmplr.byte_code(), &globals);
                 machine.run();
                 const auto* result = machine.last_popped();
                 if (!result->is_null()) {
@@ -284,9 +415,13 @@ auto run_repl(const command_line_args& opts) -> int
             }
         } else {
             try {
-                evaluator ev {global_env};
-
-                const auto* result = ev.evaluate(prgrm);
+                const object* result = nullptr;
+                if (opts.mode == engine::closures) {
+                    result = lower_program(prgrm.get())->run(global_env);
+                } else {
+                    evaluator ev {global_env};
+                    result = ev.evaluate(prgrm.get());
+                }
                 if (!result->is_null()) {
                     std::cout << result->inspect() << '\n';
                 }
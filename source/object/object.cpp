@@ -1,13 +1,20 @@
 #include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
 #include <cmath>
+#include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <ios>
 #include <iterator>
+#include <memory>
 #include <ostream>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <utility>
-#include <variant>
 
 #include "object.hpp"
 
@@ -18,7 +25,6 @@
 #include <fmt/format.h>
 #include <fmt/ranges.h>
 #include <gc.hpp>
-#include <overloaded.hpp>
 
 using enum object::object_type;
 
@@ -137,6 +143,85 @@ auto fals() -> const object*
     return &false_obj;
 }
 
+namespace
+{
+struct interned_string final
+{
+    const string_object* str;
+    // literals live as long as the program, the other strings only as long as something references them
+    bool literal;
+};
+
+/// the keys view the text of the interned strings, which never changes
+auto interned_strings() -> std::unordered_map<std::string_view, interned_string>&
+{
+    static std::unordered_map<std::string_view, interned_string> interned;
+    return interned;
+}
+}  // namespace
+
+auto intern(std::string_view str) -> const string_object*
+{
+    static std::vector<std::unique_ptr<string_object>> literals;
+    auto& interned = interned_strings();
+    if (const auto itr = interned.find(str); itr != interned.end()) {
+        // a string interned at runtime stays owned by the heap, the sweep keeps it alive from now on
+        itr->second.literal = true;
+        return itr->second.str;
+    }
+    auto& obj = literals.emplace_back(std::make_unique<string_object>(std::string {str}));
+    obj->m_interned = obj.get();
+    interned.emplace(obj->value(), interned_string {.str = obj.get(), .literal = true});
+    return obj.get();
+}
+
+auto sweep_interned(heap& hp) -> void
+{
+    std::erase_if(interned_strings(),
+                  [&hp](const auto& entry)
+                  {
+                      const auto& [str, literal] = entry.second;
+                      if (literal) {
+                          hp.mark(str);
+                          return false;
+                      }
+                      return !hp.is_marked(str);
+                  });
+}
+
+auto interned_count() -> std::size_t
+{
+    return interned_strings().size();
+}
+
+auto single_character(char chr) -> const string_object*
+{
+    static const auto characters = []
+    {
+        std::array<const string_object*, 256> result {};
+        for (std::size_t idx = 0; idx < result.size(); idx++) {
+            result[idx] = intern(std::string(1, static_cast<char>(idx)));
+        }
+        return result;
+    }();
+    return characters[static_cast<unsigned char>(chr)];
+}
+
+auto small_integer(integer_object::value_type val) -> integer_object*
+{
+    // a deque never moves its elements, integer_object can be neither copied nor moved
+    static std::deque<integer_object> integers = []
+    {
+        std::deque<integer_object> result;
+        for (auto value = small_integer_min; value <= small_integer_max; value++) {
+            result.emplace_back(value);
+        }
+        return result;
+    }();
+    assert(val >= small_integer_min && val <= small_integer_max);
+    return &integers[static_cast<std::size_t>(val - small_integer_min)];
+}
+
 auto null() -> const object*
 {
     static const struct null_object null_obj;
@@ -210,28 +295,75 @@ auto operator<<(std::ostream& ostrm, object::object_type type) -> std::ostream&
 
 auto string_object::hash_key() const -> key_type
 {
-    return value;
+    if (m_interned != nullptr) {
+        return key_type {m_interned};
+    }
+    auto& interned = interned_strings();
+    if (const auto itr = interned.find(value()); itr != interned.end()) {
+        m_interned = itr->second.str;
+        return key_type {m_interned};
+    }
+    // strings built at runtime are interned through a copy owned by the heap, so the intern table can forget it once
+    // no string or hash refers to it anymore
+    auto* copy = make<string_object>(std::string {value()});
+    copy->m_interned = copy;
+    interned.emplace(copy->value(), interned_string {.str = copy, .literal = false});
+    m_interned = copy;
+    return key_type {m_interned};
+}
+
+auto string_object::mark_references(heap& hp) const -> void
+{
+    hp.mark(m_interned);
+}
+
+auto string_object::concat(std::string_view suffix) const -> const string_object*
+{
+    const auto size = m_size + suffix.size();
+    // interned strings keep their buffer to themselves, the interner refers to its text
+    if (m_buffer && m_buffer->size() == m_size && m_interned != this) {
+        const auto* data = m_buffer->data();
+        if (suffix.data() >= data && suffix.data() < data + m_size) {
+            // the suffix is a part of the buffer that could be moved by the append
+            const std::string copy {suffix};
+            m_buffer->append(copy);
+        } else {
+            m_buffer->append(suffix);
+        }
+        return make<string_object>(m_buffer, size);
+    }
+    std::string text;
+    text.reserve(size);
+    text.append(value());
+    text.append(suffix);
+    return make<string_object>(std::move(text));
 }
 
 auto string_object::operator==(const object& other) const -> const object*
 {
-    return eq_helper(this, other);
+    return native_bool_to_object(other.is(type()) && value() == other.as<string_object>()->value());
 }
 
 auto string_object::operator>(const object& other) const -> const object*
 {
-    return gt_helper(this, other);
+    if (other.is(type())) {
+        return native_bool_to_object(value() > other.as<string_object>()->value());
+    }
+    return nullptr;
 }
 
 auto string_object::operator>=(const object& other) const -> const object*
 {
-    return ge_helper(this, other);
+    if (other.is(type())) {
+        return native_bool_to_object(value() >= other.as<string_object>()->value());
+    }
+    return nullptr;
 }
 
 auto string_object::operator+(const object& other) const -> const object*
 {
     if (other.is(string)) {
-        return make<string_object>(value + other.val<string_object>());
+        return concat(other.as<string_object>()->value());
     }
     return nullptr;
 }
@@ -239,7 +371,11 @@ auto string_object::operator+(const object& other) const -> const object*
 auto string_object::operator*(const object& other) const -> const object*
 {
     if (other.is(integer)) {
-        return multiply_sequence_helper(this, other.val<integer_object>());
+        std::string text;
+        for (integer_object::value_type i = 0; i < other.val<integer_object>(); i++) {
+            text.append(value());
+        }
+        return make<string_object>(std::move(text));
     }
     return nullptr;
 }
@@ -509,7 +645,7 @@ auto integer_object::operator*(const object& other) const -> const object*
         return multiply_sequence_helper(other.as<array_object>(), value);
     }
     if (other.is(string)) {
-        return multiply_sequence_helper(other.as<string_object>(), value);
+        return other * *this;
     }
 
     return nullptr;
@@ -743,11 +879,21 @@ auto return_value_object::inspect() const -> std::string
     return fmt::format("{}", return_value->inspect());
 }
 
+auto return_value_object::mark_references(heap& hp) const -> void
+{
+    hp.mark(return_value);
+}
+
 auto function_object::inspect() const -> std::string
 {
     return fmt::format("fn({}) {{\n{}\n}}", join(parameters, ", "), body->string());
 }
 
+auto function_object::mark_references(heap& hp) const -> void
+{
+    hp.mark(closure_env);
+}
+
 auto error_object::operator==(const object& other) const -> const object*
 {
     return eq_helper(this, other);
@@ -768,6 +914,13 @@ auto array_object::inspect() const -> std::string
     return strm.str();
 }
 
+auto array_object::mark_references(heap& hp) const -> void
+{
+    for (const auto* element : value) {
+        hp.mark(element);
+    }
+}
+
 auto array_object::operator==(const object& other) const -> const object*
 {
     if (other.is(type())) {
@@ -806,13 +959,15 @@ auto array_object::operator+(const object& other) const -> const object*
 
 auto operator<<(std::ostream& strm, const hashable::key_type& t) -> std::ostream&
 {
-    std::visit(
-        overloaded {
-            [&](int64_t val) { strm << val; },
-            [&](const std::string& val) { strm << '"' << val << '"'; },
-            [&](bool val) { strm << std::boolalpha << val; },
-        },
-        t);
+    using enum hashable::key_type::tag;
+    switch (t.kind()) {
+        case integer:
+            return strm << t.as_integer();
+        case boolean:
+            return strm << std::boolalpha << t.as_boolean();
+        case string:
+            return strm << '"' << t.as_string()->value() << '"';
+    }
     return strm;
 }
 
@@ -832,6 +987,16 @@ auto hash_object::inspect() const -> std::string
     return strm.str();
 }
 
+auto hash_object::mark_references(heap& hp) const -> void
+{
+    for (const auto& [key, element] : value) {
+        if (key.kind() == hashable::key_type::tag::string) {
+            hp.mark(key.as_string());
+        }
+        hp.mark(element);
+    }
+}
+
 auto hash_object::operator==(const object& other) const -> const object*
 {
     if (other.is(type())) {
@@ -882,6 +1047,14 @@ auto compiled_function_object::inspect() const -> std::string
     // NOLINTEND(cppcoreguidelines-pro-type-const-cast)
 }
 
+auto closure_object::mark_references(heap& hp) const -> void
+{
+    hp.mark(fn);
+    for (const auto& element : free) {
+        hp.mark(element);
+    }
+}
+
 auto closure_object::inspect() const -> std::string
 {
     return fmt::format("closure[{}]", static_cast<const void*>(fn));
@@ -1208,7 +1381,7 @@ TEST_SUITE("object tests")
     const array_object array_obj {{&int_obj, &int2_obj}};
     const hash_object hash_obj {{{1, &str_obj}, {2, &true_obj}}};
     const return_value_object ret_obj {&array_obj};
-    const function_object function_obj {{}, nullptr, nullptr};
+    const function_object function_obj {{}, nullptr, 0, nullptr, nullptr};
     const builtin_object builtin_obj {builtin::builtins()[0]};
     const compiled_function_object cmpld_obj {{}, 0, 0};
     const closure_object clsr_obj {&cmpld_obj, {}};
@@ -1387,6 +1560,58 @@ TEST_SUITE("object tests")
         check_mul(integer_object {2}, string_object {"abc"}, string_object {"abcabc"});
     }
 
+    TEST_CASE("concat")
+    {
+        const string_object str {"ab"};
+        const auto* abc = str.concat("c");
+        const auto* abd = str.concat("d");
+        const auto* abcabc = abc->concat(abc->value());
+        CHECK_EQ(str.value(), "ab");
+        CHECK_EQ(abc->value(), "abc");
+        CHECK_EQ(abd->value(), "abd");
+        CHECK_EQ(abcabc->value(), "abcabc");
+        CHECK_EQ(abcabc->concat("d")->value(), "abcabcd");
+        CHECK_EQ(abc->concat("e")->value(), "abce");
+        CHECK_EQ(intern("lit")->concat("eral")->value(), "literal");
+        CHECK_EQ(intern("lit")->value(), "lit");
+        CHECK_EQ(intern("literal"), intern("literal"));
+    }
+
+    TEST_CASE("hash keys")
+    {
+        CHECK_EQ(intern("key"), intern("key"));
+        CHECK_NE(intern("key"), intern("other"));
+        CHECK_EQ(intern("key")->value(), "key");
+        const string_object str {"key"};
+        CHECK_EQ(str.hash_key(), hashable::key_type {intern("key")});
+        CHECK_EQ(str.hash_key(), hashable::key_type {"key"});
+        CHECK_NE(str.hash_key(), string_object {"other"}.hash_key());
+        CHECK_EQ(integer_object {1}.hash_key(), hashable::key_type {1});
+        CHECK_NE(integer_object {1}.hash_key(), boolean_object {true}.hash_key());
+        CHECK_EQ(boolean_object {false}.hash_key(), hashable::key_type {false});
+    }
+
+    TEST_CASE("string keys use the low bits of their hash")
+    {
+        std::size_t low_bits = 0;
+        for (char chr = 'a'; chr <= 'z'; chr++) {
+            low_bits |= 1UL << (hashable::key_type {single_character(chr)}.hash() & 0xFU);
+        }
+        CHECK_GT(std::popcount(low_bits), 1);
+    }
+
+    TEST_CASE("small integers and single characters")
+    {
+        CHECK_EQ(make<integer_object>(0), make<integer_object>(0));
+        CHECK_EQ(make<integer_object>(small_integer_min), small_integer(small_integer_min));
+        CHECK_EQ(make<integer_object>(small_integer_max)->value, small_integer_max);
+        CHECK_NE(make<integer_object>(small_integer_max + 1), make<integer_object>(small_integer_max + 1));
+        CHECK_NE(make<integer_object>(small_integer_min - 1), make<integer_object>(small_integer_min - 1));
+        CHECK_EQ(single_character('a'), intern("a"));
+        CHECK_EQ(single_character('\xff')->value(), "\xff");
+        CHECK_EQ(single_character('\0')->value(), std::string_view {"\0", 1});
+    }
+
     TEST_CASE("operator /")
     {
         check_div(integer_object {1}, integer_object {1}, decimal_object {1});
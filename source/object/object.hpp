@@ -1,14 +1,19 @@
 #pragma once
 
 #include <cassert>
+#include <concepts>
+#include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <limits>
+#include <memory>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <utility>
 #include <variant>
 #include <vector>
 
+#include <ast/arena.hpp>
 #include <ast/identifier.hpp>
 #include <ast/statements.hpp>
 #include <ast/util.hpp>
@@ -17,6 +22,10 @@
 #include <eval/environment.hpp>
 #include <fmt/ostream.h>
 #include <gc.hpp>
+#include <object/object_pool.hpp>
+#include <object/persistent_map.hpp>
+#include <object/persistent_vector.hpp>
+#include <object/value.hpp>
 #include <sys/types.h>
 
 struct object;
@@ -28,9 +37,116 @@ auto brake() -> const object*;
 auto cont() -> const object*;
 auto null() -> const object*;
 
+struct string_object;
+/// returns the one string_object for the literal text, it is created on first use and never collected
+auto intern(std::string_view str) -> const string_object*;
+/// forgets the strings interned at runtime that are not marked, called by the heap before it deletes them
+auto sweep_interned(heap& hp) -> void;
+/// number of strings in the intern table
+auto interned_count() -> std::size_t;
+/// returns the interned string consisting of the single character, all 256 of them are preallocated
+auto single_character(char chr) -> const string_object*;
+
 struct hashable
 {
-    using key_type = std::variant<int64_t, std::string, bool>;
+    /// Key of a hash, a tagged word holding an integer, a boolean or an interned string.
+    ///
+    /// Strings are interned, so keys compare and hash by the address of the interned string_object and a lookup
+    /// never copies or rehashes the text.
+    class key_type final
+    {
+      public:
+        enum class tag : std::uint8_t
+        {
+            integer,
+            boolean,
+            string,
+        };
+
+        template<std::integral T>
+            requires(!std::same_as<T, bool>)
+        constexpr key_type(T val)  // NOLINT(*-explicit-*)
+            : m_tag {tag::integer}
+            , m_payload {.integer = static_cast<std::int64_t>(val)}
+        {
+        }
+
+        // a template, so pointers are not converted to a boolean key
+        template<std::same_as<bool> T>
+        constexpr key_type(T val)  // NOLINT(*-explicit-*)
+            : m_tag {tag::boolean}
+            , m_payload {.boolean = val}
+        {
+        }
+
+        /// interns the text
+        explicit key_type(std::string_view str)
+            : m_tag {tag::string}
+            , m_payload {.str = intern(str)}
+        {
+        }
+
+        /// the string has to be interned
+        explicit constexpr key_type(const string_object* interned)
+            : m_tag {tag::string}
+            , m_payload {.str = interned}
+        {
+        }
+
+        [[nodiscard]] constexpr auto kind() const -> tag { return m_tag; }
+
+        [[nodiscard]] constexpr auto as_integer() const -> std::int64_t { return m_payload.integer; }
+
+        [[nodiscard]] constexpr auto as_boolean() const -> bool { return m_payload.boolean; }
+
+        [[nodiscard]] constexpr auto as_string() const -> const string_object* { return m_payload.str; }
+
+        [[nodiscard]] auto hash() const -> std::size_t
+        {
+            switch (m_tag) {
+                case tag::integer:
+                    return std::hash<std::int64_t> {}(m_payload.integer);
+                case tag::boolean:
+                    return std::hash<bool> {}(m_payload.boolean);
+                case tag::string: {
+                    // the objects are aligned to 16 bytes, the finalizer of murmur3 spreads the address to the low bits
+                    const auto address = reinterpret_cast<std::uintptr_t>(m_payload.str);  // NOLINT(*-reinterpret-cast)
+                    auto bits = static_cast<std::uint64_t>(address);
+                    bits = (bits ^ (bits >> 33U)) * 0xff51afd7ed558ccdULL;
+                    bits = (bits ^ (bits >> 33U)) * 0xc4ceb9fe1a85ec53ULL;
+                    return bits ^ (bits >> 33U);
+                }
+            }
+            return 0;
+        }
+
+        [[nodiscard]] constexpr auto operator==(const key_type& other) const -> bool
+        {
+            if (m_tag != other.m_tag) {
+                return false;
+            }
+            switch (m_tag) {
+                case tag::integer:
+                    return m_payload.integer == other.m_payload.integer;
+                case tag::boolean:
+                    return m_payload.boolean == other.m_payload.boolean;
+                case tag::string:
+                    return m_payload.str == other.m_payload.str;
+            }
+            return false;
+        }
+
+      private:
+        union payload
+        {
+            std::int64_t integer;
+            bool boolean;
+            const string_object* str;
+        };
+
+        tag m_tag;
+        payload m_payload;
+    };
 
     hashable() = default;
     virtual ~hashable() = default;
@@ -42,6 +158,12 @@ struct hashable
     auto operator=(hashable&&) -> hashable& = delete;
 };
 
+template<>
+struct std::hash<hashable::key_type>
+{
+    auto operator()(const hashable::key_type& key) const -> std::size_t { return key.hash(); }
+};
+
 struct object
 {
     enum class object_type : std::uint8_t
@@ -67,6 +189,13 @@ struct object
     auto operator=(const object&) -> object& = delete;
     auto operator=(object&&) -> object& = delete;
 
+#ifdef CAPPUCHIN_OBJECT_POOL
+    // the destructor is virtual, so delete passes the size of the dynamic type
+    static auto operator new(std::size_t size) -> void* { return object_pool::local().allocate(size); }
+
+    static auto operator delete(void* ptr, std::size_t size) -> void { object_pool::local().deallocate(ptr, size); }
+#endif
+
     [[nodiscard]] auto is(object_type obj_type) const -> bool { return type() == obj_type; }
 
     template<typename T>
@@ -102,6 +231,9 @@ struct object
 
     [[nodiscard]] virtual auto inspect() const -> std::string = 0;
 
+    /// marks all objects and environments directly referenced by this object
+    virtual auto mark_references(heap& /*hp*/) const -> void {}
+
     [[nodiscard]] auto operator!=(const object& other) const -> const object*;
     [[nodiscard]] auto operator&&(const object& other) const -> const object*;
     [[nodiscard]] auto operator||(const object& other) const -> const object*;
@@ -131,6 +263,9 @@ struct object
     [[nodiscard]] virtual auto operator<<(const object& /*other*/) const -> const object* { return nullptr; }
 
     [[nodiscard]] virtual auto operator>>(const object& /*other*/) const -> const object* { return nullptr; }
+
+    /// collection cycle in which this object was last marked as reachable, see heap
+    mutable std::uint32_t epoch {};
 };
 
 template<>
@@ -195,6 +330,35 @@ struct integer_object final
     value_type value {};
 };
 
+#ifndef CAPPUCHIN_SMALL_INTEGER_MIN
+#    define CAPPUCHIN_SMALL_INTEGER_MIN (-128)
+#endif
+#ifndef CAPPUCHIN_SMALL_INTEGER_MAX
+#    define CAPPUCHIN_SMALL_INTEGER_MAX 1023
+#endif
+
+/// integers in this range are preallocated and immortal, make<integer_object> returns them instead of allocating
+constexpr integer_object::value_type small_integer_min = CAPPUCHIN_SMALL_INTEGER_MIN;
+constexpr integer_object::value_type small_integer_max = CAPPUCHIN_SMALL_INTEGER_MAX;
+static_assert(small_integer_min <= 0 && small_integer_max >= 1, "the small integer range has to contain 0 and 1");
+
+/// returns the preallocated integer, the value has to be within [small_integer_min, small_integer_max]
+auto small_integer(integer_object::value_type val) -> integer_object*;
+
+/// more specialized than the make of gc.hpp, so every integer object is created through the cache
+template<typename T, typename Arg>
+    requires std::same_as<T, integer_object>
+auto make(Arg&& val) -> T*
+{
+    const auto value = static_cast<integer_object::value_type>(std::forward<Arg>(val));
+    if (value >= small_integer_min && value <= small_integer_max) {
+        return small_integer(value);
+    }
+    auto* p = new integer_object(value);
+    heap::get().track(p);
+    return p;
+}
+
 struct decimal_object final : object
 {
     using value_type = double;
@@ -282,26 +446,52 @@ struct string_object final
     string_object() = default;
 
     explicit string_object(value_type val)
-        : value {std::move(val)}
+        : m_buffer {std::make_shared<std::string>(std::move(val))}
+        , m_size {m_buffer->size()}
     {
     }
 
-    [[nodiscard]] auto is_truthy() const -> bool final { return !value.empty(); }
+    /// a string made of the first size characters of a buffer shared with other strings
+    string_object(std::shared_ptr<std::string> buffer, std::size_t size)
+        : m_buffer {std::move(buffer)}
+        , m_size {size}
+    {
+    }
+
+    [[nodiscard]] auto value() const -> std::string_view
+    {
+        return m_buffer ? std::string_view {m_buffer->data(), m_size} : std::string_view {};
+    }
+
+    /// returns this string followed by the suffix
+    [[nodiscard]] auto concat(std::string_view suffix) const -> const string_object*;
+
+    [[nodiscard]] auto is_truthy() const -> bool final { return m_size != 0; }
 
     [[nodiscard]] auto type() const -> object_type final { return object_type::string; }
 
-    [[nodiscard]] auto inspect() const -> std::string final { return fmt::format(R"("{}")", value); }
+    [[nodiscard]] auto inspect() const -> std::string final { return fmt::format(R"("{}")", value()); }
 
     [[nodiscard]] auto is_hashable() const -> bool final { return true; }
 
     [[nodiscard]] auto hash_key() const -> key_type final;
+    auto mark_references(heap& hp) const -> void final;
     [[nodiscard]] auto operator==(const object& other) const -> const object* final;
     [[nodiscard]] auto operator>(const object& other) const -> const object* final;
     [[nodiscard]] auto operator>=(const object& other) const -> const object* final;
     [[nodiscard]] auto operator+(const object& other) const -> const object* final;
     [[nodiscard]] auto operator*(const object& other) const -> const object* final;
 
-    value_type value;
+  private:
+    friend auto intern(std::string_view str) -> const string_object*;
+
+    // Strings only ever append to the buffer, so every string sharing it keeps seeing its own prefix. A string that
+    // ends at the end of the buffer appends the suffix in place, which makes repeated concatenation amortized O(1)
+    // per character, all other strings copy their text into a new buffer first.
+    std::shared_ptr<std::string> m_buffer;
+    std::size_t m_size {};
+    // the interned string with the same text, the string itself if it is interned
+    mutable const string_object* m_interned {};
 };
 
 struct break_object final : object
@@ -347,7 +537,7 @@ auto make_error(fmt::format_string<T...> fmt, T&&... args) -> object*
 
 struct array_object final : object
 {
-    using value_type = std::vector<const object*>;
+    using value_type = persistent_vector;
 
     array_object() = default;
 
@@ -364,13 +554,14 @@ struct array_object final : object
     [[nodiscard]] auto operator==(const object& other) const -> const object* final;
     [[nodiscard]] auto operator*(const object& /*other*/) const -> const object* final;
     [[nodiscard]] auto operator+(const object& other) const -> const object* final;
+    auto mark_references(heap& hp) const -> void final;
 
     value_type value;
 };
 
 struct hash_object final : object
 {
-    using value_type = std::unordered_map<hashable::key_type, const object*>;
+    using value_type = persistent_map<hashable::key_type, const object*>;
 
     explicit hash_object(value_type&& hsh)
         : value {std::move(hsh)}
@@ -384,6 +575,7 @@ struct hash_object final : object
     [[nodiscard]] auto inspect() const -> std::string final;
     [[nodiscard]] auto operator==(const object& other) const -> const object* final;
     [[nodiscard]] auto operator+(const object& other) const -> const object* final;
+    auto mark_references(heap& hp) const -> void final;
 
     value_type value;
 };
@@ -400,16 +592,23 @@ struct return_value_object final : object
     [[nodiscard]] auto type() const -> object_type final { return object_type::return_value; }
 
     [[nodiscard]] auto inspect() const -> std::string final;
+    auto mark_references(heap& hp) const -> void final;
 
     const object* return_value;
 };
 
 struct function_object final : object
 {
-    function_object(const std::vector<const identifier*>& params, const block_statement* bod, environment* env)
+    function_object(const std::vector<const identifier*>& params,
+                    const block_statement* bod,
+                    int locals,
+                    environment* env,
+                    std::shared_ptr<const arena> nodes)
         : parameters {params}
         , body {bod}
+        , num_locals {locals}
         , closure_env {env}
+        , tree {std::move(nodes)}
     {
     }
 
@@ -418,10 +617,16 @@ struct function_object final : object
     [[nodiscard]] auto type() const -> object_type final { return object_type::function; }
 
     [[nodiscard]] auto inspect() const -> std::string final;
+    auto mark_references(heap& hp) const -> void final;
 
     std::vector<const identifier*> parameters;
     const block_statement* body {};
+    int num_locals {};
     environment* closure_env {};
+    // the arena of the program the function was parsed from, its nodes must outlive the function
+    std::shared_ptr<const arena> tree;
+    /// the lowered body if the function was created by a lowered program, which is then kept alive by the tree
+    const struct lowered_function* lowered {};
 };
 
 struct compiled_function_object final : object
@@ -439,15 +644,21 @@ struct compiled_function_object final : object
 
     [[nodiscard]] auto inspect() const -> std::string final;
 
-    instructions instrs;
+    /// the vm rewrites generic instructions in place to the variants specialized for the types it observed
+    mutable instructions instrs;
     int num_locals {};
     int num_arguments {};
-    bool inside_loop {};
+    /// name of the function for diagnostics, the name it is bound to with let, if any
+    std::string name;
+    /// number of calls and backward jumps counted by the jit compiler, which compiles the function once it is hot
+    mutable std::uint32_t hotness {};
+    /// the machine code of the function, if the jit compiler translated it
+    mutable std::shared_ptr<const struct native_code> native;
 };
 
 struct closure_object final : object
 {
-    explicit closure_object(const compiled_function_object* cmpld, std::vector<const object*> frees = {})
+    explicit closure_object(const compiled_function_object* cmpld, values frees = {})
         : fn {cmpld}
         , free {std::move(frees)}
     {
@@ -459,9 +670,10 @@ struct closure_object final : object
 
     [[nodiscard]] auto inspect() const -> std::string final;
     [[nodiscard]] auto as_mutable() const -> closure_object*;
+    auto mark_references(heap& hp) const -> void final;
 
     const compiled_function_object* fn {};
-    std::vector<const object*> free;
+    values free;
 };
 
 struct builtin_object final : object
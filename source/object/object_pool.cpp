@@ -0,0 +1,147 @@
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <new>
+#include <set>
+
+#include "object_pool.hpp"
+
+#include <doctest/doctest.h>
+
+#include "object.hpp"
+
+namespace
+{
+struct chunk_header
+{
+    chunk_header* next;
+};
+
+// every chunk stays reachable from this list, so leak checkers do not report blocks that are only linked through
+// the free lists of the thread local pools
+constinit std::atomic<chunk_header*> all_chunks {nullptr};
+constinit std::atomic<std::size_t> chunk_count {0};
+
+auto new_chunk() -> std::byte*
+{
+    auto* header = static_cast<chunk_header*>(::operator new(object_pool::chunk_size));
+    header->next = all_chunks.load(std::memory_order_relaxed);
+    while (!all_chunks.compare_exchange_weak(header->next, header, std::memory_order_release)) {
+    }
+    chunk_count.fetch_add(1, std::memory_order_relaxed);
+    return reinterpret_cast<std::byte*>(header);  // NOLINT(*-reinterpret-cast)
+}
+}  // namespace
+
+auto object_pool::local() -> object_pool&
+{
+    thread_local constinit object_pool pool;
+    return pool;
+}
+
+auto object_pool::chunks() -> std::size_t
+{
+    return chunk_count.load(std::memory_order_relaxed);
+}
+
+auto object_pool::allocate(std::size_t size) -> void*
+{
+    assert(size > 0);
+    if (size > max_pooled_size) {
+        return ::operator new(size);
+    }
+    const auto idx = size_class(size);
+    if (auto* block = m_free[idx]; block != nullptr) {
+        m_free[idx] = block->next;
+        return block;
+    }
+    const auto rounded = (idx + 1) * granularity;
+    if (m_current == nullptr || static_cast<std::size_t>(m_end - m_current) < rounded) {
+        // the rest of the current chunk is too small for the request and is left unused
+        auto* chunk = new_chunk();
+        m_current = chunk + granularity;
+        m_end = chunk + chunk_size;
+    }
+    auto* block = m_current;
+    m_current += rounded;
+    return block;
+}
+
+auto object_pool::deallocate(void* ptr, std::size_t size) -> void
+{
+    if (ptr == nullptr) {
+        return;
+    }
+    if (size > max_pooled_size) {
+        ::operator delete(ptr, size);
+        return;
+    }
+    const auto idx = size_class(size);
+    auto* block = ::new (ptr) free_block {m_free[idx]};
+    m_free[idx] = block;
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+TEST_SUITE_BEGIN("object_pool");
+
+TEST_CASE("releasedBlocksAreReusedWithinTheirSizeClass")
+{
+    object_pool pool;
+    auto* first = pool.allocate(24);
+    auto* second = pool.allocate(40);
+    CHECK_NE(first, second);
+    pool.deallocate(first, 24);
+    pool.deallocate(second, 40);
+    CHECK_EQ(pool.allocate(32), first);
+    CHECK_EQ(pool.allocate(48), second);
+    CHECK_NE(pool.allocate(32), first);
+}
+
+TEST_CASE("blocksDoNotOverlap")
+{
+    object_pool pool;
+    std::set<std::byte*> blocks;
+    const auto chunks = object_pool::chunks();
+    for (std::size_t i = 0; i < 10000; i++) {
+        auto* block = static_cast<std::byte*>(pool.allocate(48));
+        CHECK_EQ(reinterpret_cast<std::uintptr_t>(block) % object_pool::granularity, 0);
+        if (auto itr = blocks.lower_bound(block); itr != blocks.end()) {
+            REQUIRE_GE(*itr - block, 48);
+        }
+        if (auto itr = blocks.lower_bound(block); itr != blocks.begin()) {
+            REQUIRE_GE(block - *std::prev(itr), 48);
+        }
+        blocks.insert(block);
+    }
+    CHECK_GE(object_pool::chunks() - chunks, 10000 * 48 / object_pool::chunk_size);
+    CHECK_LE(object_pool::chunks() - chunks, 10000 * 48 / object_pool::chunk_size + 1);
+}
+
+TEST_CASE("largeRequestsBypassThePool")
+{
+    object_pool pool;
+    const auto chunks = object_pool::chunks();
+    auto* large = pool.allocate(object_pool::max_pooled_size + 1);
+    CHECK_EQ(object_pool::chunks(), chunks);
+    pool.deallocate(large, object_pool::max_pooled_size + 1);
+}
+
+#ifdef CAPPUCHIN_OBJECT_POOL
+TEST_CASE("objectsAreAllocatedFromThePool")
+{
+    const object* first = new integer_object {100000};
+    const auto address = reinterpret_cast<std::uintptr_t>(first);
+    delete first;
+    const object* second = new integer_object {100001};
+    CHECK_EQ(reinterpret_cast<std::uintptr_t>(second), address);
+    delete second;
+}
+#endif
+
+TEST_SUITE_END();
+// NOLINTEND(*)
+}  // namespace
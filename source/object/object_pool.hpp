@@ -0,0 +1,43 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+/// Size class allocator for runtime objects.
+///
+/// Requests are rounded up to a multiple of 16 bytes, every size class up to max_pooled_size keeps a free list of
+/// released blocks. New blocks are cut from 64 KiB chunks, larger requests go to the global operator new. Every
+/// thread has a pool of its own, so allocating and releasing never synchronizes, a block released on another thread
+/// simply joins the free list of that thread. Chunks are never returned to the system, they are reused through the
+/// free lists instead.
+class object_pool final
+{
+  public:
+    static constexpr std::size_t granularity = 16;
+    static constexpr std::size_t max_pooled_size = 256;
+    static constexpr std::size_t chunk_size = 64UL * 1024UL;
+
+    /// the pool of the calling thread
+    static auto local() -> object_pool&;
+    /// number of chunks taken from the system by all pools
+    static auto chunks() -> std::size_t;
+
+    [[nodiscard]] auto allocate(std::size_t size) -> void*;
+    auto deallocate(void* ptr, std::size_t size) -> void;
+
+  private:
+    static constexpr std::size_t size_classes = max_pooled_size / granularity;
+
+    static constexpr auto size_class(std::size_t size) -> std::size_t { return (size - 1) / granularity; }
+
+    struct free_block
+    {
+        free_block* next;
+    };
+
+    // all members are trivially destructible, so the pool of the main thread stays usable while the objects with
+    // static storage duration are destroyed
+    std::array<free_block*, size_classes> m_free {};
+    std::byte* m_current {};
+    std::byte* m_end {};
+};
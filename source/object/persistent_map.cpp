@@ -0,0 +1,101 @@
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "persistent_map.hpp"
+
+#include <doctest/doctest.h>
+
+namespace
+{
+// NOLINTBEGIN(*)
+TEST_SUITE_BEGIN("persistent_map");
+
+template<typename Map>
+auto require_entries(const Map& map, const std::map<std::int64_t, std::int64_t>& expected) -> void
+{
+    REQUIRE_EQ(map.size(), expected.size());
+    for (const auto& [key, value] : expected) {
+        REQUIRE(map.contains(key));
+        REQUIRE_EQ(map.at(key), value);
+    }
+    std::map<std::int64_t, std::int64_t> visited;
+    for (const auto& [key, value] : map) {
+        visited[key] = value;
+    }
+    REQUIRE_EQ(visited, expected);
+}
+
+/// maps every key to one of four hashes, so the trie is deep and keys end up in collision nodes
+struct colliding_hash
+{
+    auto operator()(std::int64_t key) const -> std::size_t { return static_cast<std::size_t>(key % 4); }
+};
+
+TEST_CASE("insertAndFind")
+{
+    persistent_map<std::int64_t, std::int64_t> map;
+    std::map<std::int64_t, std::int64_t> expected;
+    for (std::int64_t key = 0; key < 100000; key += 3) {
+        CHECK(map.insert({key, key * 2}));
+        expected[key] = key * 2;
+    }
+    CHECK_FALSE(map.insert({3, 0}));
+    CHECK_FALSE(map.insert_or_assign(6, 7));
+    expected[6] = 7;
+    require_entries(map, expected);
+    CHECK_FALSE(map.contains(1));
+    CHECK_EQ(map.find(2), map.end());
+    CHECK_THROWS_AS((void)map.at(1), std::out_of_range);
+}
+
+TEST_CASE("copiesAreNotModifiedByInserts")
+{
+    persistent_map<std::int64_t, std::int64_t> original;
+    std::vector<persistent_map<std::int64_t, std::int64_t>> snapshots;
+    for (std::int64_t key = 0; key < 1000; key++) {
+        snapshots.push_back(original);
+        original.insert_or_assign(key, key);
+    }
+    auto copy = original;
+    copy.insert_or_assign(0, 42);
+    copy.insert_or_assign(1000, 1000);
+    CHECK_EQ(original.at(0), 0);
+    CHECK_FALSE(original.contains(1000));
+    CHECK_EQ(copy.at(0), 42);
+    for (std::size_t idx = 0; idx < snapshots.size(); idx += 97) {
+        std::map<std::int64_t, std::int64_t> expected;
+        for (std::int64_t key = 0; key < static_cast<std::int64_t>(idx); key++) {
+            expected[key] = key;
+        }
+        require_entries(snapshots[idx], expected);
+    }
+}
+
+TEST_CASE("collidingKeys")
+{
+    persistent_map<std::int64_t, std::int64_t, colliding_hash> map;
+    std::map<std::int64_t, std::int64_t> expected;
+    for (std::int64_t key = 0; key < 64; key++) {
+        map.insert_or_assign(key, -key);
+        expected[key] = -key;
+    }
+    auto copy = map;
+    copy.insert_or_assign(5, 5);
+    require_entries(map, expected);
+    CHECK_EQ(copy.at(5), 5);
+}
+
+TEST_CASE("stringKeys")
+{
+    const persistent_map<std::string, int> map {{"one", 1}, {"two", 2}, {"one", 3}};
+    CHECK_EQ(map.size(), 2);
+    CHECK_EQ(map.at("one"), 1);
+    CHECK_EQ(map.find("two")->second, 2);
+}
+
+TEST_SUITE_END();
+// NOLINTEND(*)
+}  // namespace
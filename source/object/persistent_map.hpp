@@ -0,0 +1,274 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+/// Hash map with structural sharing, the storage of hash_object.
+///
+/// The map is a hash array mapped trie, every node consumes 5 bits of the hash of a key and stores the entries and
+/// the child nodes of its 32 slots compactly, indexed by two bitmaps. Keys with the same hash end up in a collision
+/// node below the last level. Like persistent_vector the map has value semantics: copying it only copies the
+/// pointer to the root, an insert copies the nodes on the path to the key that are shared with another map and
+/// modifies the ones it owns in place, so inserting into a copy costs O(log32 n).
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class persistent_map final
+{
+    static constexpr std::size_t bits = 5;
+    static constexpr std::size_t hash_bits = 64;
+
+  public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using value_type = std::pair<Key, Value>;
+
+  private:
+    struct node final
+    {
+        std::uint32_t entry_map {};
+        std::uint32_t child_map {};
+        std::vector<value_type> entries;
+        std::vector<std::shared_ptr<node>> children;
+    };
+
+  public:
+    class const_iterator final
+    {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = persistent_map::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        const_iterator() = default;
+
+        explicit const_iterator(const node* root)
+        {
+            if (root != nullptr) {
+                m_stack.push_back({root, 0});
+                settle();
+            }
+        }
+
+        [[nodiscard]] auto operator*() const -> reference
+        {
+            const auto& top = m_stack.back();
+            return top.current->entries[top.index];
+        }
+
+        [[nodiscard]] auto operator->() const -> pointer { return &**this; }
+
+        auto operator++() -> const_iterator&
+        {
+            m_stack.back().index++;
+            settle();
+            return *this;
+        }
+
+        auto operator++(int) -> const_iterator
+        {
+            auto previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        [[nodiscard]] auto operator==(const const_iterator& other) const -> bool
+        {
+            if (m_stack.empty() || other.m_stack.empty()) {
+                return m_stack.empty() == other.m_stack.empty();
+            }
+            return m_stack.back().current == other.m_stack.back().current
+                && m_stack.back().index == other.m_stack.back().index;
+        }
+
+      private:
+        friend persistent_map;
+
+        struct position final
+        {
+            const node* current {};
+            // the entries of a node are visited before its children
+            std::size_t index {};
+        };
+
+        /// descends until the top of the stack refers to an entry, the stack is empty at the end
+        auto settle() -> void
+        {
+            while (!m_stack.empty()) {
+                auto& top = m_stack.back();
+                if (top.index < top.current->entries.size()) {
+                    return;
+                }
+                const auto child = top.index - top.current->entries.size();
+                if (child < top.current->children.size()) {
+                    top.index++;
+                    m_stack.push_back({top.current->children[child].get(), 0});
+                    continue;
+                }
+                m_stack.pop_back();
+            }
+        }
+
+        std::vector<position> m_stack;
+    };
+
+    using iterator = const_iterator;
+
+    persistent_map() = default;
+
+    persistent_map(std::initializer_list<value_type> entries)
+    {
+        for (const auto& entry : entries) {
+            insert(entry);
+        }
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t { return m_size; }
+
+    [[nodiscard]] auto empty() const -> bool { return m_size == 0; }
+
+    [[nodiscard]] auto find(const Key& key) const -> const_iterator
+    {
+        const auto hash = hash_of(key);
+        const node* current = m_root.get();
+        const_iterator itr;
+        for (std::size_t shift = 0; current != nullptr; shift += bits) {
+            if (shift >= hash_bits) {
+                for (std::size_t idx = 0; idx < current->entries.size(); idx++) {
+                    if (current->entries[idx].first == key) {
+                        itr.m_stack.push_back({current, idx});
+                        return itr;
+                    }
+                }
+                return end();
+            }
+            const auto bit = bit_of(hash, shift);
+            if ((current->entry_map & bit) != 0) {
+                const auto idx = index_of(current->entry_map, bit);
+                if (current->entries[idx].first != key) {
+                    return end();
+                }
+                itr.m_stack.push_back({current, idx});
+                return itr;
+            }
+            if ((current->child_map & bit) == 0) {
+                return end();
+            }
+            // the iterator only has to visit the remaining entries, so the parents are not needed on its stack
+            current = current->children[index_of(current->child_map, bit)].get();
+        }
+        return end();
+    }
+
+    [[nodiscard]] auto contains(const Key& key) const -> bool { return find(key) != end(); }
+
+    [[nodiscard]] auto at(const Key& key) const -> const Value&
+    {
+        const auto itr = find(key);
+        if (itr == end()) {
+            throw std::out_of_range("persistent_map::at");
+        }
+        return itr->second;
+    }
+
+    /// inserts the entry if its key is not contained yet, like std::unordered_map::insert
+    auto insert(const value_type& entry) -> bool { return put(entry, false); }
+
+    auto insert_or_assign(const Key& key, Value val) -> bool { return put({key, std::move(val)}, true); }
+
+    [[nodiscard]] auto begin() const -> const_iterator { return const_iterator {m_root.get()}; }
+
+    [[nodiscard]] auto end() const -> const_iterator { return {}; }
+
+    [[nodiscard]] auto cbegin() const -> const_iterator { return begin(); }
+
+    [[nodiscard]] auto cend() const -> const_iterator { return end(); }
+
+  private:
+    [[nodiscard]] static auto hash_of(const Key& key) -> std::uint64_t
+    {
+        return static_cast<std::uint64_t>(Hash {}(key));
+    }
+
+    [[nodiscard]] static auto bit_of(std::uint64_t hash, std::size_t shift) -> std::uint32_t
+    {
+        return 1U << ((hash >> shift) & ((1U << bits) - 1));
+    }
+
+    [[nodiscard]] static auto index_of(std::uint32_t bitmap, std::uint32_t bit) -> std::size_t
+    {
+        return static_cast<std::size_t>(std::popcount(bitmap & (bit - 1)));
+    }
+
+    auto put(value_type entry, bool assign) -> bool
+    {
+        const auto hash = hash_of(entry.first);
+        const auto added = put(m_root, std::move(entry), hash, 0, assign);
+        if (added) {
+            m_size++;
+        }
+        return added;
+    }
+
+    static auto put(std::shared_ptr<node>& current, value_type entry, std::uint64_t hash, std::size_t shift, bool assign)
+        -> bool
+    {
+        if (!current) {
+            current = std::make_shared<node>();
+        } else if (current.use_count() > 1) {
+            current = std::make_shared<node>(*current);
+        }
+        auto& entries = current->entries;
+        if (shift >= hash_bits) {
+            for (auto& existing : entries) {
+                if (existing.first == entry.first) {
+                    if (assign) {
+                        existing.second = std::move(entry.second);
+                    }
+                    return false;
+                }
+            }
+            entries.push_back(std::move(entry));
+            return true;
+        }
+        const auto bit = bit_of(hash, shift);
+        if ((current->child_map & bit) != 0) {
+            return put(current->children[index_of(current->child_map, bit)], std::move(entry), hash, shift + bits, assign);
+        }
+        const auto idx = index_of(current->entry_map, bit);
+        if ((current->entry_map & bit) == 0) {
+            entries.insert(entries.begin() + static_cast<std::ptrdiff_t>(idx), std::move(entry));
+            current->entry_map |= bit;
+            return true;
+        }
+        if (entries[idx].first == entry.first) {
+            if (assign) {
+                entries[idx].second = std::move(entry.second);
+            }
+            return false;
+        }
+        // two keys share the slot, both move down into a new child
+        auto existing = std::move(entries[idx]);
+        entries.erase(entries.begin() + static_cast<std::ptrdiff_t>(idx));
+        current->entry_map &= ~bit;
+        const auto existing_hash = hash_of(existing.first);
+        std::shared_ptr<node> child;
+        put(child, std::move(existing), existing_hash, shift + bits, false);
+        put(child, std::move(entry), hash, shift + bits, false);
+        current->children.insert(
+            current->children.begin() + static_cast<std::ptrdiff_t>(index_of(current->child_map, bit)), std::move(child));
+        current->child_map |= bit;
+        return true;
+    }
+
+    std::shared_ptr<node> m_root;
+    std::size_t m_size {};
+};
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <vector>
+
+#include "persistent_vector.hpp"
+
+#include <doctest/doctest.h>
+#include <object/object.hpp>
+
+persistent_vector::const_iterator::const_iterator(const persistent_vector* vec, std::size_t index)
+    : m_vec {vec}
+    , m_index {index}
+    , m_leaf {index < vec->size() ? vec->leaf_for(index + vec->m_offset) : nullptr}
+{
+}
+
+auto persistent_vector::const_iterator::operator++() -> const_iterator&
+{
+    m_index++;
+    const auto position = m_index + m_vec->m_offset;
+    if ((position & mask) == 0) {
+        m_leaf = m_index < m_vec->size() ? m_vec->leaf_for(position) : nullptr;
+    }
+    return *this;
+}
+
+persistent_vector::persistent_vector(std::initializer_list<value_type> values)
+{
+    for (const auto* val : values) {
+        push_back(val);
+    }
+}
+
+auto persistent_vector::leaf_for(std::size_t position) const -> const value_type*
+{
+    if (position >= tail_offset()) {
+        return m_tail->values.data();
+    }
+    const void* node = m_root.get();
+    for (auto level = m_shift; level > 0; level -= bits) {
+        node = static_cast<const branch*>(node)->children[(position >> level) & mask].get();
+    }
+    return static_cast<const leaf*>(node)->values.data();
+}
+
+auto persistent_vector::push_back(value_type val) -> void
+{
+    const auto tail_size = m_count - tail_offset();
+    if (m_tail && tail_size < width) {
+        if (m_tail.use_count() > 1) {
+            m_tail = std::make_shared<leaf>(*m_tail);
+        }
+        m_tail->values[tail_size] = val;
+        m_count++;
+        return;
+    }
+    if (m_tail) {
+        // the tail is full, it becomes the rightmost leaf of the trie
+        if ((m_count >> bits) > (1UL << m_shift)) {
+            auto root = std::make_shared<branch>();
+            root->children[0] = std::move(m_root);
+            root->children[1] = new_path(m_shift, m_tail);
+            m_root = std::move(root);
+            m_shift += bits;
+        } else {
+            push_tail(m_shift, m_root, m_tail);
+        }
+    }
+    m_tail = std::make_shared<leaf>();
+    m_tail->values[0] = val;
+    m_count++;
+}
+
+auto persistent_vector::push_tail(std::size_t level, std::shared_ptr<void>& node, const std::shared_ptr<leaf>& tail)
+    -> void
+{
+    if (!node) {
+        node = std::make_shared<branch>();
+    } else if (node.use_count() > 1) {
+        node = std::make_shared<branch>(*static_cast<const branch*>(node.get()));
+    }
+    auto& child = static_cast<branch*>(node.get())->children[((m_count - 1) >> level) & mask];
+    if (level == bits) {
+        child = tail;
+        return;
+    }
+    if (child) {
+        push_tail(level - bits, child, tail);
+        return;
+    }
+    child = new_path(level - bits, tail);
+}
+
+auto persistent_vector::new_path(std::size_t level, const std::shared_ptr<leaf>& tail) -> std::shared_ptr<void>
+{
+    if (level == 0) {
+        return tail;
+    }
+    auto node = std::make_shared<branch>();
+    node->children[0] = new_path(level - bits, tail);
+    return node;
+}
+
+auto persistent_vector::drop_front(std::size_t count) const -> persistent_vector
+{
+    if (count >= size()) {
+        return {};
+    }
+    auto result = *this;
+    result.m_offset += count;
+    return result;
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+TEST_SUITE_BEGIN("persistent_vector");
+
+auto make_objects(std::size_t count) -> std::vector<const object*>
+{
+    std::vector<const object*> objects;
+    for (std::size_t idx = 0; idx < count; idx++) {
+        objects.push_back(make<integer_object>(static_cast<std::int64_t>(idx)));
+    }
+    return objects;
+}
+
+auto require_elements(const persistent_vector& vec, const std::vector<const object*>& expected) -> void
+{
+    REQUIRE_EQ(vec.size(), expected.size());
+    for (std::size_t idx = 0; idx < expected.size(); idx++) {
+        REQUIRE_EQ(vec[idx], expected[idx]);
+    }
+    REQUIRE(std::equal(vec.begin(), vec.end(), expected.begin(), expected.end()));
+}
+
+TEST_CASE("pushBackGrowsTheTrie")
+{
+    for (const auto count : {0UL, 1UL, 31UL, 32UL, 33UL, 1024UL, 1056UL, 1057UL, 40000UL}) {
+        const auto objects = make_objects(count);
+        const persistent_vector vec {objects.begin(), objects.end()};
+        require_elements(vec, objects);
+    }
+}
+
+TEST_CASE("copiesAreNotModifiedByPushBack")
+{
+    const auto objects = make_objects(2000);
+    persistent_vector original;
+    std::vector<persistent_vector> snapshots;
+    for (const auto* obj : objects) {
+        snapshots.push_back(original);
+        original.push_back(obj);
+    }
+    auto copy = original;
+    copy.push_back(objects[0]);
+    require_elements(original, objects);
+    for (std::size_t idx = 0; idx < snapshots.size(); idx += 97) {
+        require_elements(snapshots[idx], {objects.begin(), objects.begin() + static_cast<std::ptrdiff_t>(idx)});
+    }
+    CHECK_EQ(copy.size(), objects.size() + 1);
+    CHECK_EQ(copy.back(), objects[0]);
+}
+
+TEST_CASE("dropFrontSharesTheElements")
+{
+    const auto objects = make_objects(100);
+    const persistent_vector vec {objects.begin(), objects.end()};
+    auto rest = vec.drop_front(1);
+    require_elements(rest, {objects.begin() + 1, objects.end()});
+    for (std::size_t idx = 2; idx < objects.size(); idx++) {
+        rest = rest.drop_front(1);
+        CHECK_EQ(rest.front(), objects[idx]);
+    }
+    rest.push_back(objects[0]);
+    require_elements(rest, {objects.back(), objects.front()});
+    require_elements(vec, objects);
+    CHECK(vec.drop_front(100).empty());
+}
+
+TEST_SUITE_END();
+// NOLINTEND(*)
+}  // namespace
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+
+struct object;
+
+/// Vector of object pointers with structural sharing, the storage of array_object.
+///
+/// The elements live in a trie of nodes with 32 slots, the last, partially filled node is kept aside as the tail.
+/// Copying a vector only copies the pointer to the root and the tail, push_back copies the nodes on the path to the
+/// new element that are shared with another vector and modifies the ones it owns in place. So a vector behaves like
+/// a std::vector that is copied on every modification, while push_back on a copy costs O(log32 n).
+/// drop_front is O(1), it hides the front elements behind an offset and keeps sharing all nodes.
+class persistent_vector final
+{
+  public:
+    using value_type = const object*;
+    using size_type = std::size_t;
+
+    static constexpr std::size_t bits = 5;
+    static constexpr std::size_t width = 1UL << bits;
+    static constexpr std::size_t mask = width - 1;
+
+    class const_iterator final
+    {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = persistent_vector::value_type;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        const_iterator() = default;
+        const_iterator(const persistent_vector* vec, std::size_t index);
+
+        [[nodiscard]] auto operator*() const -> reference { return m_leaf[(m_index + m_vec->m_offset) & mask]; }
+
+        auto operator++() -> const_iterator&;
+
+        auto operator++(int) -> const_iterator
+        {
+            auto previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        [[nodiscard]] auto operator==(const const_iterator& other) const -> bool { return m_index == other.m_index; }
+
+      private:
+        const persistent_vector* m_vec {};
+        std::size_t m_index {};
+        const value_type* m_leaf {};
+    };
+
+    using iterator = const_iterator;
+
+    persistent_vector() = default;
+    persistent_vector(std::initializer_list<value_type> values);
+
+    template<std::input_iterator Iterator>
+    persistent_vector(Iterator first, Iterator last)
+    {
+        for (; first != last; ++first) {
+            push_back(*first);
+        }
+    }
+
+    [[nodiscard]] auto size() const -> std::size_t { return m_count - m_offset; }
+
+    [[nodiscard]] auto empty() const -> bool { return size() == 0; }
+
+    [[nodiscard]] auto operator[](std::size_t index) const -> value_type
+    {
+        const auto position = index + m_offset;
+        return leaf_for(position)[position & mask];
+    }
+
+    [[nodiscard]] auto front() const -> value_type { return (*this)[0]; }
+
+    [[nodiscard]] auto back() const -> value_type { return (*this)[size() - 1]; }
+
+    auto push_back(value_type val) -> void;
+    /// returns a vector without the first count elements, sharing all nodes with this one
+    [[nodiscard]] auto drop_front(std::size_t count) const -> persistent_vector;
+
+    [[nodiscard]] auto begin() const -> const_iterator { return {this, 0}; }
+
+    [[nodiscard]] auto end() const -> const_iterator { return {this, size()}; }
+
+    [[nodiscard]] auto cbegin() const -> const_iterator { return begin(); }
+
+    [[nodiscard]] auto cend() const -> const_iterator { return end(); }
+
+  private:
+    struct leaf final
+    {
+        std::array<value_type, width> values {};
+    };
+
+    struct branch final
+    {
+        // the children are leaves on the lowest level and branches above
+        std::array<std::shared_ptr<void>, width> children {};
+    };
+
+    [[nodiscard]] auto tail_offset() const -> std::size_t { return m_count < width ? 0 : ((m_count - 1) >> bits) << bits; }
+
+    [[nodiscard]] auto leaf_for(std::size_t position) const -> const value_type*;
+    auto push_tail(std::size_t level, std::shared_ptr<void>& node, const std::shared_ptr<leaf>& tail) -> void;
+    [[nodiscard]] static auto new_path(std::size_t level, const std::shared_ptr<leaf>& tail) -> std::shared_ptr<void>;
+
+    std::shared_ptr<void> m_root;
+    std::shared_ptr<leaf> m_tail;
+    std::size_t m_shift {bits};
+    // number of elements stored including the ones hidden by the offset
+    std::size_t m_count {};
+    std::size_t m_offset {};
+};
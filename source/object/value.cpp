@@ -0,0 +1,120 @@
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include "value.hpp"
+
+#include <doctest/doctest.h>
+#include <gc.hpp>
+#include <object/object.hpp>
+
+auto value::from(const object* obj) -> value
+{
+    if (obj == nullptr) {
+        return {};
+    }
+    if (obj->is_null()) {
+        return null_value();
+    }
+    switch (obj->type()) {
+        case object::object_type::integer:
+            return value::integer(obj->as<integer_object>()->value);
+        case object::object_type::decimal:
+            return value::decimal(obj->as<decimal_object>()->value);
+        case object::object_type::boolean:
+            return value::boolean(obj->as<boolean_object>()->value);
+        default:
+            return value {tag::object, {.obj = obj}};
+    }
+}
+
+auto value::to_object() const -> const object*
+{
+    switch (m_tag) {
+        case tag::undefined:
+            return nullptr;
+        case tag::null:
+            return null();
+        case tag::boolean:
+            return native_bool_to_object(m_payload.boolean);
+        case tag::integer:
+            return make<integer_object>(m_payload.integer);
+        case tag::decimal:
+            return make<decimal_object>(m_payload.decimal);
+        case tag::object:
+            return m_payload.obj;
+    }
+    return nullptr;
+}
+
+auto value::is_truthy_object() const -> bool
+{
+    return m_payload.obj->is_truthy();
+}
+
+auto value::tag_offset() -> std::size_t
+{
+    return offsetof(value, m_tag);
+}
+
+auto value::payload_offset() -> std::size_t
+{
+    return offsetof(value, m_payload);
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+TEST_SUITE_BEGIN("value");
+
+TEST_CASE("scalarsAreStoredInline")
+{
+    static_assert(sizeof(value) == 16);
+    CHECK(value {}.is_undefined());
+    CHECK(value::null_value().is_null());
+    CHECK_EQ(value::integer(std::numeric_limits<std::int64_t>::max()).as_integer(),
+             std::numeric_limits<std::int64_t>::max());
+    CHECK_EQ(value::decimal(1.5).as_decimal(), 1.5);
+    CHECK(value::boolean(true).as_boolean());
+}
+
+TEST_CASE("fromUnboxesScalars")
+{
+    const integer_object int_obj {42};
+    const decimal_object dec_obj {4.2};
+    const string_object str_obj {"str"};
+
+    CHECK(value::from(nullptr).is_undefined());
+    CHECK(value::from(null()).is_null());
+    CHECK(value::from(tru()).is_boolean());
+    CHECK_FALSE(value::from(fals()).as_boolean());
+    CHECK_EQ(value::from(&int_obj).as_integer(), 42);
+    CHECK_EQ(value::from(&dec_obj).as_decimal(), 4.2);
+    CHECK_EQ(value::from(&str_obj).as_object(), &str_obj);
+}
+
+TEST_CASE("toObjectBoxesScalars")
+{
+    CHECK_EQ(value {}.to_object(), nullptr);
+    CHECK_EQ(value::null_value().to_object(), null());
+    CHECK_EQ(value::boolean(true).to_object(), tru());
+    CHECK_EQ(value::boolean(false).to_object(), fals());
+    CHECK_EQ(value::integer(-1).to_object()->as<integer_object>()->value, -1);
+    CHECK_EQ(value::decimal(0.5).to_object()->as<decimal_object>()->value, 0.5);
+}
+
+TEST_CASE("truthiness")
+{
+    const string_object empty {""};
+    CHECK_FALSE(value {}.is_truthy());
+    CHECK_FALSE(value::null_value().is_truthy());
+    CHECK_FALSE(value::integer(0).is_truthy());
+    CHECK(value::integer(-1).is_truthy());
+    CHECK_FALSE(value::decimal(0.0).is_truthy());
+    CHECK(value::boolean(true).is_truthy());
+    CHECK_FALSE(value::from(&empty).is_truthy());
+}
+
+TEST_SUITE_END();
+// NOLINTEND(*)
+}  // namespace
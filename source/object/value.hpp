@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct object;
+
+/// Representation of the values on the stack, in the globals and in the free variables of the virtual machine.
+///
+/// Integers, decimals, booleans and null are stored inline, so arithmetic on them does not allocate. Only the
+/// remaining objects are referenced by pointer. Scalars are always kept in their inline form, value::from() unboxes
+/// them and to_object() boxes them again when a value leaves the virtual machine.
+class value final
+{
+  public:
+    enum class tag : std::uint8_t
+    {
+        undefined,
+        null,
+        boolean,
+        integer,
+        decimal,
+        object,
+    };
+
+    constexpr value() = default;
+
+    [[nodiscard]] static constexpr auto null_value() -> value { return value {tag::null, {}}; }
+
+    [[nodiscard]] static constexpr auto boolean(bool val) -> value { return value {tag::boolean, {.boolean = val}}; }
+
+    [[nodiscard]] static constexpr auto integer(std::int64_t val) -> value
+    {
+        return value {tag::integer, {.integer = val}};
+    }
+
+    [[nodiscard]] static constexpr auto decimal(double val) -> value { return value {tag::decimal, {.decimal = val}}; }
+
+    /// unboxes integers, decimals, booleans and null, every other object is referenced as is
+    [[nodiscard]] static auto from(const object* obj) -> value;
+
+    /// boxes the value, an undefined value becomes nullptr
+    [[nodiscard]] auto to_object() const -> const object*;
+
+    [[nodiscard]] constexpr auto kind() const -> tag { return m_tag; }
+
+    [[nodiscard]] constexpr auto is_undefined() const -> bool { return m_tag == tag::undefined; }
+
+    [[nodiscard]] constexpr auto is_null() const -> bool { return m_tag == tag::null; }
+
+    [[nodiscard]] constexpr auto is_boolean() const -> bool { return m_tag == tag::boolean; }
+
+    [[nodiscard]] constexpr auto is_integer() const -> bool { return m_tag == tag::integer; }
+
+    [[nodiscard]] constexpr auto is_decimal() const -> bool { return m_tag == tag::decimal; }
+
+    [[nodiscard]] constexpr auto is_object() const -> bool { return m_tag == tag::object; }
+
+    [[nodiscard]] constexpr auto as_boolean() const -> bool { return m_payload.boolean; }
+
+    [[nodiscard]] constexpr auto as_integer() const -> std::int64_t { return m_payload.integer; }
+
+    [[nodiscard]] constexpr auto as_decimal() const -> double { return m_payload.decimal; }
+
+    [[nodiscard]] constexpr auto as_object() const -> const object* { return m_payload.obj; }
+
+    [[nodiscard]] auto is_truthy() const -> bool
+    {
+        switch (m_tag) {
+            case tag::boolean:
+                return m_payload.boolean;
+            case tag::integer:
+                return m_payload.integer != 0;
+            case tag::decimal:
+                return m_payload.decimal != 0.0;
+            case tag::object:
+                return is_truthy_object();
+            default:
+                return false;
+        }
+    }
+
+    /// offsets of the tag and of the payload, for the machine code generated by the jit compiler
+    [[nodiscard]] static auto tag_offset() -> std::size_t;
+    [[nodiscard]] static auto payload_offset() -> std::size_t;
+
+  private:
+    union payload
+    {
+        std::int64_t integer;
+        double decimal;
+        bool boolean;
+        const object* obj;
+    };
+
+    constexpr value(tag tg, payload pld)
+        : m_tag {tg}
+        , m_payload {pld}
+    {
+    }
+
+    [[nodiscard]] auto is_truthy_object() const -> bool;
+
+    tag m_tag {tag::undefined};
+    payload m_payload {.integer = 0};
+};
+
+using values = std::vector<value>;
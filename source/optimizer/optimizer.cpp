@@ -0,0 +1,511 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "optimizer.hpp"
+
+#include <analyzer/analyzer.hpp>
+#include <ast/array_literal.hpp>
+#include <ast/assign_expression.hpp>
+#include <ast/binary_expression.hpp>
+#include <ast/boolean_literal.hpp>
+#include <ast/call_expression.hpp>
+#include <ast/decimal_literal.hpp>
+#include <ast/expression.hpp>
+#include <ast/function_literal.hpp>
+#include <ast/hash_literal.hpp>
+#include <ast/identifier.hpp>
+#include <ast/if_expression.hpp>
+#include <ast/index_expression.hpp>
+#include <ast/integer_literal.hpp>
+#include <ast/null_literal.hpp>
+#include <ast/program.hpp>
+#include <ast/statements.hpp>
+#include <ast/string_literal.hpp>
+#include <ast/unary_expression.hpp>
+#include <doctest/doctest.h>
+#include <eval/evaluator.hpp>
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+#include <lexer/lexer.hpp>
+#include <lexer/token_type.hpp>
+#include <object/object.hpp>
+#include <parser/parser.hpp>
+
+namespace
+{
+/// longest string repetition folded, the expression might never be evaluated
+constexpr std::size_t max_folded_string = 256;
+
+/// the visitor only hands out const nodes, but they all belong to the program being optimized
+template<typename Node>
+auto mutable_node(const Node& node) -> Node&
+{
+    return const_cast<Node&>(node);  // NOLINT(*-const-cast)
+}
+
+/// the object a literal evaluates to, nullptr for all other expressions
+auto literal_object(const expression* expr) -> const object*
+{
+    if (const auto* lit = dynamic_cast<const integer_literal*>(expr); lit != nullptr) {
+        return make<integer_object>(lit->value);
+    }
+    if (const auto* lit = dynamic_cast<const decimal_literal*>(expr); lit != nullptr) {
+        return make<decimal_object>(lit->value);
+    }
+    if (const auto* lit = dynamic_cast<const string_literal*>(expr); lit != nullptr) {
+        return make<string_object>(lit->value);
+    }
+    if (const auto* lit = dynamic_cast<const boolean_literal*>(expr); lit != nullptr) {
+        return native_bool_to_object(lit->value);
+    }
+    if (dynamic_cast<const null_literal*>(expr) != nullptr) {
+        return null();
+    }
+    return nullptr;
+}
+
+auto as_count(const object* obj) -> std::int64_t
+{
+    return obj->is(object::object_type::integer) ? obj->as<integer_object>()->value
+                                                  : static_cast<std::int64_t>(obj->as<boolean_object>()->value);
+}
+
+/// whether the operator can be applied before running, shifts out of range are left to the machine
+auto foldable(token_type oper, const object* left, const object* right) -> bool
+{
+    using enum object::object_type;
+    const auto is_count = [](const object* obj) { return obj->is(integer) || obj->is(boolean); };
+    if ((oper == token_type::shift_left || oper == token_type::shift_right) && right->is(integer)) {
+        const auto amount = right->as<integer_object>()->value;
+        return amount >= 0 && amount < std::int64_t {64};
+    }
+    if (oper == token_type::asterisk && (left->is(string) || right->is(string))) {
+        const auto* str = left->is(string) ? left : right;
+        const auto* count = left->is(string) ? right : left;
+        if (!is_count(count) || as_count(count) <= 0) {
+            return true;
+        }
+        const auto length = str->as<string_object>()->value().size();
+        return length <= max_folded_string / static_cast<std::size_t>(as_count(count));
+    }
+    return true;
+}
+
+auto defines_names(const expression* expr) -> bool;
+
+auto any_defines_names(const expressions& exprs) -> bool
+{
+    return std::ranges::any_of(exprs, defines_names);
+}
+
+/// whether the expression defines a name visible after it, the bodies of functions and loops have scopes of their
+/// own, blocks do not
+auto defines_names(const expression* expr) -> bool
+{
+    if (expr == nullptr) {
+        return false;
+    }
+    if (dynamic_cast<const let_statement*>(expr) != nullptr) {
+        return true;
+    }
+    if (const auto* block = dynamic_cast<const block_statement*>(expr); block != nullptr) {
+        return any_defines_names(block->statements);
+    }
+    if (const auto* stmt = dynamic_cast<const expression_statement*>(expr); stmt != nullptr) {
+        return defines_names(stmt->expr);
+    }
+    if (const auto* stmt = dynamic_cast<const return_statement*>(expr); stmt != nullptr) {
+        return defines_names(stmt->value);
+    }
+    if (const auto* if_expr = dynamic_cast<const if_expression*>(expr); if_expr != nullptr) {
+        return defines_names(if_expr->condition) || defines_names(if_expr->consequence)
+            || defines_names(if_expr->alternative);
+    }
+    if (const auto* binary = dynamic_cast<const binary_expression*>(expr); binary != nullptr) {
+        return defines_names(binary->left) || defines_names(binary->right);
+    }
+    if (const auto* unary = dynamic_cast<const unary_expression*>(expr); unary != nullptr) {
+        return defines_names(unary->right);
+    }
+    if (const auto* assign = dynamic_cast<const assign_expression*>(expr); assign != nullptr) {
+        return defines_names(assign->value);
+    }
+    if (const auto* call = dynamic_cast<const call_expression*>(expr); call != nullptr) {
+        return defines_names(call->function) || any_defines_names(call->arguments);
+    }
+    if (const auto* index = dynamic_cast<const index_expression*>(expr); index != nullptr) {
+        return defines_names(index->left) || defines_names(index->index);
+    }
+    if (const auto* array = dynamic_cast<const array_literal*>(expr); array != nullptr) {
+        return any_defines_names(array->elements);
+    }
+    if (const auto* hash = dynamic_cast<const hash_literal*>(expr); hash != nullptr) {
+        return std::ranges::any_of(
+            hash->pairs, [](const auto& pair) { return defines_names(pair.first) || defines_names(pair.second); });
+    }
+    return false;
+}
+
+auto ends_block(const expression* stmt) -> bool
+{
+    return dynamic_cast<const return_statement*>(stmt) != nullptr
+        || dynamic_cast<const break_statement*>(stmt) != nullptr
+        || dynamic_cast<const continue_statement*>(stmt) != nullptr;
+}
+}  // namespace
+
+void optimize_program(program* prgrm)
+{
+    optimizer opt {prgrm->nodes.get()};
+    opt.optimize(prgrm);
+}
+
+auto constant_condition(const expression* condition) -> std::optional<bool>
+{
+    if (const auto* lit = dynamic_cast<const boolean_literal*>(condition); lit != nullptr) {
+        return lit->value;
+    }
+    return std::nullopt;
+}
+
+optimizer::optimizer(arena* nodes)
+    : m_nodes {nodes}
+{
+}
+
+void optimizer::optimize(program* prgrm)
+{
+    prgrm->accept(*this);
+}
+
+auto optimizer::rewrite(const expression* expr) -> expression*
+{
+    expr->accept(*this);
+    return m_result;
+}
+
+auto optimizer::rewrite_statements(expressions& statements) -> void
+{
+    for (auto& stmt : statements) {
+        stmt = rewrite(stmt);
+    }
+}
+
+auto optimizer::rewrite_condition(const expression* condition) -> expression*
+{
+    auto* rewritten = rewrite(condition);
+    if (const auto* obj = literal_object(rewritten); obj != nullptr) {
+        return m_nodes->make<boolean_literal>(obj->is_truthy(), rewritten->l);
+    }
+    return rewritten;
+}
+
+void optimizer::visit(const array_literal& expr)
+{
+    auto& node = mutable_node(expr);
+    rewrite_statements(node.elements);
+    m_result = &node;
+}
+
+void optimizer::visit(const assign_expression& expr)
+{
+    auto& node = mutable_node(expr);
+    node.value = rewrite(expr.value);
+    m_result = &node;
+}
+
+void optimizer::visit(const binary_expression& expr)
+{
+    auto& node = mutable_node(expr);
+    node.left = rewrite(expr.left);
+    node.right = rewrite(expr.right);
+    m_result = &node;
+
+    const auto* left = literal_object(node.left);
+    // a left operand deciding && or || is all that is evaluated
+    if (left != nullptr && !defines_names(node.right)
+        && ((expr.op == token_type::logical_and && !left->is_truthy())
+            || (expr.op == token_type::logical_or && left->is_truthy())))
+    {
+        m_result = m_nodes->make<boolean_literal>(left->is_truthy(), expr.l);
+        return;
+    }
+    const auto* right = left != nullptr ? literal_object(node.right) : nullptr;
+    if (right == nullptr || !foldable(expr.op, left, right)) {
+        return;
+    }
+    const auto* result = apply_binary_operator(expr.op, left, right);
+    if (result == nullptr || result->is_error()) {
+        return;
+    }
+    using enum object::object_type;
+    if (result->is_null()) {
+        m_result = m_nodes->make<null_literal>(expr.l);
+    } else if (result->is(integer)) {
+        auto* lit = m_nodes->make<integer_literal>(expr.l);
+        lit->value = result->as<integer_object>()->value;
+        m_result = lit;
+    } else if (result->is(decimal)) {
+        auto* lit = m_nodes->make<decimal_literal>(expr.l);
+        lit->value = result->as<decimal_object>()->value;
+        m_result = lit;
+    } else if (result->is(boolean)) {
+        m_result = m_nodes->make<boolean_literal>(result->as<boolean_object>()->value, expr.l);
+    } else if (result->is(string)) {
+        m_result = m_nodes->make<string_literal>(std::string {result->as<string_object>()->value()}, expr.l);
+    }
+}
+
+void optimizer::visit(const block_statement& expr)
+{
+    auto& node = mutable_node(expr);
+    rewrite_statements(node.statements);
+    auto& statements = node.statements;
+    const auto end = std::ranges::find_if(statements, ends_block);
+    if (end != statements.end() && !std::any_of(std::next(end), statements.end(), defines_names)) {
+        statements.erase(std::next(end), statements.end());
+    }
+    m_result = &node;
+}
+
+void optimizer::visit(const boolean_literal& expr)
+{
+    m_result = &mutable_node(expr);
+}
+
+void optimizer::visit(const break_statement& expr)
+{
+    m_result = &mutable_node(expr);
+}
+
+void optimizer::visit(const call_expression& expr)
+{
+    auto& node = mutable_node(expr);
+    node.function = rewrite(expr.function);
+    rewrite_statements(node.arguments);
+    m_result = &node;
+}
+
+void optimizer::visit(const continue_statement& expr)
+{
+    m_result = &mutable_node(expr);
+}
+
+void optimizer::visit(const decimal_literal& expr)
+{
+    m_result = &mutable_node(expr);
+}
+
+void optimizer::visit(const expression_statement& expr)
+{
+    auto& node = mutable_node(expr);
+    node.expr = rewrite(expr.expr);
+    m_result = &node;
+}
+
+void optimizer::visit(const function_literal& expr)
+{
+    expr.body->accept(*this);
+    m_result = &mutable_node(expr);
+}
+
+void optimizer::visit(const hash_literal& expr)
+{
+    auto& node = mutable_node(expr);
+    for (auto& [key, value] : node.pairs) {
+        key = rewrite(key);
+        value = rewrite(value);
+    }
+    m_result = &node;
+}
+
+void optimizer::visit(const identifier& expr)
+{
+    m_result = &mutable_node(expr);
+}
+
+void optimizer::visit(const if_expression& expr)
+{
+    auto& node = mutable_node(expr);
+    node.condition = rewrite_condition(expr.condition);
+    expr.consequence->accept(*this);
+    if (expr.alternative != nullptr) {
+        expr.alternative->accept(*this);
+    }
+    m_result = &node;
+
+    const auto condition = constant_condition(node.condition);
+    if (!condition.has_value()) {
+        return;
+    }
+    auto* taken = condition.value() ? node.consequence : node.alternative;
+    const auto* not_taken = condition.value() ? node.alternative : node.consequence;
+    if (defines_names(not_taken)) {
+        return;
+    }
+    node.condition = m_nodes->make<boolean_literal>(true, node.condition->l);
+    node.consequence = taken != nullptr ? taken : m_nodes->make<block_statement>(expr.l);
+    node.alternative = nullptr;
+}
+
+void optimizer::visit(const index_expression& expr)
+{
+    auto& node = mutable_node(expr);
+    node.left = rewrite(expr.left);
+    node.index = rewrite(expr.index);
+    m_result = &node;
+}
+
+void optimizer::visit(const integer_literal& expr)
+{
+    m_result = &mutable_node(expr);
+}
+
+void optimizer::visit(const let_statement& expr)
+{
+    auto& node = mutable_node(expr);
+    node.value = rewrite(expr.value);
+    m_result = &node;
+}
+
+void optimizer::visit(const null_literal& expr)
+{
+    m_result = &mutable_node(expr);
+}
+
+void optimizer::visit(const program& expr)
+{
+    auto& node = mutable_node(expr);
+    // a return ends the program, but the names defined after it are still known to the following inputs of the repl
+    rewrite_statements(node.statements);
+    m_result = &node;
+}
+
+void optimizer::visit(const return_statement& expr)
+{
+    auto& node = mutable_node(expr);
+    node.value = rewrite(expr.value);
+    m_result = &node;
+}
+
+void optimizer::visit(const string_literal& expr)
+{
+    m_result = &mutable_node(expr);
+}
+
+void optimizer::visit(const unary_expression& expr)
+{
+    auto& node = mutable_node(expr);
+    node.right = rewrite(expr.right);
+    m_result = &node;
+
+    if (expr.op == token_type::exclamation) {
+        if (const auto* operand = literal_object(node.right); operand != nullptr) {
+            m_result = m_nodes->make<boolean_literal>(!operand->is_truthy(), expr.l);
+        }
+        return;
+    }
+    if (expr.op != token_type::minus) {
+        return;
+    }
+    if (const auto* lit = dynamic_cast<const integer_literal*>(node.right); lit != nullptr) {
+        auto* negated = m_nodes->make<integer_literal>(expr.l);
+        negated->value = -lit->value;
+        m_result = negated;
+    } else if (const auto* lit = dynamic_cast<const decimal_literal*>(node.right); lit != nullptr) {
+        auto* negated = m_nodes->make<decimal_literal>(expr.l);
+        negated->value = -lit->value;
+        m_result = negated;
+    }
+}
+
+void optimizer::visit(const while_statement& expr)
+{
+    auto& node = mutable_node(expr);
+    node.condition = rewrite_condition(expr.condition);
+    expr.body->accept(*this);
+    m_result = &node;
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+auto optimized(std::string_view input) -> std::string
+{
+    auto prsr = parser {lexer {input}};
+    auto prgrm = prsr.parse_program();
+    INFO("while parsing: `", input, "`");
+    INFO("expected no errors, got:", fmt::format("{}", fmt::join(prsr.errors(), ", ")));
+    REQUIRE(prsr.errors().empty());
+    analyze_program(prgrm.get(), nullptr, nullptr);
+    optimize_program(prgrm.get());
+    return prgrm->string();
+}
+
+TEST_SUITE("optimizer")
+{
+    TEST_CASE("foldLiterals")
+    {
+        struct test
+        {
+            std::string_view input;
+            std::string_view expected;
+        };
+
+        std::array tests {
+            test {"1 + 2 * 3", "7"},
+            test {"(5 + 10 * 2 + 15 / 3) * 2 + -10", "50"},
+            test {"7 // 2 + 7 % 3", "4"},
+            test {"1 << 4 | 3", "19"},
+            test {"1.5 * 2", "3"},
+            test {"1 / 2", "0.5"},
+            test {R"("foo" + "bar")", R"("foobar")"},
+            test {R"("ab" * 3)", R"("ababab")"},
+            test {"1 < 2 == true", "true"},
+            test {"!(1 > 2) && 3", "true"},
+            test {"--5", "5"},
+            test {"!null", "true"},
+            test {"let f = fn() { 1 }; false && f()", "let f = fn() { 1; };false"},
+            test {"let f = fn() { 1 }; 1 || f()", "let f = fn() { 1; };true"},
+        };
+        for (const auto& [input, expected] : tests) {
+            INFO(input);
+            CHECK_EQ(optimized(input), expected);
+        }
+    }
+
+    TEST_CASE("operationsFailingAtRuntimeAreKept")
+    {
+        CHECK_EQ(optimized("1 / 0"), "(1 / 0)");
+        CHECK_EQ(optimized(R"(1 + "a")"), R"((1 + "a"))");
+        CHECK_EQ(optimized("1 << 64"), "(1 << 64)");
+        CHECK_EQ(optimized(R"("a" * 1000)"), R"(("a" * 1000))");
+        CHECK_EQ(optimized("let x = 2; x * (3 + 4)"), "let x = 2;(x * 7)");
+    }
+
+    TEST_CASE("eliminateBranches")
+    {
+        CHECK_EQ(optimized("if (1 < 2) { 10 } else { 20 }"), "if true 10 ");
+        CHECK_EQ(optimized(R"(if ("") { 10 } else { 20 })"), "if true 20 ");
+        CHECK_EQ(optimized("if (false) { 10 }"), "if true  ");
+        CHECK_EQ(optimized("while (1 > 2) { 10 }"), "while false 10");
+        // the names defined in the branch not taken are still known after it
+        CHECK_EQ(optimized("if (true) { 10 } else { let x = 1; }; x"), "if true 10 else let x = 1;x");
+    }
+
+    TEST_CASE("dropStatementsAfterReturn")
+    {
+        CHECK_EQ(optimized("fn() { return 1; 2; 3 }"), "fn() { return 1;; }");
+        CHECK_EQ(optimized("while (true) { break; 2 }"), "while true break");
+        CHECK_EQ(optimized("fn() { if (true) { return 1; let y = 2; } y }"), "fn() { if true return 1;let y = 2; y; }");
+    }
+}
+
+// NOLINTEND(*)
+}  // namespace
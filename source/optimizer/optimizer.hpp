@@ -0,0 +1,61 @@
+#pragma once
+
+#include <optional>
+
+#include <ast/arena.hpp>
+#include <ast/expression.hpp>
+#include <ast/program.hpp>
+#include <ast/visitor.hpp>
+
+/// Rewrites the tree of an analyzed program before it is compiled.
+///
+/// Operators applied to literals are replaced by the literal of their result. The result is computed by the operators
+/// of the objects, so it is the value the program computes itself, and operations failing at runtime are kept to fail
+/// when they are executed. Conditions known before running become boolean literals, an if deciding its branch that
+/// way is left as `if (true)` without alternative, which the compilers emit without any jumps. Statements following a
+/// return, break or continue in a block are dropped. Code is only ever dropped if it defines no names, as the names
+/// defined in a block are visible after it.
+struct optimizer final : visitor
+{
+    explicit optimizer(arena* nodes);
+    void optimize(program* prgrm);
+
+    void visit(const array_literal& expr) final;
+    void visit(const assign_expression& expr) final;
+    void visit(const binary_expression& expr) final;
+    void visit(const block_statement& expr) final;
+    void visit(const boolean_literal& expr) final;
+    void visit(const break_statement& expr) final;
+    void visit(const call_expression& expr) final;
+    void visit(const continue_statement& expr) final;
+    void visit(const decimal_literal& expr) final;
+    void visit(const expression_statement& expr) final;
+    void visit(const function_literal& expr) final;
+    void visit(const hash_literal& expr) final;
+    void visit(const identifier& expr) final;
+    void visit(const if_expression& expr) final;
+    void visit(const index_expression& expr) final;
+    void visit(const integer_literal& expr) final;
+    void visit(const let_statement& expr) final;
+    void visit(const null_literal& expr) final;
+    void visit(const program& expr) final;
+    void visit(const return_statement& expr) final;
+    void visit(const string_literal& expr) final;
+    void visit(const unary_expression& expr) final;
+    void visit(const while_statement& expr) final;
+
+  private:
+    /// optimizes the expression, returns the expression replacing it
+    auto rewrite(const expression* expr) -> expression*;
+    auto rewrite_statements(expressions& statements) -> void;
+    /// replaces a condition whose truth is known before running by a boolean literal
+    auto rewrite_condition(const expression* condition) -> expression*;
+
+    arena* m_nodes;
+    expression* m_result {};
+};
+
+void optimize_program(program* prgrm);
+
+/// the truth of a condition the optimizer replaced by a literal, nothing if it is only known when running
+[[nodiscard]] auto constant_condition(const expression* condition) -> std::optional<bool>;
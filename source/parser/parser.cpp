@@ -1,4 +1,5 @@
 #include <cstdint>
+#include <memory>
 #include <stdexcept>
 #include <string>
 #include <utility>
@@ -28,7 +29,6 @@
 #include <ast/util.hpp>
 #include <doctest/doctest.h>
 #include <fmt/ranges.h>
-#include <gc.hpp>
 #include <lexer/lexer.hpp>
 #include <lexer/token.hpp>
 #include <lexer/token_type.hpp>
@@ -141,9 +141,10 @@ parser::parser(lexer lxr)
     register_binary(less_equal, [this](expression* left) { return parse_binary_expression(left); });
 }
 
-auto parser::parse_program() -> program*
+auto parser::parse_program() -> std::unique_ptr<program>
 {
-    auto* prog = make<program>(m_current_token.loc);
+    auto prog = std::make_unique<program>(m_current_token.loc);
+    m_nodes = prog->nodes.get();
     while (m_current_token.type != token_type::eof) {
         auto* stmt = parse_statement();
         if (stmt != nullptr) {
@@ -191,7 +192,7 @@ auto parser::parse_statement() -> statement*
 
 auto parser::parse_let_statement() -> statement*
 {
-    auto* stmt = make<let_statement>(m_current_token.loc);
+    auto* stmt = m_nodes->make<let_statement>(m_current_token.loc);
     stmt->l = m_current_token.loc;
     using enum token_type;
     if (!get(ident)) {
@@ -218,7 +219,7 @@ auto parser::parse_let_statement() -> statement*
 
 auto parser::parse_assign_statement() -> statement*
 {
-    auto* stmt = make<assign_expression>(m_current_token.loc);
+    auto* stmt = m_nodes->make<assign_expression>(m_current_token.loc);
     using enum token_type;
 
     stmt->name = parse_identifier();
@@ -239,7 +240,7 @@ auto parser::parse_assign_statement() -> statement*
 auto parser::parse_return_statement() -> statement*
 {
     using enum token_type;
-    auto* stmt = make<return_statement>(m_current_token.loc);
+    auto* stmt = m_nodes->make<return_statement>(m_current_token.loc);
 
     next_token();
     stmt->value = parse_expression(lowest);
@@ -252,7 +253,7 @@ auto parser::parse_return_statement() -> statement*
 
 auto parser::parse_expression_statement() -> statement*
 {
-    auto* expr_stmt = make<expression_statement>(m_current_token.loc);
+    auto* expr_stmt = m_nodes->make<expression_statement>(m_current_token.loc);
     expr_stmt->expr = parse_expression(lowest);
     if (peek_token_is(token_type::semicolon)) {
         next_token();
@@ -282,12 +283,12 @@ auto parser::parse_expression(int precedence) -> expression*
 
 auto parser::parse_identifier() const -> identifier*
 {
-    return make<identifier>(std::string(m_current_token.literal), m_current_token.loc);
+    return m_nodes->make<identifier>(std::string(m_current_token.literal), m_current_token.loc);
 }
 
 auto parser::parse_integer_literal() -> expression*
 {
-    auto* lit = make<integer_literal>(m_current_token.loc);
+    auto* lit = m_nodes->make<integer_literal>(m_current_token.loc);
     try {
         lit->value = std::stoll(std::string {m_current_token.literal});
     } catch (const std::out_of_range&) {
@@ -299,7 +300,7 @@ auto parser::parse_integer_literal() -> expression*
 
 auto parser::parse_decimal_literal() -> expression*
 {
-    auto* lit = make<decimal_literal>(m_current_token.loc);
+    auto* lit = m_nodes->make<decimal_literal>(m_current_token.loc);
     try {
         lit->value = std::stod(std::string {m_current_token.literal});
     } catch (const std::out_of_range&) {
@@ -311,7 +312,7 @@ auto parser::parse_decimal_literal() -> expression*
 
 auto parser::parse_unary_expression() -> expression*
 {
-    auto* unary = make<unary_expression>(m_current_token.loc);
+    auto* unary = m_nodes->make<unary_expression>(m_current_token.loc);
     unary->op = m_current_token.type;
 
     next_token();
@@ -321,7 +322,7 @@ auto parser::parse_unary_expression() -> expression*
 
 auto parser::parse_boolean() -> expression*
 {
-    return make<boolean_literal>(current_token_is(token_type::tru), m_current_token.loc);
+    return m_nodes->make<boolean_literal>(current_token_is(token_type::tru), m_current_token.loc);
 }
 
 auto parser::parse_grouped_expression() -> expression*
@@ -337,7 +338,7 @@ auto parser::parse_grouped_expression() -> expression*
 auto parser::parse_if_expression() -> expression*
 {
     using enum token_type;
-    auto* expr = make<if_expression>(m_current_token.loc);
+    auto* expr = m_nodes->make<if_expression>(m_current_token.loc);
     if (!get(lparen)) {
         return {};
     }
@@ -368,7 +369,7 @@ auto parser::parse_if_expression() -> expression*
 auto parser::parse_while_statement() -> expression*
 {
     using enum token_type;
-    auto* expr = make<while_statement>(m_current_token.loc);
+    auto* expr = m_nodes->make<while_statement>(m_current_token.loc);
     if (!get(lparen)) {
         return {};
     }
@@ -400,7 +401,7 @@ auto parser::parse_function_expression() -> expression*
         return {};
     }
     auto* body = parse_block_statement();
-    return make<function_literal>(std::move(parameters), body, loc);
+    return m_nodes->make<function_literal>(std::move(parameters), body, loc);
 }
 
 auto parser::parse_function_parameters() -> identifiers
@@ -429,7 +430,7 @@ auto parser::parse_function_parameters() -> identifiers
 auto parser::parse_block_statement() -> block_statement*
 {
     using enum token_type;
-    auto* block = make<block_statement>(m_current_token.loc);
+    auto* block = m_nodes->make<block_statement>(m_current_token.loc);
     next_token();
     while (!current_token_is(rsquirly) && !current_token_is(eof)) {
         auto* stmt = parse_statement();
@@ -445,7 +446,7 @@ auto parser::parse_block_statement() -> block_statement*
 auto parser::parse_break_statement() -> statement*
 {
     using enum token_type;
-    auto* b = make<break_statement>(m_current_token.loc);
+    auto* b = m_nodes->make<break_statement>(m_current_token.loc);
     if (peek_token_is(semicolon)) {
         next_token();
     }
@@ -455,7 +456,7 @@ auto parser::parse_break_statement() -> statement*
 auto parser::parse_continue_statement() -> statement*
 {
     using enum token_type;
-    auto* b = make<continue_statement>(m_current_token.loc);
+    auto* b = m_nodes->make<continue_statement>(m_current_token.loc);
     if (peek_token_is(semicolon)) {
         next_token();
     }
@@ -464,7 +465,7 @@ auto parser::parse_continue_statement() -> statement*
 
 auto parser::parse_call_expression(expression* function) -> expression*
 {
-    auto* call = make<call_expression>(m_current_token.loc);
+    auto* call = m_nodes->make<call_expression>(m_current_token.loc);
     call->function = function;
     call->arguments = parse_expressions(token_type::rparen);
     return call;
@@ -472,7 +473,7 @@ auto parser::parse_call_expression(expression* function) -> expression*
 
 auto parser::parse_binary_expression(expression* left) -> expression*
 {
-    auto* bin_expr = make<binary_expression>(m_current_token.loc);
+    auto* bin_expr = m_nodes->make<binary_expression>(m_current_token.loc);
     bin_expr->op = m_current_token.type;
     bin_expr->left = left;
 
@@ -485,7 +486,7 @@ auto parser::parse_binary_expression(expression* left) -> expression*
 
 auto parser::parse_string_literal() const -> expression*
 {
-    return make<string_literal>(std::string {m_current_token.literal}, m_current_token.loc);
+    return m_nodes->make<string_literal>(std::string {m_current_token.literal}, m_current_token.loc);
 }
 
 auto parser::parse_expressions(token_type end) -> expressions
@@ -514,14 +515,14 @@ auto parser::parse_expressions(token_type end) -> expressions
 
 auto parser::parse_array_expression() -> expression*
 {
-    auto* array_expr = make<array_literal>(m_current_token.loc);
+    auto* array_expr = m_nodes->make<array_literal>(m_current_token.loc);
     array_expr->elements = parse_expressions(token_type::rbracket);
     return array_expr;
 }
 
 auto parser::parse_index_expression(expression* left) -> expression*
 {
-    auto* index_expr = make<index_expression>(m_current_token.loc);
+    auto* index_expr = m_nodes->make<index_expression>(m_current_token.loc);
     index_expr->left = left;
     next_token();
     index_expr->index = parse_expression(lowest);
@@ -535,7 +536,7 @@ auto parser::parse_index_expression(expression* left) -> expression*
 
 auto parser::parse_hash_literal() -> expression*
 {
-    auto* hash = make<hash_literal>(m_current_token.loc);
+    auto* hash = m_nodes->make<hash_literal>(m_current_token.loc);
     using enum token_type;
     while (!peek_token_is(rsquirly)) {
         next_token();
@@ -559,7 +560,7 @@ auto parser::parse_hash_literal() -> expression*
 
 auto parser::parse_null_literal() -> expression*
 {
-    return make<null_literal>(m_current_token.loc);
+    return m_nodes->make<null_literal>(m_current_token.loc);
 }
 
 auto parser::get(token_type type) -> bool
@@ -624,7 +625,7 @@ auto check_no_parse_errors(const parser& prsr) -> bool
     return prsr.errors().empty();
 }
 
-using parsed_program = std::pair<program*, parser>;
+using parsed_program = std::pair<std::unique_ptr<program>, parser>;
 
 auto check_program(std::string_view input) -> parsed_program
 {
@@ -704,7 +705,7 @@ auto require_binary_expression(const expression* expr,
     require_literal_expression(binary->right, right);
 }
 
-auto require_expression_statement(const program* prgrm) -> const expression_statement*
+auto require_expression_statement(const std::unique_ptr<program>& prgrm) -> const expression_statement*
 {
     INFO("expected one statement, got: ", prgrm->statements.size());
     REQUIRE_EQ(prgrm->statements.size(), 1);
@@ -718,7 +719,7 @@ auto require_expression_statement(const program* prgrm) -> const expression_stat
 }
 
 template<typename E>
-auto require_expression(const program* prgrm) -> const E*
+auto require_expression(const std::unique_ptr<program>& prgrm) -> const E*
 {
     auto* expr_stmt = require_expression_statement(prgrm);
     auto* expr = dynamic_cast<const E*>(expr_stmt->expr);
@@ -728,7 +729,7 @@ auto require_expression(const program* prgrm) -> const E*
 }
 
 template<typename E>
-auto require_statement(const program* prgrm) -> const E*
+auto require_statement(const std::unique_ptr<program>& prgrm) -> const E*
 {
     INFO("expected one statement, got: ", prgrm->statements.size());
     REQUIRE_EQ(prgrm->statements.size(), 1);
@@ -876,12 +877,11 @@ return 993322;
 TEST_CASE("string")
 {
     using enum token_type;
-    auto name = make<identifier>("myVar", location {"<stdin>", 1, 1});
-    auto value = make<identifier>("anotherVar", location {"<stdin>", 1, 9});
-
     program prgrm {location {"<stdin>", 1, 1}};
 
-    auto let_stmt = make<let_statement>(location {});
+    auto name = prgrm.nodes->make<identifier>("myVar", location {"<stdin>", 1, 1});
+    auto value = prgrm.nodes->make<identifier>("anotherVar", location {"<stdin>", 1, 9});
+    auto let_stmt = prgrm.nodes->make<let_statement>(location {});
 
     let_stmt->name = name;
     let_stmt->value = value;
@@ -1,10 +1,12 @@
 #pragma once
 
 #include <functional>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <vector>
 
+#include <ast/arena.hpp>
 #include <ast/expression.hpp>
 #include <ast/identifier.hpp>
 #include <ast/program.hpp>
@@ -16,7 +18,7 @@ class parser final
 {
   public:
     explicit parser(lexer lxr);
-    auto parse_program() -> program*;
+    auto parse_program() -> std::unique_ptr<program>;
     auto errors() const -> const std::vector<std::string>&;
 
   private:
@@ -73,6 +75,8 @@ class parser final
     token m_current_token {};
     token m_peek_token {};
     std::vector<std::string> m_errors;
+    // the arena of the program being parsed
+    arena* m_nodes {};
 
     std::unordered_map<token_type, unary_parser> m_unary_parsers;
     std::unordered_map<token_type, binary_parser> m_binary_parsers;
@@ -0,0 +1,1278 @@
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "jit.hpp"
+
+#include <builtin/builtin.hpp>
+#include <code/code.hpp>
+#include <compiler/compiler.hpp>
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+#include <gc.hpp>
+#include <lexer/lexer.hpp>
+#include <object/object.hpp>
+#include <object/value.hpp>
+#include <parser/parser.hpp>
+
+#include "vm.hpp"
+
+#if defined(__x86_64__) && defined(__linux__)
+#    define JIT_NATIVE
+#    include <sys/mman.h>
+#    include <unistd.h>
+#endif
+
+/// the registers of the vm shared with the machine code, which addresses the fields by their offsets
+struct jit_state final
+{
+    /// the next free slot of the stack
+    value* top {};
+    value* locals {};
+    const value* constants {};
+    value* globals {};
+    /// the end of the stack
+    const value* limit {};
+    value* free {};
+    closure_object* closure {};
+    vm* machine {};
+    const jit* compiler {};
+    /// the instruction the interpreter continues with
+    std::size_t ip {};
+    std::exception_ptr error {};
+};
+
+struct native_code final
+{
+    using entry_point = int (*)(jit_state* state, const void* target);
+
+    native_code(void* mem, std::size_t sz, std::vector<std::uint32_t> offsets)
+        : memory {mem}
+        , size {sz}
+        , entries {std::move(offsets)}
+    {
+    }
+
+    native_code(const native_code&) = delete;
+    native_code(native_code&&) = delete;
+    auto operator=(const native_code&) -> native_code& = delete;
+    auto operator=(native_code&&) -> native_code& = delete;
+
+    ~native_code()
+    {
+#ifdef JIT_NATIVE
+        munmap(memory, size);
+#endif
+    }
+
+    void* memory {};
+    std::size_t size {};
+    /// offset of the machine code of every instruction, the offsets inside of an instruction are zero
+    std::vector<std::uint32_t> entries;
+};
+
+jit::jit(jit_options options)
+    : m_options {options}
+{
+}
+
+auto jit::supported() -> bool
+{
+#ifdef JIT_NATIVE
+    return true;
+#else
+    return false;
+#endif
+}
+
+auto jit::hot(const compiled_function_object* fn, const vm& machine) const -> const native_code*
+{
+    if (fn->native != nullptr) {
+        return fn->native.get();
+    }
+    // the counter only matches the threshold once, so a function that cannot be compiled is not retried
+    if (++fn->hotness != m_options.threshold) {
+        return nullptr;
+    }
+    fn->native = compile(fn, machine);
+    return fn->native.get();
+}
+
+/// the stubs return non zero if they failed with an exception, which is rethrown once the machine code returned
+struct jit::stubs final
+{
+    template<typename Body>
+    static auto guarded(jit_state* state, Body&& body) noexcept -> int
+    {
+        try {
+            body();
+            return 0;
+        } catch (...) {
+            state->error = std::current_exception();
+            return 1;
+        }
+    }
+
+    /// writes the stack pointer back to the vm before a safe point or a helper that works on the vm
+    static auto sync(jit_state* state) -> vm&
+    {
+        auto& machine = *state->machine;
+        machine.m_sp = static_cast<int>(state->top - machine.m_stack.data());
+        return machine;
+    }
+
+    static auto collect_if_needed(jit_state* state) -> void
+    {
+        if (heap::get().should_collect()) {
+            sync(state).collect_garbage();
+        }
+    }
+
+    static auto safepoint(jit_state* state, std::uint32_t /*unused*/, std::uint32_t /*unused*/) noexcept -> int
+    {
+        return guarded(state, [state] { collect_if_needed(state); });
+    }
+
+    static auto binary(jit_state* state, std::uint32_t opcode, std::uint32_t /*unused*/) noexcept -> int
+    {
+        return guarded(state,
+                       [state, opcode]
+                       {
+                           auto* top = state->top;
+                           top[-2] = exec_binary_op(static_cast<opcodes>(opcode), top[-2], top[-1]);
+                           state->top = top - 1;
+                       });
+    }
+
+    static auto binary_constant(jit_state* state, std::uint32_t opcode, std::uint32_t const_idx) noexcept -> int
+    {
+        return guarded(state,
+                       [state, opcode, const_idx]
+                       {
+                           auto& left = state->top[-1];
+                           left = exec_binary_op(static_cast<opcodes>(opcode), left, state->constants[const_idx]);
+                       });
+    }
+
+    static auto inc_local(jit_state* state, std::uint32_t local_idx, std::uint32_t const_idx) noexcept -> int
+    {
+        return guarded(state,
+                       [state, local_idx, const_idx]
+                       {
+                           auto& local = state->locals[local_idx];
+                           local = exec_binary_op(opcodes::add, local, state->constants[const_idx]);
+                       });
+    }
+
+    static auto minus(jit_state* state, std::uint32_t /*unused*/, std::uint32_t /*unused*/) noexcept -> int
+    {
+        return guarded(state, [state] { state->top[-1] = exec_minus(state->top[-1]); });
+    }
+
+    static auto index(jit_state* state, std::uint32_t /*unused*/, std::uint32_t /*unused*/) noexcept -> int
+    {
+        return guarded(state,
+                       [state]
+                       {
+                           auto* top = state->top;
+                           top[-2] = exec_index(top[-2], top[-1]);
+                           state->top = top - 1;
+                       });
+    }
+
+    static auto array(jit_state* state, std::uint32_t num_elements, std::uint32_t /*unused*/) noexcept -> int
+    {
+        return guarded(state,
+                       [state, num_elements]
+                       {
+                           auto* first = state->top - num_elements;
+                           *first = build_array({first, num_elements});
+                           state->top = first + 1;
+                       });
+    }
+
+    static auto hash(jit_state* state, std::uint32_t num_elements, std::uint32_t /*unused*/) noexcept -> int
+    {
+        return guarded(state,
+                       [state, num_elements]
+                       {
+                           auto* first = state->top - num_elements;
+                           *first = build_hash({first, num_elements});
+                           state->top = first + 1;
+                       });
+    }
+
+    static auto call_builtin(jit_state* state, std::uint32_t builtin_idx, std::uint32_t num_args) noexcept -> int
+    {
+        return guarded(state,
+                       [state, builtin_idx, num_args]
+                       {
+                           collect_if_needed(state);
+                           auto* first = state->top - num_args;
+                           *first = exec_builtin(builtin::builtins()[builtin_idx], {first, num_args});
+                           state->top = first + 1;
+                       });
+    }
+
+    static auto closure(jit_state* state, std::uint32_t const_idx, std::uint32_t num_free) noexcept -> int
+    {
+        return guarded(state,
+                       [state, const_idx, num_free]
+                       {
+                           auto& machine = sync(state);
+                           machine.push_closure(const_idx, static_cast<std::uint8_t>(num_free));
+                           state->top = machine.m_stack.data() + machine.m_sp;
+                       });
+    }
+
+    /// Calls the function on the stack, returns 2 if the interpreter has to continue with the frame of the callee.
+    ///
+    /// The machine code of a hot callee is run right away, if it reaches its return the frame of the callee is
+    /// popped here and the machine code of the caller continues without returning to the interpreter.
+    static auto call(jit_state* state, std::uint32_t num_args, std::uint32_t next_ip) noexcept -> int
+    {
+        auto returned = true;
+        const auto failed = guarded(state,
+                                    [state, num_args, next_ip, &returned]
+                                    {
+                                        collect_if_needed(state);
+                                        auto& machine = sync(state);
+                                        machine.current_frame().ip = static_cast<int>(next_ip);
+                                        const auto caller = machine.m_frame_index;
+                                        machine.exec_call(static_cast<int>(num_args));
+                                        if (machine.m_frame_index != caller) {
+                                            const auto* fn = machine.current_frame().cl->fn;
+                                            if (const auto* native = state->compiler->hot(fn, machine)) {
+                                                state->compiler->run(native, machine);
+                                            }
+                                            returned = machine.m_frame_index == caller + 1 && return_from(machine);
+                                        }
+                                        state->top = machine.m_stack.data() + machine.m_sp;
+                                    });
+        if (failed != 0) {
+            return 1;
+        }
+        return returned ? 0 : 2;
+    }
+
+    /// executes the return the callee stopped at, returns false if it stopped at another instruction
+    static auto return_from(vm& machine) -> bool
+    {
+        const auto& callee = machine.current_frame();
+        const auto& instrs = callee.cl->fn->instrs;
+        const auto ip = static_cast<std::size_t>(callee.ip);
+        if (ip >= instrs.size()) {
+            return false;
+        }
+        const auto opcode = static_cast<opcodes>(instrs[ip]);
+        if (opcode != opcodes::return_value && opcode != opcodes::ret) {
+            return false;
+        }
+        const auto result = opcode == opcodes::return_value ? machine.pop() : value::null_value();
+        machine.m_sp = machine.pop_frame().base_ptr - 1;
+        machine.push(result);
+        return true;
+    }
+
+    static auto truthy(const value* val) noexcept -> int { return val->is_truthy() ? 1 : 0; }
+};
+
+auto jit::run(const native_code* code, vm& machine) const -> void
+{
+    auto& frm = machine.current_frame();
+    const auto ip = static_cast<std::size_t>(frm.ip);
+    if (ip >= code->entries.size() || code->entries[ip] == 0) {
+        return;
+    }
+    auto* const stack = machine.m_stack.data();
+    jit_state state {
+        .top = stack + machine.m_sp,
+        .locals = stack + frm.base_ptr,
+        .constants = machine.m_constant_values.data(),
+        .globals = machine.m_globals->data(),
+        .limit = stack + machine.m_stack.size(),
+        .free = frm.cl->free.data(),
+        .closure = frm.cl,
+        .machine = &machine,
+        .compiler = this,
+        .ip = ip,
+        .error = {},
+    };
+    auto* const memory = static_cast<std::uint8_t*>(code->memory);
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+    const auto enter = reinterpret_cast<native_code::entry_point>(memory);
+    const auto failed = enter(&state, memory + code->entries[ip]);
+    machine.m_sp = static_cast<int>(state.top - stack);
+    frm.ip = static_cast<int>(state.ip);
+    if (failed != 0) {
+        std::rethrow_exception(state.error);
+    }
+}
+
+namespace
+{
+/// the registers of x86-64 in the order of their encoding
+enum reg : std::uint8_t
+{
+    rax,
+    rcx,
+    rdx,
+    rbx,
+    rsp,
+    rbp,
+    rsi,
+    rdi,
+    r8,
+    r9,
+    r10,
+    r11,
+    r12,
+    r13,
+    r14,
+    r15,
+};
+
+/// the condition codes of jcc and setcc
+enum condition : std::uint8_t
+{
+    above_equal = 0x3,
+    equal = 0x4,
+    not_equal = 0x5,
+    less = 0xC,
+    greater_equal = 0xD,
+    less_equal = 0xE,
+    greater = 0xF,
+};
+
+/// Encodes the few instruction forms the templates are built of.
+///
+/// Memory operands are always addressed as a base register plus a 32 bit displacement. Jumps refer to labels,
+/// which are resolved when the code is finished.
+class assembler final
+{
+  public:
+    [[nodiscard]] auto size() const -> std::size_t { return m_code.size(); }
+
+    auto byte(std::uint8_t val) -> void { m_code.push_back(val); }
+
+    auto dword(std::uint32_t val) -> void
+    {
+        for (auto idx = 0; idx < 4; idx++) {
+            byte(static_cast<std::uint8_t>(val >> (idx * 8)));
+        }
+    }
+
+    auto qword(std::uint64_t val) -> void
+    {
+        dword(static_cast<std::uint32_t>(val));
+        dword(static_cast<std::uint32_t>(val >> 32U));
+    }
+
+    /// an instruction with a register and a memory operand [base + disp]
+    auto op_mem(bool wide, std::initializer_list<std::uint8_t> opcode, std::uint8_t reg, std::uint8_t base,
+                std::int32_t disp) -> void
+    {
+        rex(wide, reg, base);
+        for (const auto opc : opcode) {
+            byte(opc);
+        }
+        byte(static_cast<std::uint8_t>(0x80U | ((reg & 7U) << 3U) | (base & 7U)));
+        if ((base & 7U) == rsp) {
+            byte(0x24);
+        }
+        dword(static_cast<std::uint32_t>(disp));
+    }
+
+    /// an instruction with two register operands
+    auto op_reg(bool wide, std::uint8_t opcode, std::uint8_t reg, std::uint8_t rm) -> void
+    {
+        rex(wide, reg, rm);
+        byte(opcode);
+        byte(static_cast<std::uint8_t>(0xC0U | ((reg & 7U) << 3U) | (rm & 7U)));
+    }
+
+    auto load(std::uint8_t dst, std::uint8_t base, std::int32_t disp) -> void { op_mem(true, {0x8B}, dst, base, disp); }
+
+    auto store(std::uint8_t base, std::int32_t disp, std::uint8_t src) -> void
+    {
+        op_mem(true, {0x89}, src, base, disp);
+    }
+
+    auto store_imm(std::uint8_t base, std::int32_t disp, std::int32_t imm) -> void
+    {
+        op_mem(true, {0xC7}, 0, base, disp);
+        dword(static_cast<std::uint32_t>(imm));
+    }
+
+    auto store_byte(std::uint8_t base, std::int32_t disp, std::uint8_t imm) -> void
+    {
+        op_mem(false, {0xC6}, 0, base, disp);
+        byte(imm);
+    }
+
+    auto compare_byte(std::uint8_t base, std::int32_t disp, std::uint8_t imm) -> void
+    {
+        op_mem(false, {0x80}, 7, base, disp);
+        byte(imm);
+    }
+
+    auto lea(std::uint8_t dst, std::uint8_t base, std::int32_t disp) -> void { op_mem(true, {0x8D}, dst, base, disp); }
+
+    auto mov(std::uint8_t dst, std::uint8_t src) -> void { op_reg(true, 0x89, src, dst); }
+
+    auto mov_imm(std::uint8_t dst, std::uint64_t imm) -> void
+    {
+        byte(static_cast<std::uint8_t>(0x48U | ((dst >> 3U) & 1U)));
+        byte(static_cast<std::uint8_t>(0xB8U | (dst & 7U)));
+        qword(imm);
+    }
+
+    /// loads a 32 bit immediate zero extended into one of the low registers
+    auto mov_imm32(std::uint8_t dst, std::uint32_t imm) -> void
+    {
+        byte(static_cast<std::uint8_t>(0xB8U | (dst & 7U)));
+        dword(imm);
+    }
+
+    auto compare(std::uint8_t left, std::uint8_t right) -> void { op_reg(true, 0x39, right, left); }
+
+    auto test32(std::uint8_t reg) -> void { op_reg(false, 0x85, reg, reg); }
+
+    auto zero32(std::uint8_t reg) -> void { op_reg(false, 0x31, reg, reg); }
+
+    auto set_if(condition cond, std::uint8_t reg) -> void
+    {
+        byte(0x0F);
+        byte(static_cast<std::uint8_t>(0x90U | cond));
+        byte(static_cast<std::uint8_t>(0xC0U | reg));
+    }
+
+    auto call(std::uint8_t reg) -> void { op_reg(false, 0xFF, 2, reg); }
+
+    auto jump_to(std::uint8_t reg) -> void { op_reg(false, 0xFF, 4, reg); }
+
+    auto push(std::uint8_t reg) -> void
+    {
+        if (reg >= r8) {
+            byte(0x41);
+        }
+        byte(static_cast<std::uint8_t>(0x50U | (reg & 7U)));
+    }
+
+    auto pop(std::uint8_t reg) -> void
+    {
+        if (reg >= r8) {
+            byte(0x41);
+        }
+        byte(static_cast<std::uint8_t>(0x58U | (reg & 7U)));
+    }
+
+    auto ret() -> void { byte(0xC3); }
+
+    [[nodiscard]] auto label() -> int
+    {
+        m_labels.push_back(-1);
+        return static_cast<int>(m_labels.size()) - 1;
+    }
+
+    auto bind(int lbl) -> void { m_labels[static_cast<std::size_t>(lbl)] = static_cast<std::int64_t>(size()); }
+
+    [[nodiscard]] auto is_bound(int lbl) const -> bool { return m_labels[static_cast<std::size_t>(lbl)] >= 0; }
+
+    [[nodiscard]] auto position(int lbl) const -> std::int64_t { return m_labels[static_cast<std::size_t>(lbl)]; }
+
+    auto jump(int lbl) -> void
+    {
+        byte(0xE9);
+        fixup(lbl);
+    }
+
+    auto jump_if(condition cond, int lbl) -> void
+    {
+        byte(0x0F);
+        byte(static_cast<std::uint8_t>(0x80U | cond));
+        fixup(lbl);
+    }
+
+    /// resolves the jumps, returns false if a jump refers to a label that was never bound
+    [[nodiscard]] auto finish() -> bool
+    {
+        for (const auto& [pos, lbl] : m_fixups) {
+            const auto target = position(lbl);
+            if (target < 0) {
+                return false;
+            }
+            const auto rel = static_cast<std::int32_t>(target - static_cast<std::int64_t>(pos + 4));
+            std::memcpy(m_code.data() + pos, &rel, sizeof(rel));
+        }
+        return true;
+    }
+
+    [[nodiscard]] auto code() const -> const std::vector<std::uint8_t>& { return m_code; }
+
+  private:
+    auto rex(bool wide, std::uint8_t reg, std::uint8_t rm) -> void
+    {
+        const auto prefix = static_cast<std::uint8_t>((wide ? 0x48U : 0x40U) | (((reg >> 3U) & 1U) << 2U)
+                                                      | ((rm >> 3U) & 1U));
+        if (prefix != 0x40) {
+            byte(prefix);
+        }
+    }
+
+    auto fixup(int lbl) -> void
+    {
+        m_fixups.emplace_back(size(), lbl);
+        dword(0);
+    }
+
+    std::vector<std::uint8_t> m_code;
+    std::vector<std::int64_t> m_labels;
+    std::vector<std::pair<std::size_t, int>> m_fixups;
+};
+
+using stub = int (*)(jit_state*, std::uint32_t, std::uint32_t);
+
+constexpr auto value_size = static_cast<std::int32_t>(sizeof(value));
+
+constexpr auto field(std::size_t offset) -> std::int32_t
+{
+    return static_cast<std::int32_t>(offset);
+}
+
+auto tag_of(value::tag tag) -> std::uint8_t
+{
+    return static_cast<std::uint8_t>(tag);
+}
+
+/// Translates the instructions of one function.
+///
+/// While the machine code runs, rbx holds the jit_state, r12 the next free slot of the stack, r13 the locals,
+/// r14 the constants, r15 the globals and rbp the end of the stack.
+class translator final
+{
+  public:
+    translator(const compiled_function_object* fn, std::size_t num_constants)
+        : m_instrs {fn->instrs}
+        , m_num_constants {num_constants}
+        , m_tag {static_cast<std::int32_t>(value::tag_offset())}
+        , m_payload {static_cast<std::int32_t>(value::payload_offset())}
+    {
+        for (auto idx = 0UL; idx <= m_instrs.size(); idx++) {
+            m_instruction_labels.push_back(m_asm.label());
+        }
+        m_exit = m_asm.label();
+        m_failed = m_asm.label();
+    }
+
+    /// returns the machine code and the offsets of the instructions, or nothing for unsupported instructions
+    [[nodiscard]] auto translate() -> std::pair<std::vector<std::uint8_t>, std::vector<std::uint32_t>>
+    {
+        prologue();
+        for (auto ip = 0UL; ip < m_instrs.size();) {
+            m_asm.bind(m_instruction_labels[ip]);
+            // the instructions specialized by the interpreter share the templates of their generic instructions,
+            // which have the integer fast paths already
+            const auto opcode = generic_variant(static_cast<opcodes>(m_instrs[ip]));
+            if (m_instrs[ip] >= definitions.size() || !instruction(opcode, ip)) {
+                return {};
+            }
+            ip += definitions[m_instrs[ip]].size();
+        }
+        if (m_invalid) {
+            return {};
+        }
+        m_asm.bind(m_instruction_labels[m_instrs.size()]);
+        leave_at(m_instrs.size());
+        for (const auto& [lbl, ip] : m_bailouts) {
+            m_asm.bind(lbl);
+            leave_at(ip);
+        }
+        epilogue();
+        if (!m_asm.finish()) {
+            return {};
+        }
+        std::vector<std::uint32_t> entries(m_instrs.size() + 1);
+        for (auto ip = 0UL; ip < entries.size(); ip++) {
+            if (m_asm.is_bound(m_instruction_labels[ip])) {
+                entries[ip] = static_cast<std::uint32_t>(m_asm.position(m_instruction_labels[ip]));
+            }
+        }
+        return {m_asm.code(), std::move(entries)};
+    }
+
+  private:
+    auto prologue() -> void
+    {
+        for (const auto reg : {rbx, rbp, r12, r13, r14, r15}) {
+            m_asm.push(reg);
+        }
+        // keeps the stack aligned to 16 bytes for the calls of the stubs
+        m_asm.op_mem(true, {0x8D}, rsp, rsp, -8);
+        m_asm.mov(rbx, rdi);
+        m_asm.load(r12, rbx, field(offsetof(jit_state, top)));
+        m_asm.load(r13, rbx, field(offsetof(jit_state, locals)));
+        m_asm.load(r14, rbx, field(offsetof(jit_state, constants)));
+        m_asm.load(r15, rbx, field(offsetof(jit_state, globals)));
+        m_asm.load(rbp, rbx, field(offsetof(jit_state, limit)));
+        m_asm.jump_to(rsi);
+    }
+
+    auto epilogue() -> void
+    {
+        const auto done = m_asm.label();
+        m_asm.bind(m_exit);
+        m_asm.zero32(rax);
+        m_asm.jump(done);
+        m_asm.bind(m_failed);
+        m_asm.mov_imm32(rax, 1);
+        m_asm.bind(done);
+        m_asm.store(rbx, field(offsetof(jit_state, top)), r12);
+        m_asm.op_mem(true, {0x8D}, rsp, rsp, 8);
+        for (const auto reg : {r15, r14, r13, r12, rbp, rbx}) {
+            m_asm.pop(reg);
+        }
+        m_asm.ret();
+    }
+
+    /// returns to the interpreter, which continues with the instruction at ip
+    auto leave_at(std::size_t ip) -> void
+    {
+        m_asm.store_imm(rbx, field(offsetof(jit_state, ip)), static_cast<std::int32_t>(ip));
+        m_asm.jump(m_exit);
+    }
+
+    /// a label leaving to the interpreter at ip, which handles the uncommon case of the instruction
+    auto bailout(std::size_t ip) -> int
+    {
+        const auto lbl = m_asm.label();
+        m_bailouts.emplace_back(lbl, ip);
+        return lbl;
+    }
+
+    /// calls the stub with the stack pointer written back, leaves its result in eax
+    auto invoke(stub target, std::uint32_t first, std::uint32_t second) -> void
+    {
+        m_asm.store(rbx, field(offsetof(jit_state, top)), r12);
+        m_asm.mov(rdi, rbx);
+        m_asm.mov_imm32(rsi, first);
+        m_asm.mov_imm32(rdx, second);
+        // NOLINTNEXTLINE(cppcoreguidelines-pro-type-reinterpret-cast)
+        m_asm.mov_imm(rax, reinterpret_cast<std::uintptr_t>(target));
+        m_asm.call(rax);
+        m_asm.load(r12, rbx, field(offsetof(jit_state, top)));
+    }
+
+    auto call_stub(stub target, std::uint32_t first = 0, std::uint32_t second = 0) -> void
+    {
+        invoke(target, first, second);
+        m_asm.test32(rax);
+        m_asm.jump_if(not_equal, m_failed);
+    }
+
+    /// leaves eax non zero if the value at [base + disp] is truthy
+    auto truthy(std::uint8_t base, std::int32_t disp) -> void
+    {
+        const auto not_boolean = m_asm.label();
+        const auto not_integer = m_asm.label();
+        const auto done = m_asm.label();
+        m_asm.compare_byte(base, disp + m_tag, tag_of(value::tag::boolean));
+        m_asm.jump_if(not_equal, not_boolean);
+        m_asm.op_mem(false, {0x0F, 0xB6}, rax, base, disp + m_payload);
+        m_asm.jump(done);
+        m_asm.bind(not_boolean);
+        m_asm.compare_byte(base, disp + m_tag, tag_of(value::tag::integer));
+        m_asm.jump_if(not_equal, not_integer);
+        m_asm.zero32(rax);
+        m_asm.op_mem(true, {0x83}, 7, base, disp + m_payload);
+        m_asm.byte(0);
+        m_asm.set_if(not_equal, rax);
+        m_asm.jump(done);
+        m_asm.bind(not_integer);
+        m_asm.lea(rdi, base, disp);
+        m_asm.mov_imm(rax, reinterpret_cast<std::uintptr_t>(&jit::stubs::truthy));  // NOLINT
+        m_asm.call(rax);
+        m_asm.bind(done);
+    }
+
+    /// leaves the interpreter to report the overflow if pushing the given number of values does not fit the stack
+    auto check_overflow(std::size_t ip, std::int32_t slots = 1) -> void
+    {
+        if (slots == 1) {
+            m_asm.compare(r12, rbp);
+        } else {
+            m_asm.lea(rax, r12, (slots - 1) * value_size);
+            m_asm.compare(rax, rbp);
+        }
+        m_asm.jump_if(above_equal, bailout(ip));
+    }
+
+    auto copy(std::uint8_t dst, std::int32_t dst_disp, std::uint8_t src, std::int32_t src_disp) -> void
+    {
+        m_asm.load(rcx, src, src_disp);
+        m_asm.load(rdx, src, src_disp + 8);
+        m_asm.store(dst, dst_disp, rcx);
+        m_asm.store(dst, dst_disp + 8, rdx);
+    }
+
+    auto store_value(std::uint8_t base, std::int32_t disp, value val) -> void
+    {
+        std::array<std::uint64_t, 2> bits {};
+        std::memcpy(bits.data(), &val, sizeof(val));
+        m_asm.mov_imm(rdx, bits[0]);
+        m_asm.store(base, disp, rdx);
+        m_asm.mov_imm(rdx, bits[1]);
+        m_asm.store(base, disp + 8, rdx);
+    }
+
+    auto push_value(std::size_t ip, value val) -> void
+    {
+        check_overflow(ip);
+        store_value(r12, 0, val);
+        m_asm.lea(r12, r12, value_size);
+    }
+
+    auto drop(std::int32_t slots) -> void { m_asm.lea(r12, r12, -slots * value_size); }
+
+    auto jump_if_not_integer(std::uint8_t base, std::int32_t disp, int lbl) -> void
+    {
+        m_asm.compare_byte(base, disp + m_tag, tag_of(value::tag::integer));
+        m_asm.jump_if(not_equal, lbl);
+    }
+
+    /// the integer fast path of an arithmetic operator with a register memory form
+    auto arithmetic(opcodes opcode, std::initializer_list<std::uint8_t> alu) -> void
+    {
+        const auto slow = m_asm.label();
+        const auto done = m_asm.label();
+        jump_if_not_integer(r12, -2 * value_size, slow);
+        jump_if_not_integer(r12, -value_size, slow);
+        m_asm.load(rax, r12, (-2 * value_size) + m_payload);
+        m_asm.op_mem(true, alu, rax, r12, -value_size + m_payload);
+        m_asm.store(r12, (-2 * value_size) + m_payload, rax);
+        drop(1);
+        m_asm.jump(done);
+        m_asm.bind(slow);
+        call_stub(&jit::stubs::binary, static_cast<std::uint32_t>(opcode));
+        m_asm.bind(done);
+    }
+
+    /// compares two integers on top of the stack, leaves the flags and the slow label for the other types
+    auto compare_integers(int slow) -> void
+    {
+        jump_if_not_integer(r12, -2 * value_size, slow);
+        jump_if_not_integer(r12, -value_size, slow);
+        m_asm.load(rax, r12, (-2 * value_size) + m_payload);
+        m_asm.op_mem(true, {0x3B}, rax, r12, -value_size + m_payload);
+    }
+
+    auto comparison(opcodes opcode, condition cond) -> void
+    {
+        const auto slow = m_asm.label();
+        const auto done = m_asm.label();
+        compare_integers(slow);
+        m_asm.set_if(cond, rcx);
+        store_value(r12, -2 * value_size, value::boolean(false));
+        m_asm.op_mem(false, {0x88}, rcx, r12, (-2 * value_size) + m_payload);
+        drop(1);
+        m_asm.jump(done);
+        m_asm.bind(slow);
+        call_stub(&jit::stubs::binary, static_cast<std::uint32_t>(opcode));
+        m_asm.bind(done);
+    }
+
+    /// a fused comparison and jump, jumps to the target if the integers do not satisfy cond
+    auto compare_and_jump(opcodes opcode, condition negated, int target) -> void
+    {
+        const auto slow = m_asm.label();
+        const auto done = m_asm.label();
+        compare_integers(slow);
+        drop(2);
+        m_asm.jump_if(negated, target);
+        m_asm.jump(done);
+        m_asm.bind(slow);
+        call_stub(&jit::stubs::binary, static_cast<std::uint32_t>(opcode));
+        truthy(r12, -value_size);
+        drop(1);
+        m_asm.test32(rax);
+        m_asm.jump_if(equal, target);
+        m_asm.bind(done);
+    }
+
+    auto conditional_jump(condition cond, int target) -> void
+    {
+        truthy(r12, -value_size);
+        drop(1);
+        m_asm.test32(rax);
+        m_asm.jump_if(cond, target);
+    }
+
+    /// adds the integer constant to the integer at [base + disp], falls back to the stub otherwise
+    auto add_constant(std::uint8_t base, std::int32_t disp, std::uint32_t const_idx, opcodes opcode, stub fallback,
+                      std::uint32_t first) -> void
+    {
+        const auto slow = m_asm.label();
+        const auto done = m_asm.label();
+        jump_if_not_integer(base, disp, slow);
+        jump_if_not_integer(r14, constant(const_idx), slow);
+        m_asm.load(rax, r14, constant(const_idx) + m_payload);
+        m_asm.op_mem(true, {static_cast<std::uint8_t>(opcode == opcodes::sub_const ? 0x29 : 0x01)}, rax, base,
+                     disp + m_payload);
+        m_asm.jump(done);
+        m_asm.bind(slow);
+        call_stub(fallback, first, const_idx);
+        m_asm.bind(done);
+    }
+
+    /// the label of a jump target, a target outside of the function fails the translation
+    [[nodiscard]] auto target_at(std::size_t pos) -> int
+    {
+        const auto target = uint32_at(pos);
+        if (target > m_instrs.size()) {
+            m_invalid = true;
+            return m_exit;
+        }
+        return m_instruction_labels[target];
+    }
+
+    [[nodiscard]] static auto slot(std::size_t index) -> std::int32_t
+    {
+        return static_cast<std::int32_t>(index) * value_size;
+    }
+
+    [[nodiscard]] static auto constant(std::uint32_t const_idx) -> std::int32_t { return slot(const_idx); }
+
+    [[nodiscard]] auto valid_constant(std::uint32_t const_idx) const -> bool
+    {
+        return const_idx < m_num_constants && const_idx < (1U << 24U);
+    }
+
+    [[nodiscard]] auto uint8_at(std::size_t pos) const -> std::uint8_t { return m_instrs[pos]; }
+
+    [[nodiscard]] auto uint16_at(std::size_t pos) const -> std::uint16_t
+    {
+        return read_operand<std::uint16_t>(m_instrs.data() + pos);
+    }
+
+    [[nodiscard]] auto uint32_at(std::size_t pos) const -> std::uint32_t
+    {
+        return read_operand<std::uint32_t>(m_instrs.data() + pos);
+    }
+
+    /// emits the template of the instruction at ip, returns false if there is none
+    auto instruction(opcodes opcode, std::size_t ip) -> bool  // NOLINT(readability-function-cognitive-complexity)
+    {
+        using enum opcodes;
+        switch (opcode) {
+            case constant: {
+                const auto const_idx = uint32_at(ip + 1);
+                if (!valid_constant(const_idx)) {
+                    m_asm.jump(bailout(ip));
+                    return true;
+                }
+                check_overflow(ip);
+                copy(r12, 0, r14, translator::constant(const_idx));
+                m_asm.lea(r12, r12, value_size);
+                return true;
+            }
+            case add:
+                arithmetic(opcode, {0x03});
+                return true;
+            case sub:
+                arithmetic(opcode, {0x2B});
+                return true;
+            case mul:
+                arithmetic(opcode, {0x0F, 0xAF});
+                return true;
+            case bit_and:
+                arithmetic(opcode, {0x23});
+                return true;
+            case bit_or:
+                arithmetic(opcode, {0x0B});
+                return true;
+            case bit_xor:
+                arithmetic(opcode, {0x33});
+                return true;
+            case div:
+            case floor_div:
+            case mod:
+            case bit_lsh:
+            case bit_rsh:
+                call_stub(&jit::stubs::binary, static_cast<std::uint32_t>(opcode));
+                return true;
+            case equal:
+                comparison(opcode, condition::equal);
+                return true;
+            case not_equal:
+                comparison(opcode, condition::not_equal);
+                return true;
+            case greater_than:
+                comparison(opcode, condition::greater);
+                return true;
+            case greater_equal:
+                comparison(opcode, condition::greater_equal);
+                return true;
+            case pop:
+                drop(1);
+                return true;
+            case tru:
+                push_value(ip, value::boolean(true));
+                return true;
+            case fals:
+                push_value(ip, value::boolean(false));
+                return true;
+            case null:
+                push_value(ip, value::null_value());
+                return true;
+            case minus: {
+                const auto slow = m_asm.label();
+                const auto done = m_asm.label();
+                jump_if_not_integer(r12, -value_size, slow);
+                m_asm.op_mem(true, {0xF7}, 3, r12, -value_size + m_payload);
+                m_asm.jump(done);
+                m_asm.bind(slow);
+                call_stub(&jit::stubs::minus);
+                m_asm.bind(done);
+                return true;
+            }
+            case bang:
+                truthy(r12, -value_size);
+                m_asm.test32(rax);
+                m_asm.set_if(condition::equal, rcx);
+                store_value(r12, -value_size, value::boolean(false));
+                m_asm.op_mem(false, {0x88}, rcx, r12, -value_size + m_payload);
+                return true;
+            case jump: {
+                if (uint32_at(ip + 1) <= ip) {
+                    call_stub(&jit::stubs::safepoint);
+                }
+                m_asm.jump(target_at(ip + 1));
+                return true;
+            }
+            case jump_not_truthy:
+                conditional_jump(condition::equal, target_at(ip + 1));
+                return true;
+            case jump_truthy:
+                conditional_jump(condition::not_equal, target_at(ip + 1));
+                return true;
+            case get_global: {
+                const auto global = slot(uint16_at(ip + 1));
+                m_asm.compare_byte(r15, global + m_tag, tag_of(value::tag::undefined));
+                m_asm.jump_if(condition::equal, bailout(ip));
+                check_overflow(ip);
+                copy(r12, 0, r15, global);
+                m_asm.lea(r12, r12, value_size);
+                return true;
+            }
+            case set_global:
+                copy(r15, slot(uint16_at(ip + 1)), r12, -value_size);
+                drop(1);
+                return true;
+            case array:
+                check_overflow(ip);
+                call_stub(&jit::stubs::array, uint16_at(ip + 1));
+                return true;
+            case hash:
+                check_overflow(ip);
+                call_stub(&jit::stubs::hash, uint16_at(ip + 1));
+                return true;
+            case index:
+                call_stub(&jit::stubs::index);
+                return true;
+            case call: {
+                const auto next_ip = ip + definitions[m_instrs[ip]].size();
+                const auto done = m_asm.label();
+                invoke(&jit::stubs::call, uint8_at(ip + 1), static_cast<std::uint32_t>(next_ip));
+                m_asm.test32(rax);
+                m_asm.jump_if(condition::equal, done);
+                m_asm.op_reg(false, 0x83, 7, rax);
+                m_asm.byte(1);
+                m_asm.jump_if(condition::equal, m_failed);
+                leave_at(next_ip);
+                m_asm.bind(done);
+                return true;
+            }
+            case return_value:
+            case ret:
+                leave_at(ip);
+                return true;
+            case get_local:
+                check_overflow(ip);
+                copy(r12, 0, r13, slot(uint8_at(ip + 1)));
+                m_asm.lea(r12, r12, value_size);
+                return true;
+            case set_local:
+                copy(r13, slot(uint8_at(ip + 1)), r12, -value_size);
+                drop(1);
+                return true;
+            case get_free:
+                check_overflow(ip);
+                m_asm.load(rax, rbx, field(offsetof(jit_state, free)));
+                copy(r12, 0, rax, slot(uint8_at(ip + 1)));
+                m_asm.lea(r12, r12, value_size);
+                return true;
+            case set_free:
+                m_asm.load(rax, rbx, field(offsetof(jit_state, free)));
+                copy(rax, slot(uint8_at(ip + 1)), r12, -value_size);
+                drop(1);
+                return true;
+            case get_builtin: {
+                const auto builtin_idx = uint8_at(ip + 1);
+                if (builtin_idx >= builtin::builtin_objects().size()) {
+                    return false;
+                }
+                push_value(ip, value::from(builtin::builtin_objects()[builtin_idx]));
+                return true;
+            }
+            case closure:
+                call_stub(&jit::stubs::closure, uint32_at(ip + 1), uint8_at(ip + 5));
+                return true;
+            case current_closure:
+                check_overflow(ip);
+                m_asm.store_byte(r12, m_tag, tag_of(value::tag::object));
+                m_asm.load(rax, rbx, field(offsetof(jit_state, closure)));
+                m_asm.store(r12, m_payload, rax);
+                m_asm.lea(r12, r12, value_size);
+                return true;
+            case call_builtin:
+                check_overflow(ip);
+                call_stub(&jit::stubs::call_builtin, uint8_at(ip + 1), uint8_at(ip + 2));
+                return true;
+            case add_const:
+            case sub_const: {
+                const auto const_idx = uint32_at(ip + 1);
+                if (!valid_constant(const_idx)) {
+                    return false;
+                }
+                add_constant(r12, -value_size, const_idx, opcode, &jit::stubs::binary_constant,
+                             static_cast<std::uint32_t>(opcode == add_const ? add : sub));
+                return true;
+            }
+            case jump_not_equal:
+                compare_and_jump(equal, condition::not_equal, target_at(ip + 1));
+                return true;
+            case jump_not_greater:
+                compare_and_jump(greater_than, condition::less_equal, target_at(ip + 1));
+                return true;
+            case jump_not_greater_equal:
+                compare_and_jump(greater_equal, condition::less, target_at(ip + 1));
+                return true;
+            case get_local_get_local:
+                check_overflow(ip, 2);
+                copy(r12, 0, r13, slot(uint8_at(ip + 1)));
+                copy(r12, value_size, r13, slot(uint8_at(ip + 2)));
+                m_asm.lea(r12, r12, 2 * value_size);
+                return true;
+            case inc_local: {
+                const auto local_idx = uint8_at(ip + 1);
+                const auto const_idx = uint32_at(ip + 2);
+                if (!valid_constant(const_idx)) {
+                    return false;
+                }
+                add_constant(r13, slot(local_idx), const_idx, add_const, &jit::stubs::inc_local, local_idx);
+                return true;
+            }
+            case add_int_int:
+            case sub_int_int:
+            case mul_int_int:
+            case equal_int_int:
+            case not_equal_int_int:
+            case greater_than_int_int:
+            case greater_equal_int_int:
+            case index_array_int:
+            case call_closure:
+                return false;
+        }
+        return false;
+    }
+
+    const instructions& m_instrs;
+    std::size_t m_num_constants {};
+    std::int32_t m_tag {};
+    std::int32_t m_payload {};
+    assembler m_asm;
+    std::vector<int> m_instruction_labels;
+    std::vector<std::pair<int, std::size_t>> m_bailouts;
+    int m_exit {};
+    int m_failed {};
+    bool m_invalid {};
+};
+
+auto write_perf_map_entry(const void* address, std::size_t size, std::string_view name) -> void
+{
+#ifdef JIT_NATIVE
+    std::ofstream map(fmt::format("/tmp/perf-{}.map", getpid()), std::ios::app);
+    map << fmt::format("{:x} {:x} cappuchin::{}\n", reinterpret_cast<std::uintptr_t>(address), size, name);  // NOLINT
+#else
+    (void)address;
+    (void)size;
+    (void)name;
+#endif
+}
+}  // namespace
+
+auto jit::compile(const compiled_function_object* fn, const vm& machine) const -> std::shared_ptr<const native_code>
+{
+#ifdef JIT_NATIVE
+    static_assert(sizeof(value) == 16, "the templates copy values as two quad words");
+    auto [code, entries] = translator {fn, machine.m_constant_values.size()}.translate();
+    if (code.empty()) {
+        return nullptr;
+    }
+    const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+    const auto size = (code.size() + page - 1) / page * page;
+    auto* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {  // NOLINT(performance-no-int-to-ptr)
+        return nullptr;
+    }
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, size, PROT_READ | PROT_EXEC) != 0) {
+        munmap(memory, size);
+        return nullptr;
+    }
+    if (m_options.perf_map) {
+        write_perf_map_entry(memory, code.size(), fn->name.empty() ? "<anonymous>" : fn->name);
+    }
+    return std::make_shared<const native_code>(memory, size, std::move(entries));
+#else
+    (void)fn;
+    (void)machine;
+    return nullptr;
+#endif
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+struct compiled final
+{
+    vm machine;
+    const constants* consts;
+};
+
+auto compile_program(std::string_view input) -> compiled
+{
+    auto prsr = parser {lexer {input}};
+    auto prgrm = prsr.parse_program();
+    REQUIRE(prsr.errors().empty());
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    auto byte_code = cmplr.byte_code();
+    const auto* consts = byte_code.consts;
+    return {vm::create(std::move(byte_code)), consts};
+}
+
+auto first_function(const constants* consts) -> const compiled_function_object*
+{
+    for (const auto* constant : *consts) {
+        if (constant->is(object::object_type::compiled_function)) {
+            return constant->as<compiled_function_object>();
+        }
+    }
+    return nullptr;
+}
+
+TEST_SUITE_BEGIN("jit");
+
+TEST_CASE("hotFunctionsAreCompiled")
+{
+    if (!jit::supported()) {
+        return;
+    }
+    const jit native {{.threshold = 3}};
+    auto [machine, consts] = compile_program("let f = fn(x) { x * 2 + 1 }; f(1); f(2); f(f(3))");
+    machine.attach(&native);
+    machine.run();
+    const auto* fn = first_function(consts);
+    REQUIRE(fn != nullptr);
+    CHECK(fn->native != nullptr);
+    CHECK_EQ(machine.last_popped()->inspect(), "15");
+
+    auto [cold, cold_consts] = compile_program("let f = fn(x) { x * 2 + 1 }; f(1); f(2)");
+    cold.attach(&native);
+    cold.run();
+    CHECK(first_function(cold_consts)->native == nullptr);
+}
+
+TEST_CASE("callsSwitchBetweenMachineCodeAndInterpreter")
+{
+    if (!jit::supported()) {
+        return;
+    }
+    // the first calls of every function run in the interpreter, the later ones in machine code
+    const jit native {{.threshold = 7}};
+    auto [machine, consts] = compile_program(R"(
+        let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } };
+        let adder = fn(x) { fn(y) { x + y } };
+        let apply = fn(f, n) { let i = 0; let s = 0; while (i < n) { s = s + f(i); i = i + 1; } s };
+        apply(adder(fib(15)), 20) + apply(fn(x) { len([x]) }, 10))");
+    machine.attach(&native);
+    machine.run();
+    CHECK_EQ(machine.last_popped()->inspect(), "12400");
+}
+
+TEST_CASE("loopsAreEnteredAtTheirBackwardJump")
+{
+    if (!jit::supported()) {
+        return;
+    }
+    const jit native {{.threshold = 10}};
+    auto [machine, consts] = compile_program(R"(
+        let sum = 0;
+        let i = 0;
+        while (i < 100000) {
+            sum = sum + [i, i][1] % 7;
+            i = i + 1;
+        }
+        sum)");
+    machine.attach(&native);
+    const auto collections = heap::get().collections();
+    machine.run();
+    CHECK_EQ(machine.last_popped()->inspect(), "299995");
+    CHECK_GT(heap::get().collections(), collections);
+}
+
+TEST_CASE("errorsOfTheMachineCodeAreRethrown")
+{
+    if (!jit::supported()) {
+        return;
+    }
+    const jit native {{.threshold = 1}};
+    auto [machine, consts] = compile_program(R"(let f = fn(x) { x - "a" }; f(1))");
+    machine.attach(&native);
+    CHECK_THROWS_WITH_AS(
+        machine.run(), "unsupported types for binary operation: integer sub string", std::runtime_error);
+    CHECK(first_function(consts)->native != nullptr);
+}
+
+#ifdef JIT_NATIVE
+TEST_CASE("compiledFunctionsAreWrittenToThePerfMap")
+{
+    const auto map_file = fmt::format("/tmp/perf-{}.map", getpid());
+    const jit native {{.threshold = 1, .perf_map = true}};
+    auto [machine, consts] = compile_program("let answer = fn() { 42 }; answer()");
+    machine.attach(&native);
+    machine.run();
+    std::ifstream map(map_file);
+    const std::string contents {std::istreambuf_iterator<char>(map), std::istreambuf_iterator<char>()};
+    std::remove(map_file.c_str());
+    CHECK_NE(contents.find(" cappuchin::answer\n"), std::string::npos);
+    CHECK_NE(contents.find(" cappuchin::main\n"), std::string::npos);
+}
+#endif
+
+TEST_SUITE_END();
+// NOLINTEND(*)
+}  // namespace
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstdint>
+
+#include <object/object.hpp>
+
+struct vm;
+
+struct jit_options final
+{
+    /// number of calls of a function and of backward jumps in it after which it is compiled
+    std::uint32_t threshold {1000};
+    /// appends every compiled function to /tmp/perf-<pid>.map, so perf can symbolize the frames of the machine code
+    bool perf_map {};
+};
+
+/// Baseline compiler of the bytecode of hot functions to x86-64 machine code.
+///
+/// Every instruction is translated to a fixed template of machine code, which operates on the stack of the vm
+/// directly. Integer operands take an inlined fast path, everything else calls back into the operations shared with
+/// the interpreter. Frames are managed by the vm: a call pushes the frame of the callee and runs its machine code
+/// right away, a callee without machine code hands its frame to the interpreter. Returns go back to the interpreter,
+/// which enters the machine code of a frame at any instruction boundary, so a hot loop is entered at its backward
+/// jump as well. Functions with instructions the compiler has no template for, and every function on other platforms
+/// than x86-64 Linux, keep running in the interpreter.
+class jit final
+{
+  public:
+    explicit jit(jit_options options = {});
+
+    /// whether machine code can be generated on this platform
+    [[nodiscard]] static auto supported() -> bool;
+
+    /// counts a call of the function or a backward jump in it, returns the machine code of the function once it
+    /// got hot and was compiled
+    [[nodiscard]] auto hot(const compiled_function_object* fn, const vm& machine) const -> const native_code*;
+
+    /// runs the current frame of the vm in the machine code of its function, until it reaches an instruction left
+    /// to the interpreter, the frame and the stack pointer of the vm are updated to continue from there
+    auto run(const native_code* code, vm& machine) const -> void;
+
+    /// the operations the machine code calls back into
+    struct stubs;
+
+  private:
+    [[nodiscard]] auto compile(const compiled_function_object* fn, const vm& machine) const
+        -> std::shared_ptr<const native_code>;
+
+    jit_options m_options;
+};
@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "profiler.hpp"
+
+#include <code/code.hpp>
+#include <compiler/compiler.hpp>
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+#include <fmt/ostream.h>
+#include <gc.hpp>
+#include <lexer/lexer.hpp>
+#include <object/object.hpp>
+#include <parser/parser.hpp>
+
+#include "vm.hpp"
+
+auto profiler::on_instruction(opcodes opcode, int depth, const compiled_function_object* function) -> void
+{
+    attribute_allocations();
+    // the instructions the vm specialized at runtime are counted as the instructions the compiler emitted
+    const auto generic = generic_variant(opcode);
+    m_opcodes[static_cast<std::size_t>(generic)].executed++;
+    m_last_opcode = generic;
+    m_has_last_opcode = true;
+
+    const auto frames = static_cast<std::size_t>(depth);
+    if (m_stack.size() != frames) {
+        const auto now = clock::now();
+        while (m_stack.size() > frames) {
+            leave(now);
+        }
+        if (m_stack.size() < frames) {
+            enter(function, now);
+        }
+    }
+}
+
+auto profiler::stop() -> void
+{
+    attribute_allocations();
+    m_has_last_opcode = false;
+    const auto now = clock::now();
+    while (!m_stack.empty()) {
+        leave(now);
+    }
+}
+
+auto profiler::attribute_allocations() -> void
+{
+    const auto allocations = heap::get().total_allocations();
+    if (m_has_last_opcode) {
+        m_opcodes[static_cast<std::size_t>(m_last_opcode)].allocations += allocations - m_last_allocations;
+    }
+    m_last_allocations = allocations;
+}
+
+auto profiler::enter(const compiled_function_object* function, clock::time_point now) -> void
+{
+    auto& stats = m_functions[function];
+    if (stats.name.empty()) {
+        stats.name = function->name.empty() ? "<anonymous>" : function->name;
+    }
+    stats.calls++;
+    stats.active++;
+    auto stack = m_stack.empty() ? stats.name : m_stack.back().stack + ";" + stats.name;
+    m_stack.push_back({.stats = &stats, .start = now, .children = {}, .stack = std::move(stack)});
+}
+
+auto profiler::leave(clock::time_point now) -> void
+{
+    auto frame = std::move(m_stack.back());
+    m_stack.pop_back();
+    const auto inclusive = now - frame.start;
+    const auto self = inclusive - frame.children;
+    frame.stats->self += self;
+    frame.stats->active--;
+    // the inclusive time of recursive calls is already part of the outermost call
+    if (frame.stats->active == 0) {
+        frame.stats->inclusive += inclusive;
+    }
+    if (!m_stack.empty()) {
+        m_stack.back().children += inclusive;
+    }
+    m_folded_stacks[frame.stack] += self;
+}
+
+auto profiler::calls(const std::string& function_name) const -> std::uint64_t
+{
+    std::uint64_t calls = 0;
+    for (const auto& [_, stats] : m_functions) {
+        if (stats.name == function_name) {
+            calls += stats.calls;
+        }
+    }
+    return calls;
+}
+
+auto profiler::report(std::ostream& ost) const -> void
+{
+    using std::chrono::duration;
+    using milliseconds = duration<double, std::milli>;
+
+    std::vector<std::size_t> opcode_order;
+    for (std::size_t idx = 0; idx < m_opcodes.size(); ++idx) {
+        if (m_opcodes[idx].executed > 0) {
+            opcode_order.push_back(idx);
+        }
+    }
+    std::ranges::sort(opcode_order,
+                      [this](auto lhs, auto rhs) { return m_opcodes[lhs].executed > m_opcodes[rhs].executed; });
+    fmt::print(ost, "{:<24} {:>14} {:>12}\n", "opcode", "executed", "allocations");
+    for (const auto idx : opcode_order) {
+        fmt::print(ost,
+                   "{:<24} {:>14} {:>12}\n",
+                   fmt::format("{}", static_cast<opcodes>(idx)),
+                   m_opcodes[idx].executed,
+                   m_opcodes[idx].allocations);
+    }
+
+    std::vector<const function_stats*> functions;
+    for (const auto& [_, stats] : m_functions) {
+        functions.push_back(&stats);
+    }
+    std::ranges::sort(functions, [](const auto* lhs, const auto* rhs) { return lhs->self > rhs->self; });
+    fmt::print(ost, "\n{:<32} {:>10} {:>12} {:>14}\n", "function", "calls", "self ms", "inclusive ms");
+    for (const auto* stats : functions) {
+        fmt::print(ost,
+                   "{:<32} {:>10} {:>12.3f} {:>14.3f}\n",
+                   stats->name,
+                   stats->calls,
+                   milliseconds(stats->self).count(),
+                   milliseconds(stats->inclusive).count());
+    }
+}
+
+auto profiler::write_folded_stacks(std::ostream& ost) const -> void
+{
+    for (const auto& [stack, self] : m_folded_stacks) {
+        fmt::print(ost, "{} {}\n", stack, std::chrono::duration_cast<std::chrono::microseconds>(self).count());
+    }
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+TEST_SUITE_BEGIN("profiler");
+
+TEST_CASE("countsOpcodesCallsAndStacks")
+{
+    auto prsr = parser {lexer {R"(
+        let fibonacci = fn(x) {
+            if (x < 2) {
+                return x;
+            }
+            fibonacci(x - 1) + fibonacci(x - 2);
+        };
+        let pair = fn(x) { [x, x] };
+        fibonacci(10) + len(pair(1));)"}};
+    auto prgrm = prsr.parse_program();
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    auto mchn = vm::create(cmplr.byte_code());
+    profiler prof;
+    mchn.attach(&prof);
+    mchn.run();
+
+    CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 57);
+    CHECK_EQ(prof.calls("main"), 1);
+    CHECK_EQ(prof.calls("fibonacci"), 177);
+    CHECK_EQ(prof.calls("pair"), 1);
+    CHECK_EQ(prof.executed(opcodes::call), 177 + 1);
+    CHECK_EQ(prof.executed(opcodes::call_builtin), 1);
+    CHECK_EQ(prof.executed(opcodes::array), 1);
+    CHECK_GE(prof.allocations(opcodes::array), 1);
+    CHECK_EQ(prof.allocations(opcodes::add), 0);
+
+    std::ostringstream folded;
+    prof.write_folded_stacks(folded);
+    CHECK_NE(folded.str().find("main;fibonacci;fibonacci "), std::string::npos);
+    CHECK_NE(folded.str().find("main;pair "), std::string::npos);
+
+    std::ostringstream report;
+    prof.report(report);
+    CHECK_NE(report.str().find("fibonacci"), std::string::npos);
+    CHECK_NE(report.str().find("jump_not_greater"), std::string::npos);
+}
+
+TEST_CASE("countsDeoptimizedInstructionsOnce")
+{
+    auto prsr = parser {lexer {R"(
+        let add = fn(a, b) { a + b };
+        add(1, 2);
+        add("a", "b");
+        add(3, 4))"}};
+    auto prgrm = prsr.parse_program();
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    auto mchn = vm::create(cmplr.byte_code());
+    profiler prof;
+    mchn.attach(&prof);
+    mchn.run();
+
+    CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 7);
+    CHECK_EQ(prof.executed(opcodes::add), 3);
+    CHECK_EQ(prof.executed(opcodes::add_int_int), 0);
+}
+
+TEST_SUITE_END();
+// NOLINTEND(*)
+}  // namespace
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <code/code.hpp>
+
+struct compiled_function_object;
+
+/// Opcode level profiler of the virtual machine.
+///
+/// The virtual machine reports every instruction before executing it together with the depth of its frame stack.
+/// Executed opcodes and the allocations made by them are counted per instruction, the clock is only read when the
+/// frame stack changes, to attribute the self and inclusive time to the compiled functions.
+class profiler final
+{
+  public:
+    using clock = std::chrono::steady_clock;
+
+    auto on_instruction(opcodes opcode, int depth, const compiled_function_object* function) -> void;
+    /// leaves all functions still on the stack, called when the virtual machine halts
+    auto stop() -> void;
+
+    /// prints the executed opcodes and the functions, both sorted by their cost
+    auto report(std::ostream& ost) const -> void;
+    /// writes one line per call stack with its self time in microseconds, the input format of flamegraph.pl
+    auto write_folded_stacks(std::ostream& ost) const -> void;
+
+    [[nodiscard]] auto executed(opcodes opcode) const -> std::uint64_t
+    {
+        return m_opcodes[static_cast<std::size_t>(opcode)].executed;
+    }
+
+    [[nodiscard]] auto allocations(opcodes opcode) const -> std::uint64_t
+    {
+        return m_opcodes[static_cast<std::size_t>(opcode)].allocations;
+    }
+
+    [[nodiscard]] auto calls(const std::string& function_name) const -> std::uint64_t;
+
+  private:
+    struct opcode_stats final
+    {
+        std::uint64_t executed {};
+        std::uint64_t allocations {};
+    };
+
+    struct function_stats final
+    {
+        std::string name;
+        std::uint64_t calls {};
+        clock::duration self {};
+        clock::duration inclusive {};
+        int active {};
+    };
+
+    struct active_frame final
+    {
+        function_stats* stats {};
+        clock::time_point start;
+        clock::duration children {};
+        std::string stack;
+    };
+
+    auto enter(const compiled_function_object* function, clock::time_point now) -> void;
+    auto leave(clock::time_point now) -> void;
+    auto attribute_allocations() -> void;
+
+    std::array<opcode_stats, opcodes_count> m_opcodes {};
+    std::unordered_map<const compiled_function_object*, function_stats> m_functions;
+    std::vector<active_frame> m_stack;
+    std::map<std::string, clock::duration> m_folded_stacks;
+    opcodes m_last_opcode {};
+    bool m_has_last_opcode {};
+    std::size_t m_last_allocations {};
+};
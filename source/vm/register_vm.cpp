@@ -0,0 +1,576 @@
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "register_vm.hpp"
+
+#include <ast/program.hpp>
+#include <builtin/builtin.hpp>
+#include <code/code.hpp>
+#include <code/register_code.hpp>
+#include <compiler/register_compiler.hpp>
+#include <doctest/doctest.h>
+#include <fmt/format.h>
+#include <gc.hpp>
+#include <lexer/lexer.hpp>
+#include <object/object.hpp>
+#include <parser/parser.hpp>
+
+#include "vm.hpp"
+
+auto register_vm::create(register_bytecode code) -> register_vm
+{
+    return create_with_state(std::move(code), make<values>(globals_size));
+}
+
+auto register_vm::create_with_state(register_bytecode code, values* globals) -> register_vm
+{
+    auto* main_fn = make<compiled_function_object>(std::move(code.instrs), code.num_registers, 0);
+    main_fn->name = "main";
+    return register_vm {make<closure_object>(main_fn), code.consts, globals};
+}
+
+register_vm::register_vm(closure_object* main, const constants* consts, values* globals)
+    : m_constants {consts}
+    , m_globals {globals}
+{
+    m_constant_values.reserve(m_constants->size());
+    for (const auto* constant : *m_constants) {
+        m_constant_values.push_back(value::from(constant));
+    }
+    // the main program leaves its value in its first register, returning from it too
+    m_frames[0] = register_frame {.cl = main, .ip = 0, .base = 0, .result = 0};
+    m_high_water = static_cast<std::size_t>(main->fn->num_locals);
+    if (m_high_water > m_registers.size()) {
+        throw std::runtime_error("stack overflow");
+    }
+    m_registers[0] = value::null_value();
+}
+
+// With CAPPUCHIN_COMPUTED_GOTO every instruction jumps directly to the handler of the next one through a table of
+// label addresses, otherwise the handlers are the cases of a switch that is re-entered after every instruction.
+#if defined(CAPPUCHIN_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+#    define VM_THREADED_DISPATCH
+#endif
+
+#ifdef VM_THREADED_DISPATCH
+#    define VM_CASE(name) op_##name
+#    define VM_DISPATCH() \
+        do { \
+            if (ip >= code_size) { \
+                goto halt; \
+            } \
+            goto* dispatch_table[code[ip++]]; \
+        } while (false)
+#else
+#    define VM_CASE(name) case registers::opcodes::name
+#    define VM_DISPATCH() goto dispatch
+#endif
+
+auto register_vm::run() -> void
+{
+    // the state of the interpreter is cached in locals and written back before calling a helper that works on the
+    // members, regs points to the first register of the current frame
+    auto* frm = &current_frame();
+    const auto* code = frm->cl->fn->instrs.data();
+    auto code_size = frm->cl->fn->instrs.size();
+    auto ip = static_cast<std::size_t>(frm->ip);
+    auto* regs = m_registers.data() + frm->base;
+    auto& globals = *m_globals;
+
+    const auto sync = [&] { frm->ip = static_cast<int>(ip); };
+    const auto resume = [&]
+    {
+        frm = &current_frame();
+        code = frm->cl->fn->instrs.data();
+        code_size = frm->cl->fn->instrs.size();
+        ip = static_cast<std::size_t>(frm->ip);
+        regs = m_registers.data() + frm->base;
+    };
+    const auto read_uint8 = [&] { return code[ip++]; };
+    const auto read_uint16 = [&]
+    {
+        const auto result = read_operand<uint16_t>(code + ip);
+        ip += 2;
+        return result;
+    };
+    const auto read_uint32 = [&]
+    {
+        const auto result = read_operand<uint32_t>(code + ip);
+        ip += 4;
+        return result;
+    };
+    const auto read_reg = [&]() -> value& { return regs[read_uint16()]; };
+    const auto binary = [&](registers::opcodes opcode)
+    {
+        auto& dst = read_reg();
+        const auto left = read_reg();
+        const auto right = read_reg();
+        dst = exec_binary_op(registers::binary_operator(opcode), left, right);
+    };
+    const auto compare_and_jump = [&](auto integer_comparison, registers::opcodes opcode)
+    {
+        const auto left = read_reg();
+        const auto right = read_reg();
+        const auto target = read_uint32();
+        const auto holds = left.is_integer() && right.is_integer()
+            ? integer_comparison(left.as_integer(), right.as_integer())
+            : exec_binary_op(registers::binary_operator(opcode), left, right).is_truthy();
+        if (!holds) {
+            ip = target;
+        }
+    };
+
+#ifdef VM_THREADED_DISPATCH
+    static void* const dispatch_table[] = {
+        &&op_move,          &&op_load_constant, &&op_load_null,       &&op_load_true,      &&op_load_false,
+        &&op_get_global,    &&op_set_global,    &&op_get_free,        &&op_set_free,       &&op_get_builtin,
+        &&op_current_closure, &&op_add,         &&op_sub,             &&op_mul,            &&op_div,
+        &&op_floor_div,     &&op_mod,           &&op_bit_and,         &&op_bit_or,         &&op_bit_xor,
+        &&op_bit_lsh,       &&op_bit_rsh,       &&op_equal,           &&op_not_equal,      &&op_greater_than,
+        &&op_greater_equal, &&op_minus,         &&op_bang,            &&op_add_const,      &&op_sub_const,
+        &&op_jump,          &&op_jump_not_truthy, &&op_jump_truthy,   &&op_jump_not_equal,
+        &&op_jump_not_greater, &&op_jump_not_greater_equal, &&op_array, &&op_hash,         &&op_index,
+        &&op_call,          &&op_call_builtin,  &&op_closure,         &&op_return_value,   &&op_ret,
+    };
+    static_assert(std::size(dispatch_table) == registers::opcodes_count,
+                  "every opcode needs an entry in the dispatch table");
+    VM_DISPATCH();
+#else
+dispatch:
+    if (ip >= code_size) {
+        goto halt;
+    }
+    switch (static_cast<registers::opcodes>(code[ip++])) {
+#endif
+    VM_CASE(move) : {
+        auto& dst = read_reg();
+        dst = read_reg();
+        VM_DISPATCH();
+    }
+    VM_CASE(load_constant) : {
+        auto& dst = read_reg();
+        const auto const_idx = read_uint32();
+        if (const_idx >= m_constant_values.size()) {
+            throw std::runtime_error(fmt::format("constant at index {} does not exist", const_idx));
+        }
+        dst = m_constant_values[const_idx];
+        VM_DISPATCH();
+    }
+    VM_CASE(load_null) : {
+        read_reg() = value::null_value();
+        VM_DISPATCH();
+    }
+    VM_CASE(load_true) : {
+        read_reg() = value::boolean(true);
+        VM_DISPATCH();
+    }
+    VM_CASE(load_false) : {
+        read_reg() = value::boolean(false);
+        VM_DISPATCH();
+    }
+    VM_CASE(get_global) : {
+        auto& dst = read_reg();
+        const auto global_index = read_uint16();
+        const auto global = globals[global_index];
+        if (global.is_undefined()) {
+            throw std::runtime_error(fmt::format("global at index {} does not exits", global_index));
+        }
+        dst = global;
+        VM_DISPATCH();
+    }
+    VM_CASE(set_global) : {
+        const auto src = read_reg();
+        globals[read_uint16()] = src;
+        VM_DISPATCH();
+    }
+    VM_CASE(get_free) : {
+        auto& dst = read_reg();
+        dst = frm->cl->free[read_uint8()];
+        VM_DISPATCH();
+    }
+    VM_CASE(set_free) : {
+        const auto src = read_reg();
+        frm->cl->free[read_uint8()] = src;
+        VM_DISPATCH();
+    }
+    VM_CASE(get_builtin) : {
+        auto& dst = read_reg();
+        dst = value::from(builtin::builtin_objects()[read_uint8()]);
+        VM_DISPATCH();
+    }
+    VM_CASE(current_closure) : {
+        read_reg() = value::from(frm->cl);
+        VM_DISPATCH();
+    }
+    // the arithmetic on inline integers is done in place, everything else goes through the shared operators
+    VM_CASE(add) : {
+        auto& dst = read_reg();
+        const auto left = read_reg();
+        const auto right = read_reg();
+        dst = left.is_integer() && right.is_integer() ? value::integer(left.as_integer() + right.as_integer())
+                                                      : exec_binary_op(opcodes::add, left, right);
+        VM_DISPATCH();
+    }
+    VM_CASE(sub) : {
+        auto& dst = read_reg();
+        const auto left = read_reg();
+        const auto right = read_reg();
+        dst = left.is_integer() && right.is_integer() ? value::integer(left.as_integer() - right.as_integer())
+                                                      : exec_binary_op(opcodes::sub, left, right);
+        VM_DISPATCH();
+    }
+    VM_CASE(mul) : {
+        auto& dst = read_reg();
+        const auto left = read_reg();
+        const auto right = read_reg();
+        dst = left.is_integer() && right.is_integer() ? value::integer(left.as_integer() * right.as_integer())
+                                                      : exec_binary_op(opcodes::mul, left, right);
+        VM_DISPATCH();
+    }
+    VM_CASE(equal) : {
+        auto& dst = read_reg();
+        const auto left = read_reg();
+        const auto right = read_reg();
+        dst = left.is_integer() && right.is_integer() ? value::boolean(left.as_integer() == right.as_integer())
+                                                      : exec_binary_op(opcodes::equal, left, right);
+        VM_DISPATCH();
+    }
+    VM_CASE(greater_than) : {
+        auto& dst = read_reg();
+        const auto left = read_reg();
+        const auto right = read_reg();
+        dst = left.is_integer() && right.is_integer() ? value::boolean(left.as_integer() > right.as_integer())
+                                                      : exec_binary_op(opcodes::greater_than, left, right);
+        VM_DISPATCH();
+    }
+    VM_CASE(div) :
+    VM_CASE(floor_div) :
+    VM_CASE(mod) :
+    VM_CASE(bit_and) :
+    VM_CASE(bit_or) :
+    VM_CASE(bit_xor) :
+    VM_CASE(bit_lsh) :
+    VM_CASE(bit_rsh) :
+    VM_CASE(not_equal) :
+    VM_CASE(greater_equal) : {
+        binary(static_cast<registers::opcodes>(code[ip - 1]));
+        VM_DISPATCH();
+    }
+    VM_CASE(minus) : {
+        auto& dst = read_reg();
+        dst = exec_minus(read_reg());
+        VM_DISPATCH();
+    }
+    VM_CASE(bang) : {
+        auto& dst = read_reg();
+        dst = value::boolean(!read_reg().is_truthy());
+        VM_DISPATCH();
+    }
+    VM_CASE(add_const) : {
+        auto& dst = read_reg();
+        const auto left = read_reg();
+        const auto constant = m_constant_values[read_uint32()];
+        dst = left.is_integer() ? value::integer(left.as_integer() + constant.as_integer())
+                                : exec_binary_op(opcodes::add, left, constant);
+        VM_DISPATCH();
+    }
+    VM_CASE(sub_const) : {
+        auto& dst = read_reg();
+        const auto left = read_reg();
+        const auto constant = m_constant_values[read_uint32()];
+        dst = left.is_integer() ? value::integer(left.as_integer() - constant.as_integer())
+                                : exec_binary_op(opcodes::sub, left, constant);
+        VM_DISPATCH();
+    }
+    VM_CASE(jump) : {
+        ip = read_uint32();
+        if (heap::get().should_collect()) {
+            sync();
+            collect_garbage();
+        }
+        VM_DISPATCH();
+    }
+    VM_CASE(jump_not_truthy) : {
+        const auto condition = read_reg();
+        const auto target = read_uint32();
+        if (!condition.is_truthy()) {
+            ip = target;
+        }
+        VM_DISPATCH();
+    }
+    VM_CASE(jump_truthy) : {
+        const auto condition = read_reg();
+        const auto target = read_uint32();
+        if (condition.is_truthy()) {
+            ip = target;
+        }
+        VM_DISPATCH();
+    }
+    VM_CASE(jump_not_equal) : {
+        compare_and_jump([](std::int64_t left, std::int64_t right) { return left == right; },
+                         registers::opcodes::jump_not_equal);
+        VM_DISPATCH();
+    }
+    VM_CASE(jump_not_greater) : {
+        compare_and_jump([](std::int64_t left, std::int64_t right) { return left > right; },
+                         registers::opcodes::jump_not_greater);
+        VM_DISPATCH();
+    }
+    VM_CASE(jump_not_greater_equal) : {
+        compare_and_jump([](std::int64_t left, std::int64_t right) { return left >= right; },
+                         registers::opcodes::jump_not_greater_equal);
+        VM_DISPATCH();
+    }
+    VM_CASE(array) : {
+        auto& dst = read_reg();
+        const auto* first = &read_reg();
+        dst = build_array({first, read_uint16()});
+        VM_DISPATCH();
+    }
+    VM_CASE(hash) : {
+        auto& dst = read_reg();
+        const auto* first = &read_reg();
+        dst = build_hash({first, read_uint16()});
+        VM_DISPATCH();
+    }
+    VM_CASE(index) : {
+        auto& dst = read_reg();
+        const auto left = read_reg();
+        dst = exec_index(left, read_reg());
+        VM_DISPATCH();
+    }
+    VM_CASE(call) : {
+        const auto result = read_uint16();
+        const auto callee = read_uint16();
+        const auto num_args = read_uint8();
+        sync();
+        if (heap::get().should_collect()) {
+            collect_garbage();
+        }
+        exec_call(frm->base + callee, num_args, frm->base + result);
+        resume();
+        VM_DISPATCH();
+    }
+    VM_CASE(call_builtin) : {
+        auto& dst = read_reg();
+        const auto* first = &read_reg();
+        const auto builtin_index = read_uint8();
+        const auto num_args = read_uint8();
+        sync();
+        if (heap::get().should_collect()) {
+            collect_garbage();
+        }
+        dst = exec_builtin(builtin::builtins()[builtin_index], {first, num_args});
+        VM_DISPATCH();
+    }
+    VM_CASE(closure) : {
+        auto& dst = read_reg();
+        const auto* first = &read_reg();
+        const auto const_idx = read_uint32();
+        const auto num_free = read_uint8();
+        dst = make_closure(const_idx, {first, num_free});
+        VM_DISPATCH();
+    }
+    VM_CASE(return_value) : {
+        const auto return_value = read_reg();
+        const auto result = pop_frame().result;
+        m_registers[static_cast<std::size_t>(result)] = return_value;
+        if (m_frame_index == 0) {
+            return;
+        }
+        resume();
+        VM_DISPATCH();
+    }
+    VM_CASE(ret) : {
+        const auto result = pop_frame().result;
+        m_registers[static_cast<std::size_t>(result)] = value::null_value();
+        if (m_frame_index == 0) {
+            return;
+        }
+        resume();
+        VM_DISPATCH();
+    }
+#ifndef VM_THREADED_DISPATCH
+    }
+#endif
+halt:
+    sync();
+}
+
+#undef VM_DISPATCH
+#undef VM_CASE
+
+auto register_vm::last_popped() const -> const object*
+{
+    return m_registers[0].to_object();
+}
+
+auto register_vm::exec_call(int callee, int num_args, int result) -> void
+{
+    const auto callee_value = m_registers[static_cast<std::size_t>(callee)];
+    if (!callee_value.is_object()) {
+        throw std::runtime_error("calling non-closure and non-builtin");
+    }
+    const auto* callee_obj = callee_value.as_object();
+    const auto args = std::span {m_registers}.subspan(static_cast<std::size_t>(callee) + 1,
+                                                      static_cast<std::size_t>(num_args));
+    using enum object::object_type;
+    if (callee_obj->is(closure)) {
+        const auto* clsr = callee_obj->as<closure_object>();
+        if (num_args != clsr->fn->num_arguments) {
+            throw std::runtime_error(
+                fmt::format("wrong number of arguments: want={}, got={}", clsr->fn->num_arguments, num_args));
+        }
+        push_frame({.cl = clsr->as_mutable(), .ip = 0, .base = callee + 1, .result = result});
+        return;
+    }
+    if (callee_obj->is(builtin)) {
+        m_registers[static_cast<std::size_t>(result)] = exec_builtin(callee_obj->as<builtin_object>()->builtin, args);
+        return;
+    }
+    throw std::runtime_error("calling non-closure and non-builtin");
+}
+
+auto register_vm::make_closure(uint32_t const_idx, std::span<const value> free) const -> value
+{
+    const auto* constant = (*m_constants)[const_idx];
+    if (!constant->is(object::object_type::compiled_function)) {
+        throw std::runtime_error(
+            fmt::format("expected a compiled_function, got an object of type {}", constant->type()));
+    }
+    return value::from(
+        make<closure_object>(constant->as<compiled_function_object>(), values {free.begin(), free.end()}));
+}
+
+auto register_vm::current_frame() -> register_frame&
+{
+    return m_frames[static_cast<std::size_t>(m_frame_index - 1)];
+}
+
+auto register_vm::push_frame(register_frame frm) -> void
+{
+    const auto top = static_cast<std::size_t>(frm.base + frm.cl->fn->num_locals);
+    if (m_frame_index >= static_cast<int>(max_frames) || top > m_registers.size()) {
+        throw std::runtime_error("stack overflow");
+    }
+    m_high_water = std::max(m_high_water, top);
+    m_frames[static_cast<std::size_t>(m_frame_index)] = frm;
+    m_frame_index++;
+}
+
+auto register_vm::pop_frame() -> register_frame&
+{
+    m_frame_index--;
+    return m_frames[static_cast<std::size_t>(m_frame_index)];
+}
+
+auto register_vm::collect_garbage() -> void
+{
+    auto& hp = heap::get();
+    hp.begin_collection();
+    // the registers above the frame of the current call are dead, they are cleared after the collection so every
+    // register below refers to a live object
+    const auto& frm = current_frame();
+    const auto top = static_cast<std::size_t>(frm.base + frm.cl->fn->num_locals);
+    for (auto idx = 0UL; idx < top; idx++) {
+        hp.mark(m_registers[idx]);
+    }
+    for (auto idx = 0; idx < m_frame_index; idx++) {
+        hp.mark(m_frames[static_cast<std::size_t>(idx)].cl);
+    }
+    for (const auto* constant : *m_constants) {
+        hp.mark(constant);
+    }
+    for (const auto& global : *m_globals) {
+        hp.mark(global);
+    }
+    hp.collect();
+    if (m_high_water > top) {
+        std::fill(m_registers.begin() + static_cast<std::ptrdiff_t>(top),
+                  m_registers.begin() + static_cast<std::ptrdiff_t>(m_high_water),
+                  value {});
+    }
+    m_high_water = top;
+}
+
+namespace
+{
+// NOLINTBEGIN(*)
+auto run_program(std::string_view input) -> std::pair<register_vm, std::unique_ptr<program>>
+{
+    auto prsr = parser {lexer {input}};
+    auto prgrm = prsr.parse_program();
+    INFO("while parsing: `", input, "`");
+    REQUIRE(prsr.errors().empty());
+    auto cmplr = register_compiler::create();
+    cmplr.compile(prgrm.get());
+    return {register_vm::create(cmplr.byte_code()), std::move(prgrm)};
+}
+
+TEST_SUITE_BEGIN("register_vm");
+
+TEST_CASE("loopsDoNotAllocate")
+{
+    auto [mchn, _] = run_program(R"(
+        let f = fn() {
+            let i = 0;
+            let s = 0;
+            while (i < 1000) {
+                i = i + 1;
+                if (i % 3 == 0) { continue; }
+                s = s + i;
+            }
+            s
+        };
+        f();)");
+    const auto allocations = heap::get().total_allocations();
+    mchn.run();
+
+    // the closure of f is the only object created while running
+    CHECK_EQ(heap::get().total_allocations(), allocations + 1);
+    CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 333667);
+}
+
+TEST_CASE("temporariesSurviveCollections")
+{
+    auto [mchn, _] = run_program(R"(
+        let build = fn(n) {
+            let i = 0;
+            let parts = [];
+            while (i < n) {
+                parts = push(parts, "part" + "-" + "of" + "-" + "a" + "-" + "string");
+                i = i + 1;
+            }
+            parts
+        };
+        let all = [build(20000), build(20000)];
+        len(all[0]) + len(all[1]) + len(all[1][19999]))");
+    mchn.run();
+    CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 40000 + 16);
+}
+
+TEST_CASE("returnLeavesTheProgram")
+{
+    auto [mchn, _] = run_program("1; return 2; 3");
+    mchn.run();
+    CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 2);
+}
+
+TEST_CASE("deepRecursionOverflowsTheStack")
+{
+    auto [mchn, _] = run_program("let f = fn(n) { f(n + 1) }; f(0)");
+    CHECK_THROWS_WITH(mchn.run(), "stack overflow");
+}
+
+TEST_SUITE_END();
+// NOLINTEND(*)
+}  // namespace
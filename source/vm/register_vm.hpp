@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <compiler/compiler.hpp>
+#include <compiler/register_compiler.hpp>
+#include <gc.hpp>
+#include <object/object.hpp>
+#include <object/value.hpp>
+
+#include "vm.hpp"
+
+/// number of registers shared by the frames of all active calls
+constexpr std::size_t register_file_size = 64UL * 1024UL;
+
+struct register_frame final
+{
+    closure_object* cl {};
+    int ip {};
+    /// index of the first register of the frame in the register file
+    int base {};
+    /// index of the register of the caller receiving the return value in the register file
+    int result {};
+};
+
+/// Interpreter for the instructions of the register compiler.
+///
+/// The frames are windows into one register file, the frame of a callee starts right after the register holding
+/// the callee, so the arguments prepared by the caller are the first registers of the callee without copying them.
+struct register_vm final
+{
+    static auto create(register_bytecode code) -> register_vm;
+    static auto create_with_state(register_bytecode code, values* globals) -> register_vm;
+    auto run() -> void;
+    /// the value of the last expression statement of the program
+    [[nodiscard]] auto last_popped() const -> const object*;
+
+  private:
+    register_vm(closure_object* main, const constants* consts, values* globals);
+    /// calls the value in the callee register, the registers of the arguments follow it
+    auto exec_call(int callee, int num_args, int result) -> void;
+    [[nodiscard]] auto make_closure(uint32_t const_idx, std::span<const value> free) const -> value;
+    auto current_frame() -> register_frame&;
+    auto push_frame(register_frame frm) -> void;
+    auto pop_frame() -> register_frame&;
+    auto collect_garbage() -> void;
+
+    const constants* m_constants {};
+    values m_constant_values;
+    values* m_globals {};
+    values m_registers {register_file_size};
+    /// end of the registers written since the last collection
+    std::size_t m_high_water {};
+    std::array<register_frame, max_frames> m_frames;
+    int m_frame_index {1};
+};
@@ -1,8 +1,12 @@
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <cmath>
 #include <cstddef>
 #include <cstdint>
 #include <initializer_list>
+#include <memory>
+#include <span>
 #include <stdexcept>
 #include <string>
 #include <string_view>
@@ -17,6 +21,7 @@
 #include <builtin/builtin.hpp>
 #include <code/code.hpp>
 #include <compiler/compiler.hpp>
+#include <compiler/register_compiler.hpp>
 #include <compiler/symbol_table.hpp>
 #include <doctest/doctest.h>
 #include <fmt/format.h>
@@ -24,17 +29,22 @@
 #include <gc.hpp>
 #include <lexer/lexer.hpp>
 #include <object/object.hpp>
+#include <optimizer/optimizer.hpp>
 #include <overloaded.hpp>
 #include <parser/parser.hpp>
 
+#include "jit.hpp"
+#include "register_vm.hpp"
+
 auto vm::create(bytecode code) -> vm
 {
-    return create_with_state(std::move(code), make<constants>(globals_size));
+    return create_with_state(std::move(code), make<values>(globals_size));
 }
 
-auto vm::create_with_state(bytecode code, constants* globals) -> vm
+auto vm::create_with_state(bytecode code, values* globals) -> vm
 {
     auto* main_fn = make<compiled_function_object>(std::move(code.instrs), 0, 0);
+    main_fn->name = "main";
     auto* main_closure = make<closure_object>(main_fn);
     const frame main_frame {.cl = main_closure};
     frames frms;
@@ -42,213 +52,548 @@ auto vm::create_with_state(bytecode code, constants* globals) -> vm
     return vm {frms, code.consts, globals};
 }
 
-vm::vm(frames frames, const constants* consts, constants* globals)
+vm::vm(frames frames, const constants* consts, values* globals)
     : m_constants {consts}
     , m_globals {globals}
     , m_frames {frames}
 {
+    m_constant_values.reserve(m_constants->size());
+    for (const auto* constant : *m_constants) {
+        m_constant_values.push_back(value::from(constant));
+    }
 }
 
+// With CAPPUCHIN_COMPUTED_GOTO every instruction jumps directly to the handler of the next one through a table of
+// label addresses, otherwise the handlers are the cases of a switch that is re-entered after every instruction.
+#if defined(CAPPUCHIN_COMPUTED_GOTO) && (defined(__GNUC__) || defined(__clang__))
+#    define VM_THREADED_DISPATCH
+#endif
+
+#ifdef VM_THREADED_DISPATCH
+#    define VM_CASE(name) op_##name
+#    define VM_DISPATCH() \
+        do { \
+            if (ip >= code_size) { \
+                goto halt; \
+            } \
+            profile(); \
+            goto* dispatch_table[code[ip++]]; \
+        } while (false)
+#else
+#    define VM_CASE(name) case opcodes::name
+#    define VM_DISPATCH() goto dispatch
+#endif
+
 auto vm::run() -> void
 {
-    for (; current_frame().ip < current_frame().cl->fn->instrs.size(); current_frame().ip++) {
-        const auto ip = current_frame().ip;
-        const auto& instr = current_frame().cl->fn->instrs;
-        const auto op = static_cast<opcodes>(instr[ip]);
-        switch (op) {
-            case opcodes::constant: {
-                current_frame().ip += 2;
-                const auto const_idx = read_uint16_big_endian(instr, ip + 1UL);
-                const auto* constant = (*m_constants)[const_idx];
-                if (constant == nullptr) {
-                    throw std::runtime_error(fmt::format("constant at index {} does not exist", const_idx));
-                }
-                push((*m_constants)[const_idx]);
-            } break;
-            case opcodes::add:
-            case opcodes::sub:
-            case opcodes::mul:
-            case opcodes::div:
-            case opcodes::mod:
-            case opcodes::floor_div:
-            case opcodes::bit_and:
-            case opcodes::bit_or:
-            case opcodes::bit_xor:
-            case opcodes::bit_lsh:
-            case opcodes::bit_rsh:
-            case opcodes::logical_and:
-            case opcodes::logical_or:
-            case opcodes::equal:
-            case opcodes::not_equal:
-            case opcodes::greater_than:
-            case opcodes::greater_equal:
-                exec_binary_op(op);
-                break;
-            case opcodes::pop:
-                pop();
-                break;
-            case opcodes::tru:
-                push(tru());
-                break;
-            case opcodes::fals:
-                push(fals());
-                break;
-            case opcodes::bang:
-                exec_bang();
-                break;
-            case opcodes::minus:
-                exec_minus();
-                break;
-            case opcodes::jump: {
-                current_frame().ip = read_uint16_big_endian(instr, ip + 1UL) - 1;
-            } break;
-            case opcodes::jump_not_truthy: {
-                current_frame().ip += 2;
-                const auto* condition = pop();
-                if (!condition->is_truthy()) {
-                    current_frame().ip = read_uint16_big_endian(instr, ip + 1UL) - 1;
-                }
-            } break;
-            case opcodes::null:
-                push(null());
-                break;
-            case opcodes::set_global: {
-                current_frame().ip += 2;
-                const auto global_index = read_uint16_big_endian(instr, ip + 1UL);
-                (*m_globals)[global_index] = pop();
-            } break;
-            case opcodes::get_global: {
-                auto global_index = read_uint16_big_endian(instr, ip + 1UL);
-                current_frame().ip += 2;
-                const auto* global = (*m_globals)[global_index];
-                if (global == nullptr) {
-                    throw std::runtime_error(fmt::format("global at index {} does not exits", global_index));
-                }
-                push(global);
-            } break;
-            case opcodes::array: {
-                current_frame().ip += 2;
-                const auto num_elements = read_uint16_big_endian(instr, ip + 1UL);
-                const auto* arr = build_array(m_sp - num_elements, m_sp);
-                m_sp -= num_elements;
-                push(arr);
-            } break;
-            case opcodes::hash: {
-                current_frame().ip += 2;
-                const auto num_elements = read_uint16_big_endian(instr, ip + 1UL);
-                const auto* hsh = build_hash(m_sp - num_elements, m_sp);
-                m_sp -= num_elements;
-                push(hsh);
-            } break;
-            case opcodes::index: {
-                const auto* index = pop();
-                const auto* left = pop();
-                exec_index(left, index);
-            } break;
-            case opcodes::call: {
-                current_frame().ip += 1;
-                const auto num_args = instr[ip + 1UL];
-                exec_call(num_args);
-            } break;
-            case opcodes::brake: {
-                current_frame().ip += 1;
-                auto& frame = pop_frame();
-                m_sp = frame.base_ptr - 1;
-                push(fals());
-            } break;
-            case opcodes::cont: {
-                current_frame().ip += 1;
-                auto& frame = pop_frame();
-                m_sp = frame.base_ptr - 1;
-                push(tru());
-            } break;
-            case opcodes::return_value: {
-                const auto* return_value = pop();
-                auto& frame = pop_frame();
-                while (frame.cl->fn->inside_loop) {
-                    frame = pop_frame();
-                }
-                m_sp = frame.base_ptr - 1;
-                push(return_value);
-            } break;
-            case opcodes::ret: {
-                auto& frame = pop_frame();
-                m_sp = frame.base_ptr - 1;
-                push(null());
-            } break;
-            case opcodes::set_local: {
-                current_frame().ip += 1;
-                const auto local_index = instr[ip + 1UL];
-                auto& frame = current_frame();
-                m_stack[frame.base_ptr + local_index] = pop();
-            } break;
-            case opcodes::get_local: {
-                current_frame().ip += 1;
-                const auto local_index = instr[ip + 1UL];
-                auto& frame = current_frame();
-                push(m_stack[frame.base_ptr + local_index]);
-            } break;
-            case opcodes::set_outer:
-                current_frame().ip += 3;
-                exec_set_outer(ip, instr);
-                break;
-            case opcodes::get_outer:
-                current_frame().ip += 3;
-                exec_get_outer(ip, instr);
-                break;
-            case opcodes::get_builtin: {
-                current_frame().ip += 1;
-                const auto builtin_index = instr[ip + 1UL];
-                const auto* const builtin = builtin::builtins()[builtin_index];
-                push(make<builtin_object>(builtin));
-            } break;
-            case opcodes::set_free: {
-                current_frame().ip += 1;
-                const auto free_index = instr[ip + 1UL];
-                current_frame().cl->free[free_index] = pop();
-            } break;
-            case opcodes::get_free: {
-                current_frame().ip += 1;
-                const auto free_index = instr[ip + 1UL];
-                const auto* current_closure = current_frame().cl;
-                push(current_closure->free[free_index]);
-            } break;
-            case opcodes::closure: {
-                current_frame().ip += 3;
-                const auto const_idx = read_uint16_big_endian(instr, ip + 1UL);
-                const auto num_free = instr[ip + 3UL];
-                push_closure(const_idx, num_free);
-            } break;
-            case opcodes::current_closure: {
-                push(current_frame().cl);
-            } break;
+    if (m_profiler != nullptr) {
+        run_loop<true>();
+    } else {
+        run_loop<false>();
+    }
+}
+
+template<bool Profiling>
+auto vm::run_loop() -> void
+{
+    // the registers of the interpreter are cached in locals and written back before calling a helper that works
+    // on the members, the frame ip always points to the next instruction to execute
+    auto* frm = &current_frame();
+    auto* code = frm->cl->fn->instrs.data();
+    auto code_size = frm->cl->fn->instrs.size();
+    auto ip = static_cast<std::size_t>(frm->ip);
+    auto* const stack = m_stack.data();
+    auto sp = m_sp;
+    auto& globals = *m_globals;
+
+    const auto sync = [&]
+    {
+        frm->ip = static_cast<int>(ip);
+        m_sp = sp;
+    };
+    const auto resume = [&]
+    {
+        frm = &current_frame();
+        code = frm->cl->fn->instrs.data();
+        code_size = frm->cl->fn->instrs.size();
+        ip = static_cast<std::size_t>(frm->ip);
+    };
+    const auto read_uint8 = [&] { return code[ip++]; };
+    const auto read_uint16 = [&]
+    {
+        const auto result = read_operand<uint16_t>(code + ip);
+        ip += 2;
+        return result;
+    };
+    const auto read_uint32 = [&]
+    {
+        const auto result = read_operand<uint32_t>(code + ip);
+        ip += 4;
+        return result;
+    };
+    const auto push_value = [&](value val)
+    {
+        if (sp >= static_cast<int>(stack_size)) {
+            throw std::runtime_error("stack overflow");
+        }
+        stack[sp++] = val;
+    };
+    const auto pop_value = [&]
+    {
+        if (sp == 0) {
+            throw std::runtime_error("stack empty");
+        }
+        return stack[--sp];
+    };
+    // set when an instruction is dispatched again after its deoptimization, the profiler has counted it already
+    bool redispatch = false;
+    const auto profile = [&]
+    {
+        if constexpr (Profiling) {
+            if (!std::exchange(redispatch, false)) {
+                m_profiler->on_instruction(static_cast<opcodes>(code[ip]), m_frame_index, frm->cl->fn);
+            }
+        }
+    };
+    // a specialized instruction whose operands do not have the observed types any more is rewritten back to its
+    // generic instruction, which is executed again
+    const auto deoptimize = [&](std::size_t site)
+    {
+        code[site] = static_cast<std::uint8_t>(generic_variant(static_cast<opcodes>(code[site])));
+        ip = site;
+        redispatch = Profiling;
+    };
+    // the handlers of the integer variants of the binary operators
+    const auto integer_operator = [&](auto operation)
+    {
+        const auto right = stack[sp - 1];
+        auto& left = stack[sp - 2];
+        if (!left.is_integer() || !right.is_integer()) [[unlikely]] {
+            deoptimize(ip - 1);
+            return;
+        }
+        left = operation(left.as_integer(), right.as_integer());
+        --sp;
+    };
+    // hands the current frame over to the machine code of its function, which returns at the first instruction it
+    // leaves to the interpreter, counting marks a call or a backward jump, which may make the function hot
+    const auto enter_native = [&](bool counting)
+    {
+        if constexpr (!Profiling) {
+            if (m_jit == nullptr) {
+                return;
+            }
+            const auto* fn = frm->cl->fn;
+            const auto* native = counting ? m_jit->hot(fn, *this) : fn->native.get();
+            if (native == nullptr) {
+                return;
+            }
+            sync();
+            m_jit->run(native, *this);
+            // the machine code may leave in the frame of a function it called
+            sp = m_sp;
+            resume();
         }
+    };
+
+#ifdef VM_THREADED_DISPATCH
+    static void* const dispatch_table[] = {
+        &&op_constant,      &&op_add,        &&op_sub,        &&op_mul,           &&op_div,
+        &&op_floor_div,     &&op_mod,        &&op_bit_and,    &&op_bit_or,        &&op_bit_xor,
+        &&op_bit_lsh,       &&op_bit_rsh,    &&op_pop,
+        &&op_tru,           &&op_fals,       &&op_equal,      &&op_not_equal,     &&op_greater_than,
+        &&op_greater_equal, &&op_minus,      &&op_bang,       &&op_jump_not_truthy, &&op_jump_truthy,
+        &&op_jump,          &&op_null,          &&op_get_global, &&op_set_global, &&op_array,         &&op_hash,
+        &&op_index,         &&op_call,       &&op_return_value, &&op_ret,         &&op_get_local,
+        &&op_set_local,     &&op_get_free,   &&op_set_free,   &&op_get_builtin,   &&op_closure,
+        &&op_current_closure, &&op_call_builtin,
+        &&op_add_const,     &&op_sub_const,  &&op_jump_not_equal, &&op_jump_not_greater, &&op_jump_not_greater_equal,
+        &&op_get_local_get_local, &&op_inc_local,
+        &&op_add_int_int,   &&op_sub_int_int, &&op_mul_int_int, &&op_equal_int_int, &&op_not_equal_int_int,
+        &&op_greater_than_int_int, &&op_greater_equal_int_int, &&op_index_array_int, &&op_call_closure,
+    };
+    static_assert(std::size(dispatch_table) == opcodes_count, "every opcode needs an entry in the dispatch table");
+    enter_native(true);
+    VM_DISPATCH();
+#else
+    enter_native(true);
+dispatch:
+    if (ip >= code_size) {
+        goto halt;
+    }
+    profile();
+    switch (static_cast<opcodes>(code[ip++])) {
+#endif
+    VM_CASE(constant) : {
+        const auto const_idx = read_uint32();
+        if (const_idx >= m_constant_values.size() || m_constant_values[const_idx].is_undefined()) {
+            throw std::runtime_error(fmt::format("constant at index {} does not exist", const_idx));
+        }
+        push_value(m_constant_values[const_idx]);
+        VM_DISPATCH();
+    }
+    VM_CASE(add) :
+    VM_CASE(sub) :
+    VM_CASE(mul) :
+    VM_CASE(div) :
+    VM_CASE(mod) :
+    VM_CASE(floor_div) :
+    VM_CASE(bit_and) :
+    VM_CASE(bit_or) :
+    VM_CASE(bit_xor) :
+    VM_CASE(bit_lsh) :
+    VM_CASE(bit_rsh) :
+    VM_CASE(equal) :
+    VM_CASE(not_equal) :
+    VM_CASE(greater_than) :
+    VM_CASE(greater_equal) : {
+        const auto right = pop_value();
+        const auto left = pop_value();
+        const auto opcode = static_cast<opcodes>(code[ip - 1]);
+        if (left.is_integer() && right.is_integer()) {
+            code[ip - 1] = static_cast<std::uint8_t>(integer_variant(opcode));
+        }
+        push_value(exec_binary_op(opcode, left, right));
+        VM_DISPATCH();
+    }
+    VM_CASE(pop) : {
+        pop_value();
+        VM_DISPATCH();
+    }
+    VM_CASE(tru) : {
+        push_value(value::boolean(true));
+        VM_DISPATCH();
+    }
+    VM_CASE(fals) : {
+        push_value(value::boolean(false));
+        VM_DISPATCH();
+    }
+    VM_CASE(bang) : {
+        push_value(value::boolean(!pop_value().is_truthy()));
+        VM_DISPATCH();
+    }
+    VM_CASE(minus) : {
+        push_value(exec_minus(pop_value()));
+        VM_DISPATCH();
+    }
+    VM_CASE(jump) : {
+        const auto from = ip - 1;
+        ip = read_uint32();
+        if (heap::get().should_collect()) {
+            sync();
+            collect_garbage();
+        }
+        if (ip <= from) {
+            enter_native(true);
+        }
+        VM_DISPATCH();
+    }
+    VM_CASE(jump_not_truthy) : {
+        const auto target = read_uint32();
+        if (!pop_value().is_truthy()) {
+            ip = target;
+        }
+        VM_DISPATCH();
+    }
+    VM_CASE(jump_truthy) : {
+        const auto target = read_uint32();
+        if (pop_value().is_truthy()) {
+            ip = target;
+        }
+        VM_DISPATCH();
+    }
+    VM_CASE(null) : {
+        push_value(value::null_value());
+        VM_DISPATCH();
+    }
+    VM_CASE(set_global) : {
+        const auto global_index = read_uint16();
+        globals[global_index] = pop_value();
+        VM_DISPATCH();
+    }
+    VM_CASE(get_global) : {
+        const auto global_index = read_uint16();
+        const auto global = globals[global_index];
+        if (global.is_undefined()) {
+            throw std::runtime_error(fmt::format("global at index {} does not exits", global_index));
+        }
+        push_value(global);
+        VM_DISPATCH();
+    }
+    VM_CASE(array) : {
+        const auto num_elements = read_uint16();
+        const auto arr = build_array({stack + sp - num_elements, num_elements});
+        sp -= num_elements;
+        push_value(arr);
+        VM_DISPATCH();
+    }
+    VM_CASE(hash) : {
+        const auto num_elements = read_uint16();
+        const auto hsh = build_hash({stack + sp - num_elements, num_elements});
+        sp -= num_elements;
+        push_value(hsh);
+        VM_DISPATCH();
+    }
+    VM_CASE(index) : {
+        const auto index = pop_value();
+        const auto left = pop_value();
+        if (left.is_object() && left.as_object()->is(object::object_type::array) && index.is_integer()) {
+            code[ip - 1] = static_cast<std::uint8_t>(opcodes::index_array_int);
+        }
+        push_value(exec_index(left, index));
+        VM_DISPATCH();
+    }
+    VM_CASE(call) : {
+        const auto num_args = read_uint8();
+        sync();
+        if (heap::get().should_collect()) {
+            collect_garbage();
+        }
+        if (const auto callee = stack[sp - 1 - num_args];
+            callee.is_object() && callee.as_object()->is(object::object_type::closure))
+        {
+            code[ip - 2] = static_cast<std::uint8_t>(opcodes::call_closure);
+        }
+        const auto caller = m_frame_index;
+        exec_call(num_args);
+        sp = m_sp;
+        resume();
+        enter_native(m_frame_index != caller);
+        VM_DISPATCH();
+    }
+    VM_CASE(return_value) : {
+        const auto return_value = pop_value();
+        sp = pop_frame().base_ptr - 1;
+        push_value(return_value);
+        resume();
+        enter_native(false);
+        VM_DISPATCH();
+    }
+    VM_CASE(ret) : {
+        sp = pop_frame().base_ptr - 1;
+        push_value(value::null_value());
+        resume();
+        enter_native(false);
+        VM_DISPATCH();
+    }
+    VM_CASE(set_local) : {
+        const auto local_index = read_uint8();
+        stack[frm->base_ptr + local_index] = pop_value();
+        VM_DISPATCH();
+    }
+    VM_CASE(get_local) : {
+        const auto local_index = read_uint8();
+        push_value(stack[frm->base_ptr + local_index]);
+        VM_DISPATCH();
+    }
+    VM_CASE(get_builtin) : {
+        const auto builtin_index = read_uint8();
+        push_value(value::from(builtin::builtin_objects()[builtin_index]));
+        VM_DISPATCH();
+    }
+    VM_CASE(call_builtin) : {
+        const auto builtin_index = read_uint8();
+        const auto num_args = read_uint8();
+        sync();
+        if (heap::get().should_collect()) {
+            collect_garbage();
+        }
+        const auto result = exec_builtin(builtin::builtins()[builtin_index], arguments(num_args));
+        sp -= num_args;
+        push_value(result);
+        VM_DISPATCH();
+    }
+    VM_CASE(set_free) : {
+        const auto free_index = read_uint8();
+        frm->cl->free[free_index] = pop_value();
+        VM_DISPATCH();
+    }
+    VM_CASE(get_free) : {
+        const auto free_index = read_uint8();
+        push_value(frm->cl->free[free_index]);
+        VM_DISPATCH();
+    }
+    VM_CASE(closure) : {
+        const auto const_idx = read_uint32();
+        const auto num_free = read_uint8();
+        sync();
+        push_closure(const_idx, num_free);
+        sp = m_sp;
+        VM_DISPATCH();
+    }
+    VM_CASE(current_closure) : {
+        push_value(value::from(frm->cl));
+        VM_DISPATCH();
+    }
+    // the superinstructions operate on inline integers and fall back to the generic operators for everything else
+    VM_CASE(add_const) : {
+        const auto constant = m_constant_values[read_uint32()];
+        auto& left = stack[sp - 1];
+        left = left.is_integer() ? value::integer(left.as_integer() + constant.as_integer())
+                                 : exec_binary_op(opcodes::add, left, constant);
+        VM_DISPATCH();
+    }
+    VM_CASE(sub_const) : {
+        const auto constant = m_constant_values[read_uint32()];
+        auto& left = stack[sp - 1];
+        left = left.is_integer() ? value::integer(left.as_integer() - constant.as_integer())
+                                 : exec_binary_op(opcodes::sub, left, constant);
+        VM_DISPATCH();
+    }
+    VM_CASE(jump_not_equal) : {
+        const auto target = read_uint32();
+        const auto right = pop_value();
+        const auto left = pop_value();
+        const auto equal = left.is_integer() && right.is_integer()
+            ? left.as_integer() == right.as_integer()
+            : exec_binary_op(opcodes::equal, left, right).is_truthy();
+        if (!equal) {
+            ip = target;
+        }
+        VM_DISPATCH();
+    }
+    VM_CASE(jump_not_greater) : {
+        const auto target = read_uint32();
+        const auto right = pop_value();
+        const auto left = pop_value();
+        const auto greater = left.is_integer() && right.is_integer()
+            ? left.as_integer() > right.as_integer()
+            : exec_binary_op(opcodes::greater_than, left, right).is_truthy();
+        if (!greater) {
+            ip = target;
+        }
+        VM_DISPATCH();
+    }
+    VM_CASE(jump_not_greater_equal) : {
+        const auto target = read_uint32();
+        const auto right = pop_value();
+        const auto left = pop_value();
+        const auto greater_equal = left.is_integer() && right.is_integer()
+            ? left.as_integer() >= right.as_integer()
+            : exec_binary_op(opcodes::greater_equal, left, right).is_truthy();
+        if (!greater_equal) {
+            ip = target;
+        }
+        VM_DISPATCH();
+    }
+    VM_CASE(get_local_get_local) : {
+        const auto first_index = read_uint8();
+        const auto second_index = read_uint8();
+        push_value(stack[frm->base_ptr + first_index]);
+        push_value(stack[frm->base_ptr + second_index]);
+        VM_DISPATCH();
+    }
+    VM_CASE(inc_local) : {
+        const auto local_index = read_uint8();
+        const auto constant = m_constant_values[read_uint32()];
+        auto& local = stack[frm->base_ptr + local_index];
+        local = local.is_integer() ? value::integer(local.as_integer() + constant.as_integer())
+                                   : exec_binary_op(opcodes::add, local, constant);
+        VM_DISPATCH();
+    }
+    // the specialized instructions check the types they were specialized for and deoptimize if they changed
+    VM_CASE(add_int_int) : {
+        integer_operator([](std::int64_t left, std::int64_t right) { return value::integer(left + right); });
+        VM_DISPATCH();
+    }
+    VM_CASE(sub_int_int) : {
+        integer_operator([](std::int64_t left, std::int64_t right) { return value::integer(left - right); });
+        VM_DISPATCH();
+    }
+    VM_CASE(mul_int_int) : {
+        integer_operator([](std::int64_t left, std::int64_t right) { return value::integer(left * right); });
+        VM_DISPATCH();
+    }
+    VM_CASE(equal_int_int) : {
+        integer_operator([](std::int64_t left, std::int64_t right) { return value::boolean(left == right); });
+        VM_DISPATCH();
+    }
+    VM_CASE(not_equal_int_int) : {
+        integer_operator([](std::int64_t left, std::int64_t right) { return value::boolean(left != right); });
+        VM_DISPATCH();
+    }
+    VM_CASE(greater_than_int_int) : {
+        integer_operator([](std::int64_t left, std::int64_t right) { return value::boolean(left > right); });
+        VM_DISPATCH();
+    }
+    VM_CASE(greater_equal_int_int) : {
+        integer_operator([](std::int64_t left, std::int64_t right) { return value::boolean(left >= right); });
+        VM_DISPATCH();
+    }
+    VM_CASE(index_array_int) : {
+        const auto index = stack[sp - 1];
+        auto& left = stack[sp - 2];
+        if (!left.is_object() || !left.as_object()->is(object::object_type::array) || !index.is_integer())
+            [[unlikely]]
+        {
+            deoptimize(ip - 1);
+            VM_DISPATCH();
+        }
+        const auto& arr = left.as_object()->as<array_object>()->value;
+        const auto idx = index.as_integer();
+        left = idx < 0 || idx >= static_cast<std::int64_t>(arr.size())
+            ? value::null_value()
+            : value::from(arr[static_cast<std::size_t>(idx)]);
+        --sp;
+        VM_DISPATCH();
+    }
+    VM_CASE(call_closure) : {
+        const auto num_args = read_uint8();
+        const value callee = stack[sp - 1 - num_args];
+        const closure_object* clsr = callee.is_object() && callee.as_object()->is(object::object_type::closure)
+            ? callee.as_object()->as<closure_object>()
+            : nullptr;
+        if (clsr == nullptr || clsr->fn->num_arguments != num_args) [[unlikely]] {
+            deoptimize(ip - 2);
+            VM_DISPATCH();
+        }
+        sync();
+        if (heap::get().should_collect()) {
+            collect_garbage();
+        }
+        const frame callee_frame {.cl = clsr->as_mutable(), .ip = 0, .base_ptr = sp - num_args};
+        push_frame(callee_frame);
+        sp = callee_frame.base_ptr + clsr->fn->num_locals;
+        resume();
+        enter_native(true);
+        VM_DISPATCH();
+    }
+#ifndef VM_THREADED_DISPATCH
+    }
+#endif
+halt:
+    sync();
+    if constexpr (Profiling) {
+        m_profiler->stop();
     }
 }
 
-auto vm::push(const object* obj) -> void
+#undef VM_DISPATCH
+#undef VM_CASE
+
+auto vm::push(value val) -> void
 {
-    assert(obj != nullptr);
+    assert(!val.is_undefined());
     if (m_sp >= stack_size) {
         throw std::runtime_error("stack overflow");
     }
-    m_stack[m_sp] = obj;
+    m_stack[m_sp] = val;
     m_sp++;
 }
 
-auto vm::pop() -> const object*
+auto vm::pop() -> value
 {
     if (m_sp == 0) {
         throw std::runtime_error("stack empty");
     }
-    const auto* const result = m_stack[m_sp - 1];
+    const auto result = m_stack[m_sp - 1];
     m_sp--;
     return result;
 }
 
 auto vm::last_popped() const -> const object*
 {
-    return m_stack[m_sp];
+    return m_stack[m_sp].to_object();
 }
 
 namespace
@@ -278,10 +623,6 @@ auto apply_binary_operator(opcodes opcode, const object* left, const object* rig
             return *left << *right;
         case bit_rsh:
             return *left >> *right;
-        case logical_and:
-            return *left && *right;
-        case logical_or:
-            return *left || *right;
         case equal:
             return *left == *right;
         case not_equal:
@@ -296,88 +637,159 @@ auto apply_binary_operator(opcodes opcode, const object* left, const object* rig
             return nullptr;
     }
 }
-}  // namespace
 
-auto vm::exec_binary_op(opcodes opcode) -> void
+/// applies the operator to two inline integers, returns an undefined value for the cases handled by the objects
+auto apply_integer_operator(opcodes opcode, std::int64_t left, std::int64_t right) -> value
 {
-    const auto* right = pop();
-    const auto* left = pop();
-    if (const auto* result = apply_binary_operator(opcode, left, right); result != nullptr) {
-        push(result);
-        return;
+    using enum opcodes;
+    switch (opcode) {
+        case add:
+            return value::integer(left + right);
+        case sub:
+            return value::integer(left - right);
+        case mul:
+            return value::integer(left * right);
+        case div:
+            if (right == 0) {
+                return {};
+            }
+            return value::decimal(static_cast<double>(left) / static_cast<double>(right));
+        case mod:
+            if (right == 0) {
+                return {};
+            }
+            return value::integer(((left % right) + right) % right);
+        case bit_and:
+            return value::integer(left & right);
+        case bit_or:
+            return value::integer(left | right);
+        case bit_xor:
+            return value::integer(left ^ right);
+        case bit_lsh:
+            return value::integer(left << right);
+        case bit_rsh:
+            return value::integer(left >> right);
+        case equal:
+            return value::boolean(left == right);
+        case not_equal:
+            return value::boolean(left != right);
+        case greater_than:
+            return value::boolean(left > right);
+        case greater_equal:
+            return value::boolean(left >= right);
+        default:
+            return {};
     }
-    throw std::runtime_error(
-        fmt::format("unsupported types for binary operation: {} {} {}", left->type(), opcode, right->type()));
 }
 
-auto vm::exec_bang() -> void
+// same tolerance as used by decimal_object::operator==
+constexpr auto decimal_epsilon = 1e-9;
+
+auto as_decimal(value val) -> double
 {
-    using enum object::object_type;
-    const auto* operand = pop();
-    push(native_bool_to_object(!operand->is_truthy()));
+    return val.is_integer() ? static_cast<double>(val.as_integer()) : val.as_decimal();
 }
 
-auto vm::exec_minus() -> void
+/// applies the operator to two inline numbers of which at least one is a decimal, returns an undefined value for the cases handled by the objects
+auto apply_decimal_operator(opcodes opcode, double left, double right) -> value
 {
-    const auto* operand = pop();
-    if (operand->is(object::object_type::integer)) {
-        push(make<integer_object>(-operand->as<integer_object>()->value));
-        return;
-    }
-    if (operand->is(object::object_type::decimal)) {
-        push(make<decimal_object>(-operand->as<decimal_object>()->value));
-        return;
+    using enum opcodes;
+    switch (opcode) {
+        case add:
+            return value::decimal(left + right);
+        case sub:
+            return value::decimal(left - right);
+        case mul:
+            return value::decimal(left * right);
+        case div:
+            return value::decimal(left / right);
+        case equal:
+            return value::boolean(std::fabs(left - right) < decimal_epsilon);
+        case not_equal:
+            return value::boolean(std::fabs(left - right) >= decimal_epsilon);
+        case greater_than:
+            return value::boolean(left > right);
+        case greater_equal:
+            return value::boolean(left >= right);
+        default:
+            return {};
     }
+}
+}  // namespace
 
-    throw std::runtime_error(fmt::format("unsupported type for negation {}", operand->type()));
+auto exec_binary_op(opcodes opcode, value left, value right) -> value
+{
+    if (left.is_integer() && right.is_integer()) {
+        if (const auto result = apply_integer_operator(opcode, left.as_integer(), right.as_integer());
+            !result.is_undefined())
+        {
+            return result;
+        }
+    } else if ((left.is_decimal() || left.is_integer()) && (right.is_decimal() || right.is_integer())) {
+        if (const auto result = apply_decimal_operator(opcode, as_decimal(left), as_decimal(right));
+            !result.is_undefined())
+        {
+            return result;
+        }
+    }
+    const auto* left_obj = left.to_object();
+    const auto* right_obj = right.to_object();
+    if (const auto* result = apply_binary_operator(opcode, left_obj, right_obj); result != nullptr) {
+        return value::from(result);
+    }
+    throw std::runtime_error(
+        fmt::format("unsupported types for binary operation: {} {} {}", left_obj->type(), opcode, right_obj->type()));
 }
 
-void vm::exec_set_outer(const int ip, const instructions& instr)
+auto exec_minus(value operand) -> value
 {
-    const auto level = instr[ip + 1UL];
-    const auto scope = static_cast<symbol_scope>(instr[ip + 2UL]);
-    const auto index = instr[ip + 3UL];
-    const auto& frame = m_frames[m_frame_index - (level + 1)];
-    if (scope == symbol_scope::local) {
-        m_stack[frame.base_ptr + index] = pop();
-    } else if (scope == symbol_scope::free) {
-        frame.cl->free[index] = pop();
+    if (operand.is_integer()) {
+        return value::integer(-operand.as_integer());
     }
+    if (operand.is_decimal()) {
+        return value::decimal(-operand.as_decimal());
+    }
+
+    throw std::runtime_error(fmt::format("unsupported type for negation {}", operand.to_object()->type()));
 }
 
-void vm::exec_get_outer(const int ip, const instructions& instr)
+namespace
 {
-    const auto level = instr[ip + 1UL];
-    const auto scope = static_cast<symbol_scope>(instr[ip + 2UL]);
-    const auto index = instr[ip + 3UL];
-    const auto& frame = m_frames[m_frame_index - (level + 1)];
-    if (scope == symbol_scope::local) {
-        push(m_stack[frame.base_ptr + index]);
-    } else if (scope == symbol_scope::free) {
-        push(frame.cl->free[index]);
-    } else if (scope == symbol_scope::function) {
-        push(frame.cl);
+auto is_hashable(value val) -> bool
+{
+    return val.is_integer() || val.is_boolean() || (val.is_object() && val.as_object()->is_hashable());
+}
+
+auto hash_key_of(value val) -> hashable::key_type
+{
+    if (val.is_integer()) {
+        return val.as_integer();
     }
+    if (val.is_boolean()) {
+        return val.as_boolean();
+    }
+    return val.as_object()->as<hashable>()->hash_key();
 }
+}  // namespace
 
-auto vm::build_array(int start, int end) const -> const object*
+auto build_array(std::span<const value> elements) -> value
 {
     array_object::value_type arr;
-    for (auto idx = start; idx < end; idx++) {
-        arr.push_back(m_stack[idx]);
+    for (const auto element : elements) {
+        arr.push_back(element.to_object());
     }
-    return make<array_object>(std::move(arr));
+    return value::from(make<array_object>(std::move(arr)));
 }
 
-auto vm::build_hash(int start, int end) const -> const object*
+auto build_hash(std::span<const value> pairs) -> value
 {
     hash_object::value_type hsh;
-    for (auto idx = start; idx < end; idx += 2) {
-        const auto* key = m_stack[idx];
-        const auto* val = m_stack[idx + 1];
-        hsh[key->as<hashable>()->hash_key()] = val;
+    for (auto idx = 0UL; idx + 1 < pairs.size(); idx += 2) {
+        const auto key = pairs[idx];
+        const auto val = pairs[idx + 1];
+        hsh.insert_or_assign(hash_key_of(key), val.to_object());
     }
-    return make<hash_object>(std::move(hsh));
+    return value::from(make<hash_object>(std::move(hsh)));
 }
 
 namespace
@@ -391,39 +803,41 @@ auto exec_hash(const hash_object::value_type& hsh, const hashable::key_type& key
 }
 }  // namespace
 
-auto vm::exec_index(const object* left, const object* index) -> void
+auto exec_index(value left, value index) -> value
 {
     using enum object::object_type;
-    if (left->is(array) && index->is(integer)) {
-        auto idx = index->as<integer_object>()->value;
-        auto max = static_cast<int64_t>(left->as<array_object>()->value.size()) - 1;
+    if (left.is_object() && left.as_object()->is(array) && index.is_integer()) {
+        const auto& arr = left.as_object()->as<array_object>()->value;
+        auto idx = index.as_integer();
+        auto max = static_cast<int64_t>(arr.size()) - 1;
         if (idx < 0 || idx > max) {
-            push(null());
-            return;
+            return value::null_value();
         }
-        push(left->as<array_object>()->value[static_cast<std::size_t>(idx)]);
-        return;
+        return value::from(arr[static_cast<std::size_t>(idx)]);
     }
-    if (left->is(string) && index->is(integer)) {
-        auto idx = index->as<integer_object>()->value;
-        auto max = static_cast<int64_t>(left->as<string_object>()->value.size()) - 1;
+    if (left.is_object() && left.as_object()->is(string) && index.is_integer()) {
+        const auto str = left.as_object()->as<string_object>()->value();
+        auto idx = index.as_integer();
+        auto max = static_cast<int64_t>(str.size()) - 1;
         if (idx < 0 || idx > max) {
-            push(null());
-            return;
+            return value::null_value();
         }
-        push(make<string_object>(left->as<string_object>()->value.substr(static_cast<std::size_t>(idx), 1)));
-        return;
+        return value::from(single_character(str[static_cast<std::size_t>(idx)]));
     }
-    if (left->is(hash) && index->is_hashable()) {
-        push(exec_hash(left->as<hash_object>()->value, index->as<hashable>()->hash_key()));
-        return;
+    if (left.is_object() && left.as_object()->is(hash) && is_hashable(index)) {
+        return value::from(exec_hash(left.as_object()->as<hash_object>()->value, hash_key_of(index)));
     }
-    push(make_error("invalid index operation: {}[{}]", left->type(), index->type()));
+    return value::from(
+        make_error("invalid index operation: {}[{}]", left.to_object()->type(), index.to_object()->type()));
 }
 
 auto vm::exec_call(int num_args) -> void
 {
-    const auto* callee = m_stack[m_sp - 1 - num_args];
+    const auto callee_value = m_stack[m_sp - 1 - num_args];
+    if (!callee_value.is_object()) {
+        throw std::runtime_error("calling non-closure and non-builtin");
+    }
+    const auto* callee = callee_value.as_object();
     using enum object::object_type;
     if (callee->is(closure)) {
         const auto* clsr = callee->as<closure_object>();
@@ -431,25 +845,43 @@ auto vm::exec_call(int num_args) -> void
             throw std::runtime_error(
                 fmt::format("wrong number of arguments: want={}, got={}", clsr->fn->num_arguments, num_args));
         }
-        const frame frm {.cl = clsr->as_mutable(), .ip = -1, .base_ptr = m_sp - num_args};
+        const frame frm {.cl = clsr->as_mutable(), .ip = 0, .base_ptr = m_sp - num_args};
         m_sp = frm.base_ptr + clsr->fn->num_locals;
         push_frame(frm);
         return;
     }
     if (callee->is(builtin)) {
-        const auto* const builtin = callee->as<builtin_object>()->builtin;
-        array_object::value_type args;
-        for (auto idx = m_sp - num_args; idx < m_sp; idx++) {
-            args.push_back(m_stack[idx]);
-        }
+        const auto result = exec_builtin(callee->as<builtin_object>()->builtin, arguments(num_args));
         m_sp = m_sp - num_args - 1;
-        const auto* result = builtin->body(std::move(args));
         push(result);
         return;
     }
     throw std::runtime_error("calling non-closure and non-builtin");
 }
 
+auto vm::arguments(int num_args) const -> std::span<const value>
+{
+    return {m_stack.data() + m_sp - num_args, static_cast<std::size_t>(num_args)};
+}
+
+auto exec_builtin(const builtin* bltn, std::span<const value> arguments) -> value
+{
+    // the stack holds inline values, so the arguments are boxed into a buffer on the native stack, only calls with
+    // more arguments than fit into it need a heap allocation
+    const auto count = arguments.size();
+    std::array<const object*, max_inline_builtin_arguments> inline_args {};
+    std::vector<const object*> spilled_args;
+    std::span<const object*> args {inline_args.data(), count};
+    if (count > inline_args.size()) {
+        spilled_args.resize(count);
+        args = spilled_args;
+    }
+    for (auto idx = 0UL; idx < count; idx++) {
+        args[idx] = arguments[idx].to_object();
+    }
+    return value::from(bltn->body(args));
+}
+
 auto vm::current_frame() -> frame&
 {
     return m_frames[m_frame_index - 1];
@@ -467,19 +899,43 @@ auto vm::pop_frame() -> frame&
     return m_frames[m_frame_index];
 }
 
-auto vm::push_closure(uint16_t const_idx, uint8_t num_free) -> void
+auto vm::push_closure(uint32_t const_idx, uint8_t num_free) -> void
 {
     const auto* constant = (*m_constants)[const_idx];
     if (!constant->is(object::object_type::compiled_function)) {
         throw std::runtime_error(
             fmt::format("expected a compiled_function, got an object of type {}", constant->type()));
     }
-    array_object::value_type free;
+    values free;
+    free.reserve(num_free);
     for (auto i = 0UL; i < num_free; i++) {
         free.push_back(m_stack[m_sp - num_free + i]);
     }
     m_sp -= num_free;
-    push(make<closure_object>(constant->as<compiled_function_object>(), free));
+    push(value::from(make<closure_object>(constant->as<compiled_function_object>(), std::move(free))));
+}
+
+auto vm::collect_garbage() -> void
+{
+    auto& hp = heap::get();
+    hp.begin_collection();
+    // slots above m_sp are cleared after every collection, so every defined slot refers to a live object
+    // and the slot at m_sp, which holds the value returned by last_popped(), can be kept alive as well
+    const auto top = std::min(static_cast<std::size_t>(m_sp) + 1, m_stack.size());
+    for (auto idx = 0UL; idx < top; idx++) {
+        hp.mark(m_stack[idx]);
+    }
+    for (auto idx = 0; idx < m_frame_index; idx++) {
+        hp.mark(m_frames[idx].cl);
+    }
+    for (const auto* constant : *m_constants) {
+        hp.mark(constant);
+    }
+    for (const auto& global : *m_globals) {
+        hp.mark(global);
+    }
+    hp.collect();
+    std::fill(m_stack.begin() + static_cast<std::ptrdiff_t>(top), m_stack.end(), value {});
 }
 
 namespace
@@ -499,15 +955,15 @@ auto check_no_parse_errors(const parser& prsr) -> bool
     return prsr.errors().empty();
 }
 
-using parsed_program = std::pair<program*, parser>;
+using parsed_program = std::pair<std::unique_ptr<program>, parser>;
 
 auto check_program(std::string_view input) -> parsed_program
 {
     auto prsr = parser {lexer {input}};
-    auto* prgrm = prsr.parse_program();
+    auto prgrm = prsr.parse_program();
     INFO("while parsing: `", input, "`");
     CHECK(check_no_parse_errors(prsr));
-    return {prgrm, std::move(prsr)};
+    return {std::move(prgrm), std::move(prsr)};
 }
 
 struct error
@@ -575,7 +1031,7 @@ auto require_is(const std::string& expected, const object*& actual_obj, std::str
          actual_obj->inspect(),
          " instead");
     REQUIRE(actual_obj->is(object::object_type::string));
-    const auto& actual = actual_obj->as<string_object>()->value;
+    const auto actual = actual_obj->as<string_object>()->value();
     REQUIRE(actual == expected);
 }
 
@@ -659,13 +1115,45 @@ auto run(const std::array<vt<Expecteds...>, N>& tests)
     for (const auto& [input, expected] : tests) {
         auto [prgrm, _] = check_program(input);
         auto cmplr = compiler::create();
-        cmplr.compile(prgrm);
+        cmplr.compile(prgrm.get());
         auto byte_code = cmplr.byte_code();
         auto mchn = vm::create(std::move(byte_code));
         mchn.run();
 
         const auto* top = mchn.last_popped();
         require_eq(expected, top, input);
+
+        // every program has to give the same result on the register machine
+        auto rcmplr = register_compiler::create();
+        rcmplr.compile(prgrm.get());
+        auto rmchn = register_vm::create(rcmplr.byte_code());
+        rmchn.run();
+        const auto* result = rmchn.last_popped();
+        INFO("on the register machine");
+        require_eq(expected, result, input);
+
+        // and with every function translated to machine code when it is entered first
+        if (jit::supported()) {
+            const jit native {{.threshold = 1}};
+            auto jcmplr = compiler::create();
+            jcmplr.compile(prgrm.get());
+            auto jmchn = vm::create(jcmplr.byte_code());
+            jmchn.attach(&native);
+            jmchn.run();
+            const auto* jitted = jmchn.last_popped();
+            INFO("in machine code");
+            require_eq(expected, jitted, input);
+        }
+
+        // and the same result once optimized
+        optimize_program(prgrm.get());
+        auto ocmplr = compiler::create();
+        ocmplr.compile(prgrm.get());
+        auto omchn = vm::create(ocmplr.byte_code());
+        omchn.run();
+        const auto* optimized = omchn.last_popped();
+        INFO("optimized");
+        require_eq(expected, optimized, input);
     }
 }
 
@@ -1132,9 +1620,14 @@ TEST_CASE("callFunctionsWithWrongArgument")
     for (const auto& [input, expected] : tests) {
         auto [prgrm, _] = check_program(input);
         auto cmplr = compiler::create();
-        cmplr.compile(prgrm);
+        cmplr.compile(prgrm.get());
         auto mchn = vm::create(cmplr.byte_code());
         CHECK_THROWS_WITH(mchn.run(), std::get<std::string>(expected).c_str());
+
+        auto rcmplr = register_compiler::create();
+        rcmplr.compile(prgrm.get());
+        auto rmchn = register_vm::create(rcmplr.byte_code());
+        CHECK_THROWS_WITH(rmchn.run(), std::get<std::string>(expected).c_str());
     }
 }
 
@@ -1177,6 +1670,12 @@ TEST_CASE("callBuiltins")
                 "wrong number of arguments to len(): expected=1, got=2",
             },
         },
+        vt<error> {
+            R"(len(1, 2, 3, 4, 5, 6, 7, 8, 9))",
+            error {
+                "wrong number of arguments to len(): expected=1, got=9",
+            },
+        },
         vt<error> {
             R"(first(1))",
             error {
@@ -1291,6 +1790,346 @@ TEST_CASE("recursiveFibonacci")
     run(tests);
 }
 
+TEST_CASE("whileLoops")
+{
+    const std::array tests {
+        vt<int64_t> {"let i = 0; while (i < 10) { i = i + 1; } i", 10},
+        vt<int64_t> {"let i = 0; while (true) { i = i + 1; if (i == 5) { break; } } i", 5},
+        vt<int64_t> {
+            "let f = fn(n) { let i = 0; let s = 0; while (i < n) { if (i % 3 == 0) { s = s + i; } i = i + 1; } s }; f(10)",
+            18,
+        },
+        vt<int64_t> {
+            "let f = fn() { let i = 0; while (i < 10) { if (i > 4) { } else { let j = i; } i = i + 1; } i }; f()",
+            10,
+        },
+        vt<int64_t> {
+            R"(
+        let f = fn() {
+            let i = 0;
+            let s = 0;
+            while (i < 10) {
+                i = i + 1;
+                if (i % 2 == 0) { continue; }
+                let t = s + i;
+                s = t;
+            }
+            s
+        };
+        f())",
+            25,
+        },
+        vt<int64_t> {
+            R"(
+        let f = fn(n) {
+            let i = 0;
+            while (true) {
+                let j = 0;
+                while (j < 3) {
+                    if (i * 3 + j == n) { return i * 10 + j; }
+                    j = j + 1;
+                }
+                i = i + 1;
+            }
+        };
+        f(7))",
+            21,
+        },
+        vt<int64_t> {
+            R"(
+        let f = fn() {
+            let fs = [];
+            let i = 0;
+            while (i < 3) {
+                let j = i * 2;
+                fs = push(fs, fn() { i + j });
+                i = i + 1;
+            }
+            fs[0]() + fs[1]() + fs[2]()
+        };
+        f())",
+            9,
+        },
+        // break and continue leave the operands of the enclosing expressions behind
+        vt<int64_t> {
+            R"(
+        let f = fn(a, b) { b };
+        let i = 0;
+        while (i < 10000) {
+            i = i + 1;
+            f(1, if (i > 0) { continue; } else { 2 });
+        }
+        i)",
+            10000,
+        },
+        vt<int64_t> {
+            R"(
+        let g = fn() {
+            let i = 0;
+            let s = 0;
+            while (true) {
+                i = i + 1;
+                s = s + [i, {"k": i * (if (i % 2 == 0) { continue; } else { 1 })}["k"]][1];
+                s = s + len([1, 2, if (i > 10000) { break; } else { 0 }]) - 3;
+            }
+            s
+        };
+        g())",
+            25010001,
+        },
+    };
+    run(tests);
+}
+
+TEST_CASE("shortCircuitOperators")
+{
+    const std::array tests {
+        vt<int64_t> {"let n = 0; let f = fn(x) { n = n + 1; x }; false && f(true); true || f(true); n", 0},
+        vt<int64_t> {"let n = 0; let f = fn(x) { n = n + 1; x }; true && f(false); false || f(true); n", 2},
+        vt<int64_t> {"let n = 0; let f = fn(x) { n = n + 1; x }; if (false && f(true)) { 1 } else { n }", 0},
+        vt<int64_t> {"let n = 0; let f = fn(x) { n = n + 1; x }; if (!(true || f(true))) { 1 } else { n }", 0},
+        vt<int64_t> {
+            "let n = 0; let f = fn(x) { n = n + 1; x }; if ((f(1) > 0) && (f(0) == 0) || f(2)) { n } else { 0 }",
+            2,
+        },
+        vt<int64_t> {
+            "let n = 0; let f = fn(x) { n = n + 1; x }; if ((f(0) > 0) && f(1) || !f(false)) { n } else { 0 }",
+            2,
+        },
+        vt<int64_t> {
+            "let n = 0; let f = fn(x) { n = n + 1; x }; let i = 0; "
+            "while ((i < 10) && ((i < 5) || f(true))) { i = i + 1; } n * 100 + i",
+            510,
+        },
+    };
+    run(tests);
+}
+
+TEST_CASE("loopsDoNotAllocate")
+{
+    auto [prgrm, _] = check_program(R"(
+        let f = fn() {
+            let i = 0;
+            let s = 0;
+            while (i < 1000) {
+                i = i + 1;
+                if (i % 3 == 0) { continue; }
+                s = s + i;
+            }
+            s
+        };
+        f();)");
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    auto mchn = vm::create(cmplr.byte_code());
+    const auto allocations = heap::get().total_allocations();
+    mchn.run();
+
+    // the closure of f is the only object created while running
+    CHECK_EQ(heap::get().total_allocations(), allocations + 1);
+    CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 333667);
+}
+
+TEST_CASE("superinstructionsFallBackForNonIntegers")
+{
+    const std::array tests {
+        vt<int64_t, double, std::string> {"let f = fn(a) { a = a + 1; a }; f(1)", 2},
+        vt<int64_t, double, std::string> {"let f = fn(a) { a = a + 1; a }; f(1.5)", 2.5},
+        vt<int64_t, double, std::string> {"let f = fn(a) { a - 1 }; f(0.5)", -0.5},
+        vt<int64_t, double, std::string> {R"(let f = fn(a) { a + "b" }; f("a"))", "ab"},
+        vt<int64_t, double, std::string> {"let f = fn(a, b) { if (a > b) { 1 } else { 2 } }; f(1.5, 1)", 1},
+        vt<int64_t, double, std::string> {"let f = fn(a, b) { if (a >= b) { 1 } else { 2 } }; f(1, 1.5)", 2},
+        vt<int64_t, double, std::string> {R"(let f = fn(a, b) { if (a == b) { 1 } else { 2 } }; f("a", "a"))", 1},
+    };
+    run(tests);
+}
+
+TEST_CASE("scalarArithmeticDoesNotAllocate")
+{
+    auto [prgrm, _] = check_program(R"(
+        let fibonacci = fn(x) {
+            if (x < 2) {
+                return x;
+            }
+            fibonacci(x - 1) + fibonacci(x - 2) * 1.0 / 1.0;
+        };
+        (fibonacci(20) == 6765.0) && !false;)");
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    auto mchn = vm::create(cmplr.byte_code());
+    const auto allocations = heap::get().total_allocations();
+    mchn.run();
+
+    // the closure of fibonacci is the only object created while running
+    CHECK_EQ(heap::get().total_allocations(), allocations + 1);
+    CHECK_EQ(mchn.last_popped(), tru());
+}
+
+TEST_CASE("builtinCallsDoNotAllocateCallees")
+{
+    auto [prgrm, _] = check_program(R"(
+        let f = fn() {
+            let a = [1, 2, 3];
+            let g = first;
+            let i = 0;
+            let s = 0;
+            while (i < 1000) {
+                s = s + first(a) + g(a);
+                i = i + 1;
+            }
+            s
+        };
+        f();)");
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    auto mchn = vm::create(cmplr.byte_code());
+    const auto allocations = heap::get().total_allocations();
+    mchn.run();
+
+    // the closure of f and the array are the only objects created while running, its small elements are preallocated
+    CHECK_EQ(heap::get().total_allocations(), allocations + 2);
+    CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 2000);
+}
+
+TEST_CASE("hashLookupsDoNotAllocate")
+{
+    auto [prgrm, _] = check_program(R"(
+        let f = fn() {
+            let h = {"a": 1, "b": 2};
+            let i = 0;
+            let s = 0;
+            while (i < 1000) {
+                s = s + h["a"] + h["b"];
+                i = i + 1;
+            }
+            s
+        };
+        f();)");
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    auto mchn = vm::create(cmplr.byte_code());
+    const auto allocations = heap::get().total_allocations();
+    mchn.run();
+
+    // the closure of f and the hash are the only objects created while running, its small values are preallocated
+    CHECK_EQ(heap::get().total_allocations(), allocations + 2);
+    CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 3000);
+}
+
+TEST_CASE("jumpTargetsBeyond64KiB")
+{
+    std::string input = "let x = 0; if (x == 0) {";
+    for (int i = 0; i < 10000; i++) {
+        input += " x = x + 1;";
+    }
+    input += " } else { x = -1; }; x";
+    auto [prgrm, _] = check_program(input);
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    REQUIRE_GT(cmplr.byte_code().instrs.size(), 65536);
+    auto mchn = vm::create(cmplr.byte_code());
+    mchn.run();
+
+    CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 10000);
+}
+
+auto function_named(const constants* consts, std::string_view name) -> const compiled_function_object*
+{
+    for (const auto* constant : *consts) {
+        if (constant->is(object::object_type::compiled_function)
+            && constant->as<compiled_function_object>()->name == name)
+        {
+            return constant->as<compiled_function_object>();
+        }
+    }
+    FAIL("no function named ", name);
+    return nullptr;
+}
+
+auto contains(const compiled_function_object* fn, opcodes opcode) -> bool
+{
+    for (auto ip = 0UL; ip < fn->instrs.size(); ip += definitions[fn->instrs[ip]].size()) {
+        if (static_cast<opcodes>(fn->instrs[ip]) == opcode) {
+            return true;
+        }
+    }
+    return false;
+}
+
+TEST_CASE("sitesAreSpecializedToTheObservedTypes")
+{
+    auto [prgrm, _] = check_program(R"(
+        let f = fn(a, b) { a * b };
+        let g = fn(arr, i) { arr[i] };
+        let call = fn(h) { h(2, 3) };
+        call(f) + g([1, 2, 3], 2))");
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    const auto* consts = cmplr.byte_code().consts;
+    auto mchn = vm::create(cmplr.byte_code());
+    mchn.run();
+
+    CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 9);
+    CHECK(contains(function_named(consts, "f"), opcodes::mul_int_int));
+    CHECK(contains(function_named(consts, "g"), opcodes::index_array_int));
+    CHECK(contains(function_named(consts, "call"), opcodes::call_closure));
+    CHECK_FALSE(contains(function_named(consts, "call"), opcodes::call));
+}
+
+TEST_CASE("specializedSitesDeoptimize")
+{
+    auto [prgrm, _] = check_program(R"(
+        let f = fn(a, b) { a + b };
+        let g = fn(arr, i) { arr[i] };
+        let call = fn(h, x) { h(x) };
+        let specialized = [f(1, 2), g([1, 2], 0), call(fn(x) { x + 1 }, 1)];
+        let deoptimized = [f("a", "b"), g({0: "c"}, 0), call(len, "abc")];
+        [specialized, deoptimized, f(3, 4)])");
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    const auto* consts = cmplr.byte_code().consts;
+    auto mchn = vm::create(cmplr.byte_code());
+    mchn.run();
+
+    CHECK_EQ(mchn.last_popped()->inspect(), R"([[3, 1, 2], ["ab", "c", 3], 7])");
+    // f saw integers again and was specialized again
+    CHECK(contains(function_named(consts, "f"), opcodes::add_int_int));
+    CHECK(contains(function_named(consts, "g"), opcodes::index));
+    CHECK_FALSE(contains(function_named(consts, "g"), opcodes::index_array_int));
+    CHECK(contains(function_named(consts, "call"), opcodes::call));
+    CHECK_FALSE(contains(function_named(consts, "call"), opcodes::call_closure));
+}
+
+TEST_CASE("stringIndexingDoesNotAllocate")
+{
+    auto [prgrm, _] = check_program(R"(
+        let f = fn() {
+            let str = "hello world";
+            let i = 0;
+            let n = 0;
+            while (i < len(str)) {
+                if (str[i] == "o") {
+                    n = n + 1;
+                }
+                if (str[i] == chr(108)) {
+                    n = n + 10;
+                }
+                i = i + 1;
+            }
+            n
+        };
+        f();)");
+    auto cmplr = compiler::create();
+    cmplr.compile(prgrm.get());
+    auto mchn = vm::create(cmplr.byte_code());
+    const auto allocations = heap::get().total_allocations();
+    mchn.run();
+
+    // the characters and the builtin results are preallocated, so the closure of f is the only object created
+    CHECK_EQ(heap::get().total_allocations(), allocations + 1);
+    CHECK_EQ(mchn.last_popped()->as<integer_object>()->value, 32);
+}
+
 TEST_SUITE_END();
 // NOLINTEND(*)
 }  // namespace
@@ -2,16 +2,20 @@
 
 #include <array>
 #include <cstdint>
+#include <span>
 
 #include <code/code.hpp>
 #include <compiler/compiler.hpp>
-#include <compiler/symbol_table.hpp>
 #include <gc.hpp>
 #include <object/object.hpp>
+#include <object/value.hpp>
+
+#include "profiler.hpp"
 
 constexpr size_t stack_size = 2 * 2048UL;
 constexpr size_t globals_size = 65536UL;
 constexpr size_t max_frames = 1024UL;
+constexpr size_t max_inline_builtin_arguments = 8UL;
 
 struct frame final
 {
@@ -22,35 +26,54 @@ struct frame final
 
 using frames = std::array<frame, max_frames>;
 
+// operations shared by the stack machine and the register machine
+
+[[nodiscard]] auto exec_binary_op(opcodes opcode, value left, value right) -> value;
+[[nodiscard]] auto exec_minus(value operand) -> value;
+[[nodiscard]] auto exec_index(value left, value index) -> value;
+/// calls the builtin with the given arguments, the arguments are boxed into objects for the duration of the call
+[[nodiscard]] auto exec_builtin(const struct builtin* bltn, std::span<const value> args) -> value;
+[[nodiscard]] auto build_array(std::span<const value> elements) -> value;
+/// builds a hash from alternating keys and values
+[[nodiscard]] auto build_hash(std::span<const value> pairs) -> value;
+
 struct vm final
 {
     static auto create(bytecode code) -> vm;
-    static auto create_with_state(bytecode code, constants* globals) -> vm;
+    static auto create_with_state(bytecode code, values* globals) -> vm;
     auto run() -> void;
     [[nodiscard]] auto last_popped() const -> const object*;
 
+    /// reports every executed instruction to the profiler, the instructions run without any hooks otherwise
+    auto attach(profiler* prof) -> void { m_profiler = prof; }
+
+    /// runs hot functions in the machine code of the jit compiler, ignored while profiling
+    auto attach(const class jit* compiler) -> void { m_jit = compiler; }
+
   private:
-    vm(frames frames, const constants* consts, constants* globals);
-    auto push(const object* obj) -> void;
-    auto pop() -> const object*;
-    auto exec_binary_op(opcodes opcode) -> void;
-    auto exec_bang() -> void;
-    auto exec_minus() -> void;
-    auto exec_index(const object* left, const object* index) -> void;
+    friend class jit;
+
+    vm(frames frames, const constants* consts, values* globals);
+    template<bool Profiling>
+    auto run_loop() -> void;
+    auto push(value val) -> void;
+    auto pop() -> value;
     auto exec_call(int num_args) -> void;
-    void exec_set_outer(int ip, const instructions& instr);
-    void exec_get_outer(int ip, const instructions& instr);
-    [[nodiscard]] auto build_array(int start, int end) const -> const object*;
-    [[nodiscard]] auto build_hash(int start, int end) const -> const object*;
+    /// the topmost num_args values of the stack
+    [[nodiscard]] auto arguments(int num_args) const -> std::span<const value>;
     auto current_frame() -> frame&;
     auto push_frame(frame frm) -> void;
     auto pop_frame() -> frame&;
-    auto push_closure(uint16_t const_idx, uint8_t num_free) -> void;
+    auto push_closure(uint32_t const_idx, uint8_t num_free) -> void;
+    auto collect_garbage() -> void;
 
     const constants* m_constants {};
-    constants* m_globals {};
-    constants m_stack {stack_size};
+    values m_constant_values;
+    values* m_globals {};
+    values m_stack {stack_size};
     int m_sp {0};
     frames m_frames;
     int m_frame_index {1};
+    profiler* m_profiler {};
+    const class jit* m_jit {};
 };
@@ -1,22 +1,43 @@
+#include <algorithm>
+#include <charconv>
 #include <chrono>
+#include <cmath>
 #include <cstddef>
+#include <cstdint>
+#include <cstdlib>
 #include <span>
+#include <string>
 #include <string_view>
+#include <utility>
+#include <vector>
 
+#include <analyzer/analyzer.hpp>
 #include <compiler/compiler.hpp>
+#include <compiler/register_compiler.hpp>
+#include <eval/closure_compiler.hpp>
 #include <eval/environment.hpp>
 #include <eval/evaluator.hpp>
 #include <fmt/base.h>
+#include <fmt/format.h>
+#include <gc.hpp>
 #include <lexer/lexer.hpp>
 #include <object/object.hpp>
+#include <optimizer/optimizer.hpp>
 #include <parser/parser.hpp>
+#include <vm/jit.hpp>
+#include <vm/register_vm.hpp>
 #include <vm/vm.hpp>
 
-using namespace std::chrono_literals;
-
-auto main(int argc, char* argv[]) -> int
+namespace
+{
+struct workload final
 {
-    const char* input = R"(
+    std::string_view name;
+    std::string_view input;
+};
+
+const std::vector<workload> workloads {
+    {"fibonacci", R"(
 let fibonacci = fn(x) {
   if (x == 0) {
     0
@@ -28,38 +49,427 @@ let fibonacci = fn(x) {
     }
   }
 };
-fibonacci(35);
-    )";
+fibonacci(25);
+)"},
+    {"while_counting", R"(
+let count = fn(n) {
+  let i = 0;
+  let sum = 0;
+  while (i < n) {
+    if (i % 3 == 0) {
+      sum = sum + i;
+    }
+    i = i + 1;
+  }
+  sum
+};
+count(300000);
+)"},
+    {"guarded_loop", R"(
+let expensive = fn(x) { x * x % 7 == 3 };
+let count = fn(n) {
+  let i = 0;
+  let hits = 0;
+  while ((i < n) && (hits >= 0)) {
+    if ((i % 4 == 0) && expensive(i) || (i % 5 == 0) && !(i % 3 == 0)) {
+      hits = hits + 1;
+    }
+    if (!((i < 0) || (i % 2 == 1)) && (i % 3 == 0)) {
+      hits = hits + 2;
+    }
+    i = i + 1;
+  }
+  hits
+};
+count(300000);
+)"},
+    {"array_pipeline", R"(
+let build = fn(n) {
+  let arr = [];
+  let i = 0;
+  while (i < n) {
+    arr = push(arr, i);
+    i = i + 1;
+  }
+  arr
+};
+let sum = fn(arr) {
+  let total = 0;
+  while (len(arr) > 1) {
+    total = total + first(arr);
+    arr = rest(arr);
+  }
+  total + first(arr)
+};
+sum(build(2000));
+)"},
+    {"hash_insert_lookup", R"(
+let build = fn(n) {
+  let h = {};
+  let i = 0;
+  while (i < n) {
+    h = push(h, i, i * 2);
+    i = i + 1;
+  }
+  h
+};
+let lookup = fn(h, n) {
+  let i = 0;
+  let total = 0;
+  while (i < n) {
+    total = total + h[i % 1000];
+    i = i + 1;
+  }
+  total
+};
+lookup(build(1000), 100000);
+)"},
+    {"string_concat", R"(
+let build = fn(n) {
+  let s = "";
+  let i = 0;
+  while (i < n) {
+    s = s + "ab";
+    i = i + 1;
+  }
+  s
+};
+len(build(20000));
+)"},
+    {"closures", R"(
+let adder = fn(x) { fn(y) { x + y } };
+let compose = fn(f, g) { fn(x) { g(f(x)) } };
+let run = fn(n) {
+  let i = 0;
+  let total = 0;
+  while (i < n) {
+    let inc = compose(adder(i), adder(1));
+    total = total + inc(1);
+    i = i + 1;
+  }
+  total
+};
+run(50000);
+)"},
+};
+
+/// generates a program consisting of many small functions, used to measure the throughput of lexer and parser
+auto generate_source(int functions) -> std::string
+{
+    std::string source;
+    for (auto idx = 0; idx < functions; ++idx) {
+        source += fmt::format(
+            "let func = fn(x, y) {{ if (x > {0}) {{ [x, y, \"{0}\"] }} else {{ {{\"k\": x * {0} + y}} }} }};\n", idx);
+    }
+    return source;
+}
+
+enum class engine : std::uint8_t
+{
+    vm,
+    registers,
+    eval,
+    closures,
+    jit,
+};
+
+struct options final
+{
+    bool vm {true};
+    bool registers {true};
+    bool eval {true};
+    bool closures {true};
+    bool jit {true};
+    int warmup {1};
+    int repeat {5};
+    std::string_view filter;
+};
 
-    auto engine_vm = true;
-    for (const std::string_view arg : std::span(++argv, static_cast<std::size_t>(argc - 1))) {
-        if (arg == "--eval") {
-            engine_vm = false;
+struct statistics final
+{
+    double min {};
+    double median {};
+    double p99 {};
+};
+
+auto compute_statistics(std::vector<double> samples) -> statistics
+{
+    std::ranges::sort(samples);
+    const auto nearest_rank = [&samples](double percentile)
+    {
+        const auto rank = static_cast<std::size_t>(std::ceil(percentile * static_cast<double>(samples.size())));
+        return samples[std::clamp<std::size_t>(rank, 1, samples.size()) - 1];
+    };
+    const auto mid = samples.size() / 2;
+    const auto median = samples.size() % 2 == 0 ? (samples[mid - 1] + samples[mid]) / 2 : samples[mid];
+    return {.min = samples.front(), .median = median, .p99 = nearest_rank(0.99)};
+}
+
+auto escape_json(std::string_view str) -> std::string
+{
+    std::string escaped;
+    for (const auto chr : str) {
+        switch (chr) {
+            case '"':
+                escaped += "\\\"";
+                break;
+            case '\\':
+                escaped += "\\\\";
+                break;
+            case '\n':
+                escaped += "\\n";
+                break;
+            default:
+                escaped += chr;
         }
     }
+    return escaped;
+}
 
-    auto lxr = lexer {input};
-    auto prsr = parser {lxr};
-    auto* prgrm = prsr.parse_program();
-    const object* result = nullptr;
-    std::chrono::duration<double> duration {};
-    if (engine_vm) {
+/// runs the function warmup + repeat times and returns the durations of the measured runs in milliseconds
+template<typename Function>
+auto measure(const options& opts, Function&& function) -> std::vector<double>
+{
+    std::vector<double> samples;
+    for (auto run = 0; run < opts.warmup + opts.repeat; ++run) {
+        const auto start = std::chrono::steady_clock::now();
+        function();
+        const auto end = std::chrono::steady_clock::now();
+        if (run >= opts.warmup) {
+            samples.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+        }
+    }
+    return samples;
+}
+
+auto run_workload(const workload& wkld, engine eng, const options& opts) -> std::pair<std::vector<double>, std::string>
+{
+    auto prsr = parser {lexer {wkld.input}};
+    auto prgrm = prsr.parse_program();
+    if (!prsr.errors().empty()) {
+        fmt::println(stderr, "failed to parse workload {}: {}", wkld.name, fmt::join(prsr.errors(), ", "));
+        std::exit(EXIT_FAILURE);  // NOLINT(concurrency-mt-unsafe)
+    }
+    std::string result;
+    analyze_program(prgrm.get(), nullptr, nullptr);
+    if (eng != engine::eval) {
+        optimize_program(prgrm.get());
+    }
+    if (eng == engine::vm || eng == engine::jit) {
         auto cmplr = compiler::create();
-        cmplr.compile(prgrm);
-        auto mchn = vm::create(cmplr.byte_code());
-        auto start = std::chrono::steady_clock::now();
-        mchn.run();
-        result = mchn.last_popped();
-        auto end = std::chrono::steady_clock::now();
-        duration = end - start;
-    } else {
-        environment env;
-        evaluator ev(&env);
-        auto start = std::chrono::steady_clock::now();
-        result = ev.evaluate(prgrm);
-        auto end = std::chrono::steady_clock::now();
-        duration = end - start;
-    }
-    fmt::print("engine={}, result={}, duration={}\n", (engine_vm ? "vm" : "eval"), result->inspect(), duration.count());
-    return 0;
+        cmplr.compile(prgrm.get());
+        const auto byte_code = cmplr.byte_code();
+        // the machine code of the functions is kept in the constants, so it is compiled during the warmup
+        const jit native;
+        auto samples = measure(opts,
+                               [&]
+                               {
+                                   auto mchn = vm::create(byte_code);
+                                   if (eng == engine::jit) {
+                                       mchn.attach(&native);
+                                   }
+                                   mchn.run();
+                                   result = mchn.last_popped()->inspect();
+                               });
+        return {std::move(samples), std::move(result)};
+    }
+    if (eng == engine::registers) {
+        auto cmplr = register_compiler::create();
+        cmplr.compile(prgrm.get());
+        const auto byte_code = cmplr.byte_code();
+        auto samples = measure(opts,
+                               [&]
+                               {
+                                   auto mchn = register_vm::create(byte_code);
+                                   mchn.run();
+                                   result = mchn.last_popped()->inspect();
+                               });
+        return {std::move(samples), std::move(result)};
+    }
+    if (eng == engine::closures) {
+        const auto lowered = lower_program(prgrm.get());
+        auto samples = measure(opts, [&] { result = lowered->run(make<environment>())->inspect(); });
+        return {std::move(samples), std::move(result)};
+    }
+    auto samples = measure(opts,
+                           [&]
+                           {
+                               auto* global_env = make<environment>();
+                               evaluator ev {global_env};
+                               result = ev.evaluate(prgrm.get())->inspect();
+                           });
+    return {std::move(samples), std::move(result)};
+}
+
+auto print_result(std::string_view name,
+                  std::string_view engine_name,
+                  const std::vector<double>& samples,
+                  std::string_view result,
+                  bool last) -> void
+{
+    const auto stats = compute_statistics(samples);
+    fmt::println(
+        R"(    {{"name": "{}", "engine": "{}", "runs": {}, "min_ms": {:.3f}, "median_ms": {:.3f}, "p99_ms": {:.3f}, )"
+        R"("result": "{}"}}{})",
+        name,
+        engine_name,
+        samples.size(),
+        stats.min,
+        stats.median,
+        stats.p99,
+        escape_json(result),
+        last ? "" : ",");
+}
+
+[[noreturn]] auto show_usage(std::string_view program, int exit_code) -> void
+{
+    fmt::println(
+        "Usage: {} [--engine vm|register|eval|closures|jit|both|all] [--warmup <n>] [--repeat <n>] [--filter <name>]",
+        program);
+    fmt::println("Prints min, median and p99 durations of every workload as JSON.");
+    std::exit(exit_code);  // NOLINT(concurrency-mt-unsafe)
+}
+
+auto parse_count(std::string_view program, std::string_view arg) -> int
+{
+    auto count = 0;
+    const auto [ptr, err] = std::from_chars(arg.data(), arg.data() + arg.size(), count);
+    if (err != std::errc {} || ptr != arg.data() + arg.size() || count < 0) {
+        show_usage(program, EXIT_FAILURE);
+    }
+    return count;
+}
+
+auto parse_options(std::span<char*> args) -> options
+{
+    const std::string_view program = args.front();
+    options opts;
+    for (std::size_t idx = 1; idx < args.size(); ++idx) {
+        const std::string_view arg = args[idx];
+        if (arg == "--help" || arg == "-h") {
+            show_usage(program, EXIT_SUCCESS);
+        }
+        if (idx + 1 == args.size()) {
+            show_usage(program, EXIT_FAILURE);
+        }
+        const std::string_view value = args[++idx];
+        if (arg == "--engine") {
+            opts.vm = value == "vm" || value == "both" || value == "all";
+            opts.registers = value == "register" || value == "all";
+            opts.eval = value == "eval" || value == "both" || value == "all";
+            opts.closures = value == "closures" || value == "all";
+            opts.jit = value == "jit" || value == "all";
+        } else if (arg == "--warmup") {
+            opts.warmup = parse_count(program, value);
+        } else if (arg == "--repeat") {
+            opts.repeat = std::max(parse_count(program, value), 1);
+        } else if (arg == "--filter") {
+            opts.filter = value;
+        } else {
+            show_usage(program, EXIT_FAILURE);
+        }
+    }
+    if (!opts.vm && !opts.registers && !opts.eval && !opts.closures && !opts.jit) {
+        show_usage(program, EXIT_FAILURE);
+    }
+    return opts;
+}
+}  // namespace
+
+auto main(int argc, char* argv[]) -> int
+{
+    const auto opts = parse_options(std::span(argv, static_cast<std::size_t>(argc)));
+    const auto matches = [&opts](std::string_view name)
+    { return opts.filter.empty() || name.find(opts.filter) != std::string_view::npos; };
+
+    struct entry
+    {
+        std::string_view name;
+        std::string_view engine_name;
+        std::vector<double> samples;
+        std::string result;
+    };
+
+    std::vector<entry> entries;
+    for (const auto& wkld : workloads) {
+        if (!matches(wkld.name)) {
+            continue;
+        }
+        if (opts.vm) {
+            auto [samples, result] = run_workload(wkld, engine::vm, opts);
+            entries.push_back({wkld.name, "vm", std::move(samples), std::move(result)});
+        }
+        if (opts.registers) {
+            auto [samples, result] = run_workload(wkld, engine::registers, opts);
+            entries.push_back({wkld.name, "register", std::move(samples), std::move(result)});
+        }
+        if (opts.eval) {
+            auto [samples, result] = run_workload(wkld, engine::eval, opts);
+            entries.push_back({wkld.name, "eval", std::move(samples), std::move(result)});
+        }
+        if (opts.closures) {
+            auto [samples, result] = run_workload(wkld, engine::closures, opts);
+            entries.push_back({wkld.name, "closures", std::move(samples), std::move(result)});
+        }
+        if (opts.jit && jit::supported()) {
+            auto [samples, result] = run_workload(wkld, engine::jit, opts);
+            entries.push_back({wkld.name, "jit", std::move(samples), std::move(result)});
+        }
+    }
+    auto exit_code = EXIT_SUCCESS;
+    if (matches("lexer_parser")) {
+        const auto parse = [&opts](const std::string& source, std::size_t& statements)
+        {
+            return measure(opts,
+                           [&]
+                           {
+                               auto prsr = parser {lexer {source}};
+                               statements = prsr.parse_program()->statements.size();
+                           });
+        };
+        const auto source = generate_source(5000);
+        std::size_t statements = 0;
+        auto samples = parse(source, statements);
+        const auto median = compute_statistics(samples).median;
+        entries.push_back({"lexer_parser",
+                           "none",
+                           std::move(samples),
+                           fmt::format("{} statements, {} bytes, {:.1f} MB/s",
+                                       statements,
+                                       source.size(),
+                                       static_cast<double>(source.size()) / 1000.0 / median)});
+
+        // parsing has to stay linear in the size of the input, a four times larger input may take at most twice as
+        // long per byte before the check fails
+        const auto scaled_source = generate_source(4 * 5000);
+        auto scaled_samples = parse(scaled_source, statements);
+        const auto ratio = compute_statistics(scaled_samples).median / median;
+        if (ratio > 8.0) {
+            fmt::println(stderr,
+                         "parsing {} bytes took {:.1f} times as long as {} bytes",
+                         scaled_source.size(),
+                         ratio,
+                         source.size());
+            exit_code = EXIT_FAILURE;
+        }
+        entries.push_back({"lexer_parser_scaling",
+                           "none",
+                           std::move(scaled_samples),
+                           fmt::format("{} statements, {} bytes, {:.1f} times the time of {} bytes",
+                                       statements,
+                                       scaled_source.size(),
+                                       ratio,
+                                       source.size())});
+    }
+
+    fmt::println("{{");
+    fmt::println(R"(  "warmup": {}, "repeat": {},)", opts.warmup, opts.repeat);
+    fmt::println(R"(  "benchmarks": [)");
+    for (std::size_t idx = 0; idx < entries.size(); ++idx) {
+        const auto& [name, engine_name, samples, result] = entries[idx];
+        print_result(name, engine_name, samples, result, idx + 1 == entries.size());
+    }
+    fmt::println("  ]");
+    fmt::println("}}");
+    return exit_code;
 }